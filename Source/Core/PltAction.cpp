@@ -97,16 +97,34 @@ PLT_ArgumentDesc*
 PLT_ActionDesc::GetArgumentDesc(const char* name)
 {
     PLT_ArgumentDesc* arg_desc = NULL;
-    NPT_ContainerFind(m_ArgumentDescs, PLT_ArgumentDescNameFinder(name), arg_desc);
+
+    // arguments added directly through GetArgumentDescs aren't indexed
+    if (m_ArgumentDescsByName.GetItemCount() == m_ArgumentDescs.GetItemCount()) {
+        m_ArgumentDescsByName.Get(name, arg_desc);
+    } else {
+        NPT_ContainerFind(m_ArgumentDescs, PLT_ArgumentDescNameFinder(name), arg_desc);
+    }
     return arg_desc;
 }
 
+/*----------------------------------------------------------------------
+|   PLT_ActionDesc::AddArgumentDesc
++---------------------------------------------------------------------*/
+NPT_Result
+PLT_ActionDesc::AddArgumentDesc(PLT_ArgumentDesc* arg_desc)
+{
+    NPT_CHECK_POINTER_SEVERE(arg_desc);
+    NPT_CHECK_SEVERE(m_ArgumentDescs.Add(arg_desc));
+    return m_ArgumentDescsByName.Put(arg_desc->GetName(), arg_desc);
+}
+
 /*----------------------------------------------------------------------
 |   PLT_Action::PLT_Action
 +---------------------------------------------------------------------*/
 PLT_Action::PLT_Action(PLT_ActionDesc& action_desc) :
     m_ActionDesc(action_desc),
-    m_ErrorCode(0)
+    m_ErrorCode(0),
+    m_Timeout(0)
 {
 }
 
@@ -117,6 +135,7 @@ PLT_Action::PLT_Action(PLT_ActionDesc&          action_desc,
                        PLT_DeviceDataReference& root_device) :
     m_ActionDesc(action_desc),
     m_ErrorCode(0),
+    m_Timeout(0),
 	m_RootDevice(root_device)
 {
 }
@@ -193,9 +212,41 @@ PLT_Action::GetArgumentValue(const char* name, bool& value)
 PLT_Argument*
 PLT_Action::GetArgument(const char* name)
 {
-    PLT_Argument* argument = NULL;
-    NPT_ContainerFind(m_Arguments, PLT_ArgumentNameFinder(name), argument);
-    return argument;
+    PLT_ArgumentDesc* arg_desc = m_ActionDesc.GetArgumentDesc(name);
+    return arg_desc?GetArgumentSlot(arg_desc):NULL;
+}
+
+/*----------------------------------------------------------------------
+|   PLT_Action::GetArgumentSlot
++---------------------------------------------------------------------*/
+PLT_Argument*
+PLT_Action::GetArgumentSlot(PLT_ArgumentDesc* arg_desc)
+{
+    NPT_Ordinal position = arg_desc->GetPosition();
+    if (position >= m_ArgumentSlots.GetItemCount()) return NULL;
+
+    PLT_Argument* argument = m_ArgumentSlots[position];
+
+    // positions are unique per action, but double check in case
+    // the description was built by hand
+    return (argument && &argument->GetDesc() == arg_desc)?argument:NULL;
+}
+
+/*----------------------------------------------------------------------
+|   PLT_Action::SetArgumentSlot
++---------------------------------------------------------------------*/
+NPT_Result
+PLT_Action::SetArgumentSlot(PLT_ArgumentDesc* arg_desc, PLT_Argument* argument)
+{
+    NPT_Ordinal position = arg_desc->GetPosition();
+    if (position >= m_ArgumentSlots.GetItemCount()) {
+        NPT_Cardinal count = m_ArgumentSlots.GetItemCount();
+        NPT_CHECK_SEVERE(m_ArgumentSlots.Resize(position+1));
+        for (; count<=position; count++) m_ArgumentSlots[count] = NULL;
+    }
+
+    m_ArgumentSlots[position] = argument;
+    return NPT_SUCCESS;
 }
 
 /*----------------------------------------------------------------------
@@ -205,22 +256,34 @@ NPT_Result
 PLT_Action::SetArgumentValue(const char* name,
                              const char* value)
 {
-    // look for this argument in our argument list
+    // look for this argument in our argument slots
     // and replace the value if we found it 
+    PLT_ArgumentDesc* arg_desc = m_ActionDesc.GetArgumentDesc(name);
+    PLT_Argument*     existing = arg_desc?GetArgumentSlot(arg_desc):NULL;
 	PLT_Arguments::Iterator iter = NULL;
-    if (NPT_SUCCEEDED(NPT_ContainerFind(m_Arguments, PLT_ArgumentNameFinder(name), iter))) {
-        NPT_Result res = (*iter)->SetValue(value);
+    if (existing) {
+        NPT_Result res = existing->SetValue(value);
 
 		// remove argument from list if failed
 		// so that when we verify arguments later, 
 		// we don't use a previously set value
-		if (NPT_FAILED(res)) m_Arguments.Erase(iter);
+		if (NPT_FAILED(res)) {
+            for (NPT_Cardinal i=0; i<m_Arguments.GetItemCount(); i++) {
+                if (m_Arguments[i] == existing) {
+                    m_Arguments.Erase(m_Arguments.GetItem(i));
+                    break;
+                }
+            }
+            SetArgumentSlot(arg_desc, NULL);
+            delete existing;
+        }
 		return res;
     }
 
     // since we didn't find it, create a clone 
 	PLT_Argument* arg;
     NPT_CHECK_SEVERE(PLT_Argument::CreateArgument(m_ActionDesc, name, value, arg));
+    NPT_CHECK_SEVERE(SetArgumentSlot(&arg->GetDesc(), arg));
 
     // insert it at the right position
     for (NPT_Cardinal i=0;
@@ -264,8 +327,7 @@ PLT_Action::VerifyArguments(bool input)
             continue;
 
         // look for this argument in the list we received
-        PLT_Argument* arg = NULL;
-        if (NPT_FAILED(NPT_ContainerFind(m_Arguments, PLT_ArgumentNameFinder(arg_desc->GetName()), arg))) {
+        if (!GetArgumentSlot(arg_desc)) {
 			NPT_LOG_WARNING_2("Argument %s for action %s not found", 
 				(const char*) arg_desc->GetName(), 
 				(const char*) m_ActionDesc.GetName());
@@ -304,9 +366,8 @@ NPT_Result
 PLT_Action::SetArgumentOutFromStateVariable(const char* name)
 {
     // look for this argument in the action list of arguments
-    PLT_ArgumentDesc* arg_desc = NULL;
-    NPT_CHECK_SEVERE(NPT_ContainerFind(m_ActionDesc.GetArgumentDescs(), 
-        PLT_ArgumentDescNameFinder(name), arg_desc));
+    PLT_ArgumentDesc* arg_desc = m_ActionDesc.GetArgumentDesc(name);
+    NPT_CHECK_POINTER_SEVERE(arg_desc);
 
     return SetArgumentOutFromStateVariable(arg_desc);
 }
@@ -367,40 +428,43 @@ PLT_Action::GetErrorCode()
 NPT_Result
 PLT_Action::FormatSoapRequest(NPT_OutputStream& stream)
 {
-    NPT_String str;
-    NPT_Result res;
-    NPT_XmlElementNode* body = NULL;
-    NPT_XmlElementNode* request = NULL;
-    NPT_XmlElementNode* envelope = new NPT_XmlElementNode("s", "Envelope");
-
-    NPT_CHECK_LABEL_SEVERE(res = envelope->SetNamespaceUri("s", "http://schemas.xmlsoap.org/soap/envelope/"), cleanup);
-    NPT_CHECK_LABEL_SEVERE(res = envelope->SetAttribute("s", "encodingStyle", "http://schemas.xmlsoap.org/soap/encoding/"), cleanup);
+    PLT_SoapWriter writer(&stream);
+    return WriteSoapRequest(writer);
+}
 
-    body = new NPT_XmlElementNode("s", "Body");
-    NPT_CHECK_LABEL_SEVERE(res = envelope->AddChild(body), cleanup);
+/*----------------------------------------------------------------------
+|   PLT_Action::GetSoapRequestSize
++---------------------------------------------------------------------*/
+NPT_Size
+PLT_Action::GetSoapRequestSize()
+{
+    PLT_SoapWriter writer;
+    WriteSoapRequest(writer);
+    return writer.GetSize();
+}
 
-    request = new NPT_XmlElementNode("u", m_ActionDesc.GetName());
-    NPT_CHECK_LABEL_SEVERE(res = request->SetNamespaceUri("u", m_ActionDesc.GetService()->GetServiceType()), cleanup);
-    NPT_CHECK_LABEL_SEVERE(res = body->AddChild(request), cleanup);
+/*----------------------------------------------------------------------
+|   PLT_Action::WriteSoapRequest
++---------------------------------------------------------------------*/
+NPT_Result
+PLT_Action::WriteSoapRequest(PLT_SoapWriter& writer)
+{
+    NPT_CHECK_SEVERE(writer.StartEnvelope());
+    NPT_CHECK_SEVERE(writer.StartAction(m_ActionDesc.GetName(), 
+                                        false, 
+                                        m_ActionDesc.GetService()->GetServiceType()));
 
     for(unsigned int i=0; i<m_Arguments.GetItemCount(); i++) {
         PLT_Argument* argument = m_Arguments[i];
         if (argument->GetDesc().GetDirection().Compare("in", true) == 0) {
-            NPT_CHECK_LABEL_SEVERE(res = PLT_XmlHelper::AddChildText(
-                request, 
+            NPT_CHECK_SEVERE(writer.WriteArgument(
                 argument->GetDesc().GetName(), 
-                argument->GetValue()), cleanup);
+                argument->GetValue()));
         }
     }
 
-    NPT_CHECK_LABEL_SEVERE(res = PLT_XmlHelper::Serialize(*envelope, str), cleanup);
-    delete envelope;
-
-    return stream.Write((const char*)str, str.GetLength());
-
-cleanup:
-    delete envelope;
-    return res;
+    NPT_CHECK_SEVERE(writer.EndAction(m_ActionDesc.GetName(), false));
+    return writer.EndEnvelope();
 }
 
 /*----------------------------------------------------------------------
@@ -409,53 +473,56 @@ cleanup:
 NPT_Result
 PLT_Action::FormatSoapResponse(NPT_OutputStream& stream)
 {
-    if (m_ErrorCode) {
-        return FormatSoapError(m_ErrorCode, m_ErrorDescription, stream);
-    }
-
-    NPT_String str;
-    NPT_Result res;
-    NPT_XmlElementNode* body = NULL;
-    NPT_XmlElementNode* response = NULL;
-    NPT_XmlElementNode* node = NULL;
-    NPT_XmlElementNode* envelope = new NPT_XmlElementNode("s", "Envelope");
+    PLT_SoapWriter writer(&stream);
+    return WriteSoapResponse(writer);
+}
 
-    NPT_CHECK_LABEL_SEVERE(res = envelope->SetNamespaceUri("s", "http://schemas.xmlsoap.org/soap/envelope/"), cleanup);
-    NPT_CHECK_LABEL_SEVERE(res = envelope->SetAttribute("s", "encodingStyle", "http://schemas.xmlsoap.org/soap/encoding/"), cleanup);
+/*----------------------------------------------------------------------
+|   PLT_Action::GetSoapResponseSize
++---------------------------------------------------------------------*/
+NPT_Size
+PLT_Action::GetSoapResponseSize()
+{
+    PLT_SoapWriter writer;
+    WriteSoapResponse(writer);
+    return writer.GetSize();
+}
 
-    body = new NPT_XmlElementNode("s", "Body");
-    NPT_CHECK_LABEL_SEVERE(res = envelope->AddChild(body), cleanup);        
+/*----------------------------------------------------------------------
+|   PLT_Action::WriteSoapResponse
++---------------------------------------------------------------------*/
+NPT_Result
+PLT_Action::WriteSoapResponse(PLT_SoapWriter& writer)
+{
+    if (m_ErrorCode) {
+        return WriteSoapError(m_ErrorCode, m_ErrorDescription, writer);
+    }
 
-    response = new NPT_XmlElementNode("u", m_ActionDesc.GetName() + "Response");
-    NPT_CHECK_LABEL_SEVERE(response->SetNamespaceUri("u", m_ActionDesc.GetService()->GetServiceType()), cleanup);
-    NPT_CHECK_LABEL_SEVERE(res = body->AddChild(response), cleanup);    
+    NPT_CHECK_SEVERE(writer.StartEnvelope());
+    NPT_CHECK_SEVERE(writer.StartAction(m_ActionDesc.GetName(), 
+                                        true, 
+                                        m_ActionDesc.GetService()->GetServiceType()));
 
     for(unsigned int i=0; i<m_Arguments.GetItemCount(); i++) {
         PLT_Argument* argument = m_Arguments[i];
         if (argument->GetDesc().GetDirection().Compare("out", true) == 0) {
-            node = new NPT_XmlElementNode(argument->GetDesc().GetName());
-            NPT_CHECK_LABEL_SEVERE(res = node->AddText(argument->GetValue()), cleanup);
-            NPT_CHECK_LABEL_SEVERE(res = response->AddChild(node), cleanup);
+            const char* data_type = NULL;
 
 #ifndef REMOVE_WMP_DATATYPE_EXTENSION
             PLT_StateVariable* var = argument->GetDesc().GetRelatedStateVariable();
-            if (var) {
-                node->SetNamespaceUri("dt", "urn:schemas-microsoft-com:datatypes");
-                node->SetAttribute("dt", "dt", var->GetDataType());
-            }
+            if (var) data_type = var->GetDataType();
 #endif
+
+            // values are xml escaped straight into the stream
+            NPT_CHECK_SEVERE(writer.WriteArgument(
+                argument->GetDesc().GetName(), 
+                argument->GetValue(),
+                data_type));
         }
     }
 
-    // this will xmlescape any values that contain xml characters
-    NPT_CHECK_LABEL_SEVERE(PLT_XmlHelper::Serialize(*envelope, str), cleanup);
-    delete envelope;
-
-    return stream.Write((const char*)str, str.GetLength());
-
-cleanup:
-    delete envelope;
-    return res;
+    NPT_CHECK_SEVERE(writer.EndAction(m_ActionDesc.GetName(), true));
+    return writer.EndEnvelope();
 }
 
 /*----------------------------------------------------------------------
@@ -464,42 +531,19 @@ cleanup:
 NPT_Result
 PLT_Action::FormatSoapError(unsigned int code, NPT_String desc, NPT_OutputStream& stream)
 {
-    NPT_String str;
-    NPT_Result res;
-    NPT_XmlElementNode* body = NULL;
-    NPT_XmlElementNode* fault = NULL;
-    NPT_XmlElementNode* detail = NULL;
-    NPT_XmlElementNode* UPnPError = NULL;
-    NPT_XmlElementNode* envelope = new NPT_XmlElementNode("s", "Envelope");
-
-    NPT_CHECK_LABEL_SEVERE(res = envelope->SetNamespaceUri("s", "http://schemas.xmlsoap.org/soap/envelope/"), cleanup);
-    NPT_CHECK_LABEL_SEVERE(res = envelope->SetAttribute("s", "encodingStyle", "http://schemas.xmlsoap.org/soap/encoding/"), cleanup);
-
-    body = new NPT_XmlElementNode("s", "Body");
-    NPT_CHECK_LABEL_SEVERE(res = envelope->AddChild(body), cleanup);   
-
-    fault = new NPT_XmlElementNode("s", "Fault");
-    NPT_CHECK_LABEL_SEVERE(res = body->AddChild(fault), cleanup);
-
-    NPT_CHECK_LABEL_SEVERE(res = PLT_XmlHelper::AddChildText(fault, "faultcode", "s:Client"), cleanup);
-    NPT_CHECK_LABEL_SEVERE(res = PLT_XmlHelper::AddChildText(fault, "faultstring", "UPnPError"), cleanup);
-
-    detail = new NPT_XmlElementNode("detail");
-    NPT_CHECK_LABEL_SEVERE(res = fault->AddChild(detail), cleanup);
-
-    UPnPError = new NPT_XmlElementNode("UPnPError");
-    NPT_CHECK_LABEL_SEVERE(res = UPnPError->SetNamespaceUri("", "urn:schemas-upnp-org:control-1-0"), cleanup);
-    NPT_CHECK_LABEL_SEVERE(res = detail->AddChild(UPnPError), cleanup);
-
-    NPT_CHECK_LABEL_SEVERE(res = PLT_XmlHelper::AddChildText(UPnPError, "errorCode", NPT_String::FromInteger(code)), cleanup);
-    NPT_CHECK_LABEL_SEVERE(res = PLT_XmlHelper::AddChildText(UPnPError, "errorDescription", desc), cleanup);
-
-    NPT_CHECK_LABEL_SEVERE(res = PLT_XmlHelper::Serialize(*envelope, str), cleanup);
-    delete envelope;
-
-    return stream.Write((const char*)str, str.GetLength());
+    PLT_SoapWriter writer(&stream);
+    return WriteSoapError(code, desc, writer);
+}
 
-cleanup:
-    delete envelope;
-    return res;
+/*----------------------------------------------------------------------
+|   PLT_Action::WriteSoapError
++---------------------------------------------------------------------*/
+NPT_Result
+PLT_Action::WriteSoapError(unsigned int      code, 
+                           const NPT_String& desc, 
+                           PLT_SoapWriter&   writer)
+{
+    NPT_CHECK_SEVERE(writer.StartEnvelope());
+    NPT_CHECK_SEVERE(writer.WriteFault(code, desc));
+    return writer.EndEnvelope();
 }
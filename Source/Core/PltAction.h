@@ -45,6 +45,8 @@
 #include "Neptune.h"
 #include "PltArgument.h"
 #include "PltDeviceData.h"
+#include "PltSoap.h"
+#include "PltUtilities.h"
 
 /*----------------------------------------------------------------------
 |   forward declarations
@@ -89,6 +91,12 @@ public:
      @return PLT_ArgumentDesc pointer
      */
     PLT_ArgumentDesc* GetArgumentDesc(const char* name);
+
+    /**
+     Add an argument to the action and index it by name.
+     @param arg_desc the argument description, owned by the action from now on
+     */
+    NPT_Result        AddArgumentDesc(PLT_ArgumentDesc* arg_desc);
     
     /**
      Serialize action information to xml into an existing xml tree
@@ -106,6 +114,7 @@ protected:
     NPT_String                   m_Name;
     PLT_Service*                 m_Service;
     NPT_Array<PLT_ArgumentDesc*> m_ArgumentDescs;
+    PLT_NameMap<PLT_ArgumentDesc*> m_ArgumentDescsByName;
 };
 
 /*----------------------------------------------------------------------
@@ -230,12 +239,31 @@ public:
      @return the error code.
      */
     unsigned int GetErrorCode();
+
+    /**
+     Set how long a control point waits for the response when invoking
+     the action.
+     @param timeout time in milliseconds, 0 to use the control point default
+     */
+    void SetTimeout(NPT_Timeout timeout) { m_Timeout = timeout; }
+
+    /**
+     Return the time a control point waits for the response.
+     @return the timeout in milliseconds, 0 for the control point default
+     */
+    NPT_Timeout GetTimeout() { return m_Timeout; }
     
     /**
      Called by a control point when serializing an action.
      @param stream the stream to serialize the action to
      */
     NPT_Result    FormatSoapRequest(NPT_OutputStream& stream);
+
+    /**
+     Return the size of the serialized action, used to preallocate the 
+     request body before calling FormatSoapRequest.
+     */
+    NPT_Size      GetSoapRequestSize();
     
     /**
      Called by a device when serializing a response to an action.
@@ -243,6 +271,12 @@ public:
      */
     NPT_Result    FormatSoapResponse(NPT_OutputStream& stream);
 
+    /**
+     Return the size of the serialized response, used to preallocate the 
+     response body before calling FormatSoapResponse.
+     */
+    NPT_Size      GetSoapResponseSize();
+
     /**
      Helper method for a device to serialize an action invocation error.
      @param code optional pointer to receive the code
@@ -257,13 +291,22 @@ private:
     // methods
     NPT_Result    SetArgumentOutFromStateVariable(PLT_ArgumentDesc* arg_desc);
     PLT_Argument* GetArgument(const char* name);
+    PLT_Argument* GetArgumentSlot(PLT_ArgumentDesc* arg_desc);
+    NPT_Result    SetArgumentSlot(PLT_ArgumentDesc* arg_desc, PLT_Argument* argument);
+    NPT_Result    WriteSoapRequest(PLT_SoapWriter& writer);
+    NPT_Result    WriteSoapResponse(PLT_SoapWriter& writer);
+    static NPT_Result WriteSoapError(unsigned int      code, 
+                                     const NPT_String& desc, 
+                                     PLT_SoapWriter&   writer);
 
 protected:
     // members
     PLT_ActionDesc&         m_ActionDesc;
     PLT_Arguments           m_Arguments;
+    NPT_Array<PLT_Argument*> m_ArgumentSlots; // indexed by argument position
     unsigned int            m_ErrorCode;
     NPT_String              m_ErrorDescription;
+    NPT_Timeout             m_Timeout;
     
     // keep reference of service root device to prevent it 
     // from being released during action lifetime
@@ -43,6 +43,7 @@
 #include "PltSsdp.h"
 #include "PltHttpServer.h"
 #include "PltConstants.h"
+#include "PltSCPDCache.h"
 
 NPT_SET_LOCAL_LOGGER("platinum.core.ctrlpoint")
 
@@ -126,11 +127,24 @@ private:
 class PLT_AddGetSCPDRequestIterator
 {
 public:
-    PLT_AddGetSCPDRequestIterator(PLT_CtrlPointGetSCPDsTask& task,
-                                  PLT_DeviceDataReference&   device) :
-        m_Task(task), m_Device(device) {}
+    PLT_AddGetSCPDRequestIterator(PLT_CtrlPointInspector&  inspector,
+                                  PLT_DeviceDataReference& device,
+                                  const char*              root_uuid,
+                                  NPT_UInt32               config_id,
+                                  NPT_TimeInterval         delay) :
+        m_Inspector(inspector), m_Device(device), m_RootUUID(root_uuid), m_ConfigId(config_id), m_Delay(delay) {}
 
     NPT_Result operator()(PLT_Service*& service) const {
+        // reuse the SCPD of a device of the same model if we have seen one
+        NPT_String scpd;
+        if (NPT_SUCCEEDED(PLT_SCPDCache::GetInstance().Get(PLT_SCPDCache::GetKey(service, m_RootUUID, m_ConfigId), scpd)) &&
+            NPT_SUCCEEDED(service->SetSCPDXML(scpd))) {
+            NPT_LOG_FINER_2("Using cached SCPD for service \"%s\" of device \"%s\"", 
+                (const char*)service->GetServiceID(),
+                (const char*)service->GetDevice()->GetFriendlyName());
+            return NPT_SUCCESS;
+        }
+
         // look for the host and port of the device
         NPT_String scpd_url = service->GetSCPDURL(true);
 
@@ -149,15 +163,15 @@ public:
             return NPT_ERROR_INVALID_SYNTAX;
         }
 
-        // Create request and attach service to it
-        PLT_CtrlPointGetSCPDRequest* request = 
-            new PLT_CtrlPointGetSCPDRequest((PLT_DeviceDataReference&)m_Device, scpd_url, "GET", NPT_HTTP_PROTOCOL_1_1);
-        return m_Task.AddSCPDRequest(request);
+        return m_Inspector.FetchSCPD((PLT_DeviceDataReference&)m_Device, url, m_Delay);
     }
 
 private:
-    PLT_CtrlPointGetSCPDsTask& m_Task;
-    PLT_DeviceDataReference    m_Device;
+    PLT_CtrlPointInspector&  m_Inspector;
+    PLT_DeviceDataReference  m_Device;
+    NPT_String               m_RootUUID;
+    NPT_UInt32               m_ConfigId;
+    NPT_TimeInterval         m_Delay;
 };
 
 /*----------------------------------------------------------------------
@@ -174,10 +188,9 @@ public:
 
     NPT_Result operator()(PLT_Service*& service) const {
         PLT_EventSubscriberReference sub;
-        if (NPT_SUCCEEDED(NPT_ContainerFind(m_CtrlPoint->m_Subscribers, 
-                                            PLT_EventSubscriberFinderByService(service), sub))) {
+        if (NPT_SUCCEEDED(m_CtrlPoint->FindSubscriberByService(service, sub))) {
             NPT_LOG_INFO_1("Removed subscriber \"%s\"", (const char*)sub->GetSID());
-            m_CtrlPoint->m_Subscribers.Remove(sub);
+            m_CtrlPoint->RemoveSubscriber(sub);
         }
 
         return NPT_SUCCESS;
@@ -229,6 +242,22 @@ public:
     }
 };
 
+/*----------------------------------------------------------------------
+|   PLT_DeviceCollector class
++---------------------------------------------------------------------*/
+class PLT_DeviceCollector
+{
+public:
+    PLT_DeviceCollector(NPT_List<PLT_DeviceDataReference>& devices) : m_Devices(devices) {}
+
+    void operator()(const PLT_DeviceDataReference& device) const {
+        m_Devices.Add(device);
+    }
+
+private:
+    NPT_List<PLT_DeviceDataReference>& m_Devices;
+};
+
 /*----------------------------------------------------------------------
 |   PLT_CtrlPoint::PLT_CtrlPoint
 +---------------------------------------------------------------------*/
@@ -236,8 +265,12 @@ PLT_CtrlPoint::PLT_CtrlPoint(const char* search_criteria /* = "upnp:rootdevice"
     m_EventHttpServer(NULL),
     m_TaskManager(NULL),
 	m_Lock(true),
+    m_SubscribersBySID(true),
+    m_Generation(0),
     m_SearchCriteria(search_criteria),
-    m_Started(false)
+    m_Started(false),
+    m_Inspector(this),
+    m_Invoker(this)
 {
 }
 
@@ -268,6 +301,7 @@ PLT_CtrlPoint::Start(PLT_SsdpListenTask* task)
     if (m_Started) NPT_CHECK_WARNING(NPT_ERROR_INVALID_STATE);
     
     m_TaskManager = new PLT_TaskManager();
+    m_TaskManager->EnablePool(); // inspections and subscriptions are short lived tasks
     
     m_EventHttpServer = new PLT_HttpServer();
     m_EventHttpServer->AddRequestHandler(new PLT_HttpRequestHandler(this), "/", true, true);
@@ -276,6 +310,12 @@ PLT_CtrlPoint::Start(PLT_SsdpListenTask* task)
     // house keeping task
     m_TaskManager->StartTask(new PLT_CtrlPointHouseKeepingTask(this));
 
+    // tasks fetching device and service descriptions
+    m_Inspector.Start(m_TaskManager.AsPointer());
+
+    // tasks sending actions and delivering their responses
+    m_Invoker.Start(m_TaskManager.AsPointer());
+
     // add ourselves as an listener to SSDP multicast advertisements
     task->AddListener(this);
 
@@ -315,6 +355,11 @@ PLT_CtrlPoint::Stop(PLT_SsdpListenTask* task)
 
     m_EventHttpServer->Stop();
     m_TaskManager->Abort();
+    m_Inspector.Stop();
+    m_Invoker.Stop();
+
+    // save the service descriptions learnt while running
+    PLT_SCPDCache::GetInstance().Flush();
 
     // force remove all devices
     NPT_List<PLT_DeviceDataReference>::Iterator iter = m_RootDevices.GetFirstItem();
@@ -327,6 +372,13 @@ PLT_CtrlPoint::Stop(PLT_SsdpListenTask* task)
     // as there are no more tasks pending
     m_RootDevices.Clear();
     m_Subscribers.Clear();
+    m_DevicesByUUID.Clear();
+    m_DevicesByServiceType.Clear();
+    m_SubscribersBySID.Clear();
+    m_SubscribersByService.Clear();
+    m_DeviceExpirations.Clear();
+    m_SubscriberRenewals.Clear();
+    m_PendingInspections.Clear();
 
     m_EventHttpServer = NULL;
     m_TaskManager = NULL;
@@ -501,77 +553,95 @@ PLT_CtrlPoint::Discover(const NPT_HttpUrl& url,
 NPT_Result
 PLT_CtrlPoint::DoHouseKeeping()
 {
-    NPT_List<PLT_DeviceDataReference> devices_to_remove;
-    
-    // remove expired devices
+    NPT_List<PLT_DeviceDataReference>          devices_to_remove;
+    NPT_List<PLT_CtrlPointSubscribeEventsTask*> tasks;
+    NPT_List<NPT_String>                       hosts;
+
     {
         NPT_AutoLock lock(m_Lock);
 
-        PLT_DeviceDataReference head, device;
-        while (NPT_SUCCEEDED(m_RootDevices.PopHead(device))) {
-            NPT_TimeStamp    last_update = device->GetLeaseTimeLastUpdate();
-            NPT_TimeInterval lease_time  = device->GetLeaseTime();
+        NPT_TimeStamp now;
+        NPT_System::GetCurrentTimeStamp(now);
+
+        // look at devices whose lease may have expired only, the lease
+        // is renewed without updating the heap so check it again now
+        DeviceExpiration expiration;
+        while (NPT_SUCCEEDED(m_DeviceExpirations.PopDue(now, expiration))) {
+            const DeviceEntry* entry = m_DevicesByUUID.Find(expiration.m_UUID);
+            if (!entry || 
+                entry->m_Generation != expiration.m_Generation || 
+                entry->m_ExpirationDue != expiration.m_Due) {
+                continue;
+            }
+            PLT_DeviceDataReference device = entry->m_RootDevice;
 
             // check if device lease time has expired or if failed to renew subscribers 
             // TODO: UDA 1.1 says that root device and all embedded devices must have expired
             // before we can assume they're all no longer unavailable (we may have missed the root device renew)
-            NPT_TimeStamp now;
-            NPT_System::GetCurrentTimeStamp(now);
-            if (now > last_update + NPT_TimeInterval((double)lease_time*2)) {
+            NPT_TimeStamp expires = device->GetLeaseTimeLastUpdate() + 
+                NPT_TimeInterval((double)device->GetLeaseTime()*2);
+            if (now >= expires) {
                 devices_to_remove.Add(device);
             } else {
-                // add the device back to our list since it is still alive
-                m_RootDevices.Add(device);
-
-                // keep track of first device added back to list
-                // to know we checked all devices in initial list
-                if (head.IsNull()) head = device;
+                ScheduleDeviceExpiration(expiration.m_UUID, expires);
             }
-            
-            // have we exhausted initial list?
-            if (!head.IsNull() && head == *m_RootDevices.GetFirstItem())
-                break;
-        };
-    }
-
-    // remove old devices
-    {
-        NPT_AutoLock lock(m_Lock);
+        }
 
+        // remove old devices
         for (NPT_List<PLT_DeviceDataReference>::Iterator device =
              devices_to_remove.GetFirstItem();
              device;
              device++) {
              RemoveDevice(*device);
         }
-    }
 
-    // renew subscribers of subscribed device services
-    NPT_List<PLT_ThreadTask*> tasks;
-    {
-        NPT_AutoLock lock(m_Lock);
-
-        NPT_List<PLT_EventSubscriberReference>::Iterator sub = m_Subscribers.GetFirstItem();
-        while (sub) {
-            NPT_TimeStamp now;
-            NPT_System::GetCurrentTimeStamp(now);
+        // renew subscribers within 90 secs of expiration, 
+        // grouping requests to the same host on one connection
+        SubscriberRenewal renewal;
+        while (NPT_SUCCEEDED(m_SubscriberRenewals.PopDue(now, renewal))) {
+            const SubscriberEntry* entry = m_SubscribersBySID.Find(renewal.m_SID);
+            if (!entry || 
+                entry->m_Generation != renewal.m_Generation || 
+                entry->m_RenewalDue != renewal.m_Due) {
+                continue;
+            }
+            PLT_EventSubscriberReference sub = entry->m_Subscriber;
+
+            NPT_TimeStamp renew_time = sub->GetExpirationTime() - NPT_TimeStamp(90.);
+            if (now >= renew_time) {
+                PLT_CtrlPointSubscribeRequest* request = CreateRenewRequest(sub);
+                if (request) {
+                    NPT_String host = request->GetUrl().GetHost() + ":" + 
+                        NPT_String::FromIntegerU(request->GetUrl().GetPort());
+
+                    NPT_List<PLT_CtrlPointSubscribeEventsTask*>::Iterator task = tasks.GetFirstItem();
+                    NPT_List<NPT_String>::Iterator                        task_host = hosts.GetFirstItem();
+                    while (task && *task_host != host) {
+                        ++task;
+                        ++task_host;
+                    }
+                    if (!task) {
+                        tasks.Add(new PLT_CtrlPointSubscribeEventsTask(this));
+                        hosts.Add(host);
+                        task = tasks.GetLastItem();
+                    }
+                    (*task)->AddSubscribeRequest(request);
+                }
 
-            // time to renew if within 90 secs of expiration
-            if (now > (*sub)->GetExpirationTime() - NPT_TimeStamp(90.)) {
-                PLT_ThreadTask* task = RenewSubscriber(*sub);
-                if (task) tasks.Add(task);
+                // check again later in case the renewal doesn't go through,
+                // the response will have updated the expiration time otherwise
+                renew_time = now + NPT_TimeInterval(10.);
             }
-            sub++;
+            ScheduleSubscriberRenewal(renewal.m_SID, renew_time);
         }
     }
 
     // Queue up all tasks now outside of lock, in case they
     // block because the task manager has maxed out number of running tasks
     // and to avoid a deadlock with tasks trying to acquire the lock in the response
-    NPT_List<PLT_ThreadTask*>::Iterator task = tasks.GetFirstItem();
+    NPT_List<PLT_CtrlPointSubscribeEventsTask*>::Iterator task = tasks.GetFirstItem();
     while (task) {
-        PLT_ThreadTask* _task = *task++;
-        m_TaskManager->StartTask(_task);
+        m_TaskManager->StartTask(*task++);
     }
     
     return NPT_SUCCESS;
@@ -585,22 +655,176 @@ PLT_CtrlPoint::FindDevice(const char*              uuid,
                           PLT_DeviceDataReference& device,
                           bool                     return_root /* = false */) 
 {
-    NPT_List<PLT_DeviceDataReference>::Iterator iter = m_RootDevices.GetFirstItem();
-    while (iter) {
-        // device uuid found immediately as root device
-        if ((*iter)->GetUUID().Compare(uuid) == 0) {
-            device = *iter;
-            return NPT_SUCCESS;
-        } else if (NPT_SUCCEEDED((*iter)->FindEmbeddedDevice(uuid, device))) {
-            // we found the uuid as an embedded device of this root
-            // return root if told, otherwise return found embedded device
-            if (return_root) device = (*iter);
-            return NPT_SUCCESS;
-        }
-        ++iter;
+    const DeviceEntry* entry = m_DevicesByUUID.Find(uuid);
+    if (!entry) return NPT_ERROR_NO_SUCH_ITEM;
+
+    // return root if told, otherwise return found embedded device
+    device = return_root?entry->m_RootDevice:entry->m_Device;
+    return NPT_SUCCESS;
+}
+
+/*----------------------------------------------------------------------
+|   PLT_CtrlPoint::AddRootDevice
++---------------------------------------------------------------------*/
+NPT_Result
+PLT_CtrlPoint::AddRootDevice(PLT_DeviceDataReference& root_device)
+{
+    m_RootDevices.Add(root_device);
+    NPT_CHECK(IndexDevice(root_device, root_device, ++m_Generation));
+
+    // check for expiration when the lease runs out
+    return ScheduleDeviceExpiration(
+        root_device->GetUUID(),
+        root_device->GetLeaseTimeLastUpdate() + NPT_TimeInterval((double)root_device->GetLeaseTime()*2));
+}
+
+/*----------------------------------------------------------------------
+|   PLT_CtrlPoint::ScheduleDeviceExpiration
++---------------------------------------------------------------------*/
+NPT_Result
+PLT_CtrlPoint::ScheduleDeviceExpiration(const char* uuid, const NPT_TimeStamp& due)
+{
+    DeviceEntry* entry = m_DevicesByUUID.Find(uuid);
+    if (!entry) return NPT_ERROR_NO_SUCH_ITEM;
+
+    // entries scheduled before for this device are now ignored
+    entry->m_ExpirationDue = due;
+
+    DeviceExpiration expiration;
+    expiration.m_UUID       = uuid;
+    expiration.m_Generation = entry->m_Generation;
+    expiration.m_Due        = due;
+    return m_DeviceExpirations.Add(due, expiration);
+}
+
+/*----------------------------------------------------------------------
+|   PLT_CtrlPoint::IndexDevice
++---------------------------------------------------------------------*/
+NPT_Result
+PLT_CtrlPoint::IndexDevice(PLT_DeviceDataReference& root_device,
+                           PLT_DeviceDataReference& device,
+                           NPT_UInt32               generation)
+{
+    DeviceEntry entry;
+    entry.m_RootDevice = root_device;
+    entry.m_Device     = device;
+    entry.m_Generation = generation;
+    m_DevicesByUUID.Put(device->GetUUID(), entry);
+
+    for (NPT_Cardinal i=0; i<device->m_EmbeddedDevices.GetItemCount(); i++) {
+        IndexDevice(root_device, device->m_EmbeddedDevices[i], generation);
     }
 
-    return NPT_ERROR_NO_SUCH_ITEM;
+    return NPT_SUCCESS;
+}
+
+/*----------------------------------------------------------------------
+|   PLT_CtrlPoint::FindDevicesByServiceType
++---------------------------------------------------------------------*/
+NPT_Result
+PLT_CtrlPoint::FindDevicesByServiceType(const char*                        service_type,
+                                        NPT_List<PLT_DeviceDataReference>& devices)
+{
+    NPT_AutoLock lock(m_Lock);
+
+    const PLT_StringMap<PLT_DeviceDataReference>* found = m_DevicesByServiceType.Find(service_type);
+    if (!found) return NPT_ERROR_NO_SUCH_ITEM;
+
+    found->Apply(PLT_DeviceCollector(devices));
+    return NPT_SUCCESS;
+}
+
+/*----------------------------------------------------------------------
+|   PLT_CtrlPoint::GetServiceKey
++---------------------------------------------------------------------*/
+NPT_String
+PLT_CtrlPoint::GetServiceKey(PLT_Service* service)
+{
+    // service ids are unique within a device
+    return service->GetDevice()->GetUUID() + "/" + service->GetServiceID();
+}
+
+/*----------------------------------------------------------------------
+|   PLT_CtrlPoint::AddSubscriber
++---------------------------------------------------------------------*/
+NPT_Result
+PLT_CtrlPoint::AddSubscriber(PLT_EventSubscriberReference& sub)
+{
+    m_Subscribers.Add(sub);
+
+    SubscriberEntry entry;
+    entry.m_Subscriber = sub;
+    entry.m_Generation = ++m_Generation;
+    m_SubscribersBySID.Put(sub->GetSID(), entry);
+
+    // renew within 90 secs of expiration
+    ScheduleSubscriberRenewal(sub->GetSID(), sub->GetExpirationTime() - NPT_TimeStamp(90.));
+
+    return m_SubscribersByService.Put(GetServiceKey(sub->GetService()), sub);
+}
+
+/*----------------------------------------------------------------------
+|   PLT_CtrlPoint::ScheduleSubscriberRenewal
++---------------------------------------------------------------------*/
+NPT_Result
+PLT_CtrlPoint::ScheduleSubscriberRenewal(const char* sid, const NPT_TimeStamp& due)
+{
+    SubscriberEntry* entry = m_SubscribersBySID.Find(sid);
+    if (!entry) return NPT_ERROR_NO_SUCH_ITEM;
+
+    // entries scheduled before for this subscriber are now ignored
+    entry->m_RenewalDue = due;
+
+    SubscriberRenewal renewal;
+    renewal.m_SID        = sid;
+    renewal.m_Generation = entry->m_Generation;
+    renewal.m_Due        = due;
+    return m_SubscriberRenewals.Add(due, renewal);
+}
+
+/*----------------------------------------------------------------------
+|   PLT_CtrlPoint::RemoveSubscriber
++---------------------------------------------------------------------*/
+NPT_Result
+PLT_CtrlPoint::RemoveSubscriber(PLT_EventSubscriberReference& sub)
+{
+    // keep a reference as sub may be one of the entries we remove
+    PLT_EventSubscriberReference removed = sub;
+
+    const SubscriberEntry* entry = m_SubscribersBySID.Find(removed->GetSID());
+    if (entry && entry->m_Subscriber == removed) m_SubscribersBySID.Remove(removed->GetSID());
+
+    NPT_String key = GetServiceKey(removed->GetService());
+    PLT_EventSubscriberReference* indexed = m_SubscribersByService.Find(key);
+    if (indexed && *indexed == removed) m_SubscribersByService.Remove(key);
+
+    return m_Subscribers.Remove(removed, true);
+}
+
+/*----------------------------------------------------------------------
+|   PLT_CtrlPoint::FindSubscriberBySID
++---------------------------------------------------------------------*/
+NPT_Result
+PLT_CtrlPoint::FindSubscriberBySID(const char* sid, PLT_EventSubscriberReference& sub)
+{
+    const SubscriberEntry* entry = m_SubscribersBySID.Find(sid);
+    if (!entry) return NPT_ERROR_NO_SUCH_ITEM;
+
+    sub = entry->m_Subscriber;
+    return NPT_SUCCESS;
+}
+
+/*----------------------------------------------------------------------
+|   PLT_CtrlPoint::FindSubscriberByService
++---------------------------------------------------------------------*/
+NPT_Result
+PLT_CtrlPoint::FindSubscriberByService(PLT_Service* service, PLT_EventSubscriberReference& sub)
+{
+    const PLT_EventSubscriberReference* found = m_SubscribersByService.Find(GetServiceKey(service));
+    if (!found || (*found)->GetService() != service) return NPT_ERROR_NO_SUCH_ITEM;
+
+    sub = *found;
+    return NPT_SUCCESS;
 }
 
 /*----------------------------------------------------------------------
@@ -861,9 +1085,7 @@ PLT_CtrlPoint::ProcessPendingEventNotifications()
             PLT_EventSubscriberReference sub;
 
             // look for the subscriber with that sid
-            if (NPT_FAILED(NPT_ContainerFind(m_Subscribers,
-                                             PLT_EventSubscriberFinderBySID(notification->m_SID),
-                                             sub))) {
+            if (NPT_FAILED(FindSubscriberBySID(notification->m_SID, sub))) {
                 m_PendingNotifications.Add(notification);
                 continue;
             }
@@ -916,9 +1138,7 @@ PLT_CtrlPoint::ProcessHttpNotify(const NPT_HttpRequest&        request,
     ProcessPendingEventNotifications();
 
     // look for the subscriber with that sid
-    if (NPT_FAILED(NPT_ContainerFind(m_Subscribers,
-                                     PLT_EventSubscriberFinderBySID(notification->m_SID),
-                                     sub))) {
+    if (NPT_FAILED(FindSubscriberBySID(notification->m_SID, sub))) {
         NPT_LOG_WARNING_1("Subscriber %s not found, delaying notification process.\n", (const char*)notification->m_SID);
         AddPendingEventNotification(notification);
         return NPT_SUCCESS;
@@ -1093,6 +1313,7 @@ PLT_CtrlPoint::AddDevice(PLT_DeviceDataReference& data)
 {
     NPT_AutoLock lock(m_Lock);
 
+    m_Inspector.EndInspection(data->GetUUID(), true);
     return NotifyDeviceReady(data);
 }
 
@@ -1104,6 +1325,17 @@ PLT_CtrlPoint::NotifyDeviceReady(PLT_DeviceDataReference& data)
 {
     m_ListenerList.Apply(PLT_CtrlPointListenerOnDeviceAddedIterator(data));
 
+    /* index device by the type of its services */
+    for (NPT_Cardinal i=0; i<data->m_Services.GetItemCount(); i++) {
+        const NPT_String& type = data->m_Services[i]->GetServiceType();
+        PLT_StringMap<PLT_DeviceDataReference>* devices = m_DevicesByServiceType.Find(type);
+        if (!devices) {
+            m_DevicesByServiceType.Put(type, PLT_StringMap<PLT_DeviceDataReference>());
+            devices = m_DevicesByServiceType.Find(type);
+        }
+        devices->Put(data->GetUUID(), data);
+    }
+
     /* recursively add embedded devices */
     NPT_Array<PLT_DeviceDataReference> embedded_devices = 
         data->GetEmbeddedDevices();
@@ -1122,6 +1354,7 @@ PLT_CtrlPoint::RemoveDevice(PLT_DeviceDataReference& data)
 {
     NPT_AutoLock lock(m_Lock);
 
+    m_Inspector.EndInspection(data->GetUUID(), false);
     NotifyDeviceRemoved(data);
     CleanupDevice(data);
     
@@ -1166,8 +1399,19 @@ PLT_CtrlPoint::CleanupDevice(PLT_DeviceDataReference& data)
         CleanupDevice(embedded_devices[i]);
     }
 
-    /* remove from list */
+    /* remove from list and indexes */
     m_RootDevices.Remove(data);
+    m_DevicesByUUID.Remove(data->GetUUID());
+    for (NPT_Cardinal i=0; i<data->m_Services.GetItemCount(); i++) {
+        PLT_StringMap<PLT_DeviceDataReference>* devices = 
+            m_DevicesByServiceType.Find(data->m_Services[i]->GetServiceType());
+        if (devices) {
+            devices->Remove(data->GetUUID());
+            if (devices->GetItemCount() == 0) {
+                m_DevicesByServiceType.Remove(data->m_Services[i]->GetServiceType());
+            }
+        }
+    }
 
     /* unsubscribe from services */
     data->m_Services.Apply(PLT_EventSubscriberRemoverIterator(this));
@@ -1226,6 +1470,15 @@ PLT_CtrlPoint::ProcessSsdpMessage(const NPT_HttpMessage&        message,
         NPT_LOG_FINE_1("Device \"%s\" expiration time renewed..", 
             (const char*)data->GetFriendlyName());
 
+        // the heap only holds the previous deadline, check sooner
+        // if the root device now announces a shorter lease
+        const DeviceEntry* entry = m_DevicesByUUID.Find(uuid);
+        if (entry && entry->m_Device == entry->m_RootDevice) {
+            NPT_TimeStamp expires = data->GetLeaseTimeLastUpdate() + 
+                NPT_TimeInterval((double)data->GetLeaseTime()*2);
+            if (expires < entry->m_ExpirationDue) ScheduleDeviceExpiration(uuid, expires);
+        }
+
         return NPT_SUCCESS;
     }
 
@@ -1264,27 +1517,30 @@ PLT_CtrlPoint::InspectDevice(const NPT_HttpUrl& location,
     // remember that we're now inspecting the device
     m_PendingInspections.Add(uuid);
         
-    // Start a task to retrieve the description
-    PLT_CtrlPointGetDescriptionTask* task = new PLT_CtrlPointGetDescriptionTask(
-        location,
-        this,
-        leasetime,
-        uuid);
-
     // Add a delay to make sure that we received late NOTIFY bye-bye
-    NPT_TimeInterval delay(.5f);
-    m_TaskManager->StartTask(task, &delay);
+    return m_Inspector.FetchDescription(location, uuid, leasetime, NPT_TimeInterval(.5f));
+}
 
-    return NPT_SUCCESS;
+/*----------------------------------------------------------------------
+|   PLT_CtrlPoint::SetInspectionLimits
++---------------------------------------------------------------------*/
+NPT_Result
+PLT_CtrlPoint::SetInspectionLimits(NPT_Cardinal max_fetches, 
+                                   NPT_Cardinal max_fetches_per_host)
+{
+    if (m_Started) NPT_CHECK_WARNING(NPT_ERROR_INVALID_STATE);
+
+    return m_Inspector.SetLimits(max_fetches, max_fetches_per_host);
 }
 
 /*----------------------------------------------------------------------
 |   PLT_CtrlPoint::FetchDeviceSCPDs
 +---------------------------------------------------------------------*/
 NPT_Result
-PLT_CtrlPoint::FetchDeviceSCPDs(PLT_CtrlPointGetSCPDsTask* task,
-                                PLT_DeviceDataReference&   device, 
-                                NPT_Cardinal               level)
+PLT_CtrlPoint::FetchDeviceSCPDs(PLT_DeviceDataReference& root_device, 
+                                PLT_DeviceDataReference& device, 
+                                NPT_Cardinal             level,
+                                NPT_TimeInterval         delay)
 {
     if (level == 5 && device->m_EmbeddedDevices.GetItemCount()) {
         NPT_LOG_FATAL("Too many embedded devices depth! ");
@@ -1297,12 +1553,12 @@ PLT_CtrlPoint::FetchDeviceSCPDs(PLT_CtrlPointGetSCPDsTask* task,
     for (NPT_Cardinal i = 0;
          i<device->m_EmbeddedDevices.GetItemCount();
          i++) {
-         NPT_CHECK_SEVERE(FetchDeviceSCPDs(task, device->m_EmbeddedDevices[i], level));
+         NPT_CHECK_SEVERE(FetchDeviceSCPDs(root_device, device->m_EmbeddedDevices[i], level, delay));
     }
 
     // Get SCPD of device services now and bail right away if one fails
     return device->m_Services.ApplyUntil(
-        PLT_AddGetSCPDRequestIterator(*task, device),
+        PLT_AddGetSCPDRequestIterator(m_Inspector, device, root_device->GetUUID(), root_device->m_ConfigId, delay),
         NPT_UntilResultNotEquals(NPT_SUCCESS));
 }
 
@@ -1321,7 +1577,6 @@ PLT_CtrlPoint::ProcessGetDescriptionResponse(NPT_Result                    res,
 
     NPT_AutoLock lock(m_Lock);
     
-    PLT_CtrlPointGetSCPDsTask* task = NULL;
     NPT_String desc;
     PLT_DeviceDataReference root_device;
     PLT_DeviceDataReference device;
@@ -1353,18 +1608,13 @@ PLT_CtrlPoint::ProcessGetDescriptionResponse(NPT_Result                    res,
 
     // make sure root device was not previously queried
     if (NPT_FAILED(FindDevice(root_device->GetUUID(), device))) {
-        m_RootDevices.Add(root_device);
+        AddRootDevice(root_device);
             
         NPT_LOG_INFO_3("Device \"%s\" is now known as \"%s\" (%s)",
             (const char*)root_device->GetUUID(), 
             (const char*)root_device->GetFriendlyName(),
             (const char*)root_device->GetDescriptionUrl(NULL));
 
-        // create one single task to fetch all scpds one after the other
-        task = new PLT_CtrlPointGetSCPDsTask(this, root_device);
-        NPT_CHECK_LABEL_SEVERE(res = FetchDeviceSCPDs(task, root_device, 0),
-                               cleanup);
-
         // if device has embedded devices, we want to delay fetching scpds
         // just in case there's a chance all the initial NOTIFY bye-bye have
         // not all been received yet which would cause to remove the devices
@@ -1372,8 +1622,14 @@ PLT_CtrlPoint::ProcessGetDescriptionResponse(NPT_Result                    res,
         if (root_device->m_EmbeddedDevices.GetItemCount() > 0) {
             delay = 1.f;
         }
-        NPT_CHECK_LABEL_SEVERE(res = m_TaskManager->StartTask(task, &delay),
-                               failure);
+
+        // queue all scpds at once, they are fetched in parallel
+        NPT_CHECK_SEVERE(FetchDeviceSCPDs(root_device, root_device, 0, delay));
+
+        // all scpds were cached, no need to wait
+        if (NPT_SUCCEEDED(PLT_DeviceReadyIterator()(root_device))) {
+            return AddDevice(root_device);
+        }
     }
 
     return NPT_SUCCESS;
@@ -1382,11 +1638,6 @@ bad_response:
     NPT_LOG_SEVERE_2("Bad Description response @ %s: %s", 
         (const char*)request.GetUrl().ToString(),
         (const char*)desc);
-
-cleanup:
-    if (task) delete task;
-    
-failure:
     return res;
 }
 
@@ -1441,6 +1692,11 @@ PLT_CtrlPoint::ProcessGetSCPDResponse(NPT_Result                    res,
     // set the service scpd
     res = service->SetSCPDXML(scpd);
     NPT_CHECK_LABEL_SEVERE(res, bad_response);
+
+    // remember it for other devices of the same model
+    PLT_SCPDCache::GetInstance().Put(
+        PLT_SCPDCache::GetKey(service, root_device->GetUUID(), root_device->m_ConfigId), 
+        scpd);
     
     // if root device is ready, notify listeners about it and embedded devices
     if (NPT_SUCCEEDED(device_tester(root_device))) {
@@ -1466,6 +1722,23 @@ PLT_CtrlPoint::RenewSubscriber(PLT_EventSubscriberReference subscriber)
 {
     NPT_AutoLock lock(m_Lock);
 
+    PLT_CtrlPointSubscribeRequest* request = CreateRenewRequest(subscriber);
+    if (request == NULL) return NULL;
+
+    // create a task to post the request
+    PLT_CtrlPointSubscribeEventsTask* task = new PLT_CtrlPointSubscribeEventsTask(this);
+    task->AddSubscribeRequest(request);
+    return task;
+}
+
+/*----------------------------------------------------------------------
+|   PLT_CtrlPoint::CreateRenewRequest
++---------------------------------------------------------------------*/
+PLT_CtrlPointSubscribeRequest*
+PLT_CtrlPoint::CreateRenewRequest(PLT_EventSubscriberReference subscriber)
+{
+    NPT_AutoLock lock(m_Lock);
+
     PLT_DeviceDataReference root_device;
     if (NPT_FAILED(FindDevice(subscriber->GetService()->GetDevice()->GetUUID(),
                               root_device,
@@ -1479,22 +1752,16 @@ PLT_CtrlPoint::RenewSubscriber(PLT_EventSubscriberReference subscriber)
         (const char*)subscriber->GetService()->GetDevice()->GetFriendlyName());
 
     // create the request
-    NPT_HttpRequest* request = new NPT_HttpRequest(
-        subscriber->GetService()->GetEventSubURL(true),
-        "SUBSCRIBE", 
-        NPT_HTTP_PROTOCOL_1_1);
+    PLT_CtrlPointSubscribeRequest* request = new PLT_CtrlPointSubscribeRequest(
+        root_device,
+        subscriber->GetService(),
+        subscriber->GetService()->GetEventSubURL(true));
 
     PLT_UPnPMessageHelper::SetSID(*request, subscriber->GetSID());
     PLT_UPnPMessageHelper::SetTimeOut(*request, 
         (NPT_Int32)PLT_Constants::GetInstance().GetDefaultSubscribeLease()->ToSeconds());
 
-    // Prepare the request
-    // create a task to post the request
-    return new PLT_CtrlPointSubscribeEventTask(
-        request,
-        this, 
-        root_device,
-        subscriber->GetService());
+    return request;
 }
 
 /*----------------------------------------------------------------------
@@ -1525,9 +1792,7 @@ PLT_CtrlPoint::Subscribe(PLT_Service* service,
                                  true));
 
     // look for the subscriber with that service to decide if it's a renewal or not
-    NPT_ContainerFind(m_Subscribers, 
-                      PLT_EventSubscriberFinderByService(service), 
-                      sub);
+    FindSubscriberByService(service, sub);
 
     if (cancel == false) {
         // renewal?
@@ -1574,7 +1839,7 @@ PLT_CtrlPoint::Subscribe(PLT_Service* service,
         PLT_UPnPMessageHelper::SetSID(*request, sub->GetSID());
 
         // remove from list now
-        m_Subscribers.Remove(sub, true);
+        RemoveSubscriber(sub);
     }
 
     // verify we have request to send just in case
@@ -1633,9 +1898,7 @@ PLT_CtrlPoint::ProcessSubscribeResponse(NPT_Result                    res,
         }
 
         // Look for subscriber
-        NPT_ContainerFind(m_Subscribers, 
-            PLT_EventSubscriberFinderBySID(*sid), 
-            sub);
+        FindSubscriberBySID(*sid, sub);
         
         NPT_LOG_INFO_5("%s subscriber \"%s\" for service \"%s\" of device \"%s\" (timeout = %d)",
                        !sub.IsNull()?"Updating timeout for":"Creating new",
@@ -1647,10 +1910,15 @@ PLT_CtrlPoint::ProcessSubscribeResponse(NPT_Result                    res,
         // create new subscriber if sid never seen before
         // or update subscriber expiration otherwise
         if (sub.IsNull()) {
-            sub = new PLT_EventSubscriber(m_TaskManager, service, *sid, seconds);
-            m_Subscribers.Add(sub);
+            sub = new PLT_EventSubscriber(PLT_EventDispatcherReference(), service, *sid, seconds);
+            AddSubscriber(sub);
         } else {
             sub->SetTimeout(seconds);
+
+            // renew sooner if the device granted a shorter lease
+            const SubscriberEntry* entry = m_SubscribersBySID.Find(*sid);
+            NPT_TimeStamp renew_time = sub->GetExpirationTime() - NPT_TimeStamp(90.);
+            if (entry && renew_time < entry->m_RenewalDue) ScheduleSubscriberRenewal(*sid, renew_time);
         }
 
         // Process any pending notifcations for that subscriber we got a bit too early
@@ -1671,10 +1939,8 @@ failure:
 
 remove_sub:
     // in case it was a renewal look for the subscriber with that service and remove it from the list
-    if (NPT_SUCCEEDED(NPT_ContainerFind(m_Subscribers, 
-                                        PLT_EventSubscriberFinderByService(service), 
-                                        sub))) {
-        m_Subscribers.Remove(sub);
+    if (NPT_SUCCEEDED(FindSubscriberByService(service, sub))) {
+        RemoveSubscriber(sub);
     }
 
     return res;
@@ -1696,7 +1962,7 @@ PLT_CtrlPoint::InvokeAction(PLT_ActionReference& action,
     NPT_HttpRequest* request = new NPT_HttpRequest(url, "POST", NPT_HTTP_PROTOCOL_1_1);
     
     // create a memory stream for our request body
-    NPT_MemoryStreamReference stream(new NPT_MemoryStream);
+    NPT_MemoryStreamReference stream(new NPT_MemoryStream(action->GetSoapRequestSize()));
     action->FormatSoapRequest(*stream);
 
     // set the request body
@@ -1708,17 +1974,19 @@ PLT_CtrlPoint::InvokeAction(PLT_ActionReference& action,
     NPT_String action_name  = action->GetActionDesc().GetName();
     request->GetHeaders().SetHeader("SOAPAction", "\"" + service_type + "#" + action_name + "\"");
 
-    // create a task to post the request
-    PLT_CtrlPointInvokeActionTask* task = new PLT_CtrlPointInvokeActionTask(
-        request,
-        this, 
-        action, 
-        userdata);
+    // queue the request behind other actions sent to the same device
+    return m_Invoker.Invoke(request, action, userdata);
+}
 
-    // queue the request
-    m_TaskManager->StartTask(task);
+/*----------------------------------------------------------------------
+|   PLT_CtrlPoint::CancelAction
++---------------------------------------------------------------------*/
+NPT_Result
+PLT_CtrlPoint::CancelAction(PLT_ActionReference& action)
+{
+    if (!m_Started) NPT_CHECK_WARNING(NPT_ERROR_INVALID_STATE);
 
-    return NPT_SUCCESS;
+    return m_Invoker.Cancel(action);
 }
 
 /*----------------------------------------------------------------------
@@ -47,6 +47,9 @@
 #include "PltSsdp.h"
 #include "PltDeviceData.h"
 #include "PltHttpServer.h"
+#include "PltUtilities.h"
+#include "PltCtrlPointInspector.h"
+#include "PltCtrlPointInvoker.h"
 
 /*----------------------------------------------------------------------
 |   forward declarations
@@ -54,8 +57,7 @@
 class PLT_CtrlPointHouseKeepingTask;
 class PLT_SsdpSearchTask;
 class PLT_SsdpListenTask;
-class PLT_CtrlPointGetSCPDsTask;
-class PLT_CtrlPointGetSCPDRequest;
+class PLT_CtrlPointSubscribeRequest;
 
 /*----------------------------------------------------------------------
 |   PLT_CtrlPointListener class
@@ -120,6 +122,20 @@ public:
                                      const char*        uuid,
                                      NPT_TimeInterval   leasetime = *PLT_Constants::GetInstance().GetDefaultDeviceLease());
 
+    /**
+     Limit the number of description requests sent at the same time while
+     inspecting devices, overall and to a single host. Must be called before
+     the control point is started.
+     */
+    NPT_Result SetInspectionLimits(NPT_Cardinal max_fetches, NPT_Cardinal max_fetches_per_host);
+    void       GetInspectionStats(PLT_CtrlPointInspectionStats& stats) { m_Inspector.GetStats(stats); }
+
+    /**
+     Return the known devices, root or embedded, with a service of a given type.
+     */
+    NPT_Result FindDevicesByServiceType(const char*                        service_type,
+                                        NPT_List<PLT_DeviceDataReference>& devices);
+
     // actions
     virtual NPT_Result FindActionDesc(PLT_DeviceDataReference& device, 
                                   const char*              service_type,
@@ -132,6 +148,12 @@ public:
     virtual NPT_Result InvokeAction(PLT_ActionReference& action,
                                     void*                userdata = NULL);
 
+    /**
+     Cancel an action invoked earlier. Listeners still receive its response,
+     with NPT_ERROR_INTERRUPTED, unless the response had already arrived.
+     */
+    NPT_Result CancelAction(PLT_ActionReference& action);
+
     // events
     virtual NPT_Result Subscribe(PLT_Service* service, 
                                  bool         cancel = false, 
@@ -199,6 +221,7 @@ protected:
 private:
     // methods
     PLT_ThreadTask* RenewSubscriber(PLT_EventSubscriberReference subscriber);
+    PLT_CtrlPointSubscribeRequest* CreateRenewRequest(PLT_EventSubscriberReference subscriber);
     
     NPT_Result AddPendingEventNotification(PLT_EventNotification *notification);
     NPT_Result ProcessPendingEventNotifications();
@@ -207,16 +230,30 @@ private:
                                         NPT_List<PLT_StateVariable*> &vars);
     
     NPT_Result DoHouseKeeping();
-    NPT_Result FetchDeviceSCPDs(PLT_CtrlPointGetSCPDsTask* task,
-                                PLT_DeviceDataReference&   device, 
-                                NPT_Cardinal               level);
+    NPT_Result FetchDeviceSCPDs(PLT_DeviceDataReference& root_device, 
+                                PLT_DeviceDataReference& device, 
+                                NPT_Cardinal             level,
+                                NPT_TimeInterval         delay);
 
     // Device management
     NPT_Result FindDevice(const char* uuid, PLT_DeviceDataReference& device, bool return_root = false);
+    NPT_Result AddRootDevice(PLT_DeviceDataReference& root_device);
+    NPT_Result IndexDevice(PLT_DeviceDataReference& root_device, 
+                           PLT_DeviceDataReference& device,
+                           NPT_UInt32               generation);
+    NPT_Result ScheduleDeviceExpiration(const char* uuid, const NPT_TimeStamp& due);
     NPT_Result NotifyDeviceReady(PLT_DeviceDataReference& data);
     NPT_Result NotifyDeviceRemoved(PLT_DeviceDataReference& data);
     NPT_Result CleanupDevice(PLT_DeviceDataReference& data);
     
+    // Subscribers management
+    NPT_Result AddSubscriber(PLT_EventSubscriberReference& sub);
+    NPT_Result RemoveSubscriber(PLT_EventSubscriberReference& sub);
+    NPT_Result FindSubscriberBySID(const char* sid, PLT_EventSubscriberReference& sub);
+    NPT_Result FindSubscriberByService(PLT_Service* service, PLT_EventSubscriberReference& sub);
+    NPT_Result ScheduleSubscriberRenewal(const char* sid, const NPT_TimeStamp& due);
+    static NPT_String GetServiceKey(PLT_Service* service);
+
     NPT_Result ParseFault(PLT_ActionReference& action, NPT_XmlElementNode* fault);
     PLT_SsdpSearchTask* CreateSearchTask(const NPT_HttpUrl&   url, 
                                          const char*          target, 
@@ -230,11 +267,11 @@ private:
     friend class PLT_UPnP_CtrlPointStartIterator;
     friend class PLT_UPnP_CtrlPointStopIterator;
     friend class PLT_EventSubscriberRemoverIterator;
-    friend class PLT_CtrlPointGetDescriptionTask;
-    friend class PLT_CtrlPointGetSCPDsTask;
-    friend class PLT_CtrlPointInvokeActionTask;
     friend class PLT_CtrlPointHouseKeepingTask;
     friend class PLT_CtrlPointSubscribeEventTask;
+    friend class PLT_CtrlPointSubscribeEventsTask;
+    friend class PLT_CtrlPointInspectionTask;
+    friend class PLT_CtrlPointInvoker;
 
     NPT_List<NPT_String>                         m_UUIDsToIgnore;
     PLT_CtrlPointListenerList                    m_ListenerList;
@@ -243,10 +280,47 @@ private:
     NPT_Mutex                                    m_Lock;
     NPT_List<PLT_DeviceDataReference>            m_RootDevices;
     NPT_List<PLT_EventSubscriberReference>       m_Subscribers;
+
+    struct DeviceEntry {
+        PLT_DeviceDataReference m_RootDevice;
+        PLT_DeviceDataReference m_Device;
+        NPT_UInt32              m_Generation;    // given when the root device was added
+        NPT_TimeStamp           m_ExpirationDue; // root devices only, next check scheduled
+    };
+    struct SubscriberEntry {
+        PLT_EventSubscriberReference m_Subscriber;
+        NPT_UInt32                   m_Generation;
+        NPT_TimeStamp                m_RenewalDue; // next renewal scheduled
+    };
+
+    // indexes of the above lists
+    PLT_StringMap<DeviceEntry>                   m_DevicesByUUID;        // root and embedded devices
+    PLT_StringMap<PLT_StringMap<PLT_DeviceDataReference> > m_DevicesByServiceType; // by uuid
+    PLT_StringMap<SubscriberEntry>               m_SubscribersBySID;
+    PLT_StringMap<PLT_EventSubscriberReference>  m_SubscribersByService; // by device uuid and service id
+
+    // housekeeping deadlines, entries are checked against the indexes 
+    // above when due and dropped if the object was removed or added
+    // again since (generation differs) or an earlier check was scheduled
+    struct DeviceExpiration {
+        NPT_String    m_UUID;
+        NPT_UInt32    m_Generation;
+        NPT_TimeStamp m_Due;
+    };
+    struct SubscriberRenewal {
+        NPT_String    m_SID;
+        NPT_UInt32    m_Generation;
+        NPT_TimeStamp m_Due;
+    };
+    PLT_TimerHeap<DeviceExpiration>              m_DeviceExpirations;
+    PLT_TimerHeap<SubscriberRenewal>             m_SubscriberRenewals;
+    NPT_UInt32                                   m_Generation; // last one given
     NPT_String                                   m_SearchCriteria;
     bool                                         m_Started;
     NPT_List<PLT_EventNotification *>            m_PendingNotifications;
     NPT_List<NPT_String>                         m_PendingInspections;
+    PLT_CtrlPointInspector                       m_Inspector;
+    PLT_CtrlPointInvoker                         m_Invoker;
 };
 
 typedef NPT_Reference<PLT_CtrlPoint> PLT_CtrlPointReference;
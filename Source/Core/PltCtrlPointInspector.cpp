@@ -0,0 +1,497 @@
+/*****************************************************************
+|
+|   Platinum - Control Point Inspector
+|
+| Copyright (c) 2004-2010, Plutinosoft, LLC.
+| All rights reserved.
+| http://www.plutinosoft.com
+|
+| This program is free software; you can redistribute it and/or
+| modify it under the terms of the GNU General Public License
+| as published by the Free Software Foundation; either version 2
+| of the License, or (at your option) any later version.
+|
+| OEMs, ISVs, VARs and other distributors that combine and 
+| distribute commercially licensed software with Platinum software
+| and do not wish to distribute the source code for the commercially
+| licensed software under version 2, or (at your option) any later
+| version, of the GNU General Public License (the "GPL") must enter
+| into a commercial license agreement with Plutinosoft, LLC.
+| licensing@plutinosoft.com
+|  
+| This program is distributed in the hope that it will be useful,
+| but WITHOUT ANY WARRANTY; without even the implied warranty of
+| MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+| GNU General Public License for more details.
+|
+| You should have received a copy of the GNU General Public License
+| along with this program; see the file LICENSE.txt. If not, write to
+| the Free Software Foundation, Inc., 
+| 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+| http://www.gnu.org/licenses/gpl-2.0.html
+|
+****************************************************************/
+
+
+
+/*----------------------------------------------------------------------
+|   includes
++---------------------------------------------------------------------*/
+#include "PltCtrlPointInspector.h"
+#include "PltCtrlPoint.h"
+#include "PltHttp.h"
+#include "PltConstants.h"
+
+NPT_SET_LOCAL_LOGGER("platinum.core.ctrlpoint.inspector")
+
+/*----------------------------------------------------------------------
+|   PLT_CtrlPointInspector::PLT_CtrlPointInspector
++---------------------------------------------------------------------*/
+PLT_CtrlPointInspector::PLT_CtrlPointInspector(PLT_CtrlPoint* ctrl_point) :
+    m_CtrlPoint(ctrl_point),
+    m_Generation(0),
+    m_MaxFetches(PLT_CTRLPOINT_INSPECTOR_MAX_FETCHES),
+    m_MaxFetchesPerHost(PLT_CTRLPOINT_INSPECTOR_MAX_FETCHES_PER_HOST)
+{
+}
+
+/*----------------------------------------------------------------------
+|   PLT_CtrlPointInspector::~PLT_CtrlPointInspector
++---------------------------------------------------------------------*/
+PLT_CtrlPointInspector::~PLT_CtrlPointInspector()
+{
+    Stop();
+}
+
+/*----------------------------------------------------------------------
+|   PLT_CtrlPointInspector::SetLimits
++---------------------------------------------------------------------*/
+NPT_Result
+PLT_CtrlPointInspector::SetLimits(NPT_Cardinal max_fetches, 
+                                  NPT_Cardinal max_fetches_per_host)
+{
+    if (max_fetches == 0 || max_fetches_per_host == 0) return NPT_ERROR_INVALID_PARAMETERS;
+
+    NPT_AutoLock lock(m_Lock);
+    m_MaxFetches        = max_fetches;
+    m_MaxFetchesPerHost = max_fetches_per_host;
+    return NPT_SUCCESS;
+}
+
+/*----------------------------------------------------------------------
+|   PLT_CtrlPointInspector::Start
++---------------------------------------------------------------------*/
+NPT_Result
+PLT_CtrlPointInspector::Start(PLT_TaskManager* task_manager)
+{
+    NPT_Cardinal max_fetches;
+    {
+        NPT_AutoLock lock(m_Lock);
+        max_fetches = m_MaxFetches;
+    }
+
+    // tasks are stopped with the task manager
+    for (NPT_Cardinal i=0; i<max_fetches; i++) {
+        NPT_CHECK_SEVERE(task_manager->StartTask(new PLT_CtrlPointInspectionTask(this)));
+    }
+
+    return NPT_SUCCESS;
+}
+
+/*----------------------------------------------------------------------
+|   PLT_CtrlPointInspector::Stop
++---------------------------------------------------------------------*/
+NPT_Result
+PLT_CtrlPointInspector::Stop()
+{
+    NPT_AutoLock lock(m_Lock);
+
+    // jobs being fetched belong to the tasks until they release them
+    m_Jobs.Apply(NPT_ObjectDeleter<PLT_CtrlPointInspectionJob>());
+    m_Jobs.Clear();
+    m_Inspections.Clear();
+    Notify();
+
+    return NPT_SUCCESS;
+}
+
+/*----------------------------------------------------------------------
+|   PLT_CtrlPointInspector::FetchDescription
++---------------------------------------------------------------------*/
+NPT_Result
+PLT_CtrlPointInspector::FetchDescription(const NPT_HttpUrl& url,
+                                         const char*        uuid,
+                                         NPT_TimeInterval   leasetime,
+                                         NPT_TimeInterval   delay)
+{
+    NPT_TimeStamp now;
+    NPT_System::GetCurrentTimeStamp(now);
+
+    {
+        NPT_AutoLock lock(m_Lock);
+
+        // forget about inspections that never completed
+        NPT_List<Inspection>::Iterator inspection = m_Inspections.GetFirstItem();
+        while (inspection) {
+            if ((*inspection).m_UUID == uuid ||
+                now > (*inspection).m_Started + NPT_TimeInterval((double)PLT_CTRLPOINT_INSPECTOR_MAX_DURATION)) {
+                m_Inspections.Erase(inspection++);
+            } else {
+                ++inspection;
+            }
+        }
+
+        Inspection new_inspection;
+        new_inspection.m_UUID    = uuid;
+        new_inspection.m_Started = now;
+        m_Inspections.Add(new_inspection);
+    }
+
+    PLT_CtrlPointInspectionJob* job = new PLT_CtrlPointInspectionJob(
+        new NPT_HttpRequest(url, "GET", NPT_HTTP_PROTOCOL_1_1),
+        true);
+    job->m_UUID      = uuid;
+    job->m_LeaseTime = leasetime;
+    return AddJob(job, delay);
+}
+
+/*----------------------------------------------------------------------
+|   PLT_CtrlPointInspector::FetchSCPD
++---------------------------------------------------------------------*/
+NPT_Result
+PLT_CtrlPointInspector::FetchSCPD(PLT_DeviceDataReference& device,
+                                  const NPT_HttpUrl&       url,
+                                  NPT_TimeInterval         delay)
+{
+    NPT_String scpd_url = url.ToString();
+
+    {
+        NPT_AutoLock lock(m_Lock);
+
+        // devices behind the same host often share their SCPD urls, 
+        // wait for the response of a request already pending
+        NPT_List<PLT_CtrlPointInspectionJob*>* lists[] = { &m_Jobs, &m_Fetching };
+        for (unsigned int i=0; i<sizeof(lists)/sizeof(lists[0]); i++) {
+            NPT_List<PLT_CtrlPointInspectionJob*>::Iterator job = lists[i]->GetFirstItem();
+            while (job) {
+                if (!(*job)->m_Description && (*job)->m_Url == scpd_url) {
+                    (*job)->m_Devices.Add(device);
+                    ++m_Stats.m_SharedSCPDs;
+                    return NPT_SUCCESS;
+                }
+                ++job;
+            }
+        }
+    }
+
+    PLT_CtrlPointInspectionJob* job = new PLT_CtrlPointInspectionJob(
+        new NPT_HttpRequest(url, "GET", NPT_HTTP_PROTOCOL_1_1), // 1.1 for pipelining
+        false);
+    job->m_Url = scpd_url;
+    job->m_Devices.Add(device);
+    return AddJob(job, delay);
+}
+
+/*----------------------------------------------------------------------
+|   PLT_CtrlPointInspector::AddJob
++---------------------------------------------------------------------*/
+NPT_Result
+PLT_CtrlPointInspector::AddJob(PLT_CtrlPointInspectionJob* job, 
+                               NPT_TimeInterval            delay)
+{
+    const NPT_HttpUrl& url = job->m_Request->GetUrl();
+    job->m_Host = url.GetHost() + ":" + NPT_String::FromIntegerU(url.GetPort());
+
+    NPT_System::GetCurrentTimeStamp(job->m_Due);
+    job->m_Due += delay;
+
+    NPT_AutoLock lock(m_Lock);
+    m_Jobs.Add(job);
+    Notify();
+
+    return NPT_SUCCESS;
+}
+
+/*----------------------------------------------------------------------
+|   PLT_CtrlPointInspector::GetFetchCount
++---------------------------------------------------------------------*/
+NPT_Cardinal
+PLT_CtrlPointInspector::GetFetchCount(const NPT_String& host)
+{
+    NPT_Cardinal count = 0;
+    NPT_List<PLT_CtrlPointInspectionJob*>::Iterator job = m_Fetching.GetFirstItem();
+    while (job) {
+        if ((*job)->m_Host == host) ++count;
+        ++job;
+    }
+
+    return count;
+}
+
+/*----------------------------------------------------------------------
+|   PLT_CtrlPointInspector::Notify
++---------------------------------------------------------------------*/
+// called with m_Lock held
+void
+PLT_CtrlPointInspector::Notify()
+{
+    // waiting tasks wake up as soon as the value differs from the one they saw
+    m_Wakeup.SetValue(++m_Generation);
+}
+
+/*----------------------------------------------------------------------
+|   PLT_CtrlPointInspector::GetNextJob
++---------------------------------------------------------------------*/
+NPT_Result
+PLT_CtrlPointInspector::GetNextJob(PLT_CtrlPointInspectionJob*& job, 
+                                   NPT_Timeout&                 timeout,
+                                   int&                         generation)
+{
+    NPT_AutoLock lock(m_Lock);
+
+    NPT_TimeStamp now;
+    NPT_System::GetCurrentTimeStamp(now);
+
+    // oldest job that is due and whose host is not busy
+    NPT_List<PLT_CtrlPointInspectionJob*>::Iterator item = m_Jobs.GetFirstItem();
+    while (item) {
+        if ((*item)->m_Due <= now) {
+            if (GetFetchCount((*item)->m_Host) < m_MaxFetchesPerHost) {
+                job = *item;
+                m_Jobs.Erase(item);
+                m_Fetching.Add(job);
+
+                job->m_Started = now;
+                m_Stats.m_Queued.Add((now - job->m_Due).ToMillis());
+                return NPT_SUCCESS;
+            }
+        } else {
+            // sleep until the earliest delayed job is due, jobs waiting
+            // for a busy host are woken up by ReleaseJob
+            NPT_UInt64 due_in = ((*item)->m_Due - now).ToMillis() + 1;
+            if (timeout == NPT_TIMEOUT_INFINITE || due_in < (NPT_UInt64)timeout) {
+                timeout = (NPT_Timeout)due_in;
+            }
+        }
+        ++item;
+    }
+
+    // anything changing the queue from now on changes the generation
+    generation = m_Generation;
+    return NPT_ERROR_NO_SUCH_ITEM;
+}
+
+/*----------------------------------------------------------------------
+|   PLT_CtrlPointInspector::WaitForJob
++---------------------------------------------------------------------*/
+void
+PLT_CtrlPointInspector::WaitForJob(int generation, NPT_Timeout timeout)
+{
+    m_Wakeup.WaitWhileEquals(generation, timeout);
+}
+
+/*----------------------------------------------------------------------
+|   PLT_CtrlPointInspector::ReleaseJob
++---------------------------------------------------------------------*/
+void
+PLT_CtrlPointInspector::ReleaseJob(PLT_CtrlPointInspectionJob*        job, 
+                                   NPT_List<PLT_DeviceDataReference>* devices /* = NULL */)
+{
+    NPT_TimeStamp now;
+    NPT_System::GetCurrentTimeStamp(now);
+
+    NPT_AutoLock lock(m_Lock);
+
+    m_Fetching.Remove(job);
+    if (job->m_Description) {
+        m_Stats.m_Description.Add((now - job->m_Started).ToMillis());
+    } else {
+        m_Stats.m_SCPD.Add((now - job->m_Started).ToMillis());
+    }
+
+    // no more devices can be added to the job from now on
+    if (devices) *devices = job->m_Devices;
+
+    // a slot for this host is now free
+    Notify();
+}
+
+/*----------------------------------------------------------------------
+|   PLT_CtrlPointInspector::EndInspection
++---------------------------------------------------------------------*/
+void
+PLT_CtrlPointInspector::EndInspection(const char* uuid, bool ready)
+{
+    NPT_AutoLock lock(m_Lock);
+
+    NPT_List<Inspection>::Iterator inspection = m_Inspections.GetFirstItem();
+    while (inspection) {
+        if ((*inspection).m_UUID == uuid) {
+            if (ready) {
+                NPT_TimeStamp now;
+                NPT_System::GetCurrentTimeStamp(now);
+
+                NPT_UInt64 duration = (now - (*inspection).m_Started).ToMillis();
+                m_Stats.m_Ready.Add(duration);
+
+                NPT_LOG_FINE_2("Device \"%s\" inspected in %d ms", uuid, (int)duration);
+            } else {
+                ++m_Stats.m_Failed;
+            }
+
+            m_Inspections.Erase(inspection);
+            return;
+        }
+        ++inspection;
+    }
+}
+
+/*----------------------------------------------------------------------
+|   PLT_CtrlPointInspector::GetStats
++---------------------------------------------------------------------*/
+void
+PLT_CtrlPointInspector::GetStats(PLT_CtrlPointInspectionStats& stats)
+{
+    NPT_AutoLock lock(m_Lock);
+    stats = m_Stats;
+}
+
+/*----------------------------------------------------------------------
+|   PLT_CtrlPointInspectionTask::PLT_CtrlPointInspectionTask
++---------------------------------------------------------------------*/
+PLT_CtrlPointInspectionTask::PLT_CtrlPointInspectionTask(PLT_CtrlPointInspector* inspector) :
+    m_Inspector(inspector)
+{
+    m_Client.SetUserAgent(*PLT_Constants::GetInstance().GetDefaultUserAgent());
+    m_Client.SetTimeouts(60000, 60000, 60000);
+}
+
+/*----------------------------------------------------------------------
+|   PLT_CtrlPointInspectionTask::DoAbort
++---------------------------------------------------------------------*/
+void
+PLT_CtrlPointInspectionTask::DoAbort()
+{
+    m_Client.Abort();
+
+    // idle tasks wait for the queue to change
+    NPT_AutoLock lock(m_Inspector->m_Lock);
+    m_Inspector->Notify();
+}
+
+/*----------------------------------------------------------------------
+|   PLT_CtrlPointInspectionTask::DoRun
++---------------------------------------------------------------------*/
+void
+PLT_CtrlPointInspectionTask::DoRun()
+{
+    NPT_TimeStamp watchdog;
+    NPT_System::GetCurrentTimeStamp(watchdog);
+
+    while (!IsAborting(0)) {
+        // sleep no longer than until the next connections recycling
+        NPT_TimeStamp now;
+        NPT_System::GetCurrentTimeStamp(now);
+        NPT_TimeInterval left = watchdog + NPT_TimeInterval(60.) - now;
+        NPT_Timeout      timeout = (float)left > 0.f?(NPT_Timeout)left.ToMillis():0;
+
+        PLT_CtrlPointInspectionJob* job;
+        int                         generation;
+        if (NPT_SUCCEEDED(m_Inspector->GetNextJob(job, timeout, generation))) {
+            if (IsAborting(0)) {
+                m_Inspector->ReleaseJob(job);
+                delete job;
+                break;
+            }
+
+            if (job->m_Description) {
+                FetchDescription(job);
+            } else {
+                FetchSCPD(job);
+            }
+        } else {
+            // DoAbort changes the generation after setting the abort flag
+            if (IsAborting(0)) break;
+            m_Inspector->WaitForJob(generation, timeout);
+        }
+
+        // DLNA requires that we abort unanswered/unused sockets after 60 secs
+        NPT_System::GetCurrentTimeStamp(now);
+        if (now > watchdog + NPT_TimeInterval(60.)) {
+            NPT_HttpConnectionManager::GetInstance()->Recycle(NULL);
+            watchdog = now;
+        }
+    }
+}
+
+/*----------------------------------------------------------------------
+|   PLT_CtrlPointInspectionTask::FetchDescription
++---------------------------------------------------------------------*/
+void
+PLT_CtrlPointInspectionTask::FetchDescription(PLT_CtrlPointInspectionJob* job)
+{
+    NPT_HttpResponse*      response = NULL;
+    NPT_HttpRequestContext context;
+
+    NPT_Result res = m_Client.SendRequest(*job->m_Request, response, &context);
+    m_Inspector->ReleaseJob(job);
+
+    res = m_Inspector->m_CtrlPoint->ProcessGetDescriptionResponse(
+        res, 
+        *job->m_Request, 
+        context, 
+        response, 
+        job->m_LeaseTime, 
+        job->m_UUID);
+    if (NPT_FAILED(res)) m_Inspector->EndInspection(job->m_UUID, false);
+
+    delete response;
+    delete job;
+}
+
+/*----------------------------------------------------------------------
+|   PLT_CtrlPointInspectionTask::FetchSCPD
++---------------------------------------------------------------------*/
+void
+PLT_CtrlPointInspectionTask::FetchSCPD(PLT_CtrlPointInspectionJob* job)
+{
+    NPT_HttpResponse*      response = NULL;
+    NPT_HttpRequestContext context;
+    NPT_String             scpd;
+
+    // read the body only once for all devices waiting for it
+    NPT_Result res = m_Client.SendRequest(*job->m_Request, response, &context);
+    if (NPT_SUCCEEDED(res) && response) {
+        res = PLT_HttpHelper::GetBody(*response, scpd);
+    }
+
+    NPT_List<PLT_DeviceDataReference> devices;
+    m_Inspector->ReleaseJob(job, &devices);
+
+    NPT_List<PLT_DeviceDataReference>::Iterator device = devices.GetFirstItem();
+    while (device) {
+        if (NPT_FAILED(res) || !response) {
+            m_Inspector->m_CtrlPoint->ProcessGetSCPDResponse(
+                NPT_FAILED(res)?res:NPT_FAILURE, 
+                *job->m_Request, 
+                context, 
+                NULL, 
+                *device);
+        } else {
+            NPT_HttpResponse copy(response->GetStatusCode(), 
+                                  response->GetReasonPhrase(), 
+                                  response->GetProtocol());
+            PLT_HttpHelper::SetBody(copy, scpd);
+            m_Inspector->m_CtrlPoint->ProcessGetSCPDResponse(
+                NPT_SUCCESS, 
+                *job->m_Request, 
+                context, 
+                &copy, 
+                *device);
+        }
+        ++device;
+    }
+
+    delete response;
+    delete job;
+}
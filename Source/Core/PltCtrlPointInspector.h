@@ -0,0 +1,231 @@
+/*****************************************************************
+|
+|   Platinum - Control Point Inspector
+|
+| Copyright (c) 2004-2010, Plutinosoft, LLC.
+| All rights reserved.
+| http://www.plutinosoft.com
+|
+| This program is free software; you can redistribute it and/or
+| modify it under the terms of the GNU General Public License
+| as published by the Free Software Foundation; either version 2
+| of the License, or (at your option) any later version.
+|
+| OEMs, ISVs, VARs and other distributors that combine and 
+| distribute commercially licensed software with Platinum software
+| and do not wish to distribute the source code for the commercially
+| licensed software under version 2, or (at your option) any later
+| version, of the GNU General Public License (the "GPL") must enter
+| into a commercial license agreement with Plutinosoft, LLC.
+| licensing@plutinosoft.com
+|  
+| This program is distributed in the hope that it will be useful,
+| but WITHOUT ANY WARRANTY; without even the implied warranty of
+| MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+| GNU General Public License for more details.
+|
+| You should have received a copy of the GNU General Public License
+| along with this program; see the file LICENSE.txt. If not, write to
+| the Free Software Foundation, Inc., 
+| 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+| http://www.gnu.org/licenses/gpl-2.0.html
+|
+****************************************************************/
+
+
+
+/** @file
+ UPnP ControlPoint device inspection pipeline
+ */
+
+#ifndef _PLT_CONTROL_POINT_INSPECTOR_H_
+#define _PLT_CONTROL_POINT_INSPECTOR_H_
+
+/*----------------------------------------------------------------------
+|   includes
++---------------------------------------------------------------------*/
+#include "Neptune.h"
+#include "PltThreadTask.h"
+#include "PltTaskManager.h"
+#include "PltDeviceData.h"
+
+/*----------------------------------------------------------------------
+|   forward declarations
++---------------------------------------------------------------------*/
+class PLT_CtrlPoint;
+
+/*----------------------------------------------------------------------
+|   constants
++---------------------------------------------------------------------*/
+#define PLT_CTRLPOINT_INSPECTOR_MAX_FETCHES          8
+#define PLT_CTRLPOINT_INSPECTOR_MAX_FETCHES_PER_HOST 2
+#define PLT_CTRLPOINT_INSPECTOR_MAX_DURATION         300 // seconds
+
+/*----------------------------------------------------------------------
+|   PLT_CtrlPointInspectionStage struct
++---------------------------------------------------------------------*/
+struct PLT_CtrlPointInspectionStage {
+    PLT_CtrlPointInspectionStage() : m_Count(0), m_TotalTime(0), m_MaxTime(0) {}
+
+    void Add(NPT_UInt64 time) {
+        ++m_Count;
+        m_TotalTime += time;
+        if (time > m_MaxTime) m_MaxTime = time;
+    }
+    NPT_UInt64 GetAverageTime() const { return m_Count?m_TotalTime/m_Count:0; }
+
+    NPT_Cardinal m_Count;
+    NPT_UInt64   m_TotalTime; // milliseconds
+    NPT_UInt64   m_MaxTime;   // milliseconds
+};
+
+/*----------------------------------------------------------------------
+|   PLT_CtrlPointInspectionStats struct
++---------------------------------------------------------------------*/
+struct PLT_CtrlPointInspectionStats {
+    PLT_CtrlPointInspectionStats() : m_Failed(0), m_SharedSCPDs(0) {}
+
+    PLT_CtrlPointInspectionStage m_Queued;      // waiting for a free connection
+    PLT_CtrlPointInspectionStage m_Description; // fetching device descriptions
+    PLT_CtrlPointInspectionStage m_SCPD;        // fetching service descriptions
+    PLT_CtrlPointInspectionStage m_Ready;       // from discovery to device added
+    NPT_Cardinal                 m_Failed;      // inspections abandoned
+    NPT_Cardinal                 m_SharedSCPDs; // SCPD requests merged with a pending one
+};
+
+/*----------------------------------------------------------------------
+|   PLT_CtrlPointInspectionJob struct
++---------------------------------------------------------------------*/
+struct PLT_CtrlPointInspectionJob {
+    PLT_CtrlPointInspectionJob(NPT_HttpRequest* request, bool description) : 
+        m_Request(request), m_Description(description) {}
+    ~PLT_CtrlPointInspectionJob() { delete m_Request; }
+
+    NPT_HttpRequest*                  m_Request;
+    bool                              m_Description;
+    NPT_String                        m_Url;
+    NPT_String                        m_Host; // host:port
+    NPT_TimeStamp                     m_Due;
+    NPT_TimeStamp                     m_Started;
+    
+    // description requests
+    NPT_String                        m_UUID;
+    NPT_TimeInterval                  m_LeaseTime;
+
+    // SCPD requests, devices waiting for the same url
+    NPT_List<PLT_DeviceDataReference> m_Devices;
+};
+
+/*----------------------------------------------------------------------
+|   PLT_CtrlPointInspector class
++---------------------------------------------------------------------*/
+/**
+ The PLT_CtrlPointInspector class fetches the device and service descriptions
+ of devices found by a PLT_CtrlPoint. Requests are queued and run by a fixed 
+ number of PLT_CtrlPointInspectionTask tasks so that discovering a large 
+ network doesn't start a thread per device, and no more than a few requests 
+ are sent to the same host at once. SCPDs of a device are fetched in 
+ parallel and requests for an url already queued or being fetched are 
+ merged. The time spent in each stage is recorded.
+ */
+class PLT_CtrlPointInspector
+{
+public:
+    PLT_CtrlPointInspector(PLT_CtrlPoint* ctrl_point);
+    ~PLT_CtrlPointInspector();
+
+    /**
+     Set the number of requests that can be sent at the same time, overall
+     and to a single host. The overall limit is used when starting.
+     */
+    NPT_Result SetLimits(NPT_Cardinal max_fetches, NPT_Cardinal max_fetches_per_host);
+
+    NPT_Result Start(PLT_TaskManager* task_manager);
+    NPT_Result Stop();
+
+    NPT_Result FetchDescription(const NPT_HttpUrl& url,
+                                const char*        uuid,
+                                NPT_TimeInterval   leasetime,
+                                NPT_TimeInterval   delay);
+    NPT_Result FetchSCPD(PLT_DeviceDataReference& device,
+                         const NPT_HttpUrl&       url,
+                         NPT_TimeInterval         delay);
+
+    /**
+     Called by the control point when a device inspection is over.
+     @param uuid root device uuid
+     @param ready whether the device was added or abandoned
+     */
+    void EndInspection(const char* uuid, bool ready);
+
+    void GetStats(PLT_CtrlPointInspectionStats& stats);
+
+private:
+    friend class PLT_CtrlPointInspectionTask;
+
+    // called by PLT_CtrlPointInspectionTask
+    /**
+     Take the oldest job that is due. Otherwise lower timeout to the time left
+     until the earliest delayed job is due and return the generation of the 
+     queue to pass to WaitForJob.
+     */
+    NPT_Result GetNextJob(PLT_CtrlPointInspectionJob*& job, 
+                          NPT_Timeout&                 timeout,
+                          int&                         generation);
+    void       WaitForJob(int generation, NPT_Timeout timeout);
+    void       ReleaseJob(PLT_CtrlPointInspectionJob*         job, 
+                          NPT_List<PLT_DeviceDataReference>* devices = NULL);
+
+    // methods
+    NPT_Result   AddJob(PLT_CtrlPointInspectionJob* job, NPT_TimeInterval delay);
+    NPT_Cardinal GetFetchCount(const NPT_String& host);
+    void         Notify();
+
+    struct Inspection {
+        NPT_String    m_UUID;
+        NPT_TimeStamp m_Started;
+    };
+
+    // members
+    PLT_CtrlPoint*                         m_CtrlPoint;
+    NPT_Mutex                              m_Lock;
+    NPT_SharedVariable                     m_Wakeup;     // set to m_Generation
+    int                                    m_Generation; // changed with the queue
+    NPT_List<PLT_CtrlPointInspectionJob*>  m_Jobs;     // queued
+    NPT_List<PLT_CtrlPointInspectionJob*>  m_Fetching; // being fetched
+    NPT_List<Inspection>                   m_Inspections;
+    PLT_CtrlPointInspectionStats           m_Stats;
+    NPT_Cardinal                           m_MaxFetches;
+    NPT_Cardinal                           m_MaxFetchesPerHost;
+};
+
+/*----------------------------------------------------------------------
+|   PLT_CtrlPointInspectionTask class
++---------------------------------------------------------------------*/
+/**
+ The PLT_CtrlPointInspectionTask class runs the requests queued in a 
+ PLT_CtrlPointInspector, one at a time on its own persistent connection.
+ */
+class PLT_CtrlPointInspectionTask : public PLT_ThreadTask
+{
+public:
+    PLT_CtrlPointInspectionTask(PLT_CtrlPointInspector* inspector);
+
+protected:
+    ~PLT_CtrlPointInspectionTask() {}
+
+    // PLT_ThreadTask methods
+    virtual void DoAbort();
+    virtual void DoRun();
+    virtual bool IsLongRunning() { return true; }
+
+private:
+    void FetchDescription(PLT_CtrlPointInspectionJob* job);
+    void FetchSCPD(PLT_CtrlPointInspectionJob* job);
+
+    // members
+    PLT_CtrlPointInspector* m_Inspector;
+    NPT_HttpClient          m_Client;
+};
+
+#endif /* _PLT_CONTROL_POINT_INSPECTOR_H_ */
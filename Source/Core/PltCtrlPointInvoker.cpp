@@ -0,0 +1,510 @@
+/*****************************************************************
+|
+|   Platinum - Control Point Action Invoker
+|
+| Copyright (c) 2004-2010, Plutinosoft, LLC.
+| All rights reserved.
+| http://www.plutinosoft.com
+|
+| This program is free software; you can redistribute it and/or
+| modify it under the terms of the GNU General Public License
+| as published by the Free Software Foundation; either version 2
+| of the License, or (at your option) any later version.
+|
+| OEMs, ISVs, VARs and other distributors that combine and 
+| distribute commercially licensed software with Platinum software
+| and do not wish to distribute the source code for the commercially
+| licensed software under version 2, or (at your option) any later
+| version, of the GNU General Public License (the "GPL") must enter
+| into a commercial license agreement with Plutinosoft, LLC.
+| licensing@plutinosoft.com
+|  
+| This program is distributed in the hope that it will be useful,
+| but WITHOUT ANY WARRANTY; without even the implied warranty of
+| MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+| GNU General Public License for more details.
+|
+| You should have received a copy of the GNU General Public License
+| along with this program; see the file LICENSE.txt. If not, write to
+| the Free Software Foundation, Inc., 
+| 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+| http://www.gnu.org/licenses/gpl-2.0.html
+|
+****************************************************************/
+
+/*----------------------------------------------------------------------
+|   includes
++---------------------------------------------------------------------*/
+#include "PltCtrlPointInvoker.h"
+#include "PltCtrlPoint.h"
+#include "PltHttp.h"
+#include "PltConstants.h"
+
+NPT_SET_LOCAL_LOGGER("platinum.core.ctrlpoint.invoker")
+
+/*----------------------------------------------------------------------
+|   PLT_CtrlPointInvoker::PLT_CtrlPointInvoker
++---------------------------------------------------------------------*/
+PLT_CtrlPointInvoker::PLT_CtrlPointInvoker(PLT_CtrlPoint* ctrl_point) :
+    m_CtrlPoint(ctrl_point),
+    m_TaskManager(NULL)
+{
+}
+
+/*----------------------------------------------------------------------
+|   PLT_CtrlPointInvoker::~PLT_CtrlPointInvoker
++---------------------------------------------------------------------*/
+PLT_CtrlPointInvoker::~PLT_CtrlPointInvoker()
+{
+    // the control point is going away, drop anything left without notifying
+    NPT_List<Connection*>::Iterator connection = m_Connections.GetFirstItem();
+    while (connection) {
+        (*connection)->m_Pending.Apply(NPT_ObjectDeleter<PLT_CtrlPointInvocation>());
+        delete *connection;
+        ++connection;
+    }
+
+    PLT_CtrlPointInvocation* invocation;
+    while (NPT_SUCCEEDED(m_Completions.Pop(invocation, 0))) {
+        delete invocation;
+    }
+}
+
+/*----------------------------------------------------------------------
+|   PLT_CtrlPointInvoker::Start
++---------------------------------------------------------------------*/
+NPT_Result
+PLT_CtrlPointInvoker::Start(PLT_TaskManager* task_manager)
+{
+    {
+        NPT_AutoLock lock(m_Lock);
+        m_TaskManager = task_manager;
+    }
+
+    // connection tasks are started on demand
+    return task_manager->StartTask(new PLT_CtrlPointCompletionTask(this));
+}
+
+/*----------------------------------------------------------------------
+|   PLT_CtrlPointInvoker::Stop
++---------------------------------------------------------------------*/
+NPT_Result
+PLT_CtrlPointInvoker::Stop()
+{
+    NPT_List<PLT_CtrlPointInvocation*> pending;
+
+    {
+        NPT_AutoLock lock(m_Lock);
+        m_TaskManager = NULL;
+
+        // tasks are gone, actions being sent have been completed already
+        NPT_List<Connection*>::Iterator connection = m_Connections.GetFirstItem();
+        while (connection) {
+            NPT_List<PLT_CtrlPointInvocation*>::Iterator invocation = (*connection)->m_Pending.GetFirstItem();
+            while (invocation) {
+                (*invocation)->m_Result = NPT_ERROR_INTERRUPTED;
+                pending.Add(*invocation);
+                ++invocation;
+            }
+            delete *connection;
+            ++connection;
+        }
+        m_Connections.Clear();
+    }
+
+    // let listeners know about every action they're waiting for,
+    // responses already received first
+    PLT_CtrlPointInvocation* invocation;
+    while (NPT_SUCCEEDED(m_Completions.Pop(invocation, 0))) {
+        if (invocation) Deliver(invocation); // NULL wakes up the completion task
+    }
+    while (NPT_SUCCEEDED(pending.PopHead(invocation))) {
+        Deliver(invocation);
+    }
+
+    return NPT_SUCCESS;
+}
+
+/*----------------------------------------------------------------------
+|   PLT_CtrlPointInvoker::Invoke
++---------------------------------------------------------------------*/
+NPT_Result
+PLT_CtrlPointInvoker::Invoke(NPT_HttpRequest*     request, 
+                             PLT_ActionReference& action, 
+                             void*                userdata)
+{
+    const NPT_HttpUrl& url = request->GetUrl();
+    NPT_String host = url.GetHost() + ":" + NPT_String::FromIntegerU(url.GetPort());
+
+    PLT_CtrlPointInvocation*     invocation = new PLT_CtrlPointInvocation(request, action, userdata);
+    PLT_CtrlPointConnectionTask* task = NULL;
+    PLT_TaskManager*             task_manager;
+    Connection*                  connection = NULL;
+
+    {
+        NPT_AutoLock lock(m_Lock);
+
+        task_manager = m_TaskManager;
+        if (task_manager == NULL) {
+            delete invocation;
+            NPT_CHECK_WARNING(NPT_ERROR_INVALID_STATE);
+        }
+
+        // queue behind the other actions sent to the same host
+        NPT_List<Connection*>::Iterator item = m_Connections.GetFirstItem();
+        while (item) {
+            if ((*item)->m_Host == host) {
+                connection = *item;
+                break;
+            }
+            ++item;
+        }
+
+        if (connection == NULL) {
+            connection = new Connection();
+            connection->m_Host = host;
+            NPT_System::GetCurrentTimeStamp(connection->m_LastUsed);
+            connection->m_Task = task = new PLT_CtrlPointConnectionTask(this, connection);
+            m_Connections.Add(connection);
+        }
+
+        connection->m_Pending.Add(invocation);
+        connection->m_Wakeup.SetValue(1);
+    }
+
+    if (task == NULL) return NPT_SUCCESS;
+
+    // the task manager deletes the task if it can't be started
+    NPT_Result result = task_manager->StartTask(task);
+    if (NPT_SUCCEEDED(result)) return NPT_SUCCESS;
+
+    NPT_LOG_SEVERE_2("Failed to start connection task for %s (%d)", (const char*)host, result);
+
+    // each action is reported once, ours through the result returned and 
+    // those queued for the same host meanwhile through the listeners
+    bool failed = false;
+    {
+        NPT_AutoLock lock(m_Lock);
+
+        // no new connection can be created once stopped so if it's still 
+        // there, it's ours. Otherwise Stop has delivered our action already
+        NPT_List<Connection*>::Iterator item = m_Connections.GetFirstItem();
+        while (item && *item != connection) ++item;
+        if (item) {
+            m_Connections.Erase(item);
+
+            // our action may have been cancelled and delivered already
+            failed = NPT_SUCCEEDED(connection->m_Pending.Remove(invocation));
+
+            PLT_CtrlPointInvocation* other;
+            while (NPT_SUCCEEDED(connection->m_Pending.PopHead(other))) {
+                other->m_Result = result;
+                m_Completions.Push(other);
+            }
+            delete connection;
+        }
+    }
+
+    if (!failed) return NPT_SUCCESS;
+
+    delete invocation;
+    return result;
+}
+
+/*----------------------------------------------------------------------
+|   PLT_CtrlPointInvoker::Cancel
++---------------------------------------------------------------------*/
+NPT_Result
+PLT_CtrlPointInvoker::Cancel(PLT_ActionReference& action)
+{
+    NPT_AutoLock lock(m_Lock);
+
+    NPT_List<Connection*>::Iterator connection = m_Connections.GetFirstItem();
+    while (connection) {
+        // not sent yet, hand it back right away
+        NPT_List<PLT_CtrlPointInvocation*>::Iterator invocation = (*connection)->m_Pending.GetFirstItem();
+        while (invocation) {
+            if ((*invocation)->m_Action.AsPointer() == action.AsPointer()) {
+                (*invocation)->m_Result = NPT_ERROR_INTERRUPTED;
+                m_Completions.Push(*invocation);
+                (*connection)->m_Pending.Erase(invocation);
+                return NPT_SUCCESS;
+            }
+            ++invocation;
+        }
+
+        // being sent, the connection task completes it once aborted, 
+        // m_Current is only set once the task is running
+        PLT_CtrlPointInvocation* current = (*connection)->m_Current;
+        if (current && !current->m_Cancelled && 
+            current->m_Action.AsPointer() == action.AsPointer()) {
+            current->m_Cancelled = true;
+            (*connection)->m_Task->AbortRequest();
+            return NPT_SUCCESS;
+        }
+
+        ++connection;
+    }
+
+    return NPT_ERROR_NO_SUCH_ITEM;
+}
+
+/*----------------------------------------------------------------------
+|   PLT_CtrlPointInvoker::GetNextInvocation
++---------------------------------------------------------------------*/
+NPT_Result
+PLT_CtrlPointInvoker::GetNextInvocation(Connection*               connection,
+                                        PLT_CtrlPointInvocation*& invocation,
+                                        NPT_Timeout&              timeout)
+{
+    // reset before looking so we don't miss actions added meanwhile,
+    // the caller waits for it to be set again
+    connection->m_Wakeup.SetValue(0);
+
+    {
+        NPT_AutoLock lock(m_Lock);
+
+        if (NPT_SUCCEEDED(connection->m_Pending.PopHead(invocation))) {
+            connection->m_Current = invocation;
+            return NPT_SUCCESS;
+        }
+
+        // idle for too long, the next action for this host starts a new task
+        NPT_TimeStamp now;
+        NPT_System::GetCurrentTimeStamp(now);
+        NPT_TimeStamp idle = connection->m_LastUsed + NPT_TimeInterval((double)PLT_CTRLPOINT_INVOKER_IDLE_TIMEOUT);
+        if (now < idle) {
+            timeout = (NPT_Timeout)(idle - now).ToMillis() + 1;
+            return NPT_ERROR_TIMEOUT;
+        }
+
+        // the task deletes it, it may still be aborted meanwhile
+        m_Connections.Remove(connection);
+    }
+
+    return NPT_ERROR_EOS;
+}
+
+/*----------------------------------------------------------------------
+|   PLT_CtrlPointInvoker::CompleteInvocation
++---------------------------------------------------------------------*/
+bool
+PLT_CtrlPointInvoker::CompleteInvocation(Connection*              connection,
+                                         PLT_CtrlPointInvocation* invocation)
+{
+    NPT_AutoLock lock(m_Lock);
+
+    connection->m_Current = NULL;
+    NPT_System::GetCurrentTimeStamp(connection->m_LastUsed);
+
+    // returns whether the request was aborted so the caller can
+    // start over with a new client
+    bool cancelled = invocation->m_Cancelled;
+    if (cancelled) {
+        invocation->m_Result = NPT_ERROR_INTERRUPTED;
+        delete invocation->m_Response;
+        invocation->m_Response = NULL;
+    }
+
+    m_Completions.Push(invocation);
+    return cancelled;
+}
+
+/*----------------------------------------------------------------------
+|   PLT_CtrlPointInvoker::Deliver
++---------------------------------------------------------------------*/
+void
+PLT_CtrlPointInvoker::Deliver(PLT_CtrlPointInvocation* invocation)
+{
+    m_CtrlPoint->ProcessActionResponse(invocation->m_Result,
+                                       *invocation->m_Request,
+                                       invocation->m_Context,
+                                       invocation->m_Response,
+                                       invocation->m_Action,
+                                       invocation->m_Userdata);
+    delete invocation;
+}
+
+/*----------------------------------------------------------------------
+|   PLT_CtrlPointConnectionTask::PLT_CtrlPointConnectionTask
++---------------------------------------------------------------------*/
+PLT_CtrlPointConnectionTask::PLT_CtrlPointConnectionTask(PLT_CtrlPointInvoker*             invoker,
+                                                         PLT_CtrlPointInvoker::Connection* connection) :
+    m_Invoker(invoker),
+    m_Connection(connection),
+    m_Client(new NPT_HttpClient())
+{
+    m_Client->SetUserAgent(*PLT_Constants::GetInstance().GetDefaultUserAgent());
+}
+
+/*----------------------------------------------------------------------
+|   PLT_CtrlPointConnectionTask::AbortRequest
++---------------------------------------------------------------------*/
+void
+PLT_CtrlPointConnectionTask::AbortRequest()
+{
+    NPT_AutoLock lock(m_Lock);
+    m_Client->Abort();
+}
+
+/*----------------------------------------------------------------------
+|   PLT_CtrlPointConnectionTask::DoAbort
++---------------------------------------------------------------------*/
+void
+PLT_CtrlPointConnectionTask::DoAbort()
+{
+    NPT_AutoLock lock(m_Lock);
+    m_Client->Abort();
+
+    // wake up DoRun unless the connection has been released already
+    if (m_Connection) m_Connection->m_Wakeup.SetValue(1);
+}
+
+/*----------------------------------------------------------------------
+|   PLT_CtrlPointConnectionTask::ReleaseConnection
++---------------------------------------------------------------------*/
+void
+PLT_CtrlPointConnectionTask::ReleaseConnection()
+{
+    PLT_CtrlPointInvoker::Connection* connection;
+    {
+        NPT_AutoLock lock(m_Lock);
+        connection = m_Connection;
+        m_Connection = NULL;
+    }
+
+    delete connection;
+}
+
+/*----------------------------------------------------------------------
+|   PLT_CtrlPointConnectionTask::ResetClient
++---------------------------------------------------------------------*/
+void
+PLT_CtrlPointConnectionTask::ResetClient()
+{
+    NPT_HttpClient* client = new NPT_HttpClient();
+    client->SetUserAgent(*PLT_Constants::GetInstance().GetDefaultUserAgent());
+
+    NPT_AutoLock lock(m_Lock);
+    delete m_Client;
+    m_Client = client;
+}
+
+/*----------------------------------------------------------------------
+|   PLT_CtrlPointConnectionTask::DoRun
++---------------------------------------------------------------------*/
+void
+PLT_CtrlPointConnectionTask::DoRun()
+{
+    NPT_TimeStamp watchdog;
+    NPT_System::GetCurrentTimeStamp(watchdog);
+
+    while (!IsAborting(0)) {
+        PLT_CtrlPointInvocation* invocation;
+        NPT_Timeout              timeout;
+        NPT_Result res = m_Invoker->GetNextInvocation(m_Connection, invocation, timeout);
+        if (res == NPT_ERROR_EOS) {
+            // idle for too long, the invoker no longer knows about it
+            ReleaseConnection();
+            break;
+        }
+
+        if (NPT_SUCCEEDED(res)) {
+            if (IsAborting(0)) {
+                invocation->m_Result = NPT_ERROR_INTERRUPTED;
+            } else {
+                Send(invocation);
+            }
+
+            if (m_Invoker->CompleteInvocation(m_Connection, invocation)) {
+                ResetClient();
+            }
+        } else {
+            // sleep until an action is queued, the task is aborted
+            // or the connection has been idle for too long
+            if (IsAborting(0)) break;
+            m_Connection->m_Wakeup.WaitUntilEquals(1, timeout);
+        }
+
+        // DLNA requires that we abort unanswered/unused sockets after 60 secs
+        NPT_TimeStamp now;
+        NPT_System::GetCurrentTimeStamp(now);
+        if (now > watchdog + NPT_TimeInterval(60.)) {
+            NPT_HttpConnectionManager::GetInstance()->Recycle(NULL);
+            watchdog = now;
+        }
+    }
+}
+
+/*----------------------------------------------------------------------
+|   PLT_CtrlPointConnectionTask::Send
++---------------------------------------------------------------------*/
+void
+PLT_CtrlPointConnectionTask::Send(PLT_CtrlPointInvocation* invocation)
+{
+    NPT_HttpResponse* response = NULL;
+    NPT_String        body;
+
+    NPT_Timeout timeout = invocation->m_Action->GetTimeout();
+    if (timeout == 0) timeout = PLT_CTRLPOINT_INVOKER_DEFAULT_TIMEOUT;
+    m_Client->SetTimeouts(timeout, timeout, timeout);
+
+    // read the body now so the connection can be reused for the next
+    // action without waiting for the listeners
+    NPT_Result res = m_Client->SendRequest(*invocation->m_Request, response, &invocation->m_Context);
+    if (NPT_SUCCEEDED(res) && response) {
+        res = PLT_HttpHelper::GetBody(*response, body);
+    }
+
+    if (NPT_SUCCEEDED(res) && response) {
+        invocation->m_Response = new NPT_HttpResponse(response->GetStatusCode(), 
+                                                      response->GetReasonPhrase(), 
+                                                      response->GetProtocol());
+
+        // keep the headers, except those describing how the body was
+        // transferred since it is now held in memory
+        NPT_List<NPT_HttpHeader*>::Iterator header = response->GetHeaders().GetHeaders().GetFirstItem();
+        while (header) {
+            if ((*header)->GetName().Compare(NPT_HTTP_HEADER_CONTENT_LENGTH, true) &&
+                (*header)->GetName().Compare(NPT_HTTP_HEADER_TRANSFER_ENCODING, true)) {
+                invocation->m_Response->GetHeaders().AddHeader((*header)->GetName(), (*header)->GetValue());
+            }
+            ++header;
+        }
+
+        NPT_HttpEntity* entity = NULL;
+        PLT_HttpHelper::SetBody(*invocation->m_Response, body, &entity);
+        if (entity && response->GetEntity()) {
+            entity->SetContentType(response->GetEntity()->GetContentType());
+        }
+        invocation->m_Result = NPT_SUCCESS;
+    } else {
+        invocation->m_Result = NPT_FAILED(res)?res:NPT_FAILURE;
+    }
+
+    delete response;
+}
+
+/*----------------------------------------------------------------------
+|   PLT_CtrlPointCompletionTask::DoRun
++---------------------------------------------------------------------*/
+void
+PLT_CtrlPointCompletionTask::DoRun()
+{
+    while (!IsAborting(0)) {
+        PLT_CtrlPointInvocation* invocation;
+        if (NPT_SUCCEEDED(m_Invoker->m_Completions.Pop(invocation, NPT_TIMEOUT_INFINITE)) && invocation) {
+            m_Invoker->Deliver(invocation);
+        }
+    }
+}
+
+/*----------------------------------------------------------------------
+|   PLT_CtrlPointCompletionTask::DoAbort
++---------------------------------------------------------------------*/
+void
+PLT_CtrlPointCompletionTask::DoAbort()
+{
+    // wake up DoRun, NULL is never delivered
+    m_Invoker->m_Completions.Push(NULL);
+}
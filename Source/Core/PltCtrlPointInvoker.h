@@ -0,0 +1,228 @@
+/*****************************************************************
+|
+|   Platinum - Control Point Action Invoker
+|
+| Copyright (c) 2004-2010, Plutinosoft, LLC.
+| All rights reserved.
+| http://www.plutinosoft.com
+|
+| This program is free software; you can redistribute it and/or
+| modify it under the terms of the GNU General Public License
+| as published by the Free Software Foundation; either version 2
+| of the License, or (at your option) any later version.
+|
+| OEMs, ISVs, VARs and other distributors that combine and 
+| distribute commercially licensed software with Platinum software
+| and do not wish to distribute the source code for the commercially
+| licensed software under version 2, or (at your option) any later
+| version, of the GNU General Public License (the "GPL") must enter
+| into a commercial license agreement with Plutinosoft, LLC.
+| licensing@plutinosoft.com
+|  
+| This program is distributed in the hope that it will be useful,
+| but WITHOUT ANY WARRANTY; without even the implied warranty of
+| MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+| GNU General Public License for more details.
+|
+| You should have received a copy of the GNU General Public License
+| along with this program; see the file LICENSE.txt. If not, write to
+| the Free Software Foundation, Inc., 
+| 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+| http://www.gnu.org/licenses/gpl-2.0.html
+|
+****************************************************************/
+
+
+
+/** @file
+ UPnP ControlPoint action invocation engine
+ */
+
+#ifndef _PLT_CONTROL_POINT_INVOKER_H_
+#define _PLT_CONTROL_POINT_INVOKER_H_
+
+/*----------------------------------------------------------------------
+|   includes
++---------------------------------------------------------------------*/
+#include "Neptune.h"
+#include "PltThreadTask.h"
+#include "PltTaskManager.h"
+#include "PltAction.h"
+
+/*----------------------------------------------------------------------
+|   forward declarations
++---------------------------------------------------------------------*/
+class PLT_CtrlPoint;
+class PLT_CtrlPointConnectionTask;
+
+/*----------------------------------------------------------------------
+|   constants
++---------------------------------------------------------------------*/
+#define PLT_CTRLPOINT_INVOKER_DEFAULT_TIMEOUT 60000 // milliseconds
+#define PLT_CTRLPOINT_INVOKER_IDLE_TIMEOUT    30    // seconds
+
+/*----------------------------------------------------------------------
+|   PLT_CtrlPointInvocation struct
++---------------------------------------------------------------------*/
+struct PLT_CtrlPointInvocation {
+    PLT_CtrlPointInvocation(NPT_HttpRequest*     request, 
+                            PLT_ActionReference& action, 
+                            void*                userdata) : 
+        m_Request(request), m_Action(action), m_Userdata(userdata), 
+        m_Cancelled(false), m_Result(NPT_FAILURE), m_Response(NULL) {}
+    ~PLT_CtrlPointInvocation() { delete m_Request; delete m_Response; }
+
+    NPT_HttpRequest*       m_Request;
+    PLT_ActionReference    m_Action;
+    void*                  m_Userdata;
+    bool                   m_Cancelled;
+
+    // outcome, the response body is read by the connection task
+    NPT_Result             m_Result;
+    NPT_HttpResponse*      m_Response;
+    NPT_HttpRequestContext m_Context;
+};
+
+/*----------------------------------------------------------------------
+|   PLT_CtrlPointInvoker class
++---------------------------------------------------------------------*/
+/**
+ The PLT_CtrlPointInvoker class sends the actions invoked by a PLT_CtrlPoint.
+ Actions are queued per host and each host is served by one 
+ PLT_CtrlPointConnectionTask reusing a persistent connection, the task goes
+ away after a while without actions. Responses are read by the connection 
+ tasks and handed to a single PLT_CtrlPointCompletionTask which delivers them
+ in order to the control point listeners, so a slow listener never holds a 
+ connection. Each action can have its own timeout and can be cancelled.
+ */
+class PLT_CtrlPointInvoker
+{
+public:
+    PLT_CtrlPointInvoker(PLT_CtrlPoint* ctrl_point);
+    ~PLT_CtrlPointInvoker();
+
+    NPT_Result Start(PLT_TaskManager* task_manager);
+
+    /**
+     Fail actions still queued or not yet delivered. Must be called after 
+     the tasks have been stopped.
+     */
+    NPT_Result Stop();
+
+    /**
+     Queue an action request. The invoker takes ownership of the request.
+     On success the listeners receive exactly one response for the action,
+     on failure the request is deleted and they receive none.
+     */
+    NPT_Result Invoke(NPT_HttpRequest*     request, 
+                      PLT_ActionReference& action, 
+                      void*                userdata);
+
+    /**
+     Cancel an action previously invoked. If the action is still queued or 
+     being sent, the listeners receive its response with NPT_ERROR_INTERRUPTED.
+     @return NPT_ERROR_NO_SUCH_ITEM if the response was already received
+     */
+    NPT_Result Cancel(PLT_ActionReference& action);
+
+private:
+    friend class PLT_CtrlPointConnectionTask;
+    friend class PLT_CtrlPointCompletionTask;
+
+    struct Connection {
+        Connection() : m_Current(NULL), m_Task(NULL) {}
+
+        NPT_String                          m_Host; // host:port
+        NPT_List<PLT_CtrlPointInvocation*>  m_Pending;
+        PLT_CtrlPointInvocation*            m_Current;
+        PLT_CtrlPointConnectionTask*        m_Task;
+        NPT_SharedVariable                  m_Wakeup;
+        NPT_TimeStamp                       m_LastUsed;
+    };
+
+    // called by PLT_CtrlPointConnectionTask
+    /**
+     Take the next action queued for the connection. Otherwise return 
+     NPT_ERROR_TIMEOUT with the time left before the connection is idle for 
+     too long, or NPT_ERROR_EOS once it is. The connection has then been 
+     removed and the caller must delete it.
+     */
+    NPT_Result GetNextInvocation(Connection*               connection, 
+                                 PLT_CtrlPointInvocation*& invocation,
+                                 NPT_Timeout&              timeout);
+    bool       CompleteInvocation(Connection*              connection, 
+                                  PLT_CtrlPointInvocation* invocation);
+
+    // called by PLT_CtrlPointCompletionTask
+    void       Deliver(PLT_CtrlPointInvocation* invocation);
+
+    // members
+    PLT_CtrlPoint*                     m_CtrlPoint;
+    PLT_TaskManager*                   m_TaskManager;
+    NPT_Mutex                          m_Lock;
+    NPT_List<Connection*>              m_Connections;
+    NPT_Queue<PLT_CtrlPointInvocation> m_Completions; // waiting to be delivered
+};
+
+/*----------------------------------------------------------------------
+|   PLT_CtrlPointConnectionTask class
++---------------------------------------------------------------------*/
+/**
+ The PLT_CtrlPointConnectionTask class sends the actions queued for a host
+ one after the other, keeping the connection alive in between.
+ */
+class PLT_CtrlPointConnectionTask : public PLT_ThreadTask
+{
+public:
+    PLT_CtrlPointConnectionTask(PLT_CtrlPointInvoker*             invoker, 
+                                PLT_CtrlPointInvoker::Connection* connection);
+
+    // abort the request being sent, the task keeps running
+    void AbortRequest();
+
+protected:
+    ~PLT_CtrlPointConnectionTask() { delete m_Client; }
+
+    // PLT_ThreadTask methods
+    virtual void DoAbort();
+    virtual void DoRun();
+    virtual bool IsLongRunning() { return true; }
+
+private:
+    void Send(PLT_CtrlPointInvocation* invocation);
+    void ResetClient();
+    void ReleaseConnection();
+
+    // members
+    PLT_CtrlPointInvoker*             m_Invoker;
+    PLT_CtrlPointInvoker::Connection* m_Connection; // owned once released by the invoker
+    NPT_Mutex                         m_Lock;       // m_Client and m_Connection vs DoAbort
+    NPT_HttpClient*                   m_Client;
+};
+
+/*----------------------------------------------------------------------
+|   PLT_CtrlPointCompletionTask class
++---------------------------------------------------------------------*/
+/**
+ The PLT_CtrlPointCompletionTask class delivers action responses to the 
+ control point listeners.
+ */
+class PLT_CtrlPointCompletionTask : public PLT_ThreadTask
+{
+public:
+    PLT_CtrlPointCompletionTask(PLT_CtrlPointInvoker* invoker) : m_Invoker(invoker) {}
+
+protected:
+    ~PLT_CtrlPointCompletionTask() {}
+
+    // PLT_ThreadTask methods
+    virtual void DoAbort();
+    virtual void DoRun();
+    virtual bool IsLongRunning() { return true; }
+
+private:
+    // members
+    PLT_CtrlPointInvoker* m_Invoker;
+};
+
+#endif /* _PLT_CONTROL_POINT_INVOKER_H_ */
@@ -40,111 +40,6 @@
 #include "PltCtrlPoint.h"
 #include "PltDatagramStream.h"
 
-/*----------------------------------------------------------------------
-|    PLT_CtrlPointGetDescriptionTask::PLT_CtrlPointGetDescriptionTask
-+---------------------------------------------------------------------*/
-PLT_CtrlPointGetDescriptionTask::PLT_CtrlPointGetDescriptionTask(const NPT_HttpUrl& url,
-                                                                 PLT_CtrlPoint*     ctrl_point,
-                                                                 NPT_TimeInterval   leasetime,
-                                                                 NPT_String         uuid) :
-    PLT_HttpClientSocketTask(new NPT_HttpRequest(url, "GET", NPT_HTTP_PROTOCOL_1_1)), 
-    m_CtrlPoint(ctrl_point),
-    m_LeaseTime(leasetime),
-    m_UUID(uuid)
-{
-}
-
-/*----------------------------------------------------------------------
-|    PLT_CtrlPointGetDescriptionTask::~PLT_CtrlPointGetDescriptionTask
-+---------------------------------------------------------------------*/
-PLT_CtrlPointGetDescriptionTask::~PLT_CtrlPointGetDescriptionTask() 
-{
-}
-
-/*----------------------------------------------------------------------
-|    PLT_CtrlPointGetDescriptionTask::ProcessResponse
-+---------------------------------------------------------------------*/
-NPT_Result 
-PLT_CtrlPointGetDescriptionTask::ProcessResponse(NPT_Result                    res, 
-                                                 const NPT_HttpRequest&        request, 
-                                                 const NPT_HttpRequestContext& context, 
-                                                 NPT_HttpResponse*             response)
-{
-    NPT_COMPILER_UNUSED(request);
-    return m_CtrlPoint->ProcessGetDescriptionResponse(
-        res, 
-        request, 
-        context, 
-        response,
-        m_LeaseTime,
-        m_UUID);
-}
-
-/*----------------------------------------------------------------------
-|    PLT_CtrlPointGetSCPDsTask::PLT_CtrlPointGetSCPDsTask
-+---------------------------------------------------------------------*/
-PLT_CtrlPointGetSCPDsTask::PLT_CtrlPointGetSCPDsTask(PLT_CtrlPoint*           ctrl_point, 
-                                                     PLT_DeviceDataReference& root_device) :  
-    PLT_HttpClientSocketTask(), 
-    m_CtrlPoint(ctrl_point),
-    m_RootDevice(root_device)
-{
-}
-
-/*----------------------------------------------------------------------
-|    PLT_CtrlPointGetSCPDsTask::ProcessResponse
-+---------------------------------------------------------------------*/
-NPT_Result 
-PLT_CtrlPointGetSCPDsTask::ProcessResponse(NPT_Result                    res, 
-                                          const NPT_HttpRequest&        request, 
-                                          const NPT_HttpRequestContext& context, 
-                                          NPT_HttpResponse*             response)
-{
-    NPT_COMPILER_UNUSED(context);
-    return m_CtrlPoint->ProcessGetSCPDResponse(
-        res, 
-        request, 
-        context, 
-        response,
-        ((PLT_CtrlPointGetSCPDRequest&)request).m_Device);
-}
-
-/*----------------------------------------------------------------------
-|    PLT_CtrlPointInvokeActionTask::PLT_CtrlPointInvokeActionTask
-+---------------------------------------------------------------------*/
-PLT_CtrlPointInvokeActionTask::PLT_CtrlPointInvokeActionTask(NPT_HttpRequest*     request,
-                                                             PLT_CtrlPoint*       ctrl_point, 
-                                                             PLT_ActionReference& action,
-                                                             void*                userdata) : 
-    PLT_HttpClientSocketTask(request), 
-    m_CtrlPoint(ctrl_point), 
-    m_Action(action), 
-    m_Userdata(userdata)
-{
-}
-
-/*----------------------------------------------------------------------
-|    PLT_CtrlPointInvokeActionTask::~PLT_CtrlPointInvokeActionTask
-+---------------------------------------------------------------------*/
-PLT_CtrlPointInvokeActionTask::~PLT_CtrlPointInvokeActionTask() 
-{
-}
-
-/*----------------------------------------------------------------------
-|    PLT_CtrlPointInvokeActionTask::ProcessResponse
-+---------------------------------------------------------------------*/
-NPT_Result 
-PLT_CtrlPointInvokeActionTask::ProcessResponse(NPT_Result                    res, 
-                                               const NPT_HttpRequest&        request, 
-                                               const NPT_HttpRequestContext& context, 
-                                               NPT_HttpResponse*             response)
-{
-    NPT_COMPILER_UNUSED(request);
-    NPT_COMPILER_UNUSED(context);
-
-    return m_CtrlPoint->ProcessActionResponse(res, request, context, response, m_Action, m_Userdata);
-}
-
 /*----------------------------------------------------------------------
 |    PLT_CtrlPointHouseKeepingTask::PLT_CtrlPointHouseKeepingTask
 +---------------------------------------------------------------------*/
@@ -168,6 +63,25 @@ PLT_CtrlPointHouseKeepingTask::DoRun()
     }
 }
 
+/*----------------------------------------------------------------------
+|    PLT_CtrlPointSubscribeEventsTask::ProcessResponse
++---------------------------------------------------------------------*/
+NPT_Result 
+PLT_CtrlPointSubscribeEventsTask::ProcessResponse(NPT_Result                    res, 
+                                                  const NPT_HttpRequest&        request, 
+                                                  const NPT_HttpRequestContext& context,
+                                                  NPT_HttpResponse*             response)
+{
+    PLT_CtrlPointSubscribeRequest& subscribe = (PLT_CtrlPointSubscribeRequest&)request;
+    return m_CtrlPoint->ProcessSubscribeResponse(
+        res, 
+        request, 
+        context, 
+        response, 
+        subscribe.m_Service, 
+        subscribe.m_Userdata);
+}
+
 /*----------------------------------------------------------------------
 |    PLT_CtrlPointSubscribeEventTask::PLT_CtrlPointSubscribeEventTask
 +---------------------------------------------------------------------*/
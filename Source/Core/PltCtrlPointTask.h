@@ -54,75 +54,77 @@
 class PLT_Action;
 
 /*----------------------------------------------------------------------
-|   PLT_CtrlPointGetDescriptionTask class
+|   PLT_CtrlPointHouseKeepingTask class
 +---------------------------------------------------------------------*/
 /**
- The PLT_CtrlPointGetDescriptionTask class fetches the description xml document
- from a UPnP device
+ The PLT_CtrlPointHouseKeepingTask class is used by a PLT_CtrlPoint to keep 
+ track of expired devices and autmatically renew event subscribers. 
  */
-class PLT_CtrlPointGetDescriptionTask : public PLT_HttpClientSocketTask
+class PLT_CtrlPointHouseKeepingTask : public PLT_ThreadTask
 {
 public:
-    PLT_CtrlPointGetDescriptionTask(const NPT_HttpUrl& url,
-                                    PLT_CtrlPoint*     ctrl_point,
-                                    NPT_TimeInterval   leasetime,
-                                    NPT_String         uuid);
-    virtual ~PLT_CtrlPointGetDescriptionTask();
+    PLT_CtrlPointHouseKeepingTask(PLT_CtrlPoint*   ctrl_point, 
+                                  NPT_TimeInterval timer = NPT_TimeInterval(5.));
 
 protected:
-    // PLT_HttpClientSocketTask methods
-    NPT_Result ProcessResponse(NPT_Result                    res, 
-                               const NPT_HttpRequest&        request, 
-                               const NPT_HttpRequestContext& context, 
-                               NPT_HttpResponse*             response);
+    ~PLT_CtrlPointHouseKeepingTask() {}
+
+    // PLT_ThreadTask methods
+    virtual void DoRun();
+    virtual bool IsLongRunning() { return true; }
 
 protected:
     PLT_CtrlPoint*   m_CtrlPoint;
-    NPT_TimeInterval m_LeaseTime;
-    NPT_String       m_UUID;
+    NPT_TimeInterval m_Timer;
 };
 
 /*----------------------------------------------------------------------
-|   PLT_CtrlPointGetSCPDRequest class
+|   PLT_CtrlPointSubscribeRequest class
 +---------------------------------------------------------------------*/
 /**
- The PLT_CtrlPointGetSCPDRequest class is used by a PLT_CtrlPointGetSCPDsTask task
- to fetch a specific SCPD xml document for a given service of a given device.
+ The PLT_CtrlPointSubscribeRequest class is used by a PLT_CtrlPointSubscribeEventsTask
+ task to subscribe, renew or cancel a subscription to a given service.
  */
-class PLT_CtrlPointGetSCPDRequest : public NPT_HttpRequest
+class PLT_CtrlPointSubscribeRequest : public NPT_HttpRequest
 {
 public:
-    PLT_CtrlPointGetSCPDRequest(PLT_DeviceDataReference& device,
-                                const char*              url,
-                                const char*              method = "GET",
-                                const char*              protocol = NPT_HTTP_PROTOCOL_1_1) : // 1.1 for pipelining
-        NPT_HttpRequest(url, method, protocol), m_Device(device) {}
-    virtual ~PLT_CtrlPointGetSCPDRequest() {}
+    PLT_CtrlPointSubscribeRequest(PLT_DeviceDataReference& device,
+                                  PLT_Service*             service,
+                                  const char*              url,
+                                  const char*              method = "SUBSCRIBE",
+                                  void*                    userdata = NULL) :
+        NPT_HttpRequest(url, method, NPT_HTTP_PROTOCOL_1_1), 
+        m_Device(device), m_Service(service), m_Userdata(userdata) {}
+    virtual ~PLT_CtrlPointSubscribeRequest() {}
 
     // members
-    PLT_DeviceDataReference m_Device;
+    PLT_DeviceDataReference m_Device; // force to keep a reference to device owning m_Service
+    PLT_Service*            m_Service;
+    void*                   m_Userdata;
 };
 
 /*----------------------------------------------------------------------
-|   PLT_CtrlPointGetSCPDsTask class
+|   PLT_CtrlPointSubscribeEventsTask class
 +---------------------------------------------------------------------*/
 /**
- The PLT_CtrlPointGetSCPDsTask class fetches the SCPD xml document of one or more
- services for a given device. 
+ The PLT_CtrlPointSubscribeEventsTask class sends one or more subscription 
+ requests to the same host one after the other on a persistent connection. 
+ It is used to renew all subscriptions due at the same time.
  */
-class PLT_CtrlPointGetSCPDsTask : public PLT_HttpClientSocketTask
+class PLT_CtrlPointSubscribeEventsTask : public PLT_HttpClientSocketTask
 {
 public:
-    PLT_CtrlPointGetSCPDsTask(PLT_CtrlPoint* ctrl_point, PLT_DeviceDataReference& root_device);
-    virtual ~PLT_CtrlPointGetSCPDsTask() {}
+    PLT_CtrlPointSubscribeEventsTask(PLT_CtrlPoint* ctrl_point) : 
+        PLT_HttpClientSocketTask(), m_CtrlPoint(ctrl_point) {}
+    virtual ~PLT_CtrlPointSubscribeEventsTask() {}
 
-    NPT_Result AddSCPDRequest(PLT_CtrlPointGetSCPDRequest* request) {
+    NPT_Result AddSubscribeRequest(PLT_CtrlPointSubscribeRequest* request) {
         return PLT_HttpClientSocketTask::AddRequest((NPT_HttpRequest*)request);
     }
 
     // override to prevent calling this directly
     NPT_Result AddRequest(NPT_HttpRequest*) {
-        // only queuing PLT_CtrlPointGetSCPDRequest allowed
+        // only queuing PLT_CtrlPointSubscribeRequest allowed
         return NPT_ERROR_NOT_SUPPORTED;
     }
 
@@ -134,61 +136,7 @@ protected:
                                NPT_HttpResponse*             response);   
 
 protected:
-    PLT_CtrlPoint*          m_CtrlPoint;
-    PLT_DeviceDataReference m_RootDevice;
-};
-
-/*----------------------------------------------------------------------
-|   PLT_CtrlPointInvokeActionTask class
-+---------------------------------------------------------------------*/
-/**
- The PLT_CtrlPointInvokeActionTask class is used by a PLT_CtrlPoint to invoke
- a specific action of a given service for a given device.
- */
-class PLT_CtrlPointInvokeActionTask : public PLT_HttpClientSocketTask
-{
-public:
-    PLT_CtrlPointInvokeActionTask(NPT_HttpRequest*     request,
-                                  PLT_CtrlPoint*       ctrl_point, 
-                                  PLT_ActionReference& action,
-                                  void*                userdata);
-    virtual ~PLT_CtrlPointInvokeActionTask();
-
-protected:
-    // PLT_HttpClientSocketTask methods
-    NPT_Result ProcessResponse(NPT_Result                    res, 
-                               const NPT_HttpRequest&        request, 
-                               const NPT_HttpRequestContext& context, 
-                               NPT_HttpResponse*             response);   
-
-protected:
-    PLT_CtrlPoint*      m_CtrlPoint;
-    PLT_ActionReference m_Action;
-    void*               m_Userdata;
-};
-
-/*----------------------------------------------------------------------
-|   PLT_CtrlPointHouseKeepingTask class
-+---------------------------------------------------------------------*/
-/**
- The PLT_CtrlPointHouseKeepingTask class is used by a PLT_CtrlPoint to keep 
- track of expired devices and autmatically renew event subscribers. 
- */
-class PLT_CtrlPointHouseKeepingTask : public PLT_ThreadTask
-{
-public:
-    PLT_CtrlPointHouseKeepingTask(PLT_CtrlPoint*   ctrl_point, 
-                                  NPT_TimeInterval timer = NPT_TimeInterval(5.));
-
-protected:
-    ~PLT_CtrlPointHouseKeepingTask() {}
-
-    // PLT_ThreadTask methods
-    virtual void DoRun();
-
-protected:
-    PLT_CtrlPoint*   m_CtrlPoint;
-    NPT_TimeInterval m_Timer;
+    PLT_CtrlPoint* m_CtrlPoint;
 };
 
 /*----------------------------------------------------------------------
@@ -43,7 +43,8 @@
 PLT_InputDatagramStream::PLT_InputDatagramStream(NPT_UdpSocket* socket,
                                                  NPT_Size       buffer_size) : 
     m_Socket(socket),
-    m_BufferOffset(0)
+    m_BufferOffset(0),
+    m_InfoValid(false)
 {
     m_Buffer.SetBufferSize(buffer_size);
 }
@@ -73,8 +74,11 @@ PLT_InputDatagramStream::Read(void*     buffer,
         NPT_SocketAddress addr;
         res = m_Socket->Receive(m_Buffer, &addr);
         
-        // update info
-        m_Socket->GetInfo(m_Info);
+        // the local address of a bound socket doesn't change,
+        // only query it once instead of for every datagram
+        if (!m_InfoValid && NPT_SUCCEEDED(res)) {
+            m_InfoValid = NPT_SUCCEEDED(m_Socket->GetInfo(m_Info));
+        }
         m_Info.remote_address = addr;
     }
         
@@ -78,6 +78,7 @@ protected:
     NPT_SocketInfo      m_Info;
     NPT_DataBuffer      m_Buffer;
     NPT_Position        m_BufferOffset;
+    bool                m_InfoValid;
 };
 
 typedef NPT_Reference<PLT_InputDatagramStream> PLT_InputDatagramStreamReference;
@@ -186,6 +186,7 @@ protected:
     friend class PLT_CtrlPoint;
     friend class PLT_DeviceReadyIterator;
     friend class PLT_DeviceHost;
+    friend class PLT_SsdpSearchResponderTask;
 
     //members
     NPT_String                         m_ParentUUID;
@@ -42,9 +42,15 @@
 #include "PltSsdp.h"
 #include "PltHttpServer.h"
 #include "PltVersion.h"
+#include "PltSoap.h"
 
 NPT_SET_LOCAL_LOGGER("platinum.core.devicehost")
 
+/*----------------------------------------------------------------------
+|   constants
++---------------------------------------------------------------------*/
+#define PLT_DEVICE_HOST_MAX_DOCUMENTS 32
+
 /*----------------------------------------------------------------------
 |   externals
 +---------------------------------------------------------------------*/
@@ -70,10 +76,17 @@ PLT_DeviceHost::PLT_DeviceHost(const char*  description_path /* = "/" */,
                    friendly_name), 
     m_TaskManager(NULL),
     m_HttpServer(NULL),
+    m_SsdpResponder(NULL),
+    m_EventScheduler(NULL),
     m_ExtraBroascast(false),
     m_Port(port),
     m_PortRebind(port_rebind),
     m_ByeByeFirst(true),
+#if defined(PLATINUM_UPNP_SPECS_STRICT)
+    m_SsdpPacing(true),
+#else
+    m_SsdpPacing(false),
+#endif
     m_Started(false)
 {
     if (show_ip) {
@@ -173,6 +186,8 @@ PLT_DeviceHost::Start(PLT_SsdpListenTask* task)
     
     // setup
     m_TaskManager = new PLT_TaskManager();
+    m_TaskManager->EnablePool(); // M-SEARCH responses are short lived delayed tasks
+
     m_HttpServer = new PLT_HttpServer(NPT_IpAddress::Any, m_Port, m_PortRebind, 100); // limit to 100 clients max  
     if (NPT_FAILED(result = m_HttpServer->Start())) {
         m_TaskManager = NULL;
@@ -191,6 +206,27 @@ PLT_DeviceHost::Start(PLT_SsdpListenTask* task)
         NPT_CHECK_FATAL(result);
     }
 
+    // single task sending events for all our services, started before
+    // the http handler so subscriptions always find it
+    m_EventScheduler = new PLT_ServiceEventScheduler();
+    if (NPT_FAILED(result = m_TaskManager->StartTask(m_EventScheduler))) {
+        m_EventScheduler = NULL;
+        m_TaskManager = NULL;
+        m_HttpServer = NULL;
+        NPT_CHECK_FATAL(result);
+    }
+
+    // small pool of workers delivering the notifications of all subscribers
+    m_EventDispatcher = new PLT_EventDispatcher();
+    if (NPT_FAILED(result = m_EventDispatcher->Start(m_TaskManager.AsPointer()))) {
+        m_TaskManager->Abort();
+        m_EventScheduler = NULL;
+        m_EventDispatcher = NULL;
+        m_TaskManager = NULL;
+        m_HttpServer = NULL;
+        NPT_CHECK_FATAL(result);
+    }
+
     // all other requests including description document
     // and service control are dynamically handled
     m_HttpServer->AddRequestHandler(new PLT_HttpRequestHandler(this), "/", true, true);
@@ -206,12 +242,18 @@ PLT_DeviceHost::Start(PLT_SsdpListenTask* task)
     NPT_TimeInterval repeat;
     repeat.SetSeconds(leaseTime?(int)((leaseTime >> 1) - 10):30);
 
-    PLT_ThreadTask* announce_task = new PLT_SsdpDeviceAnnounceTask(
-        this, 
+    // announcements of all devices are sent by a shared scheduler
+    PLT_SsdpAnnounceScheduler::Schedule(this, 
         repeat, 
+        delay,
         m_ByeByeFirst, 
         m_ExtraBroascast);
-    m_TaskManager->StartTask(announce_task, &delay);
+
+    // single task responding to all M-SEARCH requests
+    m_SsdpResponder = new PLT_SsdpSearchResponderTask(this);
+    if (NPT_FAILED(m_TaskManager->StartTask(m_SsdpResponder))) {
+        m_SsdpResponder = NULL; // fall back to one task per M-SEARCH
+    }
 
     // register ourselves as a listener for SSDP search requests
     task->AddListener(this);
@@ -234,11 +276,23 @@ PLT_DeviceHost::Stop(PLT_SsdpListenTask* task)
     // unregister ourselves as a listener for ssdp requests
     task->RemoveListener(this);
 
+    // stop announcing before sending the byebye
+    PLT_SsdpAnnounceScheduler::Cancel(this);
+
+    // stop our internal http server first so no action or 
+    // subscription can reach our services from now on
+    m_HttpServer->Stop();
+
+    // services must not use the event scheduler once the task is gone
+    DetachEventScheduler(this);
+
     // remove all our running tasks
     m_TaskManager->Abort();
+    m_SsdpResponder = NULL;
+    m_EventScheduler = NULL;
 
-    // stop our internal http server
-    m_HttpServer->Stop();
+    // subscribers still reference the dispatcher until services are cleaned up
+    m_EventDispatcher = NULL;
 
     // announce we're leaving
     NPT_List<NPT_NetworkInterface*> if_list;
@@ -261,8 +315,38 @@ PLT_DeviceHost::Stop(PLT_SsdpListenTask* task)
 NPT_Result
 PLT_DeviceHost::Announce(PLT_DeviceData*      device,
                          NPT_HttpRequest&     req,
+                         NPT_UdpSocket&       socket,
+                         PLT_SsdpAnnounceType type,
+                         NPT_TimeInterval     pacing /* = 0 */)
+{
+    PLT_SsdpBatch batch;
+    NPT_CHECK_SEVERE(FormatAnnounce(device, req, type, batch));
+
+    // on byebye, don't pace otherwise it hangs when we stop upnp
+    batch.Send(socket, (type == PLT_ANNOUNCETYPE_BYEBYE)?NPT_TimeInterval(0.):pacing);
+    return NPT_SUCCESS;
+}
+
+/*----------------------------------------------------------------------
+|   PLT_DeviceHost::Announce
++---------------------------------------------------------------------*/
+NPT_Result
+PLT_DeviceHost::Announce(NPT_HttpRequest&     req,
                          NPT_UdpSocket&       socket,
                          PLT_SsdpAnnounceType type)
+{
+    return Announce(this, req, socket, type, 
+        m_SsdpPacing?NPT_TimeInterval(PLT_DLNA_SSDP_DELAY):NPT_TimeInterval(0.));
+}
+
+/*----------------------------------------------------------------------
+|   PLT_DeviceHost::FormatAnnounce
++---------------------------------------------------------------------*/
+NPT_Result
+PLT_DeviceHost::FormatAnnounce(PLT_DeviceData*      device,
+                               NPT_HttpRequest&     req,
+                               PLT_SsdpAnnounceType type,
+                               PLT_SsdpBatch&       batch)
 {
     NPT_Result res = NPT_SUCCESS;
 
@@ -313,67 +397,47 @@ PLT_DeviceHost::Announce(PLT_DeviceData*      device,
 
     // upnp:rootdevice
     if (device->m_ParentUUID.IsEmpty()) {
-        PLT_SsdpSender::SendSsdp(req,
+        PLT_SsdpSender::FormatSsdp(req,
             NPT_String("uuid:" + device->m_UUID + "::upnp:rootdevice"), 
             "upnp:rootdevice",
-            socket,
             true, 
+            batch,
             &addr);
     }
-    
-    // on byebye, don't sleep otherwise it hangs when we stop upnp
-    if (type != PLT_ANNOUNCETYPE_BYEBYE) {
-        NPT_System::Sleep(NPT_TimeInterval(PLT_DLNA_SSDP_DELAY));
-    }
 
     // uuid:device-UUID
-    PLT_SsdpSender::SendSsdp(req,
+    PLT_SsdpSender::FormatSsdp(req,
         "uuid:" + device->m_UUID, 
         "uuid:" + device->m_UUID, 
-        socket, 
         true, 
+        batch,
         &addr);
 
-    // on byebye, don't sleep otherwise it hangs when we stop upnp
-    if (type != PLT_ANNOUNCETYPE_BYEBYE) {
-        NPT_System::Sleep(NPT_TimeInterval(PLT_DLNA_SSDP_DELAY));
-    }
-
     // uuid:device-UUID::urn:schemas-upnp-org:device:deviceType:ver
-    PLT_SsdpSender::SendSsdp(req,
+    PLT_SsdpSender::FormatSsdp(req,
         NPT_String("uuid:" + device->m_UUID + "::" + device->m_DeviceType), 
         device->m_DeviceType,
-        socket,
         true,
+        batch,
         &addr);
-    
-    // on byebye, don't sleep otherwise it hangs when we stop upnp
-    if (type != PLT_ANNOUNCETYPE_BYEBYE) {
-        NPT_System::Sleep(NPT_TimeInterval(PLT_DLNA_SSDP_DELAY));
-    }
 
     // services
     for (int i=0; i < (int)device->m_Services.GetItemCount(); i++) {
         // uuid:device-UUID::urn:schemas-upnp-org:service:serviceType:ver
-        PLT_SsdpSender::SendSsdp(req,
+        PLT_SsdpSender::FormatSsdp(req,
             NPT_String("uuid:" + device->m_UUID + "::" + device->m_Services[i]->GetServiceType()), 
             device->m_Services[i]->GetServiceType(),
-            socket,
             true, 
+            batch,
             &addr); 
-        
-        // on byebye, don't sleep otherwise it hangs when we stop upnp
-        if (type != PLT_ANNOUNCETYPE_BYEBYE) {
-            NPT_System::Sleep(NPT_TimeInterval(PLT_DLNA_SSDP_DELAY));
-        }
     }
 
     // embedded devices
     for (int j=0; j < (int)device->m_EmbeddedDevices.GetItemCount(); j++) {
-        Announce(device->m_EmbeddedDevices[j].AsPointer(), 
+        FormatAnnounce(device->m_EmbeddedDevices[j].AsPointer(), 
             req, 
-            socket, 
-            type);
+            type,
+            batch);
     }
 
     return res;
@@ -437,22 +501,29 @@ PLT_DeviceHost::ProcessHttpGetRequest(NPT_HttpRequest&              request,
 |   PLT_DeviceHost::ProcessGetDescription
 +---------------------------------------------------------------------*/
 NPT_Result 
-PLT_DeviceHost::ProcessGetDescription(NPT_HttpRequest&              /*request*/,
+PLT_DeviceHost::ProcessGetDescription(NPT_HttpRequest&              request,
                                       const NPT_HttpRequestContext& context,
                                       NPT_HttpResponse&             response)
 {
     NPT_COMPILER_UNUSED(context);
 
-    NPT_String doc;
-    NPT_CHECK_FATAL(GetDescription(doc));
-    NPT_LOG_FINEST_2("Returning description to %s: %s", 
-        (const char*)context.GetRemoteAddress().GetIpAddress().ToString(),
-        (const char*)doc);
+    // description only changes with the device properties
+    NPT_String key = NPT_String::Format("%s#%08x", 
+        (const char*)request.GetUrl().GetPath(), 
+        ComputeDocumentSignature(this));
 
-    NPT_HttpEntity* entity;
-    PLT_HttpHelper::SetBody(response, doc, &entity);    
-    entity->SetContentType("text/xml; charset=\"utf-8\"");
-    return NPT_SUCCESS;
+    PLT_DeviceHostDocumentReference document;
+    if (NPT_FAILED(FindDocument(key, document))) {
+        NPT_String doc;
+        NPT_CHECK_FATAL(GetDescription(doc));
+        NPT_LOG_FINEST_2("Returning description to %s: %s", 
+            (const char*)context.GetRemoteAddress().GetIpAddress().ToString(),
+            (const char*)doc);
+
+        NPT_CHECK_FATAL(AddDocument(key, doc, document));
+    }
+
+    return ServeDocument(request, document, response);
 }
 
 /*----------------------------------------------------------------------
@@ -460,25 +531,195 @@ PLT_DeviceHost::ProcessGetDescription(NPT_HttpRequest&              /*request*/,
 +---------------------------------------------------------------------*/
 NPT_Result 
 PLT_DeviceHost::ProcessGetSCPD(PLT_Service*                  service,
-                               NPT_HttpRequest&              /*request*/,
+                               NPT_HttpRequest&              request,
                                const NPT_HttpRequestContext& context,
                                NPT_HttpResponse&             response)
 {
     NPT_COMPILER_UNUSED(context);
     NPT_CHECK_POINTER_FATAL(service);
 
-    NPT_String doc;
-    NPT_CHECK_FATAL(service->GetSCPDXML(doc));
-    NPT_LOG_FINEST_2("Returning SCPD to %s: %s", 
-        (const char*)context.GetRemoteAddress().GetIpAddress().ToString(),
-        (const char*)doc);
+    // keyed on the service content so other services changing don't invalidate it
+    NPT_String key = NPT_String::Format("%s#%08x", 
+        (const char*)request.GetUrl().GetPath(), 
+        service->GetSCPDSignature());
+
+    PLT_DeviceHostDocumentReference document;
+    if (NPT_FAILED(FindDocument(key, document))) {
+        NPT_String doc;
+        NPT_CHECK_FATAL(service->GetSCPDXML(doc));
+        NPT_LOG_FINEST_2("Returning SCPD to %s: %s", 
+            (const char*)context.GetRemoteAddress().GetIpAddress().ToString(),
+            (const char*)doc);
+
+        NPT_CHECK_FATAL(AddDocument(key, doc, document));
+    }
+
+    return ServeDocument(request, document, response);
+}
+
+/*----------------------------------------------------------------------
+|   PLT_DeviceHost::InvalidateDocuments
++---------------------------------------------------------------------*/
+void
+PLT_DeviceHost::InvalidateDocuments()
+{
+    NPT_AutoLock lock(m_DocumentsLock);
+    m_Documents.Clear();
+}
+
+/*----------------------------------------------------------------------
+|   PLT_DeviceHost::FindDocument
++---------------------------------------------------------------------*/
+NPT_Result
+PLT_DeviceHost::FindDocument(const NPT_String&                key,
+                             PLT_DeviceHostDocumentReference& document)
+{
+    NPT_AutoLock lock(m_DocumentsLock);
+
+    PLT_DeviceHostDocumentReference* cached = NULL;
+    NPT_CHECK(m_Documents.Get(key, cached));
+    document = *cached;
+    return NPT_SUCCESS;
+}
+
+/*----------------------------------------------------------------------
+|   PLT_DeviceHost::AddDocument
++---------------------------------------------------------------------*/
+NPT_Result
+PLT_DeviceHost::AddDocument(const NPT_String&                key,
+                            const NPT_String&                xml,
+                            PLT_DeviceHostDocumentReference& document)
+{
+    document = new PLT_DeviceHostDocument();
+    document->m_Body = new NPT_DataBuffer((const NPT_Byte*)xml.GetChars(), xml.GetLength());
+    document->m_ETag = NPT_String::Format("\"%08x-%x\"", 
+        PLT_HashHelper::HashData(xml.GetChars(), xml.GetLength()), 
+        xml.GetLength());
+
+#if defined(NPT_CONFIG_ENABLE_ZIP)
+    // only keep compressed variant if it is worth it
+    PLT_SharedBufferReference gzip(new NPT_DataBuffer());
+    if (NPT_SUCCEEDED(NPT_Zip::Deflate(*document->m_Body, 
+                                       *gzip, 
+                                       NPT_ZIP_COMPRESSION_LEVEL_DEFAULT, 
+                                       NPT_Zip::GZIP)) &&
+        gzip->GetDataSize() < document->m_Body->GetDataSize()) {
+        document->m_GzipBody = gzip;
+    }
+#endif
+
+    NPT_AutoLock lock(m_DocumentsLock);
+
+    // entries with an outdated signature are never requested again,
+    // start over instead of letting them accumulate
+    if (m_Documents.GetEntryCount() >= PLT_DEVICE_HOST_MAX_DOCUMENTS) {
+        m_Documents.Clear();
+    }
+    return m_Documents.Put(key, document);
+}
+
+/*----------------------------------------------------------------------
+|   PLT_DeviceHost::ServeDocument
++---------------------------------------------------------------------*/
+NPT_Result
+PLT_DeviceHost::ServeDocument(const NPT_HttpRequest&           request,
+                              PLT_DeviceHostDocumentReference& document,
+                              NPT_HttpResponse&                response)
+{
+    response.GetHeaders().SetHeader("ETag", document->m_ETag);
+    response.GetHeaders().SetHeader("Vary", "Accept-Encoding");
+
+    // client already has the latest version
+    const NPT_String* if_none_match = request.GetHeaders().GetHeaderValue("If-None-Match");
+    if (if_none_match && 
+        (if_none_match->Find(document->m_ETag) >= 0 || *if_none_match == "*")) {
+        response.SetStatus(304, "Not Modified");
+        return NPT_SUCCESS;
+    }
+
+    const NPT_String* accept_encoding = request.GetHeaders().GetHeaderValue("Accept-Encoding");
+    bool gzip = accept_encoding && 
+                accept_encoding->Find("gzip", 0, true) >= 0 && 
+                !document->m_GzipBody.IsNull();
 
+    // the cached buffer is shared with the response, not copied
     NPT_HttpEntity* entity;
-    PLT_HttpHelper::SetBody(response, doc, &entity);    
+    PLT_HttpHelper::SetBody(response, 
+                            NPT_InputStreamReference(new PLT_SharedBufferInputStream(
+                                gzip?document->m_GzipBody:document->m_Body)), 
+                            &entity);
     entity->SetContentType("text/xml; charset=\"utf-8\"");
+    if (gzip) entity->SetContentEncoding("gzip");
     return NPT_SUCCESS;
 }
 
+/*----------------------------------------------------------------------
+|   PLT_DeviceHost::DetachEventScheduler
++---------------------------------------------------------------------*/
+void
+PLT_DeviceHost::DetachEventScheduler(PLT_DeviceData* device)
+{
+    for (NPT_Cardinal i=0; i<device->m_Services.GetItemCount(); i++) {
+        device->m_Services[i]->DetachEventScheduler();
+    }
+
+    for (NPT_Cardinal i=0; i<device->m_EmbeddedDevices.GetItemCount(); i++) {
+        DetachEventScheduler(device->m_EmbeddedDevices[i].AsPointer());
+    }
+}
+
+/*----------------------------------------------------------------------
+|   PLT_DeviceHost::ComputeDocumentSignature
++---------------------------------------------------------------------*/
+NPT_UInt32
+PLT_DeviceHost::ComputeDocumentSignature(PLT_DeviceData* device, 
+                                         NPT_UInt32      signature /* = 0 */)
+{
+    // anything which ends up in the description
+    signature = PLT_HashHelper::HashInteger(device->m_ConfigId, signature);
+    signature = PLT_HashHelper::HashString(device->m_UUID, signature);
+    signature = PLT_HashHelper::HashString(device->m_DeviceType, signature);
+    signature = PLT_HashHelper::HashString(device->m_FriendlyName, signature);
+    signature = PLT_HashHelper::HashString(device->m_Manufacturer, signature);
+    signature = PLT_HashHelper::HashString(device->m_ManufacturerURL, signature);
+    signature = PLT_HashHelper::HashString(device->m_ModelDescription, signature);
+    signature = PLT_HashHelper::HashString(device->m_ModelName, signature);
+    signature = PLT_HashHelper::HashString(device->m_ModelNumber, signature);
+    signature = PLT_HashHelper::HashString(device->m_ModelURL, signature);
+    signature = PLT_HashHelper::HashString(device->m_SerialNumber, signature);
+    signature = PLT_HashHelper::HashString(device->m_UPC, signature);
+    signature = PLT_HashHelper::HashString(device->m_PresentationURL, signature);
+    signature = PLT_HashHelper::HashString(device->m_DlnaDoc, signature);
+    signature = PLT_HashHelper::HashString(device->m_DlnaCap, signature);
+    signature = PLT_HashHelper::HashString(device->m_AggregationFlags, signature);
+
+    signature = PLT_HashHelper::HashInteger(device->m_Icons.GetItemCount(), signature);
+    for (NPT_Cardinal i=0; i<device->m_Icons.GetItemCount(); i++) {
+        const PLT_DeviceIcon& icon = device->m_Icons[i];
+        signature = PLT_HashHelper::HashString(icon.m_MimeType, signature);
+        signature = PLT_HashHelper::HashInteger((NPT_UInt32)icon.m_Width, signature);
+        signature = PLT_HashHelper::HashInteger((NPT_UInt32)icon.m_Height, signature);
+        signature = PLT_HashHelper::HashInteger((NPT_UInt32)icon.m_Depth, signature);
+        signature = PLT_HashHelper::HashString(icon.m_UrlPath, signature);
+    }
+
+    signature = PLT_HashHelper::HashInteger(device->m_Services.GetItemCount(), signature);
+    for (NPT_Cardinal i=0; i<device->m_Services.GetItemCount(); i++) {
+        PLT_Service* service = device->m_Services[i];
+        signature = PLT_HashHelper::HashString(service->GetServiceType(), signature);
+        signature = PLT_HashHelper::HashString(service->GetServiceID(), signature);
+        signature = PLT_HashHelper::HashString(service->GetSCPDURL(), signature);
+        signature = PLT_HashHelper::HashString(service->GetControlURL(), signature);
+        signature = PLT_HashHelper::HashString(service->GetEventSubURL(), signature);
+    }
+
+    for (NPT_Cardinal i=0; i<device->m_EmbeddedDevices.GetItemCount(); i++) {
+        signature = ComputeDocumentSignature(device->m_EmbeddedDevices[i].AsPointer(), signature);
+    }
+
+    return signature;
+}
+
 /*----------------------------------------------------------------------
 |   PLT_DeviceHost::ProcessPostRequest
 +---------------------------------------------------------------------*/
@@ -490,11 +731,10 @@ PLT_DeviceHost::ProcessHttpPostRequest(NPT_HttpRequest&              request,
     NPT_Result                res;
     NPT_String                service_type;
     NPT_String                str;
-    NPT_XmlElementNode*       xml = NULL;
+    NPT_DataBuffer            body;
+    PLT_SoapParser*           soap = NULL;
     NPT_String                soap_action_header;
     PLT_Service*              service;
-    NPT_XmlElementNode*       soap_body;
-    NPT_XmlElementNode*       soap_action;
     PLT_ActionDesc*           action_desc;
     PLT_ActionReference       action;
     NPT_MemoryStreamReference resp(new NPT_MemoryStream);
@@ -504,10 +744,8 @@ PLT_DeviceHost::ProcessHttpPostRequest(NPT_HttpRequest&              request,
     NPT_String                protocol    = request.GetProtocol();
     NPT_List<NPT_String>      components;
     NPT_String                soap_action_name;
-
-#if defined(PLATINUM_UPNP_SPECS_STRICT)
-    const NPT_String*         attr;
-#endif
+    NPT_String                name;
+    NPT_String                value;
 
     if (NPT_FAILED(FindServiceByControlURL(url, service, true)))
         goto bad_request;
@@ -526,40 +764,33 @@ PLT_DeviceHost::ProcessHttpPostRequest(NPT_HttpRequest&              request,
     
     soap_action_name = *components.GetItem(1);
     
-    // read the xml body and parse it
-    if (NPT_FAILED(PLT_HttpHelper::ParseBody(request, xml)))
+    // read the body and walk the envelope up to the action
+    res = PLT_SoapParser::ReadBody(request, body);
+    if (res == NPT_ERROR_OUT_OF_RANGE)
+        goto too_large;
+    if (NPT_FAILED(res))
         goto bad_request;
 
-    // check envelope
-    if (xml->GetTag().Compare("Envelope", true))
+    soap = new PLT_SoapParser((const char*)body.GetData(), body.GetDataSize());
+    if (NPT_FAILED(soap->ParseEnvelope()))
         goto bad_request;
 
 #if defined(PLATINUM_UPNP_SPECS_STRICT)
     // check namespace
-    if (!xml->GetNamespace() || xml->GetNamespace()->Compare("http://schemas.xmlsoap.org/soap/envelope/"))
+    if (soap->GetEnvelopeNamespace().Compare("http://schemas.xmlsoap.org/soap/envelope/"))
         goto bad_request;
 
     // check encoding
-    attr = xml->GetAttribute("encodingStyle", "http://schemas.xmlsoap.org/soap/envelope/");
-    if (!attr || attr->Compare("http://schemas.xmlsoap.org/soap/encoding/"))
+    if (soap->GetEncodingStyle().Compare("http://schemas.xmlsoap.org/soap/encoding/"))
         goto bad_request;
 #endif
 
-    // read action
-    soap_body = PLT_XmlHelper::GetChild(xml, "Body");
-    if (soap_body == NULL)
-        goto bad_request;
-
-    PLT_XmlHelper::GetChild(soap_body, soap_action);
-    if (soap_action == NULL)
-        goto bad_request;
-
     // verify action name is identical to SOAPACTION header*/
-    if (soap_action->GetTag().Compare(soap_action_name, true))
+    if (soap->GetActionName().Compare(soap_action_name, true))
         goto bad_request;
 
     // verify namespace
-    if (!soap_action->GetNamespace() || soap_action->GetNamespace()->Compare(service->GetServiceType()))
+    if (soap->GetActionNamespace().Compare(service->GetServiceType()))
         goto bad_request;
 
     // create a buffer for our response body and call the service
@@ -573,21 +804,13 @@ PLT_DeviceHost::ProcessHttpPostRequest(NPT_HttpRequest&              request,
     action = new PLT_Action(*action_desc);
 
     // read all the arguments if any
-    for (NPT_List<NPT_XmlNode*>::Iterator args = soap_action->GetChildren().GetFirstItem(); 
-		 args; 
-		 args++) {
-        NPT_XmlElementNode* child = (*args)->AsElementNode();
-        if (!child) continue;
-
+    while (NPT_SUCCEEDED(res = soap->GetNextArgument(name, value))) {
         // Total HACK for xbox360 upnp uncompliance!
-        NPT_String name = child->GetTag();
         if (action_desc->GetName() == "Browse" && name == "ContainerID") {
             name = "ObjectID";
         }
 
-        res = action->SetArgumentValue(
-            name,
-            child->GetText()?*child->GetText():"");
+        res = action->SetArgumentValue(name, value);
 
 		// test if value was correct
 		if (res == NPT_ERROR_INVALID_PARAMETERS) {
@@ -596,6 +819,12 @@ PLT_DeviceHost::ProcessHttpPostRequest(NPT_HttpRequest&              request,
 		}
     }
 
+    // malformed arguments
+    if (res != NPT_ERROR_NO_SUCH_ITEM && NPT_FAILED(res)) {
+        action->SetError(402, "Invalid or Missing Args");
+        goto error;
+    }
+
 	// verify all required arguments were passed
     if (NPT_FAILED(action->VerifyArguments(true))) {
         action->SetError(402, "Invalid or Missing Args");
@@ -611,7 +840,8 @@ PLT_DeviceHost::ProcessHttpPostRequest(NPT_HttpRequest&              request,
         goto error;
     }
 
-    // create the soap response now
+    // create the soap response now, sized up front so it's written in one pass
+    resp = new NPT_MemoryStream(action->GetSoapResponseSize());
     action->FormatSoapResponse(*resp);
     goto done;
 
@@ -642,13 +872,19 @@ done:
         response.GetHeaders().SetHeader("Ext", ""); // should only be for M-POST but oh well
     }    
     
-    delete xml;
+    delete soap;
     return NPT_SUCCESS;
 
 bad_request:
-    delete xml;
+    delete soap;
     response.SetStatus(500, "Bad Request");
     return NPT_SUCCESS;
+
+too_large:
+    // the rest of the body is still in the connection
+    response.SetStatus(413, "Request Entity Too Large");
+    response.GetHeaders().SetHeader(NPT_HTTP_HEADER_CONNECTION, "close");
+    return NPT_SUCCESS;
 }
 
 /*----------------------------------------------------------------------
@@ -706,7 +942,8 @@ PLT_DeviceHost::ProcessHttpSubscriberRequest(NPT_HttpRequest&              reque
             NPT_Int32 timeout = *PLT_Constants::GetInstance().GetDefaultSubscribeLease().AsPointer();
 
             // send the info to the service
-            service->ProcessNewSubscription(m_TaskManager,
+            service->ProcessNewSubscription(m_EventDispatcher,
+                                            m_EventScheduler,
                                             context.GetLocalAddress(), 
                                             *callback_urls, 
                                             timeout, 
@@ -781,8 +1018,12 @@ PLT_DeviceHost::OnSsdpPacket(const NPT_HttpRequest&        request,
         NPT_UInt32 mx;
         NPT_CHECK_SEVERE(PLT_UPnPMessageHelper::GetMX(request, mx));
 
-        // create a task to respond to the request
+        // queue the response with our responder task
         NPT_TimeInterval timer((mx==0)?0.:(double)(NPT_System::GetRandomInteger()%(mx>5?5:mx)));
+        if (m_SsdpResponder) {
+            return m_SsdpResponder->Respond(context.GetRemoteAddress(), *st, timer);
+        }
+
         PLT_SsdpDeviceSearchResponseTask* task = new PLT_SsdpDeviceSearchResponseTask(this, context.GetRemoteAddress(), *st);
         m_TaskManager->StartTask(task, &timer);
         return NPT_SUCCESS;
@@ -49,12 +49,29 @@
 #include "PltAction.h"
 #include "PltHttp.h"
 #include "PltHttpServer.h"
+#include "PltEvent.h"
 
 /*----------------------------------------------------------------------
 |   forward declarations
 +---------------------------------------------------------------------*/
-class PLT_SsdpDeviceAnnounceTask;
+class PLT_SsdpAnnounceScheduler;
 class PLT_SsdpListenTask;
+class PLT_ServiceEventScheduler;
+
+/*----------------------------------------------------------------------
+|   PLT_DeviceHostDocument struct
++---------------------------------------------------------------------*/
+/**
+ A description or SCPD document serialized once by a PLT_DeviceHost and 
+ served as is until the device changes. Responses read the bodies directly.
+ */
+struct PLT_DeviceHostDocument {
+    NPT_String                m_ETag;
+    PLT_SharedBufferReference m_Body;
+    PLT_SharedBufferReference m_GzipBody; // null when not smaller
+};
+
+typedef NPT_Reference<PLT_DeviceHostDocument> PLT_DeviceHostDocumentReference;
 
 /*----------------------------------------------------------------------
 |   PLT_DeviceHost class
@@ -102,6 +119,15 @@ public:
      be sent first or not.
      */
     virtual void SetByeByeFirst(bool bye_bye_first) { m_ByeByeFirst = bye_bye_first; }
+
+    /**
+     SSDP announcement packets are formatted up front and sent as a burst. DLNA
+     recommends spacing them out instead, which can be enabled here. It is on 
+     by default when PLATINUM_UPNP_SPECS_STRICT is defined.
+     @param pacing Boolean to indicate that packets should be sent 
+     PLT_DLNA_SSDP_DELAY apart.
+     */
+    virtual void SetSsdpPacing(bool pacing) { m_SsdpPacing = pacing; }
     
     /**
      Returns the port used by the internal HTTP server for all incoming requests.
@@ -133,11 +159,13 @@ protected:
      @param request the SSDP pre formatted request
      @param socket the network socket to use to send the request
      @param type PLT_SsdpAnnounceType enum if the announce is a SSDP bye-bye, update or alive.
+     @param pacing delay between packets, bye-bye packets are never delayed
      */
     static NPT_Result Announce(PLT_DeviceData*      device,
                                NPT_HttpRequest&     request,
                                NPT_UdpSocket&       socket,
-                               PLT_SsdpAnnounceType type);
+                               PLT_SsdpAnnounceType type,
+                               NPT_TimeInterval     pacing = NPT_TimeInterval(0.));
     /**
      Called during SSDP announce. The HTTP request is already configured with
      the right method and host.
@@ -147,9 +175,19 @@ protected:
      */
     NPT_Result Announce(NPT_HttpRequest&     request,
                         NPT_UdpSocket&       socket,
-                        PLT_SsdpAnnounceType type) {
-        return Announce(this, request, socket, type);
-    }
+                        PLT_SsdpAnnounceType type);
+
+    /**
+     Format all the SSDP packets announcing a device and its embedded devices.
+     @param device the device to announce
+     @param request the SSDP pre formatted request
+     @param type PLT_SsdpAnnounceType enum if the announce is a SSDP bye-bye, update or alive.
+     @param batch the batch to add the packets to
+     */
+    static NPT_Result FormatAnnounce(PLT_DeviceData*      device,
+                                     NPT_HttpRequest&     request,
+                                     PLT_SsdpAnnounceType type,
+                                     PLT_SsdpBatch&       batch);
 
     /**
      PLT_SsdpPacketListener method called when a M-SEARCH SSDP packet is received.
@@ -282,6 +320,13 @@ protected:
                                       NPT_HttpRequest&              request,
                                       const NPT_HttpRequestContext& context,
                                       NPT_HttpResponse&             response);
+
+    /**
+     Discard all cached description and SCPD documents. Derived classes must call
+     this when they change their description in a way not reflected by the device
+     properties, for example by overriding GetDescription or OnAddExtraInfo.
+     */
+    void InvalidateDocuments();
     
     /**
      This method is called when a "GET" request for a resource other than the device
@@ -326,14 +371,36 @@ protected:
     friend class PLT_SsdpDeviceSearchResponseInterfaceIterator;
     friend class PLT_SsdpDeviceSearchResponseTask;
     friend class PLT_SsdpAnnounceInterfaceIterator;
+    friend class PLT_SsdpSearchResponderTask;
+    friend class PLT_SsdpAnnounceScheduler;
 
     PLT_TaskManagerReference m_TaskManager;
     PLT_HttpServerReference  m_HttpServer;
+    PLT_SsdpSearchResponderTask* m_SsdpResponder;
+    PLT_ServiceEventScheduler*   m_EventScheduler;
+    PLT_EventDispatcherReference m_EventDispatcher;
     bool                     m_ExtraBroascast;
     NPT_UInt16               m_Port;
     bool                     m_PortRebind;
     bool                     m_ByeByeFirst;
+    bool                     m_SsdpPacing;
     bool                     m_Started;
+
+private:
+    NPT_Result FindDocument(const NPT_String&                key,
+                            PLT_DeviceHostDocumentReference& document);
+    NPT_Result AddDocument(const NPT_String&                key,
+                           const NPT_String&                xml,
+                           PLT_DeviceHostDocumentReference& document);
+    static NPT_Result ServeDocument(const NPT_HttpRequest&           request,
+                                    PLT_DeviceHostDocumentReference& document,
+                                    NPT_HttpResponse&                response);
+    static void       DetachEventScheduler(PLT_DeviceData* device);
+    static NPT_UInt32 ComputeDocumentSignature(PLT_DeviceData* device, 
+                                               NPT_UInt32      signature = 0);
+
+    NPT_Mutex                                                m_DocumentsLock;
+    NPT_Map<NPT_String, PLT_DeviceHostDocumentReference>     m_Documents;
 };
 
 typedef NPT_Reference<PLT_DeviceHost> PLT_DeviceHostReference;
@@ -42,6 +42,7 @@
 #include "PltDeviceData.h"
 #include "PltUtilities.h"
 #include "PltCtrlPointTask.h"
+#include "PltConstants.h"
 
 NPT_SET_LOCAL_LOGGER("platinum.core.event")
 
@@ -101,14 +102,14 @@ bad_request:
 /*----------------------------------------------------------------------
 |   PLT_EventSubscriber::PLT_EventSubscriber
 +---------------------------------------------------------------------*/
-PLT_EventSubscriber::PLT_EventSubscriber(PLT_TaskManagerReference task_manager,
-                                         PLT_Service*             service,
-                                         const char*              sid,
-                                         NPT_Timeout              timeout_secs /* = -1 */) : 
-    m_TaskManager(task_manager), 
+PLT_EventSubscriber::PLT_EventSubscriber(PLT_EventDispatcherReference dispatcher,
+                                         PLT_Service*                 service,
+                                         const char*                  sid,
+                                         NPT_Timeout                  timeout_secs /* = -1 */) : 
+    m_Dispatcher(dispatcher), 
+    m_Queue(new PLT_EventDeliveryQueue()),
     m_Service(service), 
     m_EventKey(0),
-    m_SubscriberTask(NULL),
     m_SID(sid)
 {
     NPT_LOG_FINE_1("Creating new subscriber (%s)", m_SID.GetChars());
@@ -121,10 +122,9 @@ PLT_EventSubscriber::PLT_EventSubscriber(PLT_TaskManagerReference task_manager,
 PLT_EventSubscriber::~PLT_EventSubscriber() 
 {
     NPT_LOG_FINE_1("Deleting subscriber (%s)", m_SID.GetChars());
-    if (m_SubscriberTask) {
-        m_SubscriberTask->Kill();
-        m_SubscriberTask = NULL;
-    }
+    // drop notifications not sent yet, a worker may still be
+    // sending the current one and will release the queue after
+    if (!m_Dispatcher.IsNull()) m_Dispatcher->Cancel(m_Queue);
 }
 
 /*----------------------------------------------------------------------
@@ -230,10 +230,11 @@ PLT_EventSubscriber::AddCallbackURL(const char* callback_url)
 }
 
 /*----------------------------------------------------------------------
-|   PLT_EventSubscriber::Notify
+|   PLT_EventSubscriber::FormatBody
 +---------------------------------------------------------------------*/
 NPT_Result
-PLT_EventSubscriber::Notify(NPT_List<PLT_StateVariable*>& vars)
+PLT_EventSubscriber::FormatBody(NPT_List<PLT_StateVariable*>& vars,
+                                PLT_SharedBufferReference&    body)
 {
     // verify we have eventable variables
     bool foundVars = false;
@@ -267,57 +268,384 @@ PLT_EventSubscriber::Notify(NPT_List<PLT_StateVariable*>& vars)
     }
     propertyset = NULL;
 
-    // parse the callback url
-    NPT_HttpUrl url(m_CallbackURLs[0]);
-    if (!url.IsValid()) {
-        NPT_CHECK_FATAL(NPT_FAILURE);
+    // the buffer is never modified after this point
+    body = new NPT_DataBuffer(xml.GetChars(), xml.GetLength());
+    return NPT_SUCCESS;
+}
+
+/*----------------------------------------------------------------------
+|   PLT_EventSubscriber::Notify
++---------------------------------------------------------------------*/
+NPT_Result
+PLT_EventSubscriber::Notify(NPT_List<PLT_StateVariable*>& vars)
+{
+    PLT_SharedBufferReference body;
+    NPT_CHECK(FormatBody(vars, body));
+
+    return Notify(body);
+}
+
+/*----------------------------------------------------------------------
+|   PLT_EventSubscriber::Notify
++---------------------------------------------------------------------*/
+NPT_Result
+PLT_EventSubscriber::Notify(const PLT_SharedBufferReference& body)
+{
+    if (body.IsNull()) return NPT_ERROR_INVALID_PARAMETERS;
+
+    if (m_Dispatcher.IsNull() || m_CallbackURLs.GetItemCount() == 0) {
+        NPT_CHECK_SEVERE(NPT_ERROR_INVALID_STATE);
     }
-    // format request
-    NPT_HttpRequest* request = 
-        new NPT_HttpRequest(url,
-                            "NOTIFY",
-                            NPT_HTTP_PROTOCOL_1_1);
-    NPT_HttpEntity* entity;
-    PLT_HttpHelper::SetBody(*request, xml, &entity);
-
-    // add the extra headers
-    entity->SetContentType("text/xml; charset=\"utf-8\"");
-    PLT_UPnPMessageHelper::SetNT(*request, "upnp:event");
-    PLT_UPnPMessageHelper::SetNTS(*request, "upnp:propchange");
-    PLT_UPnPMessageHelper::SetSID(*request, m_SID);
-    PLT_UPnPMessageHelper::SetSeq(*request, m_EventKey);
+
+    PLT_EventDelivery delivery;
+    delivery.m_CallbackURL = m_CallbackURLs[0];
+    delivery.m_SID         = m_SID;
+    delivery.m_EventKey    = m_EventKey;
+    delivery.m_Body        = body;
+
+    // the dispatcher refuses it if the subscriber is failing
+    NPT_CHECK_WARNING(m_Dispatcher->Enqueue(m_Queue, delivery));
 
     // wrap around sequence to 1
     if (++m_EventKey == 0) m_EventKey = 1;
+     
+    return NPT_SUCCESS;
+}
+
+/*----------------------------------------------------------------------
+|   PLT_EventSubscriber::HasFailed
++---------------------------------------------------------------------*/
+bool
+PLT_EventSubscriber::HasFailed()
+{
+    return m_Dispatcher.IsNull()?false:m_Dispatcher->HasFailed(m_Queue);
+}
+
+/*----------------------------------------------------------------------
+|   PLT_EventDispatcher::PLT_EventDispatcher
++---------------------------------------------------------------------*/
+PLT_EventDispatcher::PLT_EventDispatcher(NPT_Cardinal max_pending /* = PLT_EVENT_DISPATCHER_MAX_PENDING */) :
+    m_Wakeup(0),
+    m_MaxPending(max_pending),
+    m_Aborted(false)
+{
+}
+
+/*----------------------------------------------------------------------
+|   PLT_EventDispatcher::Start
++---------------------------------------------------------------------*/
+NPT_Result
+PLT_EventDispatcher::Start(PLT_TaskManager* task_manager, 
+                           NPT_Cardinal     workers /* = PLT_EVENT_DISPATCHER_WORKERS */)
+{
+    NPT_CHECK_POINTER_FATAL(task_manager);
+
+    for (NPT_Cardinal i=0; i<workers; i++) {
+        NPT_CHECK_SEVERE(task_manager->StartTask(new PLT_EventDispatcherTask(this)));
+    }
+
+    return NPT_SUCCESS;
+}
+
+/*----------------------------------------------------------------------
+|   PLT_EventDispatcher::Abort
++---------------------------------------------------------------------*/
+NPT_Result
+PLT_EventDispatcher::Abort()
+{
+    NPT_AutoLock lock(m_Lock);
+
+    // never reset once aborted so all workers wake up and exit
+    m_Aborted = true;
+    m_Wakeup.SetValue(1);
+    return NPT_SUCCESS;
+}
+
+/*----------------------------------------------------------------------
+|   PLT_EventDispatcher::Enqueue
++---------------------------------------------------------------------*/
+NPT_Result
+PLT_EventDispatcher::Enqueue(PLT_EventDeliveryQueueReference& queue, 
+                             const PLT_EventDelivery&         delivery)
+{
+    NPT_AutoLock lock(m_Lock);
+
+    if (m_Aborted) return NPT_ERROR_INTERRUPTED;
+    if (queue->m_Failed || queue->m_Cancelled) return NPT_FAILURE;
+
+    // a subscriber not keeping up would hold on to bodies forever
+    if (queue->m_Pending.GetItemCount() >= m_MaxPending) {
+        NPT_LOG_WARNING_1("Too many pending notifications for subscriber %s",
+            delivery.m_SID.GetChars());
+        queue->m_Failed = true;
+        queue->m_Pending.Clear();
+        return NPT_FAILURE;
+    }
+
+    queue->m_Pending.Add(delivery);
+    if (!queue->m_Active) {
+        queue->m_Active = true;
+        m_Active.Add(queue);
+    }
+
+    m_Wakeup.SetValue(1);
+    return NPT_SUCCESS;
+}
+
+/*----------------------------------------------------------------------
+|   PLT_EventDispatcher::Cancel
++---------------------------------------------------------------------*/
+NPT_Result
+PLT_EventDispatcher::Cancel(PLT_EventDeliveryQueueReference& queue)
+{
+    NPT_AutoLock lock(m_Lock);
+
+    // queue is removed from the active list by the next worker scan
+    queue->m_Cancelled = true;
+    queue->m_Pending.Clear();
+    return NPT_SUCCESS;
+}
+
+/*----------------------------------------------------------------------
+|   PLT_EventDispatcher::HasFailed
++---------------------------------------------------------------------*/
+bool
+PLT_EventDispatcher::HasFailed(PLT_EventDeliveryQueueReference& queue)
+{
+    NPT_AutoLock lock(m_Lock);
+    return queue->m_Failed;
+}
+
+/*----------------------------------------------------------------------
+|   PLT_EventDispatcher::GetNextDelivery
++---------------------------------------------------------------------*/
+NPT_Result
+PLT_EventDispatcher::GetNextDelivery(PLT_EventDeliveryQueueReference& queue,
+                                     PLT_EventDelivery&               delivery,
+                                     NPT_Timeout&                     timeout)
+{
+    NPT_AutoLock lock(m_Lock);
+
+    if (m_Aborted) return NPT_ERROR_INTERRUPTED;
+
+    NPT_TimeStamp now;
+    NPT_System::GetCurrentTimeStamp(now);
+    timeout = NPT_TIMEOUT_INFINITE;
+
+    NPT_List<PLT_EventDeliveryQueueReference>::Iterator iter = m_Active.GetFirstItem();
+    while (iter) {
+        PLT_EventDeliveryQueueReference& candidate = *iter;
 
-    // start the task now if not started already
-    if (!m_SubscriberTask) {
-        // TODO: the subscriber task should inform subscriber if
-        // a notification failed to be received so it can be removed
-        // from the list of subscribers inside the device host
-        NPT_Reference<PLT_HttpClientSocketTask> task(new PLT_HttpClientSocketTask(request, true));
-        
-        // short connection time out in case subscriber is not alive
-        NPT_HttpClient::Config config;
-        config.m_ConnectionTimeout = 2000;
-        task->SetHttpClientConfig(config);
-        
-        // add initial delay to make sure ctrlpoint receives response to subscription
-        // before our first NOTIFY. Also make sure task is not auto-destroy
-        // since we want to destroy it manually when the subscriber goes away.
-        NPT_TimeInterval delay(0.05f);
-        NPT_CHECK_FATAL(m_TaskManager->StartTask(task.AsPointer(), NULL /*&delay*/, false));
-        
-        // Task successfully started, keep around for future notifications
-        m_SubscriberTask = task.AsPointer();
-        task.Detach();
+        // another worker is sending this subscriber's head
+        if (candidate->m_Busy) {
+            ++iter;
+            continue;
+        }
+
+        // nothing left to send
+        if (candidate->m_Pending.GetItemCount() == 0) {
+            candidate->m_Active = false;
+            m_Active.Erase(iter++);
+            continue;
+        }
+
+        // backing off after a failure
+        if (candidate->m_RetryTime > now) {
+            NPT_Timeout wait = (NPT_Timeout)(candidate->m_RetryTime - now).ToMillis() + 1;
+            if (timeout == NPT_TIMEOUT_INFINITE || wait < timeout) timeout = wait;
+            ++iter;
+            continue;
+        }
+
+        queue    = candidate;
+        delivery = *queue->m_Pending.GetFirstItem();
+        queue->m_Busy = true;
+
+        // move to the back so subscribers are served round robin
+        m_Active.Erase(iter);
+        m_Active.Add(queue);
+
+        // let another worker look at what's left
+        if (m_Active.GetItemCount() > 1) m_Wakeup.SetValue(1);
+        return NPT_SUCCESS;
+    }
+
+    m_Wakeup.SetValue(0);
+    return NPT_ERROR_NO_SUCH_ITEM;
+}
+
+/*----------------------------------------------------------------------
+|   PLT_EventDispatcher::ReportDelivery
++---------------------------------------------------------------------*/
+NPT_Result
+PLT_EventDispatcher::ReportDelivery(PLT_EventDeliveryQueueReference& queue, 
+                                    NPT_Result                       result,
+                                    bool                             permanent)
+{
+    NPT_AutoLock lock(m_Lock);
+
+    queue->m_Busy = false;
+
+    // queue was emptied while we were sending
+    if (queue->m_Cancelled || queue->m_Failed) goto done;
+
+    if (NPT_SUCCEEDED(result)) {
+        queue->m_Pending.Erase(queue->m_Pending.GetFirstItem());
+        queue->m_Attempts = 0;
+    } else if (permanent || ++queue->m_Attempts >= PLT_EVENT_DISPATCHER_MAX_ATTEMPTS) {
+        NPT_LOG_WARNING_2("Giving up notifying subscriber %s (%d)",
+            (*queue->m_Pending.GetFirstItem()).m_SID.GetChars(),
+            result);
+        queue->m_Failed = true;
+        queue->m_Pending.Clear();
     } else {
-        m_SubscriberTask->AddRequest(request);
+        // retry in 1, 2, 4... seconds
+        NPT_Cardinal backoff = 1 << (queue->m_Attempts-1);
+        if (backoff > PLT_EVENT_DISPATCHER_MAX_BACKOFF) backoff = PLT_EVENT_DISPATCHER_MAX_BACKOFF;
+
+        NPT_System::GetCurrentTimeStamp(queue->m_RetryTime);
+        queue->m_RetryTime += NPT_TimeInterval((double)backoff);
     }
-     
+
+done:
+    m_Wakeup.SetValue(1);
     return NPT_SUCCESS;
 }
 
+/*----------------------------------------------------------------------
+|   PLT_EventDispatcher::WaitForDelivery
++---------------------------------------------------------------------*/
+NPT_Result
+PLT_EventDispatcher::WaitForDelivery(NPT_Timeout timeout)
+{
+    return m_Wakeup.WaitUntilEquals(1, timeout);
+}
+
+/*----------------------------------------------------------------------
+|   PLT_EventDispatcherTask::PLT_EventDispatcherTask
++---------------------------------------------------------------------*/
+PLT_EventDispatcherTask::PLT_EventDispatcherTask(PLT_EventDispatcher* dispatcher) :
+    m_Dispatcher(dispatcher)
+{
+    m_Client.SetUserAgent(*PLT_Constants::GetInstance().GetDefaultUserAgent());
+
+    // short timeouts in case subscriber is not alive, a
+    // slow subscriber would otherwise hold a worker for everyone
+    NPT_HttpClient::Config config;
+    config.m_ConnectionTimeout = 2000;
+    config.m_IoTimeout         = 10000;
+    m_Client.SetConfig(config);
+}
+
+/*----------------------------------------------------------------------
+|   PLT_EventDispatcherTask::DoAbort
++---------------------------------------------------------------------*/
+void
+PLT_EventDispatcherTask::DoAbort()
+{
+    m_Dispatcher->Abort();
+    m_Client.Abort();
+}
+
+/*----------------------------------------------------------------------
+|   PLT_EventDispatcherTask::DoRun
++---------------------------------------------------------------------*/
+void
+PLT_EventDispatcherTask::DoRun()
+{
+    NPT_TimeStamp watchdog;
+    NPT_System::GetCurrentTimeStamp(watchdog);
+
+    while (!IsAborting(0)) {
+        PLT_EventDeliveryQueueReference queue;
+        PLT_EventDelivery               delivery;
+        NPT_Timeout                     timeout;
+
+        NPT_Result res = m_Dispatcher->GetNextDelivery(queue, delivery, timeout);
+        if (res == NPT_ERROR_INTERRUPTED) break;
+
+        if (NPT_SUCCEEDED(res)) {
+            bool permanent = false;
+            res = Deliver(delivery, permanent);
+            m_Dispatcher->ReportDelivery(queue, res, permanent);
+        } else {
+            // wake up at least every 60 secs for the watchdog
+            if (timeout == NPT_TIMEOUT_INFINITE || timeout > 60000) timeout = 60000;
+            m_Dispatcher->WaitForDelivery(timeout);
+        }
+
+        // DLNA requires that we abort unanswered/unused sockets after 60 secs
+        NPT_TimeStamp now;
+        NPT_System::GetCurrentTimeStamp(now);
+        if (now > watchdog + NPT_TimeInterval(60.)) {
+            NPT_HttpConnectionManager::GetInstance()->Recycle(NULL);
+            watchdog = now;
+        }
+    }
+}
+
+/*----------------------------------------------------------------------
+|   PLT_EventDispatcherTask::Deliver
++---------------------------------------------------------------------*/
+NPT_Result
+PLT_EventDispatcherTask::Deliver(const PLT_EventDelivery& delivery, bool& permanent)
+{
+    NPT_HttpResponse*      response = NULL;
+    NPT_HttpRequestContext context;
+    NPT_HttpEntity*        entity;
+    NPT_Result             res;
+
+    // parse the callback url
+    NPT_HttpUrl url(delivery.m_CallbackURL);
+    if (!url.IsValid()) {
+        permanent = true;
+        NPT_CHECK_SEVERE(NPT_ERROR_INVALID_SYNTAX);
+    }
+
+    // format request, only SID and SEQ differ between subscribers
+    NPT_HttpRequest request(url, "NOTIFY", NPT_HTTP_PROTOCOL_1_1);
+    PLT_HttpHelper::SetBody(request, 
+                            NPT_InputStreamReference(new PLT_SharedBufferInputStream(delivery.m_Body)), 
+                            &entity);
+    entity->SetContentType("text/xml; charset=\"utf-8\"");
+    PLT_UPnPMessageHelper::SetNT(request, "upnp:event");
+    PLT_UPnPMessageHelper::SetNTS(request, "upnp:propchange");
+    PLT_UPnPMessageHelper::SetSID(request, delivery.m_SID);
+    PLT_UPnPMessageHelper::SetSeq(request, delivery.m_EventKey);
+
+    // send request
+    res = m_Client.SendRequest(request, response, &context);
+    NPT_String prefix = NPT_String::Format("PLT_EventDispatcherTask::Deliver (res = %d):", res);
+    PLT_LOG_HTTP_RESPONSE(NPT_LOG_LEVEL_FINER, prefix, response);
+    NPT_CHECK_LABEL_WARNING(res, done);
+    if (response == NULL) {
+        res = NPT_FAILURE;
+        goto done;
+    }
+
+    // read the body so the connection can be reused
+    {
+        NPT_InputStreamReference body;
+        entity = response->GetEntity();
+        if (entity && NPT_SUCCEEDED(entity->GetInputStream(body)) && !body.IsNull()) {
+            NPT_NullOutputStream output;
+            NPT_StreamToStreamCopy(*body, output, 0, entity->GetContentLength());
+        }
+    }
+
+    // subscriber doesn't know about this SID anymore
+    if (response->GetStatusCode() == 412) {
+        permanent = true;
+        res = NPT_FAILURE;
+    } else if (response->GetStatusCode() < 200 || response->GetStatusCode() >= 300) {
+        res = NPT_FAILURE;
+    }
+
+done:
+    delete response;
+    return res;
+}
+
 /*----------------------------------------------------------------------
 |   PLT_EventSubscriberFinderByService::operator()
 +---------------------------------------------------------------------*/
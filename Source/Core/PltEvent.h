@@ -43,7 +43,9 @@
 |   includes
 +---------------------------------------------------------------------*/
 #include "Neptune.h"
+#include "PltHttp.h"
 #include "PltHttpClientTask.h"
+#include "PltThreadTask.h"
 
 /*----------------------------------------------------------------------
 |   forward declarations
@@ -54,6 +56,14 @@ class PLT_Service;
 class PLT_TaskManager;
 class PLT_CtrlPoint;
 
+/*----------------------------------------------------------------------
+|   constants
++---------------------------------------------------------------------*/
+#define PLT_EVENT_DISPATCHER_WORKERS      3
+#define PLT_EVENT_DISPATCHER_MAX_PENDING  32  // per subscriber
+#define PLT_EVENT_DISPATCHER_MAX_ATTEMPTS 4   // per notification
+#define PLT_EVENT_DISPATCHER_MAX_BACKOFF  8   // seconds
+
 /*----------------------------------------------------------------------
 |   PLT_EventNotification class
 +---------------------------------------------------------------------*/
@@ -81,6 +91,130 @@ protected:
     PLT_EventNotification() : m_EventKey(0) {}
 };
 
+/*----------------------------------------------------------------------
+|   PLT_EventDelivery
++---------------------------------------------------------------------*/
+/**
+ The PLT_EventDelivery struct holds what is needed to send one NOTIFY to a
+ subscriber. The body is shared by all subscribers notified in the same cycle.
+ */
+struct PLT_EventDelivery
+{
+    NPT_String                m_CallbackURL;
+    NPT_String                m_SID;
+    NPT_Ordinal               m_EventKey;
+    PLT_SharedBufferReference m_Body;
+};
+
+/*----------------------------------------------------------------------
+|   PLT_EventDeliveryQueue class
++---------------------------------------------------------------------*/
+/**
+ The PLT_EventDeliveryQueue class holds the ordered list of notifications not
+ yet delivered to a subscriber. It is only accessed by the PLT_EventDispatcher
+ it was queued with, under its lock.
+ */
+class PLT_EventDeliveryQueue
+{
+public:
+    PLT_EventDeliveryQueue() : 
+        m_Active(false), m_Busy(false), m_Failed(false), m_Cancelled(false), m_Attempts(0) {}
+
+private:
+    friend class PLT_EventDispatcher;
+
+    // members
+    NPT_List<PLT_EventDelivery> m_Pending;
+    bool                        m_Active;    // in the dispatcher active list
+    bool                        m_Busy;      // head is being sent by a worker
+    bool                        m_Failed;    // gave up delivering
+    bool                        m_Cancelled; // subscriber went away
+    NPT_Cardinal                m_Attempts;
+    NPT_TimeStamp               m_RetryTime;
+};
+
+typedef NPT_Reference<PLT_EventDeliveryQueue> PLT_EventDeliveryQueueReference;
+
+/*----------------------------------------------------------------------
+|   PLT_EventDispatcher class
++---------------------------------------------------------------------*/
+/**
+ The PLT_EventDispatcher class delivers the NOTIFY requests of all the
+ subscribers of a PLT_DeviceHost with a small pool of worker tasks. Persistent
+ connections to each callback host are reused through the HTTP connection
+ manager. Notifications to a given subscriber are sent in order, one at a time,
+ and a failed delivery is retried with an increasing delay before the 
+ subscriber is marked as failed so its service can drop it.
+ */
+class PLT_EventDispatcher
+{
+public:
+    PLT_EventDispatcher(NPT_Cardinal max_pending = PLT_EVENT_DISPATCHER_MAX_PENDING);
+    ~PLT_EventDispatcher() {}
+
+    /**
+     Start the worker tasks. The dispatcher must outlive the task manager
+     tasks, so the owner must abort the task manager before releasing it.
+     */
+    NPT_Result Start(PLT_TaskManager* task_manager, 
+                     NPT_Cardinal     workers = PLT_EVENT_DISPATCHER_WORKERS);
+    NPT_Result Abort();
+
+    NPT_Result Enqueue(PLT_EventDeliveryQueueReference& queue, 
+                       const PLT_EventDelivery&         delivery);
+    NPT_Result Cancel(PLT_EventDeliveryQueueReference& queue);
+    bool       HasFailed(PLT_EventDeliveryQueueReference& queue);
+
+private:
+    friend class PLT_EventDispatcherTask;
+
+    // methods called by the worker tasks
+    NPT_Result GetNextDelivery(PLT_EventDeliveryQueueReference& queue,
+                               PLT_EventDelivery&               delivery,
+                               NPT_Timeout&                     timeout);
+    NPT_Result ReportDelivery(PLT_EventDeliveryQueueReference& queue, 
+                              NPT_Result                       result,
+                              bool                             permanent);
+    NPT_Result WaitForDelivery(NPT_Timeout timeout);
+
+    // members
+    NPT_Mutex                                 m_Lock;
+    NPT_SharedVariable                        m_Wakeup;
+    NPT_List<PLT_EventDeliveryQueueReference> m_Active;
+    NPT_Cardinal                              m_MaxPending;
+    bool                                      m_Aborted;
+};
+
+typedef NPT_Reference<PLT_EventDispatcher> PLT_EventDispatcherReference;
+
+/*----------------------------------------------------------------------
+|   PLT_EventDispatcherTask class
++---------------------------------------------------------------------*/
+/**
+ The PLT_EventDispatcherTask class is a worker sending the NOTIFY requests
+ queued with a PLT_EventDispatcher.
+ */
+class PLT_EventDispatcherTask : public PLT_ThreadTask
+{
+public:
+    PLT_EventDispatcherTask(PLT_EventDispatcher* dispatcher);
+
+protected:
+    virtual ~PLT_EventDispatcherTask() {}
+
+    // PLT_ThreadTask methods
+    virtual void DoAbort();
+    virtual void DoRun();
+    virtual bool IsLongRunning() { return true; }
+
+private:
+    NPT_Result Deliver(const PLT_EventDelivery& delivery, bool& permanent);
+
+    // members
+    PLT_EventDispatcher* m_Dispatcher;
+    NPT_HttpClient       m_Client;
+};
+
 /*----------------------------------------------------------------------
 |   PLT_EventSubscriber class
 +---------------------------------------------------------------------*/
@@ -91,10 +225,10 @@ protected:
 class PLT_EventSubscriber
 {
 public:
-    PLT_EventSubscriber(PLT_TaskManagerReference task_manager,
-                        PLT_Service*             service,
-                        const char*              sid,
-                        NPT_Timeout              timeout_secs = -1);
+    PLT_EventSubscriber(PLT_EventDispatcherReference dispatcher,
+                        PLT_Service*                 service,
+                        const char*                  sid,
+                        NPT_Timeout                  timeout_secs = -1);
     ~PLT_EventSubscriber();
 
     PLT_Service*      GetService();
@@ -108,17 +242,23 @@ public:
     NPT_Result        FindCallbackURL(const char* callback_url);
     NPT_Result        AddCallbackURL(const char* callback_url);
     NPT_Result        Notify(NPT_List<PLT_StateVariable*>& vars);
+    NPT_Result        Notify(const PLT_SharedBufferReference& body);
+    bool              HasFailed();
+
+    // formats the propertyset body once so it can be shared by all subscribers
+    static NPT_Result FormatBody(NPT_List<PLT_StateVariable*>& vars,
+                                 PLT_SharedBufferReference&    body);
     
 protected:
     //members
-    PLT_TaskManagerReference  m_TaskManager;
-    PLT_Service*              m_Service;
-    NPT_Ordinal               m_EventKey;
-    PLT_HttpClientSocketTask* m_SubscriberTask;
-    NPT_String                m_SID;
-    NPT_SocketAddress         m_LocalIf;
-    NPT_Array<NPT_String>     m_CallbackURLs;
-    NPT_TimeStamp             m_ExpirationTime;
+    PLT_EventDispatcherReference    m_Dispatcher;
+    PLT_EventDeliveryQueueReference m_Queue;
+    PLT_Service*                    m_Service;
+    NPT_Ordinal                     m_EventKey;
+    NPT_String                      m_SID;
+    NPT_SocketAddress               m_LocalIf;
+    NPT_Array<NPT_String>           m_CallbackURLs;
+    NPT_TimeStamp                   m_ExpirationTime;
 };
 
 typedef NPT_Reference<PLT_EventSubscriber> PLT_EventSubscriberReference;
@@ -0,0 +1,395 @@
+/*****************************************************************
+|
+|   Platinum - File Cache
+|
+| Copyright (c) 2004-2010, Plutinosoft, LLC.
+| All rights reserved.
+| http://www.plutinosoft.com
+|
+| This program is free software; you can redistribute it and/or
+| modify it under the terms of the GNU General Public License
+| as published by the Free Software Foundation; either version 2
+| of the License, or (at your option) any later version.
+|
+| OEMs, ISVs, VARs and other distributors that combine and 
+| distribute commercially licensed software with Platinum software
+| and do not wish to distribute the source code for the commercially
+| licensed software under version 2, or (at your option) any later
+| version, of the GNU General Public License (the "GPL") must enter
+| into a commercial license agreement with Plutinosoft, LLC.
+| licensing@plutinosoft.com
+|  
+| This program is distributed in the hope that it will be useful,
+| but WITHOUT ANY WARRANTY; without even the implied warranty of
+| MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+| GNU General Public License for more details.
+|
+| You should have received a copy of the GNU General Public License
+| along with this program; see the file LICENSE.txt. If not, write to
+| the Free Software Foundation, Inc., 
+| 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+| http://www.gnu.org/licenses/gpl-2.0.html
+|
+****************************************************************/
+
+
+/*----------------------------------------------------------------------
+|   includes
++---------------------------------------------------------------------*/
+#include "PltFileCache.h"
+
+NPT_SET_LOCAL_LOGGER("platinum.core.filecache")
+
+/*----------------------------------------------------------------------
+|   globals
++---------------------------------------------------------------------*/
+static PLT_FileCache FileCache;
+
+/*----------------------------------------------------------------------
+|   PLT_CachedFile::PLT_CachedFile
++---------------------------------------------------------------------*/
+PLT_CachedFile::PLT_CachedFile(const char* path, const NPT_FileInfo& info) :
+    m_Path(path),
+    m_Info(info),
+    m_LoadedBlocks(0),
+    m_Readers(0),
+    m_Cached(true)
+{
+    m_Blocks.Resize((NPT_Cardinal)((info.m_Size + PLT_FILE_CACHE_BLOCK_SIZE - 1) / PLT_FILE_CACHE_BLOCK_SIZE));
+}
+
+/*----------------------------------------------------------------------
+|   PLT_FileCache::GetInstance
++---------------------------------------------------------------------*/
+PLT_FileCache&
+PLT_FileCache::GetInstance()
+{
+    return FileCache;
+}
+
+/*----------------------------------------------------------------------
+|   PLT_FileCache::PLT_FileCache
++---------------------------------------------------------------------*/
+PLT_FileCache::PLT_FileCache() :
+    m_MaxSize(0),
+    m_Size(0)
+{
+}
+
+/*----------------------------------------------------------------------
+|   PLT_FileCache::~PLT_FileCache
++---------------------------------------------------------------------*/
+PLT_FileCache::~PLT_FileCache()
+{
+    NPT_AutoLock lock(m_Lock);
+    Clear();
+}
+
+/*----------------------------------------------------------------------
+|   PLT_FileCache::SetMaxSize
++---------------------------------------------------------------------*/
+NPT_Result
+PLT_FileCache::SetMaxSize(NPT_LargeSize max_size)
+{
+    NPT_AutoLock lock(m_Lock);
+
+    m_MaxSize = max_size;
+    if (m_MaxSize == 0) {
+        Clear();
+    } else {
+        Evict();
+    }
+
+    return NPT_SUCCESS;
+}
+
+/*----------------------------------------------------------------------
+|   PLT_FileCache::GetInputStream
++---------------------------------------------------------------------*/
+NPT_Result
+PLT_FileCache::GetInputStream(const char*               path, 
+                              const NPT_FileInfo&       info,
+                              NPT_InputStreamReference& stream)
+{
+    NPT_AutoLock lock(m_Lock);
+
+    if (m_MaxSize == 0) return NPT_ERROR_INVALID_STATE;
+
+    PLT_CachedFileReference file;
+    NPT_List<PLT_CachedFileReference>::Iterator iter = m_Files.GetFirstItem();
+    while (iter) {
+        if ((*iter)->m_Path == path) {
+            // drop what we have if the file changed on disk
+            if ((*iter)->m_Info.m_Size != info.m_Size ||
+                (*iter)->m_Info.m_ModificationTime != info.m_ModificationTime) {
+                NPT_LOG_FINE_1("File %s changed, dropping cached blocks", path);
+                Forget(**iter);
+                m_Files.Erase(iter);
+            } else {
+                file = *iter;
+            }
+            break;
+        }
+        ++iter;
+    }
+
+    if (file.IsNull()) {
+        file = new PLT_CachedFile(path, info);
+
+        // open it now so missing files are reported before any header is sent
+        NPT_File input(path);
+        NPT_CHECK_WARNING(input.Open(NPT_FILE_OPEN_MODE_READ));
+        NPT_CHECK_WARNING(input.GetInputStream(file->m_Stream));
+
+        m_Files.Add(file);
+    }
+
+    ++file->m_Readers;
+    stream = new PLT_CachedFileInputStream(*this, file);
+    return NPT_SUCCESS;
+}
+
+/*----------------------------------------------------------------------
+|   PLT_FileCache::ReleaseFile
++---------------------------------------------------------------------*/
+NPT_Result
+PLT_FileCache::ReleaseFile(PLT_CachedFileReference& file)
+{
+    NPT_AutoLock lock(m_Lock);
+
+    if (file->m_Readers) --file->m_Readers;
+
+    // nothing worth keeping an entry around for
+    if (file->m_Cached && file->m_Readers == 0 && file->m_LoadedBlocks == 0) {
+        RemoveFile(*file);
+    }
+
+    return NPT_SUCCESS;
+}
+
+/*----------------------------------------------------------------------
+|   PLT_FileCache::GetBlock
++---------------------------------------------------------------------*/
+NPT_Result
+PLT_FileCache::GetBlock(PLT_CachedFileReference&   file, 
+                        NPT_Ordinal                index,
+                        PLT_SharedBufferReference& block)
+{
+    if (index >= file->m_Blocks.GetItemCount()) return NPT_ERROR_OUT_OF_RANGE;
+
+    // fast path, block already in memory
+    {
+        NPT_AutoLock lock(m_Lock);
+        PLT_CachedFile::Block& cached = file->m_Blocks[index];
+        if (!cached.m_Data.IsNull()) {
+            Touch(cached);
+            block = cached.m_Data;
+            return NPT_SUCCESS;
+        }
+    }
+
+    // only one reader goes to disk for a given file, others 
+    // waiting for the same block will find it when they get the lock
+    NPT_AutoLock file_lock(file->m_FileLock);
+    {
+        NPT_AutoLock lock(m_Lock);
+        PLT_CachedFile::Block& cached = file->m_Blocks[index];
+        if (!cached.m_Data.IsNull()) {
+            Touch(cached);
+            block = cached.m_Data;
+            return NPT_SUCCESS;
+        }
+    }
+
+    NPT_CHECK_WARNING(LoadBlock(*file, index, block));
+
+    NPT_AutoLock lock(m_Lock);
+
+    // file was dropped or cache disabled while we were reading
+    if (!file->m_Cached || m_MaxSize == 0) return NPT_SUCCESS;
+
+    PLT_CachedFile::Block& cached = file->m_Blocks[index];
+    cached.m_Data = block;
+    ++file->m_LoadedBlocks;
+    m_Size += block->GetDataSize();
+
+    Entry entry = { file.AsPointer(), index };
+    m_Loaded.Add(entry);
+    cached.m_Entry = m_Loaded.GetLastItem();
+
+    Evict();
+    return NPT_SUCCESS;
+}
+
+/*----------------------------------------------------------------------
+|   PLT_FileCache::LoadBlock
++---------------------------------------------------------------------*/
+NPT_Result
+PLT_FileCache::LoadBlock(PLT_CachedFile&            file, 
+                         NPT_Ordinal                index,
+                         PLT_SharedBufferReference& block)
+{
+    NPT_Result res;
+
+    // reopen if a previous read failed
+    if (file.m_Stream.IsNull()) {
+        NPT_File input(file.m_Path);
+        NPT_CHECK_WARNING(input.Open(NPT_FILE_OPEN_MODE_READ));
+        NPT_CHECK_WARNING(input.GetInputStream(file.m_Stream));
+    }
+
+    NPT_Position offset = (NPT_Position)index*PLT_FILE_CACHE_BLOCK_SIZE;
+    NPT_Size     size   = PLT_FILE_CACHE_BLOCK_SIZE;
+    if (offset + size > file.m_Info.m_Size) size = (NPT_Size)(file.m_Info.m_Size - offset);
+
+    NPT_DataBuffer* data = new NPT_DataBuffer(size);
+    data->SetDataSize(size);
+
+    res = file.m_Stream->Seek(offset);
+    if (NPT_SUCCEEDED(res)) res = file.m_Stream->ReadFully(data->UseData(), size);
+    if (NPT_FAILED(res)) {
+        NPT_LOG_WARNING_3("Failed to read block %d of %s (%d)", index, file.m_Path.GetChars(), res);
+        file.m_Stream = NULL;
+        delete data;
+        return res;
+    }
+
+    block = data;
+    return NPT_SUCCESS;
+}
+
+/*----------------------------------------------------------------------
+|   PLT_FileCache::Touch
++---------------------------------------------------------------------*/
+void
+PLT_FileCache::Touch(PLT_CachedFile::Block& cached)
+{
+    // move to the most recently used end of the list
+    Entry entry = *cached.m_Entry;
+    m_Loaded.Erase(cached.m_Entry);
+    m_Loaded.Add(entry);
+    cached.m_Entry = m_Loaded.GetLastItem();
+}
+
+/*----------------------------------------------------------------------
+|   PLT_FileCache::Evict
++---------------------------------------------------------------------*/
+void
+PLT_FileCache::Evict()
+{
+    while (m_Size > m_MaxSize && m_Loaded.GetItemCount()) {
+        // least recently used block is at the head
+        NPT_List<Entry>::Iterator oldest = m_Loaded.GetFirstItem();
+
+        // readers still holding the block keep it alive
+        PLT_CachedFile& file = *(*oldest).m_File;
+        PLT_CachedFile::Block& cached = file.m_Blocks[(*oldest).m_Index];
+        m_Size -= cached.m_Data->GetDataSize();
+        cached.m_Data  = NULL;
+        cached.m_Entry = NPT_List<Entry>::Iterator();
+        m_Loaded.Erase(oldest);
+
+        // this may delete the file
+        if (--file.m_LoadedBlocks == 0 && file.m_Readers == 0) RemoveFile(file);
+    }
+}
+
+/*----------------------------------------------------------------------
+|   PLT_FileCache::RemoveFile
++---------------------------------------------------------------------*/
+void
+PLT_FileCache::RemoveFile(PLT_CachedFile& file)
+{
+    file.m_Cached = false;
+
+    NPT_List<PLT_CachedFileReference>::Iterator iter = m_Files.GetFirstItem();
+    while (iter) {
+        if ((*iter).AsPointer() == &file) {
+            m_Files.Erase(iter);
+            return;
+        }
+        ++iter;
+    }
+}
+
+/*----------------------------------------------------------------------
+|   PLT_FileCache::Forget
++---------------------------------------------------------------------*/
+void
+PLT_FileCache::Forget(PLT_CachedFile& file)
+{
+    for (NPT_Ordinal i=0; i<file.m_Blocks.GetItemCount() && file.m_LoadedBlocks; i++) {
+        PLT_CachedFile::Block& cached = file.m_Blocks[i];
+        if (cached.m_Data.IsNull()) continue;
+
+        m_Size -= cached.m_Data->GetDataSize();
+        cached.m_Data = NULL;
+        m_Loaded.Erase(cached.m_Entry);
+        cached.m_Entry = NPT_List<Entry>::Iterator();
+        --file.m_LoadedBlocks;
+    }
+
+    file.m_LoadedBlocks = 0;
+    file.m_Cached = false;
+}
+
+/*----------------------------------------------------------------------
+|   PLT_FileCache::Clear
++---------------------------------------------------------------------*/
+void
+PLT_FileCache::Clear()
+{
+    NPT_List<PLT_CachedFileReference>::Iterator iter = m_Files.GetFirstItem();
+    while (iter) {
+        Forget(**iter);
+        ++iter;
+    }
+
+    m_Files.Clear();
+    m_Loaded.Clear();
+    m_Size = 0;
+}
+
+/*----------------------------------------------------------------------
+|   PLT_CachedFileInputStream::Read
++---------------------------------------------------------------------*/
+NPT_Result
+PLT_CachedFileInputStream::Read(void*     buffer, 
+                                NPT_Size  bytes_to_read, 
+                                NPT_Size* bytes_read /* = NULL */)
+{
+    if (bytes_read) *bytes_read = 0;
+    if (bytes_to_read == 0) return NPT_SUCCESS;
+    if (m_Position >= m_File->GetSize()) return NPT_ERROR_EOS;
+
+    // switch to the block holding the current position
+    NPT_Ordinal index = (NPT_Ordinal)(m_Position / PLT_FILE_CACHE_BLOCK_SIZE);
+    if (m_Block.IsNull() || m_BlockIndex != index) {
+        m_Block = NULL;
+        NPT_CHECK_WARNING(m_Cache.GetBlock(m_File, index, m_Block));
+        m_BlockIndex = index;
+    }
+
+    NPT_Size offset    = (NPT_Size)(m_Position - (NPT_Position)index*PLT_FILE_CACHE_BLOCK_SIZE);
+    NPT_Size available = m_Block->GetDataSize() - offset;
+    if (available == 0) return NPT_ERROR_EOS;
+    if (bytes_to_read > available) bytes_to_read = available;
+
+    NPT_CopyMemory(buffer, m_Block->GetData()+offset, bytes_to_read);
+    m_Position += bytes_to_read;
+
+    if (bytes_read) *bytes_read = bytes_to_read;
+    return NPT_SUCCESS;
+}
+
+/*----------------------------------------------------------------------
+|   PLT_CachedFileInputStream::Seek
++---------------------------------------------------------------------*/
+NPT_Result
+PLT_CachedFileInputStream::Seek(NPT_Position offset)
+{
+    if (offset > m_File->GetSize()) return NPT_ERROR_OUT_OF_RANGE;
+
+    m_Position = offset;
+    return NPT_SUCCESS;
+}
@@ -0,0 +1,206 @@
+/*****************************************************************
+|
+|   Platinum - File Cache
+|
+| Copyright (c) 2004-2010, Plutinosoft, LLC.
+| All rights reserved.
+| http://www.plutinosoft.com
+|
+| This program is free software; you can redistribute it and/or
+| modify it under the terms of the GNU General Public License
+| as published by the Free Software Foundation; either version 2
+| of the License, or (at your option) any later version.
+|
+| OEMs, ISVs, VARs and other distributors that combine and 
+| distribute commercially licensed software with Platinum software
+| and do not wish to distribute the source code for the commercially
+| licensed software under version 2, or (at your option) any later
+| version, of the GNU General Public License (the "GPL") must enter
+| into a commercial license agreement with Plutinosoft, LLC.
+| licensing@plutinosoft.com
+|  
+| This program is distributed in the hope that it will be useful,
+| but WITHOUT ANY WARRANTY; without even the implied warranty of
+| MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+| GNU General Public License for more details.
+|
+| You should have received a copy of the GNU General Public License
+| along with this program; see the file LICENSE.txt. If not, write to
+| the Free Software Foundation, Inc., 
+| 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+| http://www.gnu.org/licenses/gpl-2.0.html
+|
+****************************************************************/
+
+
+/** @file
+ Shared file block cache
+ */
+
+#ifndef _PLT_FILE_CACHE_H_
+#define _PLT_FILE_CACHE_H_
+
+/*----------------------------------------------------------------------
+|   includes
++---------------------------------------------------------------------*/
+#include "Neptune.h"
+#include "PltHttp.h"
+
+/*----------------------------------------------------------------------
+|   constants
++---------------------------------------------------------------------*/
+#define PLT_FILE_CACHE_BLOCK_SIZE (256*1024)
+
+/*----------------------------------------------------------------------
+|   PLT_CachedFile class
++---------------------------------------------------------------------*/
+/**
+ The PLT_CachedFile class holds the blocks of a file loaded so far by a
+ PLT_FileCache. It is shared by all the streams reading the same file.
+ */
+class PLT_CachedFile
+{
+public:
+    PLT_CachedFile(const char* path, const NPT_FileInfo& info);
+    ~PLT_CachedFile() {}
+
+    const NPT_String& GetPath() const { return m_Path; }
+    NPT_LargeSize     GetSize() const { return m_Info.m_Size; }
+
+private:
+    friend class PLT_FileCache;
+
+    struct Entry {
+        PLT_CachedFile* m_File;
+        NPT_Ordinal     m_Index;
+    };
+
+    struct Block {
+        PLT_SharedBufferReference m_Data;
+        NPT_List<Entry>::Iterator m_Entry; // position in the cache lru list
+    };
+
+    // members
+    NPT_String               m_Path;
+    NPT_FileInfo             m_Info;
+    NPT_Array<Block>         m_Blocks;
+    NPT_Cardinal             m_LoadedBlocks;
+    NPT_Cardinal             m_Readers;
+    bool                     m_Cached;   // still owned by the cache
+    NPT_Mutex                m_FileLock; // serializes disk reads
+    NPT_InputStreamReference m_Stream;
+};
+
+typedef NPT_Reference<PLT_CachedFile> PLT_CachedFileReference;
+
+/*----------------------------------------------------------------------
+|   PLT_FileCache class
++---------------------------------------------------------------------*/
+/**
+ The PLT_FileCache class keeps recently read blocks of files in memory so that
+ concurrent clients streaming the same media share one copy of the data and
+ only the first reader of a block hits the disk. Blocks are loaded on demand
+ and the least recently used ones are dropped when the total size goes over
+ the configured budget. The cache is disabled until a budget is set.
+ */
+class PLT_FileCache
+{
+public:
+    // class methods
+    static PLT_FileCache& GetInstance();
+
+    PLT_FileCache();
+    ~PLT_FileCache();
+
+    /**
+     Set the maximum number of bytes kept in memory, 0 disables the cache
+     and releases everything.
+     */
+    NPT_Result    SetMaxSize(NPT_LargeSize max_size);
+    NPT_LargeSize GetMaxSize() { return m_MaxSize; }
+    bool          IsEnabled()  { return m_MaxSize > 0; }
+
+    /**
+     Return a seekable stream reading a file through the cache.
+     @param path file path
+     @param info file info used to detect files modified since cached
+     @param stream the new stream
+     */
+    NPT_Result GetInputStream(const char*               path, 
+                              const NPT_FileInfo&       info,
+                              NPT_InputStreamReference& stream);
+
+    /**
+     Return a block of a file, loading it from disk if necessary.
+     */
+    NPT_Result GetBlock(PLT_CachedFileReference&   file, 
+                        NPT_Ordinal                index,
+                        PLT_SharedBufferReference& block);
+
+private:
+    friend class PLT_CachedFileInputStream;
+
+    typedef PLT_CachedFile::Entry Entry;
+
+    // methods
+    NPT_Result ReleaseFile(PLT_CachedFileReference& file);
+    NPT_Result LoadBlock(PLT_CachedFile&            file, 
+                         NPT_Ordinal                index,
+                         PLT_SharedBufferReference& block);
+    void       Touch(PLT_CachedFile::Block& cached); // must be called with m_Lock held
+    void       Evict(); // must be called with m_Lock held
+    void       Clear(); // must be called with m_Lock held
+    void       Forget(PLT_CachedFile& file);     // must be called with m_Lock held
+    void       RemoveFile(PLT_CachedFile& file); // must be called with m_Lock held
+
+    // members
+    NPT_Mutex                         m_Lock;
+    NPT_List<PLT_CachedFileReference> m_Files;
+    NPT_List<Entry>                   m_Loaded; // least recently used first
+    NPT_LargeSize                     m_MaxSize;
+    NPT_LargeSize                     m_Size;
+};
+
+/*----------------------------------------------------------------------
+|   PLT_CachedFileInputStream class
++---------------------------------------------------------------------*/
+/**
+ The PLT_CachedFileInputStream class is a seekable stream reading a file from
+ a PLT_FileCache. It holds on to the block being read so it stays valid even
+ if the cache drops it meanwhile.
+ */
+class PLT_CachedFileInputStream : public NPT_InputStream
+{
+public:
+    PLT_CachedFileInputStream(PLT_FileCache&                 cache,
+                              const PLT_CachedFileReference& file) :
+        m_Cache(cache), m_File(file), m_Position(0), m_BlockIndex(0) {}
+    virtual ~PLT_CachedFileInputStream() { m_Cache.ReleaseFile(m_File); }
+
+    // NPT_InputStream methods
+    NPT_Result Read(void*     buffer, 
+                    NPT_Size  bytes_to_read, 
+                    NPT_Size* bytes_read = NULL);
+    NPT_Result Seek(NPT_Position offset);
+    NPT_Result Tell(NPT_Position& offset) { 
+        offset = m_Position; 
+        return NPT_SUCCESS; 
+    }
+    NPT_Result GetSize(NPT_LargeSize& size) {
+        size = m_File->GetSize();
+        return NPT_SUCCESS;
+    }
+    NPT_Result GetAvailable(NPT_LargeSize& available) {
+        available = (m_Position < m_File->GetSize())?(m_File->GetSize() - m_Position):0;
+        return NPT_SUCCESS;
+    }
+
+private:
+    PLT_FileCache&            m_Cache;
+    PLT_CachedFileReference   m_File;
+    NPT_Position              m_Position;
+    PLT_SharedBufferReference m_Block;
+    NPT_Ordinal               m_BlockIndex;
+};
+
+#endif /* _PLT_FILE_CACHE_H_ */
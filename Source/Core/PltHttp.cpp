@@ -350,3 +350,156 @@ PLT_HttpHelper::SetBasicAuthorization(NPT_HttpRequest& request,
 	request.GetHeaders().SetHeader(NPT_HTTP_HEADER_AUTHORIZATION, NPT_String("Basic " + encoded)); 
 }
 
+/*----------------------------------------------------------------------
+|   PLT_SharedBufferInputStream::Read
++---------------------------------------------------------------------*/
+NPT_Result
+PLT_SharedBufferInputStream::Read(void*     buffer, 
+                                  NPT_Size  bytes_to_read, 
+                                  NPT_Size* bytes_read /* = NULL */)
+{
+    if (bytes_read) *bytes_read = 0;
+    if (bytes_to_read == 0) return NPT_SUCCESS;
+
+    NPT_Size size = m_Buffer.IsNull()?0:m_Buffer->GetDataSize();
+    if (m_Position >= size) return NPT_ERROR_EOS;
+
+    NPT_Size available = size - (NPT_Size)m_Position;
+    if (bytes_to_read > available) bytes_to_read = available;
+
+    NPT_CopyMemory(buffer, m_Buffer->GetData()+m_Position, bytes_to_read);
+    m_Position += bytes_to_read;
+
+    if (bytes_read) *bytes_read = bytes_to_read;
+    return NPT_SUCCESS;
+}
+
+/*----------------------------------------------------------------------
+|   PLT_SharedBufferInputStream::Seek
++---------------------------------------------------------------------*/
+NPT_Result
+PLT_SharedBufferInputStream::Seek(NPT_Position offset)
+{
+    NPT_Size size = m_Buffer.IsNull()?0:m_Buffer->GetDataSize();
+    if (offset > size) return NPT_ERROR_OUT_OF_RANGE;
+
+    m_Position = offset;
+    return NPT_SUCCESS;
+}
+
+/*----------------------------------------------------------------------
+|   PLT_SharedBufferInputStream::GetAvailable
++---------------------------------------------------------------------*/
+NPT_Result
+PLT_SharedBufferInputStream::GetAvailable(NPT_LargeSize& available)
+{
+    NPT_Size size = m_Buffer.IsNull()?0:m_Buffer->GetDataSize();
+    available = (m_Position < size)?(size - m_Position):0;
+    return NPT_SUCCESS;
+}
+
+/*----------------------------------------------------------------------
+|   PLT_MultipartRangeInputStream::PLT_MultipartRangeInputStream
++---------------------------------------------------------------------*/
+PLT_MultipartRangeInputStream::PLT_MultipartRangeInputStream(const NPT_InputStreamReference& source,
+                                                             const char*                     content_type,
+                                                             NPT_LargeSize                   source_size,
+                                                             const NPT_List<Range>&          ranges,
+                                                             const char*                     boundary) :
+    m_Source(source),
+    m_Part(0),
+    m_PartOffset(0),
+    m_Position(0),
+    m_Size(0)
+{
+    NPT_List<Range>::Iterator range = ranges.GetFirstItem();
+    while (range) {
+        Part part;
+        part.m_Header  = m_Parts.GetItemCount()?"\r\n--":"--";
+        part.m_Header += boundary;
+        part.m_Header += "\r\nContent-Type: ";
+        part.m_Header += content_type;
+        part.m_Header += "\r\nContent-Range: bytes ";
+        part.m_Header += NPT_String::FromIntegerU((*range).m_Start);
+        part.m_Header += "-";
+        part.m_Header += NPT_String::FromIntegerU((*range).m_Start + (*range).m_Length - 1);
+        part.m_Header += "/";
+        part.m_Header += NPT_String::FromIntegerU(source_size);
+        part.m_Header += "\r\n\r\n";
+        part.m_Start   = (*range).m_Start;
+        part.m_Length  = (*range).m_Length;
+        m_Parts.Add(part);
+        m_Size += part.m_Header.GetLength() + part.m_Length;
+        ++range;
+    }
+
+    Part closing;
+    closing.m_Header  = "\r\n--";
+    closing.m_Header += boundary;
+    closing.m_Header += "--\r\n";
+    closing.m_Start   = 0;
+    closing.m_Length  = 0;
+    m_Parts.Add(closing);
+    m_Size += closing.m_Header.GetLength();
+}
+
+/*----------------------------------------------------------------------
+|   PLT_MultipartRangeInputStream::Read
++---------------------------------------------------------------------*/
+NPT_Result
+PLT_MultipartRangeInputStream::Read(void*     buffer, 
+                                    NPT_Size  bytes_to_read, 
+                                    NPT_Size* bytes_read /* = NULL */)
+{
+    if (bytes_read) *bytes_read = 0;
+    if (bytes_to_read == 0) return NPT_SUCCESS;
+
+    while (m_Part < m_Parts.GetItemCount()) {
+        const Part& part = m_Parts[m_Part];
+        NPT_Size header_size = part.m_Header.GetLength();
+
+        // part header
+        if (m_PartOffset < header_size) {
+            NPT_Size available = header_size - (NPT_Size)m_PartOffset;
+            if (bytes_to_read > available) bytes_to_read = available;
+
+            NPT_CopyMemory(buffer, part.m_Header.GetChars()+m_PartOffset, bytes_to_read);
+            m_PartOffset += bytes_to_read;
+            m_Position   += bytes_to_read;
+            if (bytes_read) *bytes_read = bytes_to_read;
+            return NPT_SUCCESS;
+        }
+
+        // part body
+        NPT_Position body_offset = m_PartOffset - header_size;
+        if (body_offset < part.m_Length) {
+            if (body_offset == 0) NPT_CHECK_WARNING(m_Source->Seek(part.m_Start));
+
+            if (bytes_to_read > part.m_Length - body_offset) {
+                bytes_to_read = (NPT_Size)(part.m_Length - body_offset);
+            }
+
+            NPT_Size read = 0;
+            NPT_CHECK(m_Source->Read(buffer, bytes_to_read, &read));
+            m_PartOffset += read;
+            m_Position   += read;
+            if (bytes_read) *bytes_read = read;
+            return NPT_SUCCESS;
+        }
+
+        ++m_Part;
+        m_PartOffset = 0;
+    }
+
+    return NPT_ERROR_EOS;
+}
+
+/*----------------------------------------------------------------------
+|   PLT_MultipartRangeInputStream::Seek
++---------------------------------------------------------------------*/
+NPT_Result
+PLT_MultipartRangeInputStream::Seek(NPT_Position offset)
+{
+    // the body is only ever sent sequentially
+    return (offset == m_Position)?NPT_SUCCESS:NPT_ERROR_NOT_SUPPORTED;
+}
@@ -125,6 +125,107 @@ private:
     const NPT_HttpRequest& m_Request;
 };
 
+/*----------------------------------------------------------------------
+|   PLT_SharedBufferReference
++---------------------------------------------------------------------*/
+/**
+ Immutable, reference counted buffer which can be used as the body of several
+ HTTP messages at once (for example the same GENA NOTIFY body sent to every
+ subscriber of a service).
+ */
+typedef NPT_Reference<NPT_DataBuffer> PLT_SharedBufferReference;
+
+/*----------------------------------------------------------------------
+|   PLT_SharedBufferInputStream
++---------------------------------------------------------------------*/
+/**
+ The PLT_SharedBufferInputStream class is a seekable input stream reading from
+ a shared buffer. Each stream keeps its own position so that the same buffer
+ can be read concurrently by several connections without being copied.
+ */
+class PLT_SharedBufferInputStream : public NPT_InputStream
+{
+public:
+    PLT_SharedBufferInputStream(const PLT_SharedBufferReference& buffer) :
+        m_Buffer(buffer), m_Position(0) {}
+    virtual ~PLT_SharedBufferInputStream() {}
+
+    // NPT_InputStream methods
+    NPT_Result Read(void*     buffer, 
+                    NPT_Size  bytes_to_read, 
+                    NPT_Size* bytes_read = NULL);
+    NPT_Result Seek(NPT_Position offset);
+    NPT_Result Tell(NPT_Position& offset) { 
+        offset = m_Position; 
+        return NPT_SUCCESS; 
+    }
+    NPT_Result GetSize(NPT_LargeSize& size) {
+        size = m_Buffer.IsNull()?0:m_Buffer->GetDataSize();
+        return NPT_SUCCESS;
+    }
+    NPT_Result GetAvailable(NPT_LargeSize& available);
+
+private:
+    PLT_SharedBufferReference m_Buffer;
+    NPT_Position              m_Position;
+};
+
+/*----------------------------------------------------------------------
+|   PLT_MultipartRangeInputStream
++---------------------------------------------------------------------*/
+/**
+ The PLT_MultipartRangeInputStream class reads several byte ranges of a source
+ stream as a multipart/byteranges body (RFC 2616 section 19.2). Ranges must be
+ within the source size and are read in the order given.
+ */
+class PLT_MultipartRangeInputStream : public NPT_InputStream
+{
+public:
+    struct Range {
+        NPT_Position  m_Start;
+        NPT_LargeSize m_Length;
+    };
+
+    PLT_MultipartRangeInputStream(const NPT_InputStreamReference& source,
+                                  const char*                     content_type,
+                                  NPT_LargeSize                   source_size,
+                                  const NPT_List<Range>&          ranges,
+                                  const char*                     boundary);
+    virtual ~PLT_MultipartRangeInputStream() {}
+
+    // NPT_InputStream methods
+    NPT_Result Read(void*     buffer, 
+                    NPT_Size  bytes_to_read, 
+                    NPT_Size* bytes_read = NULL);
+    NPT_Result Seek(NPT_Position offset);
+    NPT_Result Tell(NPT_Position& offset) { 
+        offset = m_Position; 
+        return NPT_SUCCESS; 
+    }
+    NPT_Result GetSize(NPT_LargeSize& size) {
+        size = m_Size;
+        return NPT_SUCCESS;
+    }
+    NPT_Result GetAvailable(NPT_LargeSize& available) {
+        available = m_Size - m_Position;
+        return NPT_SUCCESS;
+    }
+
+private:
+    struct Part {
+        NPT_String    m_Header;
+        NPT_Position  m_Start;
+        NPT_LargeSize m_Length;
+    };
+
+    NPT_InputStreamReference m_Source;
+    NPT_Array<Part>          m_Parts; // last part is the closing boundary
+    NPT_Ordinal              m_Part;
+    NPT_Position             m_PartOffset;
+    NPT_Position             m_Position;
+    NPT_LargeSize            m_Size;
+};
+
 /*----------------------------------------------------------------------
 |   NPT_HttpHeaderPrinter
 +---------------------------------------------------------------------*/
@@ -182,6 +283,10 @@ do { \
 #else /* NPT_CONFIG_ENABLE_LOGGING */
 #define PLT_LOG_HTTP_MESSAGE_L(_logger, _level, _prefix, _msg)
 #define PLT_LOG_HTTP_MESSAGE(_level, _prefix, _msg)
+#define PLT_LOG_HTTP_REQUEST_L(_logger, _level, _prefix, _request)
+#define PLT_LOG_HTTP_RESPONSE_L(_logger, _level, _prefix, _response)
+#define PLT_LOG_HTTP_REQUEST(_level, _prefix, _request)
+#define PLT_LOG_HTTP_RESPONSE(_level, _prefix, _response)
 #endif /* NPT_CONFIG_ENABLE_LOGGING */
 
 /*----------------------------------------------------------------------
@@ -42,9 +42,41 @@
 #include "PltUtilities.h"
 #include "PltProtocolInfo.h"
 #include "PltMimeType.h"
+#include "PltFileCache.h"
+#include "PltSeekIndex.h"
 
 NPT_SET_LOCAL_LOGGER("platinum.core.http.server")
 
+/*----------------------------------------------------------------------
+|   constants
++---------------------------------------------------------------------*/
+#define PLT_HTTP_SERVER_MAX_RANGES 32
+
+/*----------------------------------------------------------------------
+|   globals
++---------------------------------------------------------------------*/
+static NPT_Mutex  DateLock;
+static NPT_UInt32 DateSeconds = 0;
+static NPT_String Date;
+
+/*----------------------------------------------------------------------
+|   PLT_HttpServer_SetDate
++---------------------------------------------------------------------*/
+static NPT_Result
+PLT_HttpServer_SetDate(NPT_HttpMessage& message)
+{
+    NPT_TimeStamp now;
+    NPT_System::GetCurrentTimeStamp(now);
+
+    // formatted once per second for all responses
+    NPT_AutoLock lock(DateLock);
+    if (Date.IsEmpty() || (NPT_UInt32)now.ToSeconds() != DateSeconds) {
+        DateSeconds = (NPT_UInt32)now.ToSeconds();
+        Date = NPT_DateTime(now).ToString(NPT_DateTime::FORMAT_RFC_1123);
+    }
+    return message.GetHeaders().SetHeader("Date", Date, true);
+}
+
 /*----------------------------------------------------------------------
 |   PLT_HttpServer::PLT_HttpServer
 +---------------------------------------------------------------------*/
@@ -72,6 +104,23 @@ PLT_HttpServer::~PLT_HttpServer()
     Stop();
 }
 
+/*----------------------------------------------------------------------
+|   PLT_HttpServer::EnableReactor
++---------------------------------------------------------------------*/
+NPT_Result
+PLT_HttpServer::EnableReactor(NPT_Cardinal workers,          /* = 8 */
+                              NPT_Cardinal max_connections)  /* = 1024 */
+{
+    if (m_Running || m_Aborted) NPT_CHECK_WARNING(NPT_ERROR_INVALID_STATE);
+
+    m_Reactor = new PLT_HttpServerReactor(this, workers, max_connections);
+
+    // the number of tasks is now fixed (listen, poll and workers), 
+    // connections are limited by the reactor instead
+    m_TaskManager = new PLT_TaskManager();
+    return NPT_SUCCESS;
+}
+
 /*----------------------------------------------------------------------
 |   PLT_HttpServer::Start
 +---------------------------------------------------------------------*/
@@ -112,12 +161,19 @@ PLT_HttpServer::Start()
 
     // Tell server to try to listen to more incoming sockets
     // (this could fail silently)
-    if (m_TaskManager->GetMaxTasks() > 20) {
-        m_Socket.Listen(m_TaskManager->GetMaxTasks());
+    NPT_Cardinal max_clients = m_Reactor.IsNull()?
+        m_TaskManager->GetMaxTasks():m_Reactor->GetMaxConnections();
+    if (max_clients > 20) {
+        m_Socket.Listen(max_clients);
     }
     
+    // start the reactor tasks first if any
+    if (!m_Reactor.IsNull()) {
+        NPT_CHECK_SEVERE(m_Reactor->Start(m_TaskManager));
+    }
+
     // start a task to listen for incoming connections
-    PLT_HttpListenTask *task = new PLT_HttpListenTask(this, &m_Socket, false);
+    PLT_HttpListenTask *task = new PLT_HttpListenTask(this, &m_Socket, false, m_Reactor.AsPointer());
     NPT_CHECK_SEVERE(m_TaskManager->StartTask(task));
 
     NPT_SocketInfo info;
@@ -141,6 +197,9 @@ PLT_HttpServer::Stop()
     
     // stop all other pending tasks 
     m_TaskManager->Abort();
+
+    // close connections left with the reactor now that no task uses them
+    if (!m_Reactor.IsNull()) m_Reactor->Stop();
     
     m_Running = false;
     m_Aborted = true;
@@ -156,11 +215,13 @@ PLT_HttpServer::SetupResponse(NPT_HttpRequest&              request,
                               const NPT_HttpRequestContext& context,
                               NPT_HttpResponse&             response) 
 {
-    NPT_String prefix = NPT_String::Format("PLT_HttpServer::SetupResponse %s request from %s for \"%s\"", 
-        (const char*) request.GetMethod(),
-        (const char*) context.GetRemoteAddress().ToString(),
-        (const char*) request.GetUrl().ToString());
-    PLT_LOG_HTTP_REQUEST(NPT_LOG_LEVEL_FINE, prefix, &request);
+    // prefix is only formatted when the log level is enabled
+    PLT_LOG_HTTP_REQUEST(NPT_LOG_LEVEL_FINE, 
+        NPT_String::Format("PLT_HttpServer::SetupResponse %s request from %s for \"%s\"", 
+            (const char*) request.GetMethod(),
+            (const char*) context.GetRemoteAddress().ToString(),
+            (const char*) request.GetUrl().ToString()), 
+        &request);
 
     NPT_List<NPT_HttpRequestHandler*> handlers = FindRequestHandlers(request);
     if (handlers.GetItemCount() == 0) return NPT_ERROR_NO_SUCH_ITEM;
@@ -169,7 +230,7 @@ PLT_HttpServer::SetupResponse(NPT_HttpRequest&              request,
     NPT_Result result = (*handlers.GetFirstItem())->SetupResponse(request, context, response);
     
     // DLNA compliance
-    PLT_UPnPMessageHelper::SetDate(response);
+    PLT_HttpServer_SetDate(response);
     if (request.GetHeaders().GetHeader("Accept-Language")) {
         response.GetHeaders().SetHeader("Content-Language", "en");
     }
@@ -220,10 +281,14 @@ PLT_HttpServer::ServeFile(const NPT_HttpRequest&        request,
         }
     }
     
-    // open file
-    if (NPT_FAILED(file.Open(NPT_FILE_OPEN_MODE_READ)) || 
-        NPT_FAILED(file.GetInputStream(stream))        ||
-        stream.IsNull()) {
+    // open file, sharing blocks already read by other clients if enabled
+    if (PLT_FileCache::GetInstance().IsEnabled()) {
+        PLT_FileCache::GetInstance().GetInputStream(file_path, file_info, stream);
+    }
+    if (stream.IsNull() &&
+        (NPT_FAILED(file.Open(NPT_FILE_OPEN_MODE_READ)) || 
+         NPT_FAILED(file.GetInputStream(stream))        ||
+         stream.IsNull())) {
         return NPT_ERROR_NO_SUCH_ITEM;
     }
     
@@ -235,8 +300,141 @@ PLT_HttpServer::ServeFile(const NPT_HttpRequest&        request,
         //response.GetHeaders().SetHeader("Cache-Control", "max-age=1800", true);
     }
     
+    // time based seek requests need an index of the file
+    PLT_SeekIndexReference seek_index;
+    if (request.GetHeaders().GetHeaderValue("TimeSeekRange.dlna.org")) {
+        PLT_SeekIndexCache::GetInstance().GetIndex(file_path, file_info, seek_index);
+    }
+    
     PLT_HttpRequestContext tmp_context(request, context);
-    return ServeStream(request, context, response, stream, PLT_MimeType::GetMimeType(file_path, &tmp_context));
+    return ServeStream(request, 
+                       context, 
+                       response, 
+                       stream, 
+                       PLT_MimeType::GetMimeType(file_path, &tmp_context), 
+                       seek_index.AsPointer());
+}
+
+/*----------------------------------------------------------------------
+|   PLT_HttpServer::SetupTimeSeek
++---------------------------------------------------------------------*/
+NPT_Result 
+PLT_HttpServer::SetupTimeSeek(const PLT_SeekIndex& seek_index,
+                              const NPT_String&    time_seek,
+                              NPT_Position&        start_offset,
+                              NPT_LargeSize&       length,
+                              NPT_String&          time_seek_range)
+{
+    // npt=<start>-[<end>]
+    if (!time_seek.StartsWith("npt=", true)) return NPT_ERROR_INVALID_SYNTAX;
+    NPT_String spec = time_seek.SubString(4);
+    spec.Trim();
+    int dash = spec.Find('-');
+    if (dash < 0) return NPT_ERROR_INVALID_SYNTAX;
+    
+    NPT_String start_npt = spec.Left(dash);
+    NPT_String end_npt   = spec.SubString(dash+1);
+    NPT_UInt64 start, end = 0;
+    NPT_CHECK_WARNING(PLT_SeekIndex::ParseNptTime(start_npt, start));
+    if (!end_npt.IsEmpty()) {
+        NPT_CHECK_WARNING(PLT_SeekIndex::ParseNptTime(end_npt, end));
+        if (end < start) return NPT_ERROR_INVALID_SYNTAX;
+    }
+    
+    NPT_Position end_offset = seek_index.GetSize();
+    NPT_CHECK_WARNING(seek_index.FindOffset(start, start_offset));
+    if (!end_npt.IsEmpty()) NPT_CHECK_WARNING(seek_index.FindEndOffset(end, end_offset));
+    if (start_offset >= end_offset) return NPT_ERROR_OUT_OF_RANGE;
+    length = end_offset - start_offset;
+    
+    // npt=<start>-<end>/<duration> bytes=<first>-<last>/<size>
+    NPT_UInt64 duration = seek_index.GetDuration();
+    NPT_String total    = duration?PLT_SeekIndex::FormatNptTime(duration):NPT_String("*");
+    time_seek_range  = "npt=" + PLT_SeekIndex::FormatNptTime(start) + "-";
+    time_seek_range += end_npt.IsEmpty()?total:PLT_SeekIndex::FormatNptTime(end);
+    time_seek_range += "/" + total;
+    time_seek_range += " bytes=" + NPT_String::FromIntegerU(start_offset);
+    time_seek_range += "-" + NPT_String::FromIntegerU(end_offset-1);
+    time_seek_range += "/" + NPT_String::FromIntegerU(seek_index.GetSize());
+    return NPT_SUCCESS;
+}
+
+/*----------------------------------------------------------------------
+|   PLT_HttpServer::SetupMultipartResponseBody
++---------------------------------------------------------------------*/
+NPT_Result 
+PLT_HttpServer::SetupMultipartResponseBody(NPT_HttpResponse&         response,
+                                           NPT_InputStreamReference& body,
+                                           const NPT_String&         range_spec,
+                                           const char*               content_type)
+{
+    NPT_LargeSize size;
+    NPT_List<PLT_MultipartRangeInputStream::Range> ranges;
+    
+    // send the whole body when ranges can't be served
+    if (!range_spec.StartsWith("bytes=") || NPT_FAILED(body->GetSize(size))) {
+        return NPT_HttpFileRequestHandler::SetupResponseBody(response, body, NULL);
+    }
+    
+    NPT_List<NPT_String> specs = range_spec.SubString(6).Split(",");
+    if (specs.GetItemCount() > PLT_HTTP_SERVER_MAX_RANGES) {
+        return NPT_HttpFileRequestHandler::SetupResponseBody(response, body, NULL);
+    }
+    
+    for (NPT_List<NPT_String>::Iterator spec = specs.GetFirstItem(); spec; ++spec) {
+        (*spec).Trim();
+        int dash = (*spec).Find('-');
+        if (dash < 0) return NPT_HttpFileRequestHandler::SetupResponseBody(response, body, NULL);
+        
+        NPT_String first = (*spec).Left(dash);
+        NPT_String last  = (*spec).SubString(dash+1);
+        NPT_UInt64 start, end;
+        if (first.IsEmpty()) {
+            // suffix range, last bytes of the body
+            if (NPT_FAILED(last.ToInteger64(end))) {
+                return NPT_HttpFileRequestHandler::SetupResponseBody(response, body, NULL);
+            }
+            if (end == 0 || size == 0) continue;
+            start = (end < size)?size-end:0;
+            end   = size-1;
+        } else {
+            if (NPT_FAILED(first.ToInteger64(start))) {
+                return NPT_HttpFileRequestHandler::SetupResponseBody(response, body, NULL);
+            }
+            if (last.IsEmpty()) {
+                end = size-1;
+            } else if (NPT_FAILED(last.ToInteger64(end)) || end < start) {
+                return NPT_HttpFileRequestHandler::SetupResponseBody(response, body, NULL);
+            }
+            if (start >= size) continue;
+            if (end >= size) end = size-1;
+        }
+        
+        PLT_MultipartRangeInputStream::Range range;
+        range.m_Start  = start;
+        range.m_Length = end - start + 1;
+        ranges.Add(range);
+    }
+    
+    if (ranges.GetItemCount() == 0) {
+        response.SetStatus(416, "Requested Range Not Satisfiable");
+        response.GetHeaders().SetHeader(NPT_HTTP_HEADER_CONTENT_RANGE, "bytes */" + NPT_String::FromIntegerU(size));
+        return NPT_SUCCESS;
+    }
+    
+    NPT_String boundary = NPT_String::Format("PLATINUM_BOUNDARY_%08x", NPT_System::GetRandomInteger());
+    NPT_InputStreamReference multipart(new PLT_MultipartRangeInputStream(body, 
+                                                                        content_type, 
+                                                                        size, 
+                                                                        ranges, 
+                                                                        boundary));
+    
+    NPT_HttpEntity* entity = response.GetEntity();
+    NPT_CHECK_POINTER_FATAL(entity);
+    NPT_CHECK_SEVERE(entity->SetInputStream(multipart, true));
+    entity->SetContentType("multipart/byteranges; boundary=" + boundary);
+    response.SetStatus(206, "Partial Content");
+    return NPT_SUCCESS;
 }
 
 /*----------------------------------------------------------------------
@@ -247,14 +445,13 @@ PLT_HttpServer::ServeStream(const NPT_HttpRequest&        request,
                             const NPT_HttpRequestContext& context,
                             NPT_HttpResponse&             response,
                             NPT_InputStreamReference&     body, 
-                            const char*                   content_type) 
+                            const char*                   content_type,
+                            const PLT_SeekIndex*          seek_index /* = NULL */) 
 {    
     if (body.IsNull()) return NPT_FAILURE;
     
     // set date
-    NPT_TimeStamp now;
-    NPT_System::GetCurrentTimeStamp(now);
-    response.GetHeaders().SetHeader("Date", NPT_DateTime(now).ToString(NPT_DateTime::FORMAT_RFC_1123), true);
+    PLT_HttpServer_SetDate(response);
     
     // get entity
     NPT_HttpEntity* entity = response.GetEntity();
@@ -266,8 +463,40 @@ PLT_HttpServer::ServeStream(const NPT_HttpRequest&        request,
     // check for range requests
     const NPT_String* range_spec = request.GetHeaders().GetHeaderValue(NPT_HTTP_HEADER_RANGE);
     
-    // setup entity body
-    NPT_CHECK(NPT_HttpFileRequestHandler::SetupResponseBody(response, body, range_spec));
+    // time based seek requests are answered with a 200 carrying the matching
+    // part of the body, the byte range is only given in TimeSeekRange.dlna.org
+    NPT_InputStreamReference content = body;
+    NPT_String               time_seek_range;
+    const NPT_String* time_seek = request.GetHeaders().GetHeaderValue("TimeSeekRange.dlna.org");
+    if (time_seek) {
+        NPT_Position  start_offset = 0;
+        NPT_LargeSize length = 0;
+        NPT_Result    result = seek_index?
+            SetupTimeSeek(*seek_index, *time_seek, start_offset, length, time_seek_range):
+            NPT_ERROR_NOT_SUPPORTED;
+        if (result == NPT_ERROR_NOT_SUPPORTED || result == NPT_ERROR_NO_SUCH_ITEM) {
+            response.SetStatus(406, "Not Acceptable");
+            return NPT_SUCCESS;
+        } else if (result == NPT_ERROR_OUT_OF_RANGE) {
+            response.SetStatus(416, "Requested Range Not Satisfiable");
+            return NPT_SUCCESS;
+        } else if (NPT_FAILED(result)) {
+            response.SetStatus(400, "Bad Request");
+            return NPT_SUCCESS;
+        }
+        
+        // a Range header is ignored when a time seek is requested
+        content    = new NPT_SubInputStream(body, start_offset, length);
+        range_spec = NULL;
+        response.GetHeaders().SetHeader("TimeSeekRange.dlna.org", time_seek_range);
+    }
+    
+    // setup entity body, several ranges are sent as multipart/byteranges
+    if (range_spec && range_spec->Find(',') >= 0) {
+        NPT_CHECK(SetupMultipartResponseBody(response, content, *range_spec, content_type));
+    } else {
+        NPT_CHECK(NPT_HttpFileRequestHandler::SetupResponseBody(response, content, range_spec));
+    }
               
     // set some default headers
     if (response.GetEntity()->GetTransferEncoding() != NPT_HTTP_TRANSFER_ENCODING_CHUNKED) {
@@ -282,7 +511,7 @@ PLT_HttpServer::ServeStream(const NPT_HttpRequest&        request,
     const NPT_String* value = request.GetHeaders().GetHeaderValue("getcontentFeatures.dlna.org");
     if (value) {
         PLT_HttpRequestContext tmp_context(request, context);
-        const char* dlna = PLT_ProtocolInfo::GetDlnaExtension(entity->GetContentType(),
+        const char* dlna = PLT_ProtocolInfo::GetDlnaExtension(content_type,
                                                               &tmp_context);
         if (dlna) response.GetHeaders().SetHeader("ContentFeatures.DLNA.ORG", dlna, false);
     }
@@ -301,10 +530,5 @@ PLT_HttpServer::ServeStream(const NPT_HttpRequest&        request,
         response.GetHeaders().SetHeader("TransferMode.DLNA.ORG", "Streaming", false);
     }
     
-    if (request.GetHeaders().GetHeaderValue("TimeSeekRange.dlna.org")) {
-        response.SetStatus(406, "Not Acceptable");
-        return NPT_SUCCESS;
-    }
-    
     return NPT_SUCCESS;
 }
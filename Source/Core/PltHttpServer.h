@@ -44,6 +44,12 @@
 +---------------------------------------------------------------------*/
 #include "Neptune.h"
 #include "PltHttpServerTask.h"
+#include "PltHttpServerReactor.h"
+
+/*----------------------------------------------------------------------
+|   forward declarations
++---------------------------------------------------------------------*/
+class PLT_SeekIndex;
 
 /*----------------------------------------------------------------------
 |   PLT_HttpServer class
@@ -72,13 +78,34 @@ public:
                                   const NPT_HttpRequestContext& context,
                                   NPT_HttpResponse&             response,
                                   NPT_InputStreamReference&     stream, 
-                                  const char*                   content_type);
+                                  const char*                   content_type,
+                                  const PLT_SeekIndex*          seek_index = NULL);
+
+    static NPT_Result SetupTimeSeek(const PLT_SeekIndex& seek_index,
+                                    const NPT_String&    time_seek,
+                                    NPT_Position&        start_offset,
+                                    NPT_LargeSize&       length,
+                                    NPT_String&          time_seek_range);
+    static NPT_Result SetupMultipartResponseBody(NPT_HttpResponse&         response,
+                                                 NPT_InputStreamReference& body,
+                                                 const NPT_String&         range_spec,
+                                                 const char*               content_type);
 
     // NPT_HttpRequestHandler methods
     virtual NPT_Result SetupResponse(NPT_HttpRequest&              request,
                                      const NPT_HttpRequestContext& context,
                                      NPT_HttpResponse&             response);
 
+    /**
+     Switches the server to reactor mode. Instead of one task per connection, 
+     idle keep-alive connections are parked and a fixed pool of worker tasks
+     processes requests as they come. Must be called before Start.
+     @param workers number of worker tasks processing requests
+     @param max_connections maximum number of connections kept open, 0 for no limit
+     */
+    virtual NPT_Result   EnableReactor(NPT_Cardinal workers = 8, 
+                                       NPT_Cardinal max_connections = 1024);
+
     // methods
     virtual NPT_Result   Start();
     virtual NPT_Result   Stop();
@@ -86,6 +113,7 @@ public:
 
 private:
     PLT_TaskManagerReference        m_TaskManager;
+    PLT_HttpServerReactorReference  m_Reactor;
     NPT_Reference<NPT_HttpServer>   m_Server;
     NPT_IpAddress                   m_Address;
     NPT_IpPort                      m_Port;
@@ -0,0 +1,444 @@
+/*****************************************************************
+|
+|   Platinum - HTTP Server Reactor
+|
+| Copyright (c) 2004-2010, Plutinosoft, LLC.
+| All rights reserved.
+| http://www.plutinosoft.com
+|
+| This program is free software; you can redistribute it and/or
+| modify it under the terms of the GNU General Public License
+| as published by the Free Software Foundation; either version 2
+| of the License, or (at your option) any later version.
+|
+| OEMs, ISVs, VARs and other distributors that combine and 
+| distribute commercially licensed software with Platinum software
+| and do not wish to distribute the source code for the commercially
+| licensed software under version 2, or (at your option) any later
+| version, of the GNU General Public License (the "GPL") must enter
+| into a commercial license agreement with Plutinosoft, LLC.
+| licensing@plutinosoft.com
+|  
+| This program is distributed in the hope that it will be useful,
+| but WITHOUT ANY WARRANTY; without even the implied warranty of
+| MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+| GNU General Public License for more details.
+|
+| You should have received a copy of the GNU General Public License
+| along with this program; see the file LICENSE.txt. If not, write to
+| the Free Software Foundation, Inc., 
+| 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+| http://www.gnu.org/licenses/gpl-2.0.html
+|
+****************************************************************/
+
+/*----------------------------------------------------------------------
+|   includes
++---------------------------------------------------------------------*/
+#include "PltHttpServerReactor.h"
+
+NPT_SET_LOCAL_LOGGER("platinum.core.http.reactor")
+
+/*----------------------------------------------------------------------
+|   PLT_HttpServerConnection::PLT_HttpServerConnection
++---------------------------------------------------------------------*/
+PLT_HttpServerConnection::PLT_HttpServerConnection(NPT_Socket* socket) :
+    m_Socket(socket),
+    m_Receiving(false),
+    m_Scanned(0)
+{
+    // parked until a request arrives, same write timeout 
+    // as a PLT_HttpServerSocketTask
+    m_Socket->SetReadTimeout(0);
+    m_Socket->SetWriteTimeout(600000);
+
+    NPT_InputStreamReference input_stream;
+    if (NPT_SUCCEEDED(m_Socket->GetInputStream(input_stream))) {
+        // large enough to hold a complete request header
+        m_InputStream = new NPT_BufferedInputStream(input_stream, PLT_HTTP_SERVER_REACTOR_MAX_HEADER_SIZE);
+    }
+
+    NPT_System::GetCurrentTimeStamp(m_LastActivity);
+    m_LastCheck = m_LastActivity;
+}
+
+/*----------------------------------------------------------------------
+|   PLT_HttpServerConnection::~PLT_HttpServerConnection
++---------------------------------------------------------------------*/
+PLT_HttpServerConnection::~PLT_HttpServerConnection()
+{
+    m_InputStream = NULL;
+
+    m_Socket->Cancel();
+    delete m_Socket;
+}
+
+/*----------------------------------------------------------------------
+|   PLT_HttpServerConnection::Poll
++---------------------------------------------------------------------*/
+NPT_Result
+PLT_HttpServerConnection::Poll(const NPT_TimeStamp& now)
+{
+    NPT_Result res;
+    NPT_Size   bytes_read = 0;
+
+    // what is in our buffer (pipelined request) and in the socket, 
+    // asking doesn't read anything
+    NPT_LargeSize available = 0;
+    res = m_InputStream->GetAvailable(available);
+    if (NPT_FAILED(res)) return res;
+
+    if (available > m_Scanned) {
+        // only look at bytes we haven't scanned yet for the end of the header,
+        // a worker only gets the connection once the header is complete
+        char     buffer[PLT_HTTP_SERVER_REACTOR_MAX_HEADER_SIZE];
+        NPT_Size bytes_to_peek = (available < sizeof(buffer))?(NPT_Size)available:sizeof(buffer);
+        res = m_InputStream->Peek(buffer, bytes_to_peek, &bytes_read);
+        if (bytes_read == 0) {
+            return (NPT_SUCCEEDED(res) || res == NPT_ERROR_TIMEOUT)?NPT_ERROR_WOULD_BLOCK:res;
+        }
+
+        for (NPT_Size i=(m_Scanned>3)?m_Scanned:3; i<bytes_read; i++) {
+            if (buffer[i-3] == '\r' && buffer[i-2] == '\n' && 
+                buffer[i-1] == '\r' && buffer[i]   == '\n') {
+                m_Receiving = false;
+                m_Scanned   = 0;
+                return NPT_SUCCESS;
+            }
+        }
+        m_Scanned = bytes_read;
+
+        if (bytes_read >= sizeof(buffer)) {
+            NPT_LOG_FINE("Request header too large, closing connection");
+            return NPT_ERROR_OUT_OF_RANGE;
+        }
+    } else if (available == 0 && now > m_LastCheck + NPT_TimeInterval((double)PLT_HTTP_SERVER_REACTOR_CLOSE_CHECK)) {
+        // a closed peer is only reported as end of stream when reading, 
+        // anything read instead is scanned next time
+        char byte;
+        m_LastCheck = now;
+        res = m_InputStream->Peek(&byte, 1, &bytes_read);
+        if (bytes_read == 0 && NPT_FAILED(res) && res != NPT_ERROR_TIMEOUT) return res;
+    }
+
+    if (m_Scanned == 0) return NPT_ERROR_WOULD_BLOCK;
+
+    // don't let clients trickle their header forever
+    if (!m_Receiving) {
+        m_Receiving     = true;
+        m_HeaderStarted = now;
+    } else if (now > m_HeaderStarted + NPT_TimeInterval((double)PLT_HTTP_SERVER_REACTOR_HEADER_TIMEOUT)) {
+        NPT_LOG_FINE("Request header too slow, closing connection");
+        return NPT_ERROR_TIMEOUT;
+    }
+
+    return NPT_ERROR_WOULD_BLOCK;
+}
+
+/*----------------------------------------------------------------------
+|   PLT_HttpServerWorkerTask::DoAbort
++---------------------------------------------------------------------*/
+void
+PLT_HttpServerWorkerTask::DoAbort()
+{
+    NPT_AutoLock lock(m_Lock);
+    if (m_Socket) m_Socket->Cancel();
+}
+
+/*----------------------------------------------------------------------
+|   PLT_HttpServerWorkerTask::DoRun
++---------------------------------------------------------------------*/
+void
+PLT_HttpServerWorkerTask::DoRun()
+{
+    while (!IsAborting(0)) {
+        PLT_HttpServerConnection* connection = NULL;
+        if (NPT_FAILED(m_Reactor->WaitForConnection(connection, 100))) continue;
+
+        {
+            NPT_AutoLock lock(m_Lock);
+            m_Socket = connection->m_Socket;
+        }
+        connection->m_Socket->SetReadTimeout(PLT_HTTP_SERVER_REACTOR_READ_TIMEOUT);
+
+        // serve one request only so other connections are not kept waiting,
+        // unless more were pipelined and can be answered in the same write
+        bool         keep_alive = false;
+        NPT_Cardinal served = 0;
+        do {
+            ProcessRequest(connection->m_InputStream, connection->m_Context, keep_alive);
+        } while (keep_alive && 
+                 ++served < PLT_HTTP_SERVER_MAX_PIPELINED && 
+                 !IsAborting(0) &&
+                 HasPipelinedRequest(connection->m_InputStream));
+        if (NPT_FAILED(FlushResponses())) keep_alive = false;
+
+        {
+            NPT_AutoLock lock(m_Lock);
+            m_Socket = NULL;
+        }
+
+        // give connection back to reactor until next request
+        if (keep_alive && !IsAborting(0)) {
+            m_Reactor->ParkConnection(connection);
+        } else {
+            m_Reactor->CloseConnection(connection);
+        }
+    }
+}
+
+/*----------------------------------------------------------------------
+|   PLT_HttpServerPollTask::DoAbort
++---------------------------------------------------------------------*/
+void
+PLT_HttpServerPollTask::DoAbort()
+{
+    m_Reactor->m_Wakeup.SetValue(1);
+}
+
+/*----------------------------------------------------------------------
+|   PLT_HttpServerPollTask::DoRun
++---------------------------------------------------------------------*/
+void
+PLT_HttpServerPollTask::DoRun()
+{
+    NPT_Timeout interval = m_Interval;
+
+    while (!IsAborting(0)) {
+        // reset before polling so we don't miss connections added meanwhile
+        m_Reactor->m_Wakeup.SetValue(0);
+
+        bool         active = false;
+        NPT_Cardinal idle   = 0;
+        m_Reactor->PollConnections(active, idle);
+
+        // clients usually send their next request right after a response,
+        // check less and less often while connections stay quiet
+        if (active) {
+            interval = m_Interval;
+        } else if (interval < PLT_HTTP_SERVER_REACTOR_MAX_POLL_INTERVAL) {
+            interval *= 2;
+            if (interval > PLT_HTTP_SERVER_REACTOR_MAX_POLL_INTERVAL) {
+                interval = PLT_HTTP_SERVER_REACTOR_MAX_POLL_INTERVAL;
+            }
+        }
+
+        // nothing to poll, sleep until a connection is added
+        if (NPT_SUCCEEDED(m_Reactor->WaitForActivity(idle?interval:NPT_TIMEOUT_INFINITE))) {
+            interval = m_Interval;
+        }
+    }
+}
+
+/*----------------------------------------------------------------------
+|   PLT_HttpServerReactor::PLT_HttpServerReactor
++---------------------------------------------------------------------*/
+PLT_HttpServerReactor::PLT_HttpServerReactor(NPT_HttpRequestHandler* handler,
+                                             NPT_Cardinal            workers,         /* = 8 */
+                                             NPT_Cardinal            max_connections, /* = 1024 */
+                                             NPT_TimeInterval        idle_timeout) :  /* = NPT_TimeInterval(60.) */
+    m_Handler(handler),
+    m_Workers(workers?workers:1),
+    m_MaxConnections(max_connections),
+    m_IdleTimeout(idle_timeout),
+    m_ConnectionCount(0),
+    m_IdleCount(0),
+    m_Evictions(0)
+{
+}
+
+/*----------------------------------------------------------------------
+|   PLT_HttpServerReactor::~PLT_HttpServerReactor
++---------------------------------------------------------------------*/
+PLT_HttpServerReactor::~PLT_HttpServerReactor()
+{
+    Stop();
+}
+
+/*----------------------------------------------------------------------
+|   PLT_HttpServerReactor::Start
++---------------------------------------------------------------------*/
+NPT_Result
+PLT_HttpServerReactor::Start(PLT_TaskManagerReference& task_manager)
+{
+    NPT_CHECK_SEVERE(task_manager->StartTask(new PLT_HttpServerPollTask(this)));
+
+    for (NPT_Cardinal i=0; i<m_Workers; i++) {
+        NPT_CHECK_SEVERE(task_manager->StartTask(new PLT_HttpServerWorkerTask(m_Handler, this)));
+    }
+
+    NPT_LOG_INFO_2("HttpServer reactor started with %d workers (max %d connections)", 
+        m_Workers, 
+        m_MaxConnections);
+    return NPT_SUCCESS;
+}
+
+/*----------------------------------------------------------------------
+|   PLT_HttpServerReactor::Stop
++---------------------------------------------------------------------*/
+NPT_Result
+PLT_HttpServerReactor::Stop()
+{
+    NPT_AutoLock lock(m_Lock);
+
+    // the poll task is gone so we can touch its connections
+    PLT_HttpServerConnection* connection;
+    while (NPT_SUCCEEDED(m_PolledConnections.PopHead(connection))) {
+        delete connection;
+    }
+    while (NPT_SUCCEEDED(m_IdleConnections.PopHead(connection))) {
+        delete connection;
+    }
+    while (NPT_SUCCEEDED(m_ReadyConnections.Pop(connection, 0))) {
+        delete connection;
+    }
+    m_ConnectionCount = 0;
+    m_IdleCount       = 0;
+    m_Evictions       = 0;
+
+    return NPT_SUCCESS;
+}
+
+/*----------------------------------------------------------------------
+|   PLT_HttpServerReactor::AddConnection
++---------------------------------------------------------------------*/
+NPT_Result
+PLT_HttpServerReactor::AddConnection(NPT_Socket* socket)
+{
+    NPT_CHECK_POINTER_SEVERE(socket);
+
+    PLT_HttpServerConnection* connection = new PLT_HttpServerConnection(socket);
+    if (connection->m_InputStream.IsNull()) {
+        delete connection;
+        NPT_CHECK_WARNING(NPT_FAILURE);
+    }
+
+    NPT_AutoLock lock(m_Lock);
+
+    if (m_MaxConnections && m_ConnectionCount - m_Evictions >= m_MaxConnections) {
+        // make room by having the poll task close the connection idle for the 
+        // longest time, we're over the limit until it does
+        if (m_IdleCount <= m_Evictions) {
+            NPT_LOG_WARNING_1("Too many busy connections (%d), dropping new client", 
+                m_ConnectionCount);
+            delete connection;
+            return NPT_ERROR_OUT_OF_RESOURCES;
+        }
+
+        NPT_LOG_FINE("Max connections reached, closing oldest idle connection");
+        ++m_Evictions;
+    }
+
+    ++m_ConnectionCount;
+    ++m_IdleCount;
+    m_IdleConnections.Add(connection);
+    m_Wakeup.SetValue(1);
+
+    return NPT_SUCCESS;
+}
+
+/*----------------------------------------------------------------------
+|   PLT_HttpServerReactor::WaitForConnection
++---------------------------------------------------------------------*/
+NPT_Result
+PLT_HttpServerReactor::WaitForConnection(PLT_HttpServerConnection*& connection, 
+                                         NPT_Timeout                timeout)
+{
+    return m_ReadyConnections.Pop(connection, timeout);
+}
+
+/*----------------------------------------------------------------------
+|   PLT_HttpServerReactor::ParkConnection
++---------------------------------------------------------------------*/
+NPT_Result
+PLT_HttpServerReactor::ParkConnection(PLT_HttpServerConnection* connection)
+{
+    NPT_System::GetCurrentTimeStamp(connection->m_LastActivity);
+    connection->m_LastCheck = connection->m_LastActivity;
+    connection->m_Socket->SetReadTimeout(0);
+
+    NPT_AutoLock lock(m_Lock);
+    ++m_IdleCount;
+    m_IdleConnections.Add(connection);
+    m_Wakeup.SetValue(1);
+
+    return NPT_SUCCESS;
+}
+
+/*----------------------------------------------------------------------
+|   PLT_HttpServerReactor::WaitForActivity
++---------------------------------------------------------------------*/
+NPT_Result
+PLT_HttpServerReactor::WaitForActivity(NPT_Timeout timeout)
+{
+    return m_Wakeup.WaitUntilEquals(1, timeout);
+}
+
+/*----------------------------------------------------------------------
+|   PLT_HttpServerReactor::CloseConnection
++---------------------------------------------------------------------*/
+NPT_Result
+PLT_HttpServerReactor::CloseConnection(PLT_HttpServerConnection* connection)
+{
+    NPT_AutoLock lock(m_Lock);
+
+    if (m_ConnectionCount) --m_ConnectionCount;
+    delete connection;
+    return NPT_SUCCESS;
+}
+
+/*----------------------------------------------------------------------
+|   PLT_HttpServerReactor::PollConnections
++---------------------------------------------------------------------*/
+NPT_Result
+PLT_HttpServerReactor::PollConnections(bool& active, NPT_Cardinal& idle)
+{
+    active = false;
+
+    NPT_TimeStamp now;
+    NPT_System::GetCurrentTimeStamp(now);
+
+    // take parked connections and close the oldest ones if asked to, 
+    // the rest is done without the lock so parking isn't held up
+    NPT_Cardinal evictions;
+    {
+        NPT_AutoLock lock(m_Lock);
+        PLT_HttpServerConnection* connection;
+        while (NPT_SUCCEEDED(m_IdleConnections.PopHead(connection))) {
+            m_PolledConnections.Add(connection);
+        }
+        evictions   = m_Evictions;
+        m_Evictions = 0;
+    }
+
+    NPT_Cardinal ready = 0, closed = 0;
+    NPT_List<PLT_HttpServerConnection*>::Iterator iter = m_PolledConnections.GetFirstItem();
+    while (iter) {
+        PLT_HttpServerConnection* connection = *iter;
+
+        NPT_Result res = evictions?NPT_ERROR_INTERRUPTED:connection->Poll(now);
+        if (NPT_SUCCEEDED(res)) {
+            // a request header is complete, hand connection to a worker
+            m_PolledConnections.Erase(iter++);
+            m_ReadyConnections.Push(connection);
+            ++ready;
+            active = true;
+        } else if (res != NPT_ERROR_WOULD_BLOCK || 
+                   (!connection->m_Receiving && now > connection->m_LastActivity + m_IdleTimeout)) {
+            // connection evicted, closed, in error, too slow or idle for too long
+            if (evictions) --evictions;
+            m_PolledConnections.Erase(iter++);
+            ++closed;
+            delete connection;
+        } else {
+            if (connection->m_Receiving) active = true;
+            ++iter;
+        }
+    }
+
+    NPT_AutoLock lock(m_Lock);
+    m_IdleCount       -= ready + closed;
+    m_ConnectionCount -= closed;
+    idle = m_PolledConnections.GetItemCount() + m_IdleConnections.GetItemCount();
+    return NPT_SUCCESS;
+}
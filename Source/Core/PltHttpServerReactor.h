@@ -0,0 +1,231 @@
+/*****************************************************************
+|
+|   Platinum - HTTP Server Reactor
+|
+| Copyright (c) 2004-2010, Plutinosoft, LLC.
+| All rights reserved.
+| http://www.plutinosoft.com
+|
+| This program is free software; you can redistribute it and/or
+| modify it under the terms of the GNU General Public License
+| as published by the Free Software Foundation; either version 2
+| of the License, or (at your option) any later version.
+|
+| OEMs, ISVs, VARs and other distributors that combine and 
+| distribute commercially licensed software with Platinum software
+| and do not wish to distribute the source code for the commercially
+| licensed software under version 2, or (at your option) any later
+| version, of the GNU General Public License (the "GPL") must enter
+| into a commercial license agreement with Plutinosoft, LLC.
+| licensing@plutinosoft.com
+|  
+| This program is distributed in the hope that it will be useful,
+| but WITHOUT ANY WARRANTY; without even the implied warranty of
+| MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+| GNU General Public License for more details.
+|
+| You should have received a copy of the GNU General Public License
+| along with this program; see the file LICENSE.txt. If not, write to
+| the Free Software Foundation, Inc., 
+| 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+| http://www.gnu.org/licenses/gpl-2.0.html
+|
+****************************************************************/
+
+/** @file
+ HTTP Server Reactor
+ */
+
+#ifndef _PLT_HTTP_SERVER_REACTOR_H_
+#define _PLT_HTTP_SERVER_REACTOR_H_
+
+/*----------------------------------------------------------------------
+|   includes
++---------------------------------------------------------------------*/
+#include "Neptune.h"
+#include "PltHttpServerTask.h"
+#include "PltTaskManager.h"
+
+/*----------------------------------------------------------------------
+|   forward declarations
++---------------------------------------------------------------------*/
+class PLT_HttpServerReactor;
+
+/*----------------------------------------------------------------------
+|   constants
++---------------------------------------------------------------------*/
+#define PLT_HTTP_SERVER_REACTOR_MAX_HEADER_SIZE   8192
+#define PLT_HTTP_SERVER_REACTOR_HEADER_TIMEOUT    10    // seconds
+#define PLT_HTTP_SERVER_REACTOR_CLOSE_CHECK       1     // seconds between checks for closed peers
+#define PLT_HTTP_SERVER_REACTOR_MAX_POLL_INTERVAL 100   // milliseconds
+#define PLT_HTTP_SERVER_REACTOR_READ_TIMEOUT      60000 // milliseconds, while serving a request
+
+/*----------------------------------------------------------------------
+|   PLT_HttpServerConnection class
++---------------------------------------------------------------------*/
+/**
+ The PLT_HttpServerConnection class holds the state of a client connection
+ managed by a PLT_HttpServerReactor between two requests: the socket, its
+ buffered input stream, the time of last activity, when the first bytes
+ of the next request header arrived and how much of it was scanned already.
+ The socket has no read timeout while the connection is parked so checking
+ it never blocks.
+ */
+class PLT_HttpServerConnection
+{
+public:
+    PLT_HttpServerConnection(NPT_Socket* socket);
+    ~PLT_HttpServerConnection();
+
+    /**
+     Checks the connection without blocking. Only bytes received since the
+     last check are scanned, and a quiet connection is only read from once in
+     a while to find out if the peer closed it.
+     @param now current time
+     @return NPT_SUCCESS when a complete request header has been received,
+     NPT_ERROR_WOULD_BLOCK while waiting for it, an error if the connection 
+     was closed by the peer, failed or the header is too large.
+     */
+    NPT_Result Poll(const NPT_TimeStamp& now);
+
+    // members
+    NPT_Socket*                      m_Socket;
+    NPT_BufferedInputStreamReference m_InputStream;
+    NPT_HttpRequestContext           m_Context;
+    NPT_TimeStamp                    m_LastActivity;
+    bool                             m_Receiving; // part of a request header received
+    NPT_TimeStamp                    m_HeaderStarted;
+    NPT_Size                         m_Scanned;   // bytes of the request header scanned so far
+    NPT_TimeStamp                    m_LastCheck; // last read looking for a closed peer
+};
+
+/*----------------------------------------------------------------------
+|   PLT_HttpServerWorkerTask class
++---------------------------------------------------------------------*/
+/**
+ The PLT_HttpServerWorkerTask class is one of the tasks of a PLT_HttpServerReactor
+ pool. It processes one request at a time from any connection with data available
+ and returns keep-alive connections to the reactor once the response is sent.
+ */
+class PLT_HttpServerWorkerTask : public PLT_HttpServerTask
+{
+public:
+    PLT_HttpServerWorkerTask(NPT_HttpRequestHandler* handler, 
+                             PLT_HttpServerReactor*  reactor) : 
+        PLT_HttpServerTask(handler, NULL), m_Reactor(reactor) {}
+
+protected:
+    virtual ~PLT_HttpServerWorkerTask() {}
+
+    // PLT_ThreadTask methods
+    virtual void DoAbort();
+    virtual void DoRun();
+
+private:
+    PLT_HttpServerReactor* m_Reactor;
+    NPT_Mutex              m_Lock;
+};
+
+/*----------------------------------------------------------------------
+|   PLT_HttpServerPollTask class
++---------------------------------------------------------------------*/
+/**
+ The PLT_HttpServerPollTask class checks the idle connections of a
+ PLT_HttpServerReactor for complete requests and closed peers. Neptune sockets
+ expose neither their descriptor nor a way to wait on a set of them, so 
+ connections are swept instead: asking a socket how many bytes are waiting 
+ costs a single system call and reads nothing, only connections which received
+ something are read from. Sweeps happen often right after some activity then 
+ less and less often while nothing happens. The task sleeps until a connection 
+ is added when there is none to check.
+ */
+class PLT_HttpServerPollTask : public PLT_ThreadTask
+{
+public:
+    PLT_HttpServerPollTask(PLT_HttpServerReactor* reactor, 
+                           NPT_Timeout            interval = 10) : 
+        m_Reactor(reactor), m_Interval(interval) {}
+
+protected:
+    virtual ~PLT_HttpServerPollTask() {}
+
+    // PLT_ThreadTask methods
+    virtual void DoAbort();
+    virtual void DoRun();
+
+private:
+    PLT_HttpServerReactor* m_Reactor;
+    NPT_Timeout            m_Interval; // shortest
+};
+
+/*----------------------------------------------------------------------
+|   PLT_HttpServerReactor class
++---------------------------------------------------------------------*/
+/**
+ The PLT_HttpServerReactor class lets a PLT_HttpServer serve a large number of
+ keep-alive connections with a fixed number of tasks. Connections waiting for a
+ request are parked in an idle list polled by a single task, and connections with
+ a complete request header are queued for a pool of worker tasks, so slow clients
+ can't hold a worker while sending their headers. An idle connection only costs
+ its socket and input buffer instead of a task with its own thread.
+ */
+class PLT_HttpServerReactor
+{
+public:
+    PLT_HttpServerReactor(NPT_HttpRequestHandler* handler,
+                          NPT_Cardinal            workers = 8,
+                          NPT_Cardinal            max_connections = 1024,
+                          NPT_TimeInterval        idle_timeout = NPT_TimeInterval(60.));
+    ~PLT_HttpServerReactor();
+
+    /**
+     Starts the poll task and the worker tasks.
+     @param task_manager task manager to run the tasks with
+     */
+    NPT_Result Start(PLT_TaskManagerReference& task_manager);
+    
+    /**
+     Closes all connections. The task manager passed to Start must have
+     been aborted first.
+     */
+    NPT_Result Stop();
+
+    /**
+     Adds a newly accepted connection. The reactor takes ownership of the socket. 
+     If the maximum number of connections is reached, the connection idle for the
+     longest time is closed to make room for it.
+     */
+    NPT_Result AddConnection(NPT_Socket* socket);
+
+    NPT_Cardinal GetWorkerCount()     { return m_Workers;        }
+    NPT_Cardinal GetMaxConnections()  { return m_MaxConnections; }
+
+private:
+    friend class PLT_HttpServerWorkerTask;
+    friend class PLT_HttpServerPollTask;
+
+    // methods
+    NPT_Result WaitForConnection(PLT_HttpServerConnection*& connection, NPT_Timeout timeout);
+    NPT_Result ParkConnection(PLT_HttpServerConnection* connection);
+    NPT_Result CloseConnection(PLT_HttpServerConnection* connection);
+    NPT_Result PollConnections(bool& active, NPT_Cardinal& idle);
+    NPT_Result WaitForActivity(NPT_Timeout timeout);
+
+    // members
+    NPT_HttpRequestHandler*              m_Handler;
+    NPT_Cardinal                         m_Workers;
+    NPT_Cardinal                         m_MaxConnections;
+    NPT_TimeInterval                     m_IdleTimeout;
+    NPT_Mutex                            m_Lock;              // members below but m_PolledConnections
+    NPT_List<PLT_HttpServerConnection*>  m_IdleConnections;   // parked, not picked up by the poll task yet
+    NPT_List<PLT_HttpServerConnection*>  m_PolledConnections; // poll task only, longest idle first
+    NPT_Queue<PLT_HttpServerConnection>  m_ReadyConnections;
+    NPT_Cardinal                         m_ConnectionCount;
+    NPT_Cardinal                         m_IdleCount;         // parked or polled
+    NPT_Cardinal                         m_Evictions;         // idle connections to close to make room
+    NPT_SharedVariable                   m_Wakeup;            // connection added or parked
+};
+
+typedef NPT_Reference<PLT_HttpServerReactor> PLT_HttpServerReactorReference;
+
+#endif /* _PLT_HTTP_SERVER_REACTOR_H_ */
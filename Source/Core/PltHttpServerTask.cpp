@@ -36,6 +36,7 @@
 |   includes
 +---------------------------------------------------------------------*/
 #include "PltHttpServerTask.h"
+#include "PltHttpServerReactor.h"
 #include "PltHttp.h"
 #include "PltVersion.h"
 
@@ -57,10 +58,13 @@ PLT_HttpServerSocketTask::PLT_HttpServerSocketTask(NPT_Socket* socket,
     m_Socket(socket),
     m_StayAliveForever(stay_alive_forever)
 {
-    // needed for PS3 that is some case will request data every 35 secs and 
-    // won't like it if server disconnected too early
-    m_Socket->SetReadTimeout(60000);
-    m_Socket->SetWriteTimeout(600000);
+    // socket can be NULL for tasks serving connections handed to them later
+    if (m_Socket) {
+        // needed for PS3 that is some case will request data every 35 secs and 
+        // won't like it if server disconnected too early
+        m_Socket->SetReadTimeout(60000);
+        m_Socket->SetWriteTimeout(600000);
+    }
 }
 
 /*----------------------------------------------------------------------
@@ -82,8 +86,6 @@ PLT_HttpServerSocketTask::DoRun()
 {
     NPT_BufferedInputStreamReference buffered_input_stream;
     NPT_HttpRequestContext           context;
-    NPT_Result                       res = NPT_SUCCESS;
-    bool                             headers_only;
     bool                             keep_alive = false;
 
     // create a buffered input stream to parse HTTP request
@@ -93,44 +95,124 @@ PLT_HttpServerSocketTask::DoRun()
     buffered_input_stream = new NPT_BufferedInputStream(input_stream);
 
     while (!IsAborting(0)) {
-        NPT_HttpRequest*  request = NULL;
-        NPT_HttpResponse* response = NULL;
+        // read, process and respond to one request
+        ProcessRequest(buffered_input_stream, context, keep_alive);
 
-        // reset keep-alive to exit task on read failure
-        keep_alive = false;
+        if (!keep_alive && !m_StayAliveForever) {
+            return;
+        }
+    }
+done:
+    return;
+}
 
-        // wait for a request
-        res = Read(buffered_input_stream, request, &context);
-        if (NPT_FAILED(res) || (request == NULL)) 
-            goto cleanup;
-        
-        // process request and setup response
-        res = RespondToClient(*request, context, response);
-        if (NPT_FAILED(res) || (response == NULL)) 
-            goto cleanup;
+/*----------------------------------------------------------------------
+|   PLT_HttpServerSocketTask::ProcessRequest
++---------------------------------------------------------------------*/
+NPT_Result
+PLT_HttpServerSocketTask::ProcessRequest(NPT_BufferedInputStreamReference& buffered_input_stream,
+                                         NPT_HttpRequestContext&           context,
+                                         bool&                             keep_alive)
+{
+    NPT_HttpRequest*  request = NULL;
+    NPT_HttpResponse* response = NULL;
+    NPT_Result        res;
+    bool              headers_only;
+    bool              flush = true;
+
+    // reset keep-alive to exit task on read failure
+    keep_alive = false;
+
+    // wait for a request
+    res = Read(buffered_input_stream, request, &context);
+    if (NPT_FAILED(res) || (request == NULL)) 
+        goto cleanup;
+    
+    // process request and setup response
+    res = RespondToClient(*request, context, response);
+    if (NPT_FAILED(res) || (response == NULL)) 
+        goto cleanup;
+
+    // check if client requested keep-alive
+    keep_alive = PLT_HttpHelper::IsConnectionKeepAlive(*request);
+    headers_only = request->GetMethod() == NPT_HTTP_METHOD_HEAD;
 
-        // check if client requested keep-alive
-        keep_alive = PLT_HttpHelper::IsConnectionKeepAlive(*request);
-        headers_only = request->GetMethod() == NPT_HTTP_METHOD_HEAD;
+    // send response, pass keep-alive request from client
+    // (it can be overridden if response handler did not allow it)
+    res = Write(response, keep_alive, headers_only);
 
-        // send response, pass keep-alive request from client
-        // (it can be overridden if response handler did not allow it)
-        res = Write(response, keep_alive, headers_only);
+    // on write error, reset keep_alive so we can close this connection
+    if (NPT_FAILED(res)) keep_alive = false;
 
-        // on write error, reset keep_alive so we can close this connection
-        if (NPT_FAILED(res)) keep_alive = false;
+    // hold the response if the next request is already here so that
+    // both responses go out together
+    flush = !keep_alive                                           || 
+            m_Output.GetDataSize() >= PLT_HTTP_SERVER_COALESCE_SIZE ||
+            !HasPipelinedRequest(buffered_input_stream);
 
 cleanup:
-        // cleanup
-        delete request;
-        delete response;
+    // cleanup
+    delete request;
+    delete response;
 
-        if (!keep_alive && !m_StayAliveForever) {
-            return;
+    // responses to earlier pipelined requests are still owed on failure
+    if (flush && NPT_FAILED(FlushResponses())) {
+        keep_alive = false;
+        if (NPT_SUCCEEDED(res)) res = NPT_FAILURE;
+    }
+
+    return res;
+}
+
+/*----------------------------------------------------------------------
+|   PLT_HttpServerSocketTask::FlushResponses
++---------------------------------------------------------------------*/
+NPT_Result
+PLT_HttpServerSocketTask::FlushResponses()
+{
+    if (m_Output.GetDataSize() == 0) return NPT_SUCCESS;
+
+    NPT_OutputStreamReference output_stream;
+    NPT_Result result = m_Socket?m_Socket->GetOutputStream(output_stream):NPT_ERROR_INVALID_STATE;
+    if (NPT_SUCCEEDED(result)) {
+        result = output_stream->WriteFully(m_Output.GetData(), m_Output.GetDataSize());
+        output_stream->Flush();
+    }
+
+    // keep the buffer allocated for the next responses
+    m_Output.SetDataSize(0);
+
+    NPT_CHECK_WARNING(result);
+    return NPT_SUCCESS;
+}
+
+/*----------------------------------------------------------------------
+|   PLT_HttpServerSocketTask::HasPipelinedRequest
++---------------------------------------------------------------------*/
+bool
+PLT_HttpServerSocketTask::HasPipelinedRequest(NPT_BufferedInputStreamReference& buffered_input_stream)
+{
+    NPT_LargeSize available = 0;
+    if (NPT_FAILED(buffered_input_stream->GetAvailable(available)) || available == 0) {
+        return false;
+    }
+
+    // only a complete request header counts, otherwise we could hold
+    // responses back while the client waits for them
+    char     buffer[NPT_BUFFERED_BYTE_STREAM_DEFAULT_SIZE];
+    NPT_Size bytes_read = 0;
+    if (NPT_FAILED(buffered_input_stream->Peek(buffer, sizeof(buffer), &bytes_read))) {
+        return false;
+    }
+
+    for (NPT_Size i=3; i<bytes_read; i++) {
+        if (buffer[i-3] == '\r' && buffer[i-2] == '\n' && 
+            buffer[i-1] == '\r' && buffer[i]   == '\n') {
+            return true;
         }
     }
-done:
-    return;
+
+    return false;
 }
 
 /*----------------------------------------------------------------------
@@ -198,20 +280,27 @@ PLT_HttpServerSocketTask::Read(NPT_BufferedInputStreamReference& buffered_input_
     NPT_HttpEntity* request_entity = new NPT_HttpEntity(request->GetHeaders());
     request->SetEntity(request_entity);
 
-    NPT_MemoryStream* body_stream = new NPT_MemoryStream();
+    // small bodies (SOAP requests) are read in one go in a buffer of the right size
+    NPT_LargeSize     content_length = request_entity->GetContentLength();
+    bool              chunked = request_entity->GetTransferEncoding() == "chunked";
+    NPT_MemoryStream* body_stream = new NPT_MemoryStream(
+        (!chunked && content_length <= PLT_HTTP_SERVER_BODY_BUFFER_SIZE)?(NPT_Size)content_length:0);
     request_entity->SetInputStream((NPT_InputStreamReference)body_stream);
 
     // unbuffer the stream to read body fast
     buffered_input_stream->SetBufferSize(0);
 
     // check for chunked Transfer-Encoding
-    if (request_entity->GetTransferEncoding() == "chunked") {
+    if (chunked) {
         NPT_CHECK_SEVERE(NPT_StreamToStreamCopy(
             *NPT_InputStreamReference(new NPT_HttpChunkedInputStream(buffered_input_stream)).AsPointer(), 
             *body_stream));
 
         request_entity->SetTransferEncoding(NULL);
-    } else if (request_entity->GetContentLength()) {
+    } else if (content_length && content_length <= PLT_HTTP_SERVER_BODY_BUFFER_SIZE) {
+        NPT_CHECK_SEVERE(body_stream->SetDataSize((NPT_Size)content_length));
+        NPT_CHECK_SEVERE(buffered_input_stream->ReadFully(body_stream->UseData(), (NPT_Size)content_length));
+    } else if (content_length) {
         // a request with a body must always have a content length if not chunked
         NPT_CHECK_SEVERE(NPT_StreamToStreamCopy(
             *buffered_input_stream.AsPointer(), 
@@ -340,12 +429,8 @@ PLT_HttpServerSocketTask::SendResponseHeaders(NPT_HttpResponse* response,
 
     PLT_LOG_HTTP_RESPONSE(NPT_LOG_LEVEL_FINE, "PLT_HttpServerSocketTask::Write", response);
 
-    // create a memory stream to buffer the headers
-    NPT_MemoryStream header_stream;
-    response->Emit(header_stream);
-
-    // send the headers
-    NPT_CHECK_WARNING(output_stream.WriteFully(header_stream.GetData(), header_stream.GetDataSize()));
+    // output is buffered by the caller
+    NPT_CHECK_WARNING(response->Emit(output_stream));
 
     return NPT_SUCCESS;
 }
@@ -398,17 +483,28 @@ PLT_HttpServerSocketTask::Write(NPT_HttpResponse* response,
                                 bool&             keep_alive, 
                                 bool              headers_only /* = false */) 
 {
-    // get the socket output stream
-    NPT_OutputStreamReference output_stream;
-    NPT_CHECK_WARNING(m_Socket->GetOutputStream(output_stream));
+    // headers are buffered to go out with the body or the next response
+    NPT_CHECK_WARNING(SendResponseHeaders(response, m_Output, keep_alive));
+    if (headers_only) return NPT_SUCCESS;
 
-    // send headers
-    NPT_CHECK_WARNING(SendResponseHeaders(response, *output_stream, keep_alive));
-
-    // send the body
-    if (!headers_only) {
-        NPT_CHECK_WARNING(SendResponseBody(response, *output_stream));
+    // small bodies (SOAP responses, descriptions) are appended to the headers
+    NPT_HttpEntity*          entity = response->GetEntity();
+    NPT_InputStreamReference body_stream;
+    if (entity) entity->GetInputStream(body_stream);
+    if (body_stream.IsNull() || 
+        (entity->GetTransferEncoding() != NPT_HTTP_TRANSFER_ENCODING_CHUNKED &&
+         entity->ContentLengthIsKnown() && 
+         entity->GetContentLength() <= PLT_HTTP_SERVER_COALESCE_SIZE)) {
+        NPT_CHECK_WARNING(SendResponseBody(response, m_Output));
+        return NPT_SUCCESS;
     }
+
+    // others are streamed to the socket once what's buffered is sent
+    NPT_CHECK_WARNING(FlushResponses());
+
+    NPT_OutputStreamReference output_stream;
+    NPT_CHECK_WARNING(m_Socket->GetOutputStream(output_stream));
+    NPT_CHECK_WARNING(SendResponseBody(response, *output_stream));
     
     // flush
     output_stream->Flush();
@@ -435,6 +531,9 @@ PLT_HttpListenTask::DoRun()
             // exit on other errors ?
             NPT_LOG_WARNING_2("PLT_HttpListenTask exiting with %d (%s)", result, NPT_ResultText(result));
             break;
+        } else if (m_Reactor) {
+            // let the reactor wait for the request without tying a task up
+            m_Reactor->AddConnection(client);
         } else {
             PLT_ThreadTask* task = new PLT_HttpServerTask(m_Handler, client);
             m_TaskManager->StartTask(task);
@@ -47,6 +47,18 @@
 #include "PltDatagramStream.h"
 #include "PltThreadTask.h"
 
+/*----------------------------------------------------------------------
+|   forward declarations
++---------------------------------------------------------------------*/
+class PLT_HttpServerReactor;
+
+/*----------------------------------------------------------------------
+|   constants
++---------------------------------------------------------------------*/
+#define PLT_HTTP_SERVER_BODY_BUFFER_SIZE     65536
+#define PLT_HTTP_SERVER_COALESCE_SIZE        16384
+#define PLT_HTTP_SERVER_MAX_PIPELINED        16
+
 /*----------------------------------------------------------------------
 |   PLT_HttpServerSocketTask class
 +---------------------------------------------------------------------*/
@@ -80,6 +92,31 @@ protected:
     virtual void DoAbort() { if (m_Socket) m_Socket->Cancel(); }
     virtual void DoRun();
 
+    /**
+     Reads one request from the socket, sets up the response and sends it back.
+     Headers and small bodies are written with a single call. When the next 
+     request is already waiting (pipelining), the response is kept buffered to
+     be sent along with the next one, FlushResponses must then be called if 
+     ProcessRequest is not called again for this connection.
+     @param buffered_input_stream buffered stream used to parse requests from the socket
+     @param context request context updated with the socket addresses
+     @param keep_alive set to true if the connection can be used for another request
+     @return NPT_SUCCESS if a response was sent, error code otherwise
+     */
+    NPT_Result ProcessRequest(NPT_BufferedInputStreamReference& buffered_input_stream,
+                              NPT_HttpRequestContext&           context,
+                              bool&                             keep_alive);
+
+    /**
+     Sends responses kept buffered by ProcessRequest.
+     */
+    NPT_Result FlushResponses();
+
+    /**
+     Returns true if a complete request header has already been received.
+     */
+    bool HasPipelinedRequest(NPT_BufferedInputStreamReference& buffered_input_stream);
+
 private:
     virtual NPT_Result Read(NPT_BufferedInputStreamReference& buffered_input_stream, 
                             NPT_HttpRequest*&                 request,
@@ -99,6 +136,9 @@ private:
 protected:
     NPT_Socket*         m_Socket;
     bool                m_StayAliveForever;
+
+private:
+    NPT_MemoryStream    m_Output; // responses not sent yet
 };
 
 /*----------------------------------------------------------------------
@@ -134,15 +174,17 @@ protected:
 +---------------------------------------------------------------------*/
 /**
  The PLT_HttpListenTask class is used by a PLT_HttpServer to listen for incoming
- connections and spawn a new task for handling each request.
+ connections and spawn a new task for handling each request. When a
+ PLT_HttpServerReactor is passed, new connections are handed to it instead.
  */
 class PLT_HttpListenTask : public PLT_ThreadTask
 {
 public:
     PLT_HttpListenTask(NPT_HttpRequestHandler* handler, 
                        NPT_TcpServerSocket*    socket, 
-                       bool                    owns_socket = true) : 
-        m_Handler(handler), m_Socket(socket), m_OwnsSocket(owns_socket) {}
+                       bool                    owns_socket = true,
+                       PLT_HttpServerReactor*  reactor = NULL) : 
+        m_Handler(handler), m_Socket(socket), m_OwnsSocket(owns_socket), m_Reactor(reactor) {}
 
 protected:
     virtual ~PLT_HttpListenTask() { 
@@ -158,6 +200,7 @@ protected:
     NPT_HttpRequestHandler* m_Handler;
     NPT_TcpServerSocket*    m_Socket;
     bool                    m_OwnsSocket;
+    PLT_HttpServerReactor*  m_Reactor;
 };
 
 #endif /* _PLT_HTTP_SERVER_TASK_H_ */
@@ -0,0 +1,271 @@
+/*****************************************************************
+|
+|   Platinum - Network Interface Cache
+|
+| Copyright (c) 2004-2010, Plutinosoft, LLC.
+| All rights reserved.
+| http://www.plutinosoft.com
+|
+| This program is free software; you can redistribute it and/or
+| modify it under the terms of the GNU General Public License
+| as published by the Free Software Foundation; either version 2
+| of the License, or (at your option) any later version.
+|
+| OEMs, ISVs, VARs and other distributors that combine and 
+| distribute commercially licensed software with Platinum software
+| and do not wish to distribute the source code for the commercially
+| licensed software under version 2, or (at your option) any later
+| version, of the GNU General Public License (the "GPL") must enter
+| into a commercial license agreement with Plutinosoft, LLC.
+| licensing@plutinosoft.com
+|  
+| This program is distributed in the hope that it will be useful,
+| but WITHOUT ANY WARRANTY; without even the implied warranty of
+| MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+| GNU General Public License for more details.
+|
+| You should have received a copy of the GNU General Public License
+| along with this program; see the file LICENSE.txt. If not, write to
+| the Free Software Foundation, Inc., 
+| 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+| http://www.gnu.org/licenses/gpl-2.0.html
+|
+****************************************************************/
+
+/*----------------------------------------------------------------------
+|   includes
++---------------------------------------------------------------------*/
+#include "PltNetworkInterfaceCache.h"
+
+NPT_SET_LOCAL_LOGGER("platinum.core.network")
+
+/*----------------------------------------------------------------------
+|   globals
++---------------------------------------------------------------------*/
+static PLT_NetworkInterfaceCache NetworkInterfaceCache;
+
+/*----------------------------------------------------------------------
+|   PLT_NetworkInterfaceCache::GetInstance
++---------------------------------------------------------------------*/
+PLT_NetworkInterfaceCache&
+PLT_NetworkInterfaceCache::GetInstance()
+{
+    return NetworkInterfaceCache;
+}
+
+/*----------------------------------------------------------------------
+|   PLT_NetworkInterfaceCache::PLT_NetworkInterfaceCache
++---------------------------------------------------------------------*/
+PLT_NetworkInterfaceCache::PLT_NetworkInterfaceCache() :
+    m_MaxAge(10.),
+    m_Generation(0),
+    m_Valid(false)
+{
+}
+
+/*----------------------------------------------------------------------
+|   PLT_NetworkInterfaceCache::~PLT_NetworkInterfaceCache
++---------------------------------------------------------------------*/
+PLT_NetworkInterfaceCache::~PLT_NetworkInterfaceCache()
+{
+    m_Interfaces.Apply(NPT_ObjectDeleter<NPT_NetworkInterface>());
+}
+
+/*----------------------------------------------------------------------
+|   PLT_NetworkInterfaceCache::GetNetworkInterfaces
++---------------------------------------------------------------------*/
+NPT_Result
+PLT_NetworkInterfaceCache::GetNetworkInterfaces(NPT_List<NPT_NetworkInterface*>& if_list)
+{
+    NPT_TimeStamp now;
+    NPT_System::GetCurrentTimeStamp(now);
+
+    {
+        NPT_AutoLock lock(m_Lock);
+        if (m_Valid && now < m_LastUpdate + m_MaxAge) {
+            return CopyNetworkInterfaces(m_Interfaces, if_list);
+        }
+    }
+
+    // snapshot is too old, polling fallback
+    NPT_CHECK_WARNING(Refresh());
+
+    NPT_AutoLock lock(m_Lock);
+    return CopyNetworkInterfaces(m_Interfaces, if_list);
+}
+
+/*----------------------------------------------------------------------
+|   PLT_NetworkInterfaceCache::Refresh
++---------------------------------------------------------------------*/
+NPT_Result
+PLT_NetworkInterfaceCache::Refresh()
+{
+    NPT_List<NPT_NetworkInterface*> if_list;
+    NPT_Result result = NPT_NetworkInterface::GetNetworkInterfaces(if_list);
+    if (NPT_FAILED(result)) {
+        if_list.Apply(NPT_ObjectDeleter<NPT_NetworkInterface>());
+        NPT_CHECK_WARNING(result);
+    }
+
+    NPT_TimeStamp now;
+    NPT_System::GetCurrentTimeStamp(now);
+
+    NPT_AutoLock lock(m_Lock);
+    m_LastUpdate = now;
+
+    if (m_Valid && SameNetworkInterfaces(m_Interfaces, if_list)) {
+        if_list.Apply(NPT_ObjectDeleter<NPT_NetworkInterface>());
+        return NPT_SUCCESS;
+    }
+
+    NPT_LOG_FINE_1("Network interfaces changed (%d interfaces)", if_list.GetItemCount());
+
+    m_Interfaces.Apply(NPT_ObjectDeleter<NPT_NetworkInterface>());
+    m_Interfaces = if_list;
+    m_Valid      = true;
+    ++m_Generation;
+    return NPT_SUCCESS;
+}
+
+/*----------------------------------------------------------------------
+|   PLT_NetworkInterfaceCache::GetGeneration
++---------------------------------------------------------------------*/
+NPT_UInt32
+PLT_NetworkInterfaceCache::GetGeneration()
+{
+    NPT_AutoLock lock(m_Lock);
+    return m_Generation;
+}
+
+/*----------------------------------------------------------------------
+|   PLT_NetworkInterfaceCache::SetMaxAge
++---------------------------------------------------------------------*/
+void
+PLT_NetworkInterfaceCache::SetMaxAge(NPT_TimeInterval max_age)
+{
+    NPT_AutoLock lock(m_Lock);
+    m_MaxAge = max_age;
+}
+
+/*----------------------------------------------------------------------
+|   PLT_NetworkInterfaceCache::AddListener
++---------------------------------------------------------------------*/
+NPT_Result
+PLT_NetworkInterfaceCache::AddListener(PLT_NetworkInterfaceListener* listener)
+{
+    NPT_AutoLock lock(m_ListenersLock);
+    if (m_Listeners.Contains(listener)) return NPT_SUCCESS;
+    return m_Listeners.Add(listener);
+}
+
+/*----------------------------------------------------------------------
+|   PLT_NetworkInterfaceCache::RemoveListener
++---------------------------------------------------------------------*/
+NPT_Result
+PLT_NetworkInterfaceCache::RemoveListener(PLT_NetworkInterfaceListener* listener)
+{
+    NPT_AutoLock lock(m_ListenersLock);
+    return m_Listeners.Remove(listener);
+}
+
+/*----------------------------------------------------------------------
+|   PLT_NetworkInterfaceCache::NotifyListeners
++---------------------------------------------------------------------*/
+NPT_Result
+PLT_NetworkInterfaceCache::NotifyListeners()
+{
+    // listeners are notified with the lock held so that once
+    // RemoveListener returns, the listener is no longer called
+    NPT_AutoLock lock(m_ListenersLock);
+    NPT_List<PLT_NetworkInterfaceListener*>::Iterator listener = m_Listeners.GetFirstItem();
+    while (listener) {
+        (*listener)->OnNetworkInterfacesChanged();
+        ++listener;
+    }
+
+    return NPT_SUCCESS;
+}
+
+/*----------------------------------------------------------------------
+|   PLT_NetworkInterfaceCache::CopyNetworkInterfaces
++---------------------------------------------------------------------*/
+NPT_Result
+PLT_NetworkInterfaceCache::CopyNetworkInterfaces(const NPT_List<NPT_NetworkInterface*>& from,
+                                                 NPT_List<NPT_NetworkInterface*>&       to)
+{
+    NPT_List<NPT_NetworkInterface*>::Iterator iface = from.GetFirstItem();
+    while (iface) {
+        NPT_NetworkInterface* copy = new NPT_NetworkInterface(
+            (*iface)->GetName(), 
+            (*iface)->GetMacAddress(), 
+            (*iface)->GetFlags());
+
+        NPT_List<NPT_NetworkInterfaceAddress>::Iterator niaddr = 
+            (*iface)->GetAddresses().GetFirstItem();
+        while (niaddr) {
+            copy->AddAddress(*niaddr);
+            ++niaddr;
+        }
+
+        to.Add(copy);
+        ++iface;
+    }
+
+    return NPT_SUCCESS;
+}
+
+/*----------------------------------------------------------------------
+|   PLT_NetworkInterfaceCache::SameNetworkInterfaces
++---------------------------------------------------------------------*/
+bool
+PLT_NetworkInterfaceCache::SameNetworkInterfaces(const NPT_List<NPT_NetworkInterface*>& a,
+                                                 const NPT_List<NPT_NetworkInterface*>& b)
+{
+    if (a.GetItemCount() != b.GetItemCount()) return false;
+
+    NPT_List<NPT_NetworkInterface*>::Iterator if_a = a.GetFirstItem();
+    NPT_List<NPT_NetworkInterface*>::Iterator if_b = b.GetFirstItem();
+    while (if_a && if_b) {
+        if ((*if_a)->GetName() != (*if_b)->GetName() ||
+            (*if_a)->GetFlags() != (*if_b)->GetFlags() ||
+            (*if_a)->GetAddresses().GetItemCount() != (*if_b)->GetAddresses().GetItemCount()) {
+            return false;
+        }
+
+        NPT_List<NPT_NetworkInterfaceAddress>::Iterator addr_a = (*if_a)->GetAddresses().GetFirstItem();
+        NPT_List<NPT_NetworkInterfaceAddress>::Iterator addr_b = (*if_b)->GetAddresses().GetFirstItem();
+        while (addr_a && addr_b) {
+            if ((*addr_a).GetPrimaryAddress().AsLong() != (*addr_b).GetPrimaryAddress().AsLong() ||
+                (*addr_a).GetNetMask().AsLong()        != (*addr_b).GetNetMask().AsLong()) {
+                return false;
+            }
+            ++addr_a;
+            ++addr_b;
+        }
+
+        ++if_a;
+        ++if_b;
+    }
+
+    return true;
+}
+
+/*----------------------------------------------------------------------
+|   PLT_NetworkInterfaceMonitorTask::DoRun
++---------------------------------------------------------------------*/
+void
+PLT_NetworkInterfaceMonitorTask::DoRun()
+{
+    PLT_NetworkInterfaceCache& cache = PLT_NetworkInterfaceCache::GetInstance();
+    NPT_UInt32 generation = cache.GetGeneration();
+
+    while (!IsAborting((NPT_Timeout)m_Interval.ToMillis())) {
+        if (NPT_FAILED(cache.Refresh())) continue;
+
+        // the snapshot may also have been refreshed by a reader
+        if (cache.GetGeneration() != generation) {
+            generation = cache.GetGeneration();
+            cache.NotifyListeners();
+        }
+    }
+}
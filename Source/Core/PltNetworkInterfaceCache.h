@@ -0,0 +1,157 @@
+/*****************************************************************
+|
+|   Platinum - Network Interface Cache
+|
+| Copyright (c) 2004-2010, Plutinosoft, LLC.
+| All rights reserved.
+| http://www.plutinosoft.com
+|
+| This program is free software; you can redistribute it and/or
+| modify it under the terms of the GNU General Public License
+| as published by the Free Software Foundation; either version 2
+| of the License, or (at your option) any later version.
+|
+| OEMs, ISVs, VARs and other distributors that combine and 
+| distribute commercially licensed software with Platinum software
+| and do not wish to distribute the source code for the commercially
+| licensed software under version 2, or (at your option) any later
+| version, of the GNU General Public License (the "GPL") must enter
+| into a commercial license agreement with Plutinosoft, LLC.
+| licensing@plutinosoft.com
+|  
+| This program is distributed in the hope that it will be useful,
+| but WITHOUT ANY WARRANTY; without even the implied warranty of
+| MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+| GNU General Public License for more details.
+|
+| You should have received a copy of the GNU General Public License
+| along with this program; see the file LICENSE.txt. If not, write to
+| the Free Software Foundation, Inc., 
+| 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+| http://www.gnu.org/licenses/gpl-2.0.html
+|
+****************************************************************/
+
+/** @file
+ Network Interface Cache
+ */
+
+#ifndef _PLT_NETWORK_INTERFACE_CACHE_H_
+#define _PLT_NETWORK_INTERFACE_CACHE_H_
+
+/*----------------------------------------------------------------------
+|   includes
++---------------------------------------------------------------------*/
+#include "Neptune.h"
+#include "PltThreadTask.h"
+
+/*----------------------------------------------------------------------
+|   PLT_NetworkInterfaceListener class
++---------------------------------------------------------------------*/
+/**
+ The PLT_NetworkInterfaceListener class is an interface for being notified
+ when the list of network interfaces or their addresses change.
+ */
+class PLT_NetworkInterfaceListener
+{
+public:
+    virtual ~PLT_NetworkInterfaceListener() {}
+    virtual void OnNetworkInterfacesChanged() = 0;
+};
+
+/*----------------------------------------------------------------------
+|   PLT_NetworkInterfaceCache class
++---------------------------------------------------------------------*/
+/**
+ The PLT_NetworkInterfaceCache class keeps a process wide snapshot of the
+ network interfaces so that frequent callers do not query the OS every time.
+ The snapshot is refreshed when older than its maximum age or periodically by a
+ PLT_NetworkInterfaceMonitorTask which also notifies listeners of changes.
+ */
+class PLT_NetworkInterfaceCache
+{
+public:
+    // class methods
+    static PLT_NetworkInterfaceCache& GetInstance();
+
+    PLT_NetworkInterfaceCache();
+    ~PLT_NetworkInterfaceCache();
+
+    /**
+     Return a copy of the cached network interfaces. The caller must delete 
+     the returned interfaces.
+     @param if_list list to append the interfaces to
+     */
+    NPT_Result GetNetworkInterfaces(NPT_List<NPT_NetworkInterface*>& if_list);
+
+    /**
+     Query the OS for the network interfaces and update the snapshot.
+     */
+    NPT_Result Refresh();
+
+    /**
+     Return a counter incremented every time the snapshot changes. It lets
+     callers deriving data from the interfaces know when to recompute it.
+     */
+    NPT_UInt32 GetGeneration();
+
+    /**
+     Set how long the snapshot is used before querying the OS again.
+     @param max_age maximum age of the snapshot
+     */
+    void SetMaxAge(NPT_TimeInterval max_age);
+
+    /**
+     Register a listener notified by the monitor task when the interfaces change.
+     Listeners must not add or remove listeners from their callback.
+     */
+    NPT_Result AddListener(PLT_NetworkInterfaceListener* listener);
+    NPT_Result RemoveListener(PLT_NetworkInterfaceListener* listener);
+
+    /**
+     Notify all listeners that the interfaces have changed.
+     */
+    NPT_Result NotifyListeners();
+
+private:
+    static NPT_Result CopyNetworkInterfaces(const NPT_List<NPT_NetworkInterface*>& from,
+                                            NPT_List<NPT_NetworkInterface*>&       to);
+    static bool       SameNetworkInterfaces(const NPT_List<NPT_NetworkInterface*>& a,
+                                            const NPT_List<NPT_NetworkInterface*>& b);
+
+private:
+    NPT_Mutex                                m_Lock;
+    NPT_List<NPT_NetworkInterface*>          m_Interfaces;
+    NPT_TimeStamp                            m_LastUpdate;
+    NPT_TimeInterval                         m_MaxAge;
+    NPT_UInt32                               m_Generation;
+    bool                                     m_Valid;
+
+    NPT_Mutex                                m_ListenersLock;
+    NPT_List<PLT_NetworkInterfaceListener*>  m_Listeners;
+};
+
+/*----------------------------------------------------------------------
+|   PLT_NetworkInterfaceMonitorTask class
++---------------------------------------------------------------------*/
+/**
+ The PLT_NetworkInterfaceMonitorTask class periodically refreshes the
+ PLT_NetworkInterfaceCache and notifies its listeners when it changed.
+ */
+class PLT_NetworkInterfaceMonitorTask : public PLT_ThreadTask
+{
+public:
+    PLT_NetworkInterfaceMonitorTask(NPT_TimeInterval interval = NPT_TimeInterval(5.)) :
+        m_Interval(interval) {}
+
+protected:
+    virtual ~PLT_NetworkInterfaceMonitorTask() {}
+
+    // PLT_ThreadTask methods
+    virtual void DoRun();
+
+private:
+    NPT_TimeInterval m_Interval;
+};
+
+#endif /* _PLT_NETWORK_INTERFACE_CACHE_H_ */
@@ -0,0 +1,286 @@
+/*****************************************************************
+|
+|   Platinum - SCPD Cache
+|
+| Copyright (c) 2004-2010, Plutinosoft, LLC.
+| All rights reserved.
+| http://www.plutinosoft.com
+|
+| This program is free software; you can redistribute it and/or
+| modify it under the terms of the GNU General Public License
+| as published by the Free Software Foundation; either version 2
+| of the License, or (at your option) any later version.
+|
+| OEMs, ISVs, VARs and other distributors that combine and 
+| distribute commercially licensed software with Platinum software
+| and do not wish to distribute the source code for the commercially
+| licensed software under version 2, or (at your option) any later
+| version, of the GNU General Public License (the "GPL") must enter
+| into a commercial license agreement with Plutinosoft, LLC.
+| licensing@plutinosoft.com
+|  
+| This program is distributed in the hope that it will be useful,
+| but WITHOUT ANY WARRANTY; without even the implied warranty of
+| MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+| GNU General Public License for more details.
+|
+| You should have received a copy of the GNU General Public License
+| along with this program; see the file LICENSE.txt. If not, write to
+| the Free Software Foundation, Inc., 
+| 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+| http://www.gnu.org/licenses/gpl-2.0.html
+|
+****************************************************************/
+
+
+
+/*----------------------------------------------------------------------
+|   includes
++---------------------------------------------------------------------*/
+#include "PltSCPDCache.h"
+#include "PltService.h"
+#include "PltDeviceData.h"
+#include "PltUtilities.h"
+
+NPT_SET_LOCAL_LOGGER("platinum.core.scpdcache")
+
+/*----------------------------------------------------------------------
+|   globals
++---------------------------------------------------------------------*/
+static PLT_SCPDCache SCPDCache;
+
+/*----------------------------------------------------------------------
+|   PLT_SCPDCache::GetInstance
++---------------------------------------------------------------------*/
+PLT_SCPDCache&
+PLT_SCPDCache::GetInstance()
+{
+    return SCPDCache;
+}
+
+/*----------------------------------------------------------------------
+|   PLT_SCPDCache::GetKey
++---------------------------------------------------------------------*/
+NPT_String
+PLT_SCPDCache::GetKey(PLT_Service* service, 
+                      const char*  root_uuid, 
+                      NPT_UInt32   config_id)
+{
+    PLT_DeviceData* device = service->GetDevice();
+
+    NPT_UInt32 hash = PLT_HashHelper::HashString(service->GetSCPDURL());
+    hash = PLT_HashHelper::HashString(device->GetType(), hash);
+    hash = PLT_HashHelper::HashString(device->m_Manufacturer, hash);
+    hash = PLT_HashHelper::HashString(device->m_ModelName, hash);
+    hash = PLT_HashHelper::HashString(device->m_ModelNumber, hash);
+
+    // without a configId, there's no telling if two devices of the same
+    // model share the same firmware so only reuse the device own SCPDs
+    if (config_id == 0) hash = PLT_HashHelper::HashString(root_uuid, hash);
+
+    return NPT_String::Format("%s#%u#%08x", 
+        (const char*)service->GetServiceType(), 
+        config_id, 
+        hash);
+}
+
+/*----------------------------------------------------------------------
+|   PLT_SCPDCache::SetPath
++---------------------------------------------------------------------*/
+NPT_Result
+PLT_SCPDCache::SetPath(const char* path)
+{
+    // don't lose what was added since the previous file was saved
+    Flush();
+
+    NPT_AutoLock lock(m_Lock);
+
+    m_Path  = path;
+    m_Dirty = false;
+    if (m_Path.IsEmpty()) return NPT_SUCCESS;
+
+    // a missing file is not an error, it will be created with the first SCPD
+    NPT_String text;
+    if (NPT_FAILED(NPT_File::Load(m_Path, text))) return NPT_SUCCESS;
+
+    NPT_Result res = Parse(text);
+    if (NPT_FAILED(res)) {
+        NPT_LOG_WARNING_2("Ignoring invalid SCPD cache file %s (%d)", path, res);
+    }
+
+    return NPT_SUCCESS;
+}
+
+/*----------------------------------------------------------------------
+|   PLT_SCPDCache::Get
++---------------------------------------------------------------------*/
+NPT_Result
+PLT_SCPDCache::Get(const char* key, NPT_String& scpd)
+{
+    NPT_AutoLock lock(m_Lock);
+
+    NPT_List<Entry>::Iterator entry = m_Entries.GetFirstItem();
+    while (entry) {
+        if ((*entry).m_Key == key) {
+            // move to the end of the list as most recently used
+            Entry found = *entry;
+            m_Entries.Erase(entry);
+            m_Entries.Add(found);
+
+            scpd = found.m_SCPD;
+            return NPT_SUCCESS;
+        }
+        ++entry;
+    }
+
+    return NPT_ERROR_NO_SUCH_ITEM;
+}
+
+/*----------------------------------------------------------------------
+|   PLT_SCPDCache::Put
++---------------------------------------------------------------------*/
+NPT_Result
+PLT_SCPDCache::Put(const char* key, const NPT_String& scpd)
+{
+    NPT_String new_key = key;
+    if (new_key.IsEmpty() || 
+        new_key.Find(' ') >= 0 || 
+        new_key.Find('\n') >= 0) {
+        return NPT_ERROR_INVALID_PARAMETERS;
+    }
+    if (scpd.GetLength() > PLT_SCPD_CACHE_MAX_SIZE) return NPT_ERROR_OUT_OF_RANGE;
+
+    NPT_AutoLock lock(m_Lock);
+
+    NPT_List<Entry>::Iterator entry = m_Entries.GetFirstItem();
+    while (entry) {
+        if ((*entry).m_Key == new_key) {
+            // nothing to save if the SCPD hasn't changed
+            if ((*entry).m_SCPD == scpd) return NPT_SUCCESS;
+
+            m_Entries.Erase(entry);
+            break;
+        }
+        ++entry;
+    }
+
+    Entry new_entry;
+    new_entry.m_Key  = new_key;
+    new_entry.m_SCPD = scpd;
+    m_Entries.Add(new_entry);
+    if (m_Entries.GetItemCount() > m_MaxEntries) m_Entries.Erase(m_Entries.GetFirstItem());
+
+    m_Dirty = true;
+    return NPT_SUCCESS;
+}
+
+/*----------------------------------------------------------------------
+|   PLT_SCPDCache::Clear
++---------------------------------------------------------------------*/
+NPT_Result
+PLT_SCPDCache::Clear()
+{
+    NPT_AutoLock lock(m_Lock);
+
+    m_Entries.Clear();
+    m_Dirty = true;
+    return NPT_SUCCESS;
+}
+
+/*----------------------------------------------------------------------
+|   PLT_SCPDCache::Flush
++---------------------------------------------------------------------*/
+NPT_Result
+PLT_SCPDCache::Flush()
+{
+    NPT_AutoLock save_lock(m_SaveLock);
+
+    // take a snapshot so lookups aren't blocked while writing the file
+    NPT_String path, text;
+    {
+        NPT_AutoLock lock(m_Lock);
+        if (!m_Dirty || m_Path.IsEmpty()) return NPT_SUCCESS;
+
+        NPT_CHECK_SEVERE(Serialize(text));
+        path    = m_Path;
+        m_Dirty = false;
+    }
+
+    NPT_Result res = NPT_File::Save(path, text);
+    if (NPT_FAILED(res)) {
+        NPT_LOG_WARNING_2("Failed to save SCPD cache to %s (%d)", (const char*)path, res);
+
+        // try again next time
+        NPT_AutoLock lock(m_Lock);
+        if (m_Path == path) m_Dirty = true;
+    }
+
+    return res;
+}
+
+/*----------------------------------------------------------------------
+|   PLT_SCPDCache::Serialize
++---------------------------------------------------------------------*/
+NPT_Result
+PLT_SCPDCache::Serialize(NPT_String& text)
+{
+    // each entry is a "key length" line followed by the SCPD itself
+    text = "PLTSCPD 1\n";
+    NPT_List<Entry>::Iterator entry = m_Entries.GetFirstItem();
+    while (entry) {
+        text += (*entry).m_Key;
+        text += " ";
+        text += NPT_String::FromIntegerU((*entry).m_SCPD.GetLength());
+        text += "\n";
+        text += (*entry).m_SCPD;
+        text += "\n";
+        ++entry;
+    }
+
+    return NPT_SUCCESS;
+}
+
+/*----------------------------------------------------------------------
+|   PLT_SCPDCache::Parse
++---------------------------------------------------------------------*/
+NPT_Result
+PLT_SCPDCache::Parse(const NPT_String& text)
+{
+    NPT_List<Entry> entries;
+
+    int eol = text.Find('\n');
+    if (eol < 0 || text.SubString(0, eol).Compare("PLTSCPD 1")) return NPT_ERROR_INVALID_FORMAT;
+
+    NPT_Size position = eol + 1;
+    while (position < text.GetLength()) {
+        eol = text.Find('\n', position);
+        if (eol < 0) return NPT_ERROR_INVALID_FORMAT;
+
+        NPT_String line = text.SubString(position, eol - position);
+        int separator = line.Find(' ');
+        if (separator <= 0) return NPT_ERROR_INVALID_FORMAT;
+
+        NPT_UInt32 length;
+        NPT_CHECK(line.SubString(separator + 1).ToInteger(length));
+
+        position = eol + 1;
+        if (length > PLT_SCPD_CACHE_MAX_SIZE || 
+            position + length + 1 > text.GetLength() ||
+            text[position + length] != '\n') {
+            return NPT_ERROR_INVALID_FORMAT;
+        }
+
+        Entry entry;
+        entry.m_Key  = line.SubString(0, separator);
+        entry.m_SCPD = text.SubString(position, length);
+        entries.Add(entry);
+
+        position += length + 1;
+    }
+
+    // only keep the most recently used entries
+    while (entries.GetItemCount() > m_MaxEntries) entries.Erase(entries.GetFirstItem());
+
+    m_Entries = entries;
+    return NPT_SUCCESS;
+}
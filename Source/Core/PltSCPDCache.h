@@ -0,0 +1,129 @@
+/*****************************************************************
+|
+|   Platinum - SCPD Cache
+|
+| Copyright (c) 2004-2010, Plutinosoft, LLC.
+| All rights reserved.
+| http://www.plutinosoft.com
+|
+| This program is free software; you can redistribute it and/or
+| modify it under the terms of the GNU General Public License
+| as published by the Free Software Foundation; either version 2
+| of the License, or (at your option) any later version.
+|
+| OEMs, ISVs, VARs and other distributors that combine and 
+| distribute commercially licensed software with Platinum software
+| and do not wish to distribute the source code for the commercially
+| licensed software under version 2, or (at your option) any later
+| version, of the GNU General Public License (the "GPL") must enter
+| into a commercial license agreement with Plutinosoft, LLC.
+| licensing@plutinosoft.com
+|  
+| This program is distributed in the hope that it will be useful,
+| but WITHOUT ANY WARRANTY; without even the implied warranty of
+| MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+| GNU General Public License for more details.
+|
+| You should have received a copy of the GNU General Public License
+| along with this program; see the file LICENSE.txt. If not, write to
+| the Free Software Foundation, Inc., 
+| 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+| http://www.gnu.org/licenses/gpl-2.0.html
+|
+****************************************************************/
+
+
+
+/** @file
+ Shared service description (SCPD) cache
+ */
+
+#ifndef _PLT_SCPD_CACHE_H_
+#define _PLT_SCPD_CACHE_H_
+
+/*----------------------------------------------------------------------
+|   includes
++---------------------------------------------------------------------*/
+#include "Neptune.h"
+
+/*----------------------------------------------------------------------
+|   forward declarations
++---------------------------------------------------------------------*/
+class PLT_Service;
+
+/*----------------------------------------------------------------------
+|   constants
++---------------------------------------------------------------------*/
+#define PLT_SCPD_CACHE_MAX_ENTRIES 256
+#define PLT_SCPD_CACHE_MAX_SIZE    (256*1024)
+
+/*----------------------------------------------------------------------
+|   PLT_SCPDCache class
++---------------------------------------------------------------------*/
+/**
+ The PLT_SCPDCache class keeps the service descriptions (SCPDs) fetched by
+ control points so that devices of the same model only need their device
+ description to be fetched once their services have been seen. Entries are
+ keyed by service type, the configId of the root device (CONFIGID.UPNP.ORG)
+ and a hash of the SCPD url and device model. Devices that don't advertise
+ a configId are only matched against themselves. When a file is set, the
+ cache is loaded from it. New SCPDs only mark the cache as modified, the
+ file is rewritten by Flush, which control points call when they stop.
+ */
+class PLT_SCPDCache
+{
+public:
+    // class methods
+    static PLT_SCPDCache& GetInstance();
+
+    /**
+     Compute the key of a service SCPD.
+     @param service service of a device being inspected
+     @param root_uuid uuid of the root device of the service
+     @param config_id configId of the root device, 0 if unknown
+     */
+    static NPT_String GetKey(PLT_Service* service, 
+                             const char*  root_uuid, 
+                             NPT_UInt32   config_id);
+
+    PLT_SCPDCache(NPT_Cardinal max_entries = PLT_SCPD_CACHE_MAX_ENTRIES) : 
+        m_MaxEntries(max_entries), m_Dirty(false) {}
+    ~PLT_SCPDCache() {}
+
+    /**
+     Load previously saved SCPDs and save new ones to a file from now on.
+     Pending changes are saved to the previous file first.
+     Pass NULL to keep the cache in memory only.
+     */
+    NPT_Result SetPath(const char* path);
+
+    /**
+     Save the cache to its file if it was modified since the last save.
+     */
+    NPT_Result Flush();
+
+    NPT_Result Get(const char* key, NPT_String& scpd);
+    NPT_Result Put(const char* key, const NPT_String& scpd);
+    NPT_Result Clear();
+
+    NPT_Cardinal GetEntryCount() { NPT_AutoLock lock(m_Lock); return m_Entries.GetItemCount(); }
+
+private:
+    NPT_Result Serialize(NPT_String& text);
+    NPT_Result Parse(const NPT_String& text);
+
+    struct Entry {
+        NPT_String m_Key;
+        NPT_String m_SCPD;
+    };
+
+    // members
+    NPT_Mutex        m_Lock;
+    NPT_Mutex        m_SaveLock; // serializes file writes, taken before m_Lock
+    NPT_List<Entry>  m_Entries; // least recently used first
+    NPT_Cardinal     m_MaxEntries;
+    NPT_String       m_Path;
+    bool             m_Dirty;   // modified since loaded or saved
+};
+
+#endif /* _PLT_SCPD_CACHE_H_ */
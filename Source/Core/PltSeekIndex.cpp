@@ -0,0 +1,628 @@
+/*****************************************************************
+|
+|   Platinum - Seek Index
+|
+| Copyright (c) 2004-2010, Plutinosoft, LLC.
+| All rights reserved.
+| http://www.plutinosoft.com
+|
+| This program is free software; you can redistribute it and/or
+| modify it under the terms of the GNU General Public License
+| as published by the Free Software Foundation; either version 2
+| of the License, or (at your option) any later version.
+|
+| OEMs, ISVs, VARs and other distributors that combine and 
+| distribute commercially licensed software with Platinum software
+| and do not wish to distribute the source code for the commercially
+| licensed software under version 2, or (at your option) any later
+| version, of the GNU General Public License (the "GPL") must enter
+| into a commercial license agreement with Plutinosoft, LLC.
+| licensing@plutinosoft.com
+|  
+| This program is distributed in the hope that it will be useful,
+| but WITHOUT ANY WARRANTY; without even the implied warranty of
+| MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+| GNU General Public License for more details.
+|
+| You should have received a copy of the GNU General Public License
+| along with this program; see the file LICENSE.txt. If not, write to
+| the Free Software Foundation, Inc., 
+| 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+| http://www.gnu.org/licenses/gpl-2.0.html
+|
+****************************************************************/
+
+
+/*----------------------------------------------------------------------
+|   includes
++---------------------------------------------------------------------*/
+#include "PltSeekIndex.h"
+
+NPT_SET_LOCAL_LOGGER("platinum.core.seekindex")
+
+/*----------------------------------------------------------------------
+|   constants
++---------------------------------------------------------------------*/
+#define PLT_SEEK_INDEX_TS_SYNC_BYTE  0x47
+#define PLT_SEEK_INDEX_TS_SCAN_SIZE  65536
+#define PLT_SEEK_INDEX_TS_MIN_STEP   (1024*1024)
+#define PLT_SEEK_INDEX_TS_PCR_WRAP   ((NPT_UInt64)1 << 33)
+#define PLT_SEEK_INDEX_MP3_SCAN_SIZE 4096
+
+/*----------------------------------------------------------------------
+|   globals
++---------------------------------------------------------------------*/
+static PLT_SeekIndexCache SeekIndexCache;
+
+static const NPT_UInt32 PLT_SeekIndex_Mp3Bitrates[2][16] = {
+    {0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160, 0},     // MPEG 2 & 2.5
+    {0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 0}  // MPEG 1
+};
+static const NPT_UInt32 PLT_SeekIndex_Mp3SampleRates[3] = {44100, 48000, 32000};
+
+/*----------------------------------------------------------------------
+|   PLT_SeekIndex::Add
++---------------------------------------------------------------------*/
+NPT_Result
+PLT_SeekIndex::Add(NPT_UInt64 time, NPT_Position offset)
+{
+    // keep entries sorted by both time and offset
+    if (m_Entries.GetItemCount()) {
+        const Entry& last = m_Entries[m_Entries.GetItemCount()-1];
+        if (time < last.m_Time || offset < last.m_Offset) return NPT_ERROR_INVALID_PARAMETERS;
+        if (time == last.m_Time) return NPT_SUCCESS;
+    }
+
+    Entry entry;
+    entry.m_Time   = time;
+    entry.m_Offset = offset;
+    return m_Entries.Add(entry);
+}
+
+/*----------------------------------------------------------------------
+|   PLT_SeekIndex::FindOffset
++---------------------------------------------------------------------*/
+NPT_Result
+PLT_SeekIndex::FindOffset(NPT_UInt64 time, NPT_Position& offset) const
+{
+    if (m_Entries.GetItemCount() == 0) return NPT_ERROR_NO_SUCH_ITEM;
+    if (m_Duration && time > m_Duration) return NPT_ERROR_OUT_OF_RANGE;
+
+    // last entry at or before time
+    NPT_Cardinal low = 0, high = m_Entries.GetItemCount();
+    while (high - low > 1) {
+        NPT_Cardinal middle = (low + high) / 2;
+        if (m_Entries[middle].m_Time <= time) {
+            low = middle;
+        } else {
+            high = middle;
+        }
+    }
+
+    offset = m_Entries[low].m_Offset;
+    return NPT_SUCCESS;
+}
+
+/*----------------------------------------------------------------------
+|   PLT_SeekIndex::FindEndOffset
++---------------------------------------------------------------------*/
+NPT_Result
+PLT_SeekIndex::FindEndOffset(NPT_UInt64 time, NPT_Position& offset) const
+{
+    if (m_Entries.GetItemCount() == 0) return NPT_ERROR_NO_SUCH_ITEM;
+
+    // first entry at or after time, end of file otherwise
+    NPT_Cardinal low = 0, high = m_Entries.GetItemCount();
+    while (low < high) {
+        NPT_Cardinal middle = (low + high) / 2;
+        if (m_Entries[middle].m_Time < time) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+
+    offset = (low < m_Entries.GetItemCount())?m_Entries[low].m_Offset:m_Size;
+    return NPT_SUCCESS;
+}
+
+/*----------------------------------------------------------------------
+|   PLT_SeekIndex::Serialize
++---------------------------------------------------------------------*/
+NPT_Result
+PLT_SeekIndex::Serialize(NPT_String& text) const
+{
+    text  = "PLTSEEK 1\n";
+    text += "size " + NPT_String::FromIntegerU(m_Size) + "\n";
+    text += "duration " + NPT_String::FromIntegerU(m_Duration) + "\n";
+    for (NPT_Cardinal i=0; i<m_Entries.GetItemCount(); i++) {
+        text += NPT_String::FromIntegerU(m_Entries[i].m_Time);
+        text += " ";
+        text += NPT_String::FromIntegerU(m_Entries[i].m_Offset);
+        text += "\n";
+    }
+
+    return NPT_SUCCESS;
+}
+
+/*----------------------------------------------------------------------
+|   PLT_SeekIndex::Parse
++---------------------------------------------------------------------*/
+NPT_Result
+PLT_SeekIndex::Parse(const char* text)
+{
+    m_Entries.Clear();
+    m_Duration = 0;
+    m_Size     = 0;
+
+    NPT_List<NPT_String> lines = NPT_String(text).Split("\n");
+    NPT_List<NPT_String>::Iterator line = lines.GetFirstItem();
+    if (!line || (*line).Compare("PLTSEEK 1")) return NPT_ERROR_INVALID_FORMAT;
+
+    while (++line) {
+        if ((*line).GetLength() == 0) continue;
+
+        NPT_List<NPT_String> fields = (*line).Split(" ");
+        if (fields.GetItemCount() != 2) return NPT_ERROR_INVALID_FORMAT;
+
+        NPT_UInt64 value;
+        NPT_CHECK((*fields.GetItem(1)).ToInteger64(value));
+
+        const NPT_String& name = *fields.GetFirstItem();
+        if (name == "size") {
+            m_Size = value;
+        } else if (name == "duration") {
+            m_Duration = value;
+        } else {
+            NPT_UInt64 time;
+            NPT_CHECK(name.ToInteger64(time));
+            NPT_CHECK(Add(time, value));
+        }
+    }
+
+    return NPT_SUCCESS;
+}
+
+/*----------------------------------------------------------------------
+|   PLT_SeekIndex::ParseNptTime
++---------------------------------------------------------------------*/
+NPT_Result
+PLT_SeekIndex::ParseNptTime(const char* npt, NPT_UInt64& time)
+{
+    NPT_UInt64   seconds = 0;
+    NPT_UInt64   value   = 0;
+    NPT_UInt64   millis  = 0;
+    NPT_Cardinal digits  = 0;
+    NPT_Cardinal fraction_digits = 0;
+    bool         fraction = false;
+
+    time = 0;
+    if (npt == NULL) return NPT_ERROR_INVALID_PARAMETERS;
+
+    for (const char* c = npt; *c; ++c) {
+        if (*c >= '0' && *c <= '9') {
+            if (!fraction) {
+                value = value*10 + (*c - '0');
+                ++digits;
+            } else if (fraction_digits < 3) {
+                millis = millis*10 + (*c - '0');
+                ++fraction_digits;
+            }
+        } else if (*c == ':' && !fraction && digits) {
+            // hh:mm:ss form
+            seconds = (seconds + value)*60;
+            value   = 0;
+            digits  = 0;
+        } else if (*c == '.' && !fraction && digits) {
+            fraction = true;
+        } else {
+            return NPT_ERROR_INVALID_SYNTAX;
+        }
+    }
+    if (digits == 0) return NPT_ERROR_INVALID_SYNTAX;
+
+    while (fraction_digits++ < 3) millis *= 10;
+    time = (seconds + value)*1000 + millis;
+    return NPT_SUCCESS;
+}
+
+/*----------------------------------------------------------------------
+|   PLT_SeekIndex::FormatNptTime
++---------------------------------------------------------------------*/
+NPT_String
+PLT_SeekIndex::FormatNptTime(NPT_UInt64 time)
+{
+    return NPT_String::Format("%u.%03u", 
+                              (NPT_UInt32)(time/1000), 
+                              (NPT_UInt32)(time%1000));
+}
+
+/*----------------------------------------------------------------------
+|   PLT_SeekIndex_GetExtension
++---------------------------------------------------------------------*/
+static NPT_String
+PLT_SeekIndex_GetExtension(const char* path)
+{
+    NPT_String filename = path;
+    int last_dot = filename.ReverseFind('.');
+    if (last_dot < 0) return "";
+
+    NPT_String extension = filename.GetChars()+last_dot+1;
+    extension.MakeLowercase();
+    return extension;
+}
+
+/*----------------------------------------------------------------------
+|   PLT_SeekIndex::IsSupported
++---------------------------------------------------------------------*/
+bool
+PLT_SeekIndex::IsSupported(const char* path)
+{
+    // no MP4, a byte range of its media data can't be played without its movie box
+    NPT_String extension = PLT_SeekIndex_GetExtension(path);
+    return extension == "ts"  || extension == "m2ts" || extension == "mts" || 
+           extension == "m2t" || extension == "tts"  || extension == "mp3";
+}
+
+/*----------------------------------------------------------------------
+|   PLT_SeekIndex::Build
++---------------------------------------------------------------------*/
+NPT_Result
+PLT_SeekIndex::Build(const char* path, PLT_SeekIndex& index)
+{
+    if (!IsSupported(path)) return NPT_ERROR_NOT_SUPPORTED;
+    NPT_String extension = PLT_SeekIndex_GetExtension(path);
+
+    // open file
+    NPT_File                 file(path);
+    NPT_InputStreamReference stream;
+    NPT_LargeSize            size;
+    NPT_CHECK_WARNING(file.Open(NPT_FILE_OPEN_MODE_READ));
+    NPT_CHECK_WARNING(file.GetInputStream(stream));
+    NPT_CHECK_WARNING(file.GetSize(size));
+
+    NPT_Result res = (extension == "mp3")?
+        BuildMp3(*stream, size, index):
+        BuildMpegTs(*stream, size, index);
+
+    NPT_LOG_FINE_3("Seek index for %s: %d entries (%d)", path, index.GetEntryCount(), res);
+    return res;
+}
+
+/*----------------------------------------------------------------------
+|   PLT_SeekIndex_FindTsPcr
++---------------------------------------------------------------------*/
+static NPT_Result
+PLT_SeekIndex_FindTsPcr(const NPT_Byte* data,
+                        NPT_Size        size,
+                        NPT_Size        packet_size,
+                        NPT_UInt32&     pcr_pid,
+                        NPT_UInt64&     pcr,
+                        NPT_Size&       sync_position)
+{
+    // resynchronize on 3 consecutive sync bytes
+    NPT_Size position = 0;
+    for (; position + 2*packet_size < size; position++) {
+        if (data[position]               == PLT_SEEK_INDEX_TS_SYNC_BYTE &&
+            data[position+packet_size]   == PLT_SEEK_INDEX_TS_SYNC_BYTE &&
+            data[position+2*packet_size] == PLT_SEEK_INDEX_TS_SYNC_BYTE) {
+            break;
+        }
+    }
+
+    for (; position + 188 <= size; position += packet_size) {
+        const NPT_Byte* packet = data + position;
+        if (packet[0] != PLT_SEEK_INDEX_TS_SYNC_BYTE) break;
+
+        // adaptation field with a PCR
+        if ((packet[3] & 0x20) == 0 || packet[4] < 7 || (packet[5] & 0x10) == 0) continue;
+
+        NPT_UInt32 pid = ((packet[1] & 0x1F) << 8) | packet[2];
+        if (pcr_pid != 0xFFFF && pid != pcr_pid) continue;
+
+        pcr_pid = pid;
+        pcr = ((NPT_UInt64)packet[6] << 25) |
+              ((NPT_UInt64)packet[7] << 17) |
+              ((NPT_UInt64)packet[8] << 9)  |
+              ((NPT_UInt64)packet[9] << 1)  |
+              (packet[10] >> 7);
+        sync_position = position;
+        return NPT_SUCCESS;
+    }
+
+    return NPT_ERROR_NO_SUCH_ITEM;
+}
+
+/*----------------------------------------------------------------------
+|   PLT_SeekIndex::BuildMpegTs
++---------------------------------------------------------------------*/
+NPT_Result
+PLT_SeekIndex::BuildMpegTs(NPT_InputStream& stream, NPT_LargeSize size, PLT_SeekIndex& index)
+{
+    NPT_DataBuffer buffer(PLT_SEEK_INDEX_TS_SCAN_SIZE);
+    NPT_Byte*      data = buffer.UseData();
+    NPT_Size       bytes_read;
+
+    index.SetSize(size);
+
+    // find out packet size (188 or 192 with timecode prefix)
+    NPT_CHECK_WARNING(stream.Seek(0));
+    NPT_CHECK_WARNING(stream.Read(data, PLT_SEEK_INDEX_TS_SCAN_SIZE, &bytes_read));
+    NPT_Size packet_size = 0;
+    for (NPT_Size candidate = 188; candidate <= 192 && !packet_size; candidate += 4) {
+        for (NPT_Size i=0; i<candidate && i + 2*candidate < bytes_read; i++) {
+            if (data[i]             == PLT_SEEK_INDEX_TS_SYNC_BYTE &&
+                data[i+candidate]   == PLT_SEEK_INDEX_TS_SYNC_BYTE &&
+                data[i+2*candidate] == PLT_SEEK_INDEX_TS_SYNC_BYTE) {
+                packet_size = candidate;
+                break;
+            }
+        }
+    }
+    if (packet_size == 0) return NPT_ERROR_INVALID_FORMAT;
+    NPT_Size prefix_size = packet_size - 188;
+
+    // sample PCRs at regular intervals of the file, the last sample
+    // being close enough to the end to give the duration
+    NPT_LargeSize step = size / PLT_SEEK_INDEX_MAX_ENTRIES;
+    if (step < PLT_SEEK_INDEX_TS_MIN_STEP) step = PLT_SEEK_INDEX_TS_MIN_STEP;
+
+    NPT_UInt32 pcr_pid = 0xFFFF;
+    NPT_UInt64 first_pcr = 0, last_pcr = 0, wrap = 0;
+    bool       first = true;
+    for (NPT_Position offset = 0; offset < size; offset += step) {
+        if (offset + step >= size && size > PLT_SEEK_INDEX_TS_SCAN_SIZE) {
+            offset = size - PLT_SEEK_INDEX_TS_SCAN_SIZE;
+        }
+
+        NPT_Size to_read = PLT_SEEK_INDEX_TS_SCAN_SIZE;
+        if (offset + to_read > size) to_read = (NPT_Size)(size - offset);
+        if (NPT_FAILED(stream.Seek(offset)) || 
+            NPT_FAILED(stream.ReadFully(data, to_read))) {
+            break;
+        }
+
+        NPT_UInt64 pcr;
+        NPT_Size   position;
+        if (NPT_FAILED(PLT_SeekIndex_FindTsPcr(data, to_read, packet_size, pcr_pid, pcr, position))) {
+            continue;
+        }
+
+        if (first) {
+            first_pcr = last_pcr = pcr;
+            first = false;
+        }
+        if (pcr < last_pcr) wrap += PLT_SEEK_INDEX_TS_PCR_WRAP;
+        last_pcr = pcr;
+
+        // PCR base is 90kHz, start at the packet including its prefix
+        NPT_UInt64 time = (pcr + wrap - first_pcr)/90;
+        index.Add(time, offset + position - ((position >= prefix_size)?prefix_size:0));
+        if (time > index.GetDuration()) index.SetDuration(time);
+
+        if (offset + PLT_SEEK_INDEX_TS_SCAN_SIZE >= size) break;
+    }
+
+    return index.GetEntryCount()?NPT_SUCCESS:NPT_ERROR_INVALID_FORMAT;
+}
+
+/*----------------------------------------------------------------------
+|   PLT_SeekIndex::BuildMp3
++---------------------------------------------------------------------*/
+NPT_Result
+PLT_SeekIndex::BuildMp3(NPT_InputStream& stream, NPT_LargeSize size, PLT_SeekIndex& index)
+{
+    NPT_Byte     data[PLT_SEEK_INDEX_MP3_SCAN_SIZE];
+    NPT_Position start = 0;
+
+    index.SetSize(size);
+
+    // skip ID3v2 tag
+    NPT_CHECK_WARNING(stream.Seek(0));
+    NPT_CHECK_WARNING(stream.ReadFully(data, 10));
+    if (NPT_MemoryEqual(data, "ID3", 3)) {
+        start = 10 + (((data[6] & 0x7F) << 21) | 
+                      ((data[7] & 0x7F) << 14) | 
+                      ((data[8] & 0x7F) << 7)  | 
+                       (data[9] & 0x7F));
+        if (data[5] & 0x10) start += 10; // footer
+    }
+    if (start >= size) return NPT_ERROR_INVALID_FORMAT;
+
+    NPT_Size to_read = PLT_SEEK_INDEX_MP3_SCAN_SIZE;
+    if (start + to_read > size) to_read = (NPT_Size)(size - start);
+    NPT_CHECK_WARNING(stream.Seek(start));
+    NPT_CHECK_WARNING(stream.ReadFully(data, to_read));
+
+    // first layer III frame header
+    NPT_Size   position;
+    NPT_UInt32 header = 0;
+    for (position = 0; position + 4 <= to_read; position++) {
+        header = NPT_BytesToInt32Be(data+position);
+        if ((header & 0xFFE00000) == 0xFFE00000 &&  // sync
+            ((header >> 19) & 3) != 1           &&  // version
+            ((header >> 17) & 3) == 1           &&  // layer III
+            ((header >> 12) & 0xF) != 0xF       &&  // bitrate
+            ((header >> 10) & 3) != 3) {            // sample rate
+            break;
+        }
+    }
+    if (position + 4 > to_read) return NPT_ERROR_INVALID_FORMAT;
+
+    bool         mpeg1       = ((header >> 19) & 3) == 3;
+    bool         mono        = ((header >> 6) & 3) == 3;
+    NPT_UInt32   sample_rate = PLT_SeekIndex_Mp3SampleRates[(header >> 10) & 3] >> (mpeg1?0:((((header >> 19) & 3) == 2)?1:2));
+    NPT_UInt32   bitrate     = PLT_SeekIndex_Mp3Bitrates[mpeg1?1:0][(header >> 12) & 0xF]*1000;
+    NPT_UInt32   spf         = mpeg1?1152:576;
+    NPT_Position first_frame = start + position;
+    NPT_UInt64   stream_size = size - first_frame;
+
+    // Xing/Info header with an optional table of contents
+    NPT_Size xing = position + 4 + (mpeg1?(mono?17:32):(mono?9:17));
+    if (xing + 8 <= to_read && 
+        (NPT_MemoryEqual(data+xing, "Xing", 4) || NPT_MemoryEqual(data+xing, "Info", 4))) {
+        NPT_UInt32 flags  = NPT_BytesToInt32Be(data+xing+4);
+        NPT_Size   field  = xing + 8;
+        NPT_UInt32 frames = 0;
+        if ((flags & 1) && field + 4 <= to_read) {
+            frames = NPT_BytesToInt32Be(data+field);
+            field += 4;
+        }
+        if ((flags & 2) && field + 4 <= to_read) {
+            if (NPT_BytesToInt32Be(data+field)) stream_size = NPT_BytesToInt32Be(data+field);
+            field += 4;
+        }
+        if (frames && sample_rate) {
+            NPT_UInt64 duration = (NPT_UInt64)frames*spf*1000/sample_rate;
+            index.SetDuration(duration);
+            if ((flags & 4) && field + 100 <= to_read) {
+                for (unsigned int i=0; i<100; i++) {
+                    index.Add(duration*i/100, first_frame + stream_size*data[field+i]/256);
+                }
+                return NPT_SUCCESS;
+            }
+        }
+    }
+
+    // VBRI header always 32 bytes after the frame header
+    NPT_Size vbri = position + 4 + 32;
+    if (vbri + 26 <= to_read && NPT_MemoryEqual(data+vbri, "VBRI", 4)) {
+        NPT_UInt32 frames           = NPT_BytesToInt32Be(data+vbri+14);
+        NPT_UInt32 entries          = NPT_BytesToInt16Be(data+vbri+18);
+        NPT_UInt32 scale            = NPT_BytesToInt16Be(data+vbri+20);
+        NPT_UInt32 entry_size       = NPT_BytesToInt16Be(data+vbri+22);
+        NPT_UInt32 frames_per_entry = NPT_BytesToInt16Be(data+vbri+24);
+        if (frames && sample_rate && entry_size >= 1 && entry_size <= 4 &&
+            vbri + 26 + entries*entry_size <= to_read) {
+            index.SetDuration((NPT_UInt64)frames*spf*1000/sample_rate);
+
+            NPT_Position offset = first_frame;
+            for (NPT_UInt32 i=0; i<=entries; i++) {
+                index.Add((NPT_UInt64)i*frames_per_entry*spf*1000/sample_rate, offset);
+                if (i == entries) break;
+
+                NPT_UInt32 delta = 0;
+                for (NPT_UInt32 b=0; b<entry_size; b++) {
+                    delta = (delta << 8) | data[vbri+26+i*entry_size+b];
+                }
+                offset += (NPT_Position)delta*scale;
+            }
+            return NPT_SUCCESS;
+        }
+    }
+
+    // constant bitrate
+    if (bitrate == 0) return NPT_ERROR_NOT_SUPPORTED;
+    NPT_UInt64 duration = stream_size*8*1000/bitrate;
+    index.SetDuration(duration);
+    for (unsigned int i=0; i<100; i++) {
+        index.Add(duration*i/100, first_frame + stream_size*i/100);
+    }
+
+    return NPT_SUCCESS;
+}
+
+/*----------------------------------------------------------------------
+|   PLT_SeekIndexCache::GetInstance
++---------------------------------------------------------------------*/
+PLT_SeekIndexCache&
+PLT_SeekIndexCache::GetInstance()
+{
+    return SeekIndexCache;
+}
+
+/*----------------------------------------------------------------------
+|   PLT_SeekIndexCache::GetIndex
++---------------------------------------------------------------------*/
+NPT_Result
+PLT_SeekIndexCache::GetIndex(const char*             path, 
+                             const NPT_FileInfo&     info,
+                             PLT_SeekIndexReference& index)
+{
+    Item entry;
+    entry.m_Path             = path;
+    entry.m_Size             = info.m_Size;
+    entry.m_ModificationTime = (NPT_UInt32)info.m_ModificationTime;
+
+    // most recently used files
+    if (Find(entry, index)) {
+        // remember files we can't index too
+        return index.IsNull()?NPT_ERROR_NOT_SUPPORTED:NPT_SUCCESS;
+    }
+
+    // load or build the index without holding the lock, building reads
+    // parts of the file and saving writes next to it
+    entry.m_Index = new PLT_SeekIndex();
+
+    // try the index saved next to the file if more recent, 
+    // as long as we still answer time seeks for this kind of file
+    NPT_String   index_path = entry.m_Path + PLT_SEEK_INDEX_FILE_EXTENSION;
+    NPT_FileInfo index_info;
+    NPT_String   text;
+    if (!PLT_SeekIndex::IsSupported(path)                                                     ||
+        NPT_FAILED(NPT_File::GetInfo(index_path, &index_info))                               ||
+        (NPT_UInt32)index_info.m_ModificationTime < (NPT_UInt32)info.m_ModificationTime ||
+        NPT_FAILED(NPT_File::Load(index_path, text))                                      ||
+        NPT_FAILED(entry.m_Index->Parse(text))                                            ||
+        entry.m_Index->GetSize() != info.m_Size) {
+        // build it, this only reads small parts of the file
+        entry.m_Index = new PLT_SeekIndex();
+        if (NPT_FAILED(PLT_SeekIndex::Build(path, *entry.m_Index))) {
+            entry.m_Index = NULL;
+        } else if (NPT_SUCCEEDED(entry.m_Index->Serialize(text))) {
+            // best effort, media folders are often read only
+            NPT_File::Save(index_path, text);
+        }
+    }
+
+    {
+        NPT_AutoLock lock(m_Lock);
+
+        // another request may have indexed the same file meanwhile
+        if (!FindLocked(entry, index)) {
+            m_Items.Add(entry);
+            if (m_Items.GetItemCount() > m_MaxItems) m_Items.Erase(m_Items.GetFirstItem());
+            index = entry.m_Index;
+        }
+    }
+
+    return index.IsNull()?NPT_ERROR_NOT_SUPPORTED:NPT_SUCCESS;
+}
+
+/*----------------------------------------------------------------------
+|   PLT_SeekIndexCache::Find
++---------------------------------------------------------------------*/
+bool
+PLT_SeekIndexCache::Find(const Item& entry, PLT_SeekIndexReference& index)
+{
+    NPT_AutoLock lock(m_Lock);
+    return FindLocked(entry, index);
+}
+
+/*----------------------------------------------------------------------
+|   PLT_SeekIndexCache::FindLocked
++---------------------------------------------------------------------*/
+bool
+PLT_SeekIndexCache::FindLocked(const Item& entry, PLT_SeekIndexReference& index)
+{
+    NPT_List<Item>::Iterator item = m_Items.GetFirstItem();
+    while (item) {
+        if ((*item).m_Path == entry.m_Path) {
+            if ((*item).m_Size == entry.m_Size && 
+                (*item).m_ModificationTime == entry.m_ModificationTime) {
+                Item found = *item;
+                m_Items.Erase(item);
+                m_Items.Add(found);
+                index = found.m_Index;
+                return true;
+            }
+
+            // stale, the file changed since it was indexed
+            m_Items.Erase(item);
+            return false;
+        }
+        ++item;
+    }
+
+    return false;
+}
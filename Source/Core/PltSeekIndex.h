@@ -0,0 +1,167 @@
+/*****************************************************************
+|
+|   Platinum - Seek Index
+|
+| Copyright (c) 2004-2010, Plutinosoft, LLC.
+| All rights reserved.
+| http://www.plutinosoft.com
+|
+| This program is free software; you can redistribute it and/or
+| modify it under the terms of the GNU General Public License
+| as published by the Free Software Foundation; either version 2
+| of the License, or (at your option) any later version.
+|
+| OEMs, ISVs, VARs and other distributors that combine and 
+| distribute commercially licensed software with Platinum software
+| and do not wish to distribute the source code for the commercially
+| licensed software under version 2, or (at your option) any later
+| version, of the GNU General Public License (the "GPL") must enter
+| into a commercial license agreement with Plutinosoft, LLC.
+| licensing@plutinosoft.com
+|  
+| This program is distributed in the hope that it will be useful,
+| but WITHOUT ANY WARRANTY; without even the implied warranty of
+| MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+| GNU General Public License for more details.
+|
+| You should have received a copy of the GNU General Public License
+| along with this program; see the file LICENSE.txt. If not, write to
+| the Free Software Foundation, Inc., 
+| 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+| http://www.gnu.org/licenses/gpl-2.0.html
+|
+****************************************************************/
+
+
+/** @file
+ Time to byte offset seek index
+ */
+
+#ifndef _PLT_SEEK_INDEX_H_
+#define _PLT_SEEK_INDEX_H_
+
+/*----------------------------------------------------------------------
+|   includes
++---------------------------------------------------------------------*/
+#include "Neptune.h"
+
+/*----------------------------------------------------------------------
+|   constants
++---------------------------------------------------------------------*/
+#define PLT_SEEK_INDEX_FILE_EXTENSION ".pltseek"
+#define PLT_SEEK_INDEX_MAX_ENTRIES    4096
+
+/*----------------------------------------------------------------------
+|   PLT_SeekIndex class
++---------------------------------------------------------------------*/
+/**
+ The PLT_SeekIndex class maps playback times to byte offsets in a media file
+ so that DLNA time based seek requests (TimeSeekRange.dlna.org) can be
+ answered with a byte range. Indexes are built by scanning MPEG transport
+ streams for PCRs or reading the Xing/VBRI table of contents of MP3 files.
+ Both can be played from any packet or frame. MP4 files are not supported:
+ a byte range of their media data carries no movie box and can't be played
+ without remuxing, so time seeks on them are refused (406).
+ */
+class PLT_SeekIndex
+{
+public:
+    struct Entry {
+        NPT_UInt64   m_Time;   // milliseconds
+        NPT_Position m_Offset; // bytes
+    };
+
+    PLT_SeekIndex() : m_Duration(0), m_Size(0) {}
+    ~PLT_SeekIndex() {}
+
+    /**
+     Return whether an index can be built for a media file based on its extension.
+     */
+    static bool IsSupported(const char* path);
+
+    /**
+     Build an index for a media file based on its extension.
+     @return NPT_ERROR_NOT_SUPPORTED if the container is not supported
+     */
+    static NPT_Result Build(const char* path, PLT_SeekIndex& index);
+    static NPT_Result BuildMpegTs(NPT_InputStream& stream, NPT_LargeSize size, PLT_SeekIndex& index);
+    static NPT_Result BuildMp3(NPT_InputStream& stream, NPT_LargeSize size, PLT_SeekIndex& index);
+
+    /**
+     Add an entry, times must be added in increasing order.
+     */
+    NPT_Result Add(NPT_UInt64 time, NPT_Position offset);
+
+    /**
+     Find the offset to start reading from to play at a given time.
+     */
+    NPT_Result FindOffset(NPT_UInt64 time, NPT_Position& offset) const;
+
+    /**
+     Find the offset to stop reading at to play up to a given time.
+     */
+    NPT_Result FindEndOffset(NPT_UInt64 time, NPT_Position& offset) const;
+
+    NPT_UInt64    GetDuration() const { return m_Duration; }
+    NPT_LargeSize GetSize() const { return m_Size; }
+    NPT_Cardinal  GetEntryCount() const { return m_Entries.GetItemCount(); }
+    void          SetDuration(NPT_UInt64 duration) { m_Duration = duration; }
+    void          SetSize(NPT_LargeSize size) { m_Size = size; }
+
+    NPT_Result Serialize(NPT_String& text) const;
+    NPT_Result Parse(const char* text);
+
+    /**
+     Parse a npt time as used by TimeSeekRange.dlna.org (ss.sss or hh:mm:ss.sss).
+     */
+    static NPT_Result ParseNptTime(const char* npt, NPT_UInt64& time);
+    static NPT_String FormatNptTime(NPT_UInt64 time);
+
+private:
+    NPT_Array<Entry> m_Entries;
+    NPT_UInt64       m_Duration; // milliseconds
+    NPT_LargeSize    m_Size;
+};
+
+typedef NPT_Reference<PLT_SeekIndex> PLT_SeekIndexReference;
+
+/*----------------------------------------------------------------------
+|   PLT_SeekIndexCache class
++---------------------------------------------------------------------*/
+/**
+ The PLT_SeekIndexCache class returns the seek index of a media file, building
+ it the first time it is needed. Indexes are saved next to the media file
+ when the directory is writable and kept in memory for the most recently used
+ files.
+ */
+class PLT_SeekIndexCache
+{
+public:
+    // class methods
+    static PLT_SeekIndexCache& GetInstance();
+
+    PLT_SeekIndexCache(NPT_Cardinal max_items = 32) : m_MaxItems(max_items) {}
+    ~PLT_SeekIndexCache() {}
+
+    NPT_Result GetIndex(const char*             path, 
+                        const NPT_FileInfo&     info,
+                        PLT_SeekIndexReference& index);
+
+private:
+    struct Item {
+        NPT_String             m_Path;
+        NPT_LargeSize          m_Size;
+        NPT_UInt32             m_ModificationTime;
+        PLT_SeekIndexReference m_Index;
+    };
+
+    bool Find(const Item& entry, PLT_SeekIndexReference& index);
+    bool FindLocked(const Item& entry, PLT_SeekIndexReference& index);
+
+    // members
+    NPT_Mutex      m_Lock;
+    NPT_List<Item> m_Items; // most recently used last
+    NPT_Cardinal   m_MaxItems;
+};
+
+#endif /* _PLT_SEEK_INDEX_H_ */
@@ -55,7 +55,7 @@ PLT_Service::PLT_Service(PLT_DeviceData* device,
     m_ServiceType(type),
     m_ServiceID(id),
 	m_ServiceName(name),
-    m_EventTask(NULL),
+    m_EventScheduler(NULL),
     m_EventingPaused(false),
     m_LastChangeNamespace(last_change_namespace)
 {
@@ -81,6 +81,8 @@ PLT_Service::~PLT_Service()
 
      m_ActionDescs.Clear();
      m_StateVars.Clear();
+     m_ActionDescsByName.Clear();
+     m_StateVarsByName.Clear();
      m_Subscribers.Clear();
  }
 
@@ -129,6 +131,54 @@ cleanup:
     return res;
 }
 
+/*----------------------------------------------------------------------
+|   PLT_Service::GetSCPDSignature
++---------------------------------------------------------------------*/
+NPT_UInt32
+PLT_Service::GetSCPDSignature()
+{
+    NPT_UInt32 signature = PLT_HashHelper::HashInteger(m_ActionDescs.GetItemCount());
+    for (NPT_Cardinal i=0; i<m_ActionDescs.GetItemCount(); i++) {
+        PLT_ActionDesc* action = m_ActionDescs[i];
+        signature = PLT_HashHelper::HashString(action->GetName(), signature);
+
+        NPT_Array<PLT_ArgumentDesc*>& args = action->GetArgumentDescs();
+        signature = PLT_HashHelper::HashInteger(args.GetItemCount(), signature);
+        for (NPT_Cardinal j=0; j<args.GetItemCount(); j++) {
+            PLT_StateVariable* related = args[j]->GetRelatedStateVariable();
+            signature = PLT_HashHelper::HashString(args[j]->GetName(), signature);
+            signature = PLT_HashHelper::HashString(args[j]->GetDirection(), signature);
+            signature = PLT_HashHelper::HashString(related?related->GetName().GetChars():"", signature);
+            signature = PLT_HashHelper::HashInteger(args[j]->HasReturnValue()?1:0, signature);
+        }
+    }
+
+    signature = PLT_HashHelper::HashInteger(m_StateVars.GetItemCount(), signature);
+    NPT_List<PLT_StateVariable*>::Iterator var = m_StateVars.GetFirstItem();
+    while (var) {
+        signature = PLT_HashHelper::HashString((*var)->m_Name, signature);
+        signature = PLT_HashHelper::HashString((*var)->m_DataType, signature);
+        signature = PLT_HashHelper::HashString((*var)->m_DefaultValue, signature);
+        signature = PLT_HashHelper::HashInteger((*var)->m_IsSendingEvents?1:0, signature);
+
+        signature = PLT_HashHelper::HashInteger((*var)->m_AllowedValues.GetItemCount(), signature);
+        for (NPT_Cardinal i=0; i<(*var)->m_AllowedValues.GetItemCount(); i++) {
+            signature = PLT_HashHelper::HashString(*(*var)->m_AllowedValues[i], signature);
+        }
+
+        const NPT_AllowedValueRange* range = (*var)->m_AllowedValueRange;
+        signature = PLT_HashHelper::HashInteger(range?1:0, signature);
+        if (range) {
+            signature = PLT_HashHelper::HashInteger((NPT_UInt32)range->min_value, signature);
+            signature = PLT_HashHelper::HashInteger((NPT_UInt32)range->max_value, signature);
+            signature = PLT_HashHelper::HashInteger((NPT_UInt32)range->step, signature);
+        }
+        ++var;
+    }
+
+    return signature;
+}
+
 /*----------------------------------------------------------------------
 |   PLT_Service::ToXML
 +---------------------------------------------------------------------*/
@@ -218,6 +268,7 @@ PLT_Service::SetSCPDXML(const char* scpd)
 
         PLT_StateVariable* variable = new PLT_StateVariable(this);
         m_StateVars.Add(variable);
+        m_StateVarsByName.Put(name, variable);
 
         variable->m_Name = name;
         variable->m_DataType = type;
@@ -309,6 +360,7 @@ PLT_Service::SetSCPDXML(const char* scpd)
 
             PLT_ActionDesc* action_desc = new PLT_ActionDesc(action_name, this);
             m_ActionDescs.Add(action_desc);        
+            m_ActionDescsByName.Put(action_name, action_desc);
             
             // action arguments
             NPT_XmlElementNode* argumentList = PLT_XmlHelper::GetChild(actions[i], "argumentList");
@@ -349,7 +401,7 @@ PLT_Service::SetSCPDXML(const char* scpd)
                         ret_value_found = true;
                     }
                 }
-                action_desc->GetArgumentDescs().Add(new PLT_ArgumentDesc(name, j, direction, variable, ret_value));
+                action_desc->AddArgumentDesc(new PLT_ArgumentDesc(name, j, direction, variable, ret_value));
             }
         }
     }
@@ -414,7 +466,7 @@ PLT_ActionDesc*
 PLT_Service::FindActionDesc(const char* name)
 {
     PLT_ActionDesc* action = NULL;
-    NPT_ContainerFind(m_ActionDescs, PLT_ActionDescNameFinder(name), action);
+    m_ActionDescsByName.Get(name, action);
     return action;
 }
 
@@ -425,7 +477,7 @@ PLT_StateVariable*
 PLT_Service::FindStateVariable(const char* name)
 {
     PLT_StateVariable* stateVariable = NULL;
-    NPT_ContainerFind(m_StateVars, PLT_StateVariableNameFinder(name), stateVariable);
+    m_StateVarsByName.Get(name, stateVariable);
     return stateVariable;
 }
 
@@ -461,8 +513,7 @@ PLT_Service::IsSubscribable()
 NPT_Result
 PLT_Service::SetStateVariable(const char* name, const char* value)
 {
-    PLT_StateVariable* stateVariable = NULL;
-    NPT_ContainerFind(m_StateVars, PLT_StateVariableNameFinder(name), stateVariable);
+    PLT_StateVariable* stateVariable = FindStateVariable(name);
     if (stateVariable == NULL)
         return NPT_FAILURE;
 
@@ -475,8 +526,7 @@ PLT_Service::SetStateVariable(const char* name, const char* value)
 NPT_Result
 PLT_Service::SetStateVariableRate(const char* name, NPT_TimeInterval rate)
 {
-    PLT_StateVariable* stateVariable = NULL;
-    NPT_ContainerFind(m_StateVars, PLT_StateVariableNameFinder(name), stateVariable);
+    PLT_StateVariable* stateVariable = FindStateVariable(name);
     if (stateVariable == NULL)
         return NPT_FAILURE;
 
@@ -491,8 +541,7 @@ PLT_Service::SetStateVariableExtraAttribute(const char* name,
 											const char* key,
 											const char* value)
 {
-    PLT_StateVariable* stateVariable = NULL;
-    NPT_ContainerFind(m_StateVars, PLT_StateVariableNameFinder(name), stateVariable);
+    PLT_StateVariable* stateVariable = FindStateVariable(name);
     if (stateVariable == NULL)
         return NPT_FAILURE;
 
@@ -505,8 +554,7 @@ PLT_Service::SetStateVariableExtraAttribute(const char* name,
 NPT_Result
 PLT_Service::IncStateVariable(const char* name)
 {
-    PLT_StateVariable* stateVariable = NULL;
-    NPT_ContainerFind(m_StateVars, PLT_StateVariableNameFinder(name), stateVariable);
+    PLT_StateVariable* stateVariable = FindStateVariable(name);
     if (stateVariable == NULL)
         return NPT_FAILURE;
 
@@ -524,11 +572,12 @@ PLT_Service::IncStateVariable(const char* name)
 |   PLT_Service::ProcessNewSubscription
 +---------------------------------------------------------------------*/
 NPT_Result
-PLT_Service::ProcessNewSubscription(PLT_TaskManagerReference task_manager,
-                                    const NPT_SocketAddress& addr, 
-                                    const NPT_String&        callback_urls, 
-                                    int                      timeout, 
-                                    NPT_HttpResponse&        response)
+PLT_Service::ProcessNewSubscription(PLT_EventDispatcherReference dispatcher,
+                                    PLT_ServiceEventScheduler*   scheduler,
+                                    const NPT_SocketAddress&     addr, 
+                                    const NPT_String&            callback_urls, 
+                                    int                          timeout, 
+                                    NPT_HttpResponse&            response)
 {
     NPT_LOG_FINE_2("New subscription for %s (timeout = %d)", m_EventSubURL.GetChars(), timeout);
 
@@ -546,7 +595,7 @@ PLT_Service::ProcessNewSubscription(PLT_TaskManagerReference task_manager,
 //    }
 //
     // reject if we have too many subscribers already
-    if (m_Subscribers.GetItemCount() > 30) {
+    if (m_Subscribers.GetItemCount() >= PLT_SERVICE_MAX_SUBSCRIBERS) {
         response.SetStatus(500, "Internal Server Error");
         return NPT_FAILURE;
     }
@@ -558,7 +607,7 @@ PLT_Service::ProcessNewSubscription(PLT_TaskManagerReference task_manager,
     PLT_UPnPMessageHelper::GenerateGUID(sid);
     sid = "uuid:" + sid;
 
-    PLT_EventSubscriberReference subscriber(new PLT_EventSubscriber(task_manager, this, sid, timeout));
+    PLT_EventSubscriberReference subscriber(new PLT_EventSubscriber(dispatcher, this, sid, timeout));
     // parse the callback URLs
     bool reachable = false;
     if (callback_urls[0] == '<') {
@@ -602,16 +651,11 @@ PLT_Service::ProcessNewSubscription(PLT_TaskManagerReference task_manager,
         // reset LastChange var to what was really just changed
         UpdateLastChange(m_StateVarsChanged);
 
-        // make sure the event worked before spawning our recurrent task
+        // make sure the event worked before enabling eventing
         NPT_CHECK_LABEL_FATAL(res, cleanup);
 
-        // schedule a recurring event notification task if not running already
-        if (!m_EventTask) {
-            PLT_ServiceEventTask *task = new PLT_ServiceEventTask(this);
-            NPT_CHECK_SEVERE(task_manager->StartTask(task));
-            
-            m_EventTask = task;
-        }
+        // from now on changes get scheduled with the device event scheduler
+        if (!m_EventScheduler) m_EventScheduler = scheduler;
 
         m_Subscribers.Add(subscriber);
     }
@@ -709,10 +753,10 @@ PLT_Service::AddChanged(PLT_StateVariable* var)
 {
     NPT_AutoLock lock(m_Lock);
 
-    // no event task means no subscribers yet, so don't bother
+    // no event scheduler means no subscribers yet, so don't bother
     // Note: this will take care also when setting default state 
     //       variables values during init and avoid being published
-    if (!m_EventTask) return NPT_SUCCESS;
+    if (!m_EventScheduler) return NPT_SUCCESS;
     
     if (var->IsSendingEvents()) {
         if (!m_StateVarsToPublish.Contains(var)) m_StateVarsToPublish.Add(var);
@@ -722,7 +766,7 @@ PLT_Service::AddChanged(PLT_StateVariable* var)
         UpdateLastChange(m_StateVarsChanged);
     }
 
-    return NPT_SUCCESS;
+    return ScheduleNotification();
 }
 
 /*----------------------------------------------------------------------
@@ -775,7 +819,9 @@ PLT_Service::PauseEventing(bool pause /* = TRUE */)
 {
     NPT_AutoLock lock(m_Lock);
     m_EventingPaused = pause;
-    return NPT_SUCCESS;
+
+    // catch up on changes that happened while paused
+    return pause?NPT_SUCCESS:ScheduleNotification();
 }
 
 /*----------------------------------------------------------------------
@@ -808,9 +854,17 @@ PLT_Service::NotifyChanged()
         ++iter;
     }
     
+    // vars not ready yet because of their moderation rate
+    ScheduleNotification();
+
     // if nothing to publish then bail out now
     // we'll clean up expired subscribers when we have something to publish
     if (vars_ready.GetItemCount() == 0) return NPT_SUCCESS;
+
+    // format the propertyset once, every subscriber shares the same body
+    // and only gets its own SID and SEQ headers
+    PLT_SharedBufferReference body;
+    NPT_CHECK_SEVERE(PLT_EventSubscriber::FormatBody(vars_ready, body));
     
     // send vars that are ready to go and remove old subscribers 
     NPT_List<PLT_EventSubscriberReference>::Iterator sub_iter = m_Subscribers.GetFirstItem();
@@ -821,12 +875,11 @@ PLT_Service::NotifyChanged()
         NPT_System::GetCurrentTimeStamp(now);
         expiration = sub->GetExpirationTime();
 
-        // forget sub if it didn't renew subscription in time or if notification failed
-        if (expiration == NPT_TimeStamp() || now < expiration + NPT_TimeStamp(30.f)) {
-            // TODO: Notification is asynchronous, so we won't know if it failed until
-            // the subscriber m_SubscriberTask is done
-            NPT_Result res = vars_ready.GetItemCount()?sub->Notify(vars_ready):NPT_SUCCESS;
-            if (NPT_SUCCEEDED(res)) {
+        // forget sub if it didn't renew subscription in time or if the
+        // dispatcher gave up delivering previous notifications
+        if ((expiration == NPT_TimeStamp() || now < expiration + NPT_TimeStamp(30.f)) &&
+            !sub->HasFailed()) {
+            if (NPT_SUCCEEDED(sub->Notify(body))) {
                 ++sub_iter;
                 continue;
             }
@@ -838,6 +891,158 @@ PLT_Service::NotifyChanged()
     return NPT_SUCCESS;
 }
 
+/*----------------------------------------------------------------------
+|   PLT_Service::ScheduleNotification
++---------------------------------------------------------------------*/
+NPT_Result
+PLT_Service::ScheduleNotification()
+{
+    if (!m_EventScheduler || m_EventingPaused) return NPT_SUCCESS;
+    if (m_StateVarsToPublish.GetItemCount() == 0) return NPT_SUCCESS;
+
+    // find when the first pending var can go out
+    NPT_TimeStamp due;
+    NPT_List<PLT_StateVariable*>::Iterator var = m_StateVarsToPublish.GetFirstItem();
+    for (bool first = true; var; ++var, first = false) {
+        NPT_TimeStamp next = (*var)->GetNextPublishTime();
+        if (first || next < due) due = next;
+    }
+
+    return m_EventScheduler->Schedule(this, due);
+}
+
+/*----------------------------------------------------------------------
+|   PLT_Service::DetachEventScheduler
++---------------------------------------------------------------------*/
+NPT_Result
+PLT_Service::DetachEventScheduler()
+{
+    NPT_AutoLock lock(m_Lock);
+
+    if (m_EventScheduler) {
+        m_EventScheduler->Unschedule(this);
+        m_EventScheduler = NULL;
+    }
+
+    return NPT_SUCCESS;
+}
+
+/*----------------------------------------------------------------------
+|   PLT_ServiceEventScheduler::PLT_ServiceEventScheduler
++---------------------------------------------------------------------*/
+PLT_ServiceEventScheduler::PLT_ServiceEventScheduler()
+{
+    m_Wakeup.SetValue(0);
+}
+
+/*----------------------------------------------------------------------
+|   PLT_ServiceEventScheduler::Schedule
++---------------------------------------------------------------------*/
+NPT_Result
+PLT_ServiceEventScheduler::Schedule(PLT_Service* service, const NPT_TimeStamp& due)
+{
+    NPT_AutoLock lock(m_Lock);
+
+    // keep the earliest time if already scheduled
+    NPT_List<Entry>::Iterator entry = m_Pending.GetFirstItem();
+    while (entry) {
+        if ((*entry).m_Service == service) {
+            if ((*entry).m_Due <= due) return NPT_SUCCESS;
+            m_Pending.Erase(entry);
+            break;
+        }
+        ++entry;
+    }
+
+    Entry new_entry;
+    new_entry.m_Service = service;
+    new_entry.m_Due     = due;
+
+    NPT_List<Entry>::Iterator pending = m_Pending.GetFirstItem();
+    while (pending && (*pending).m_Due <= due) ++pending;
+    NPT_CHECK_SEVERE(m_Pending.Insert(pending, new_entry));
+
+    // wake up the thread if this is now the next one due
+    if ((*m_Pending.GetFirstItem()).m_Service == service) m_Wakeup.SetValue(1);
+    return NPT_SUCCESS;
+}
+
+/*----------------------------------------------------------------------
+|   PLT_ServiceEventScheduler::Unschedule
++---------------------------------------------------------------------*/
+NPT_Result
+PLT_ServiceEventScheduler::Unschedule(PLT_Service* service)
+{
+    NPT_AutoLock lock(m_Lock);
+
+    NPT_List<Entry>::Iterator entry = m_Pending.GetFirstItem();
+    while (entry) {
+        if ((*entry).m_Service == service) {
+            m_Pending.Erase(entry);
+            return NPT_SUCCESS;
+        }
+        ++entry;
+    }
+    return NPT_ERROR_NO_SUCH_ITEM;
+}
+
+/*----------------------------------------------------------------------
+|   PLT_ServiceEventScheduler::DoAbort
++---------------------------------------------------------------------*/
+void
+PLT_ServiceEventScheduler::DoAbort()
+{
+    m_Wakeup.SetValue(1);
+}
+
+/*----------------------------------------------------------------------
+|   PLT_ServiceEventScheduler::DoRun
++---------------------------------------------------------------------*/
+void
+PLT_ServiceEventScheduler::DoRun()
+{
+    while (!IsAborting(0)) {
+        NPT_Timeout  timeout = NPT_TIMEOUT_INFINITE;
+        PLT_Service* service = PopDueService(timeout);
+
+        if (service == NULL) {
+            // sleep until next service is due or a new one is scheduled
+            m_Wakeup.WaitUntilEquals(1, timeout);
+            m_Wakeup.SetValue(0);
+            continue;
+        }
+
+        // the service reschedules itself if some vars are still pending
+        service->NotifyChanged();
+    }
+}
+
+/*----------------------------------------------------------------------
+|   PLT_ServiceEventScheduler::PopDueService
++---------------------------------------------------------------------*/
+PLT_Service*
+PLT_ServiceEventScheduler::PopDueService(NPT_Timeout& timeout)
+{
+    NPT_TimeStamp now;
+    NPT_System::GetCurrentTimeStamp(now);
+
+    NPT_AutoLock lock(m_Lock);
+    NPT_List<Entry>::Iterator pending = m_Pending.GetFirstItem();
+    if (!pending) {
+        timeout = NPT_TIMEOUT_INFINITE;
+        return NULL;
+    }
+
+    if ((*pending).m_Due > now) {
+        timeout = (NPT_Timeout)(((*pending).m_Due - now).ToMillis() + 1);
+        return NULL;
+    }
+
+    PLT_Service* service = (*pending).m_Service;
+    m_Pending.Erase(pending);
+    return service;
+}
+
 /*----------------------------------------------------------------------
 |   PLT_ServiceSCPDURLFinder::operator()
 +---------------------------------------------------------------------*/
@@ -52,6 +52,12 @@
 |    forward declarations
 +---------------------------------------------------------------------*/
 class PLT_DeviceData;
+class PLT_ServiceEventScheduler;
+
+/*----------------------------------------------------------------------
+|    constants
++---------------------------------------------------------------------*/
+#define PLT_SERVICE_MAX_SUBSCRIBERS 512
 
 /*----------------------------------------------------------------------
 |    PLT_Service class
@@ -195,6 +201,12 @@ public:
      @param xml String to receive document
      */
     NPT_Result GetSCPDXML(NPT_String& xml);
+
+    /**
+     Return a hash of everything that ends up in the service SCPD xml document,
+     so that a cached copy can be reused for as long as it doesn't change.
+     */
+    NPT_UInt32 GetSCPDSignature();
     
     /**
      Set the service SCPD xml document.
@@ -212,7 +224,7 @@ public:
 
     /**
      Set a new value for a given state variable. The service keeps track of which
-     state variables have changed and events are being triggered by a PLT_ServiceEventTask
+     state variables have changed and events are being triggered by a PLT_ServiceEventScheduler
      when necessary.
      @param name state variable name
      @param value new State Variable value.
@@ -282,30 +294,12 @@ public:
     const NPT_Array<PLT_ActionDesc*>& GetActionDescs() const { return m_ActionDescs; }
 
 private:    
-    /**
-     A task to send events.
-     The PLT_ServiceEventTask is started when receiving a first subscription. It
-     monitors if some state variables have changed and sends events to all
-     subscribers if so.
-     */
-    class PLT_ServiceEventTask : public PLT_ThreadTask {
-    public:
-        PLT_ServiceEventTask(PLT_Service* service) : m_Service(service) {}
-        
-        void DoRun() { 
-            while (!IsAborting(100)) m_Service->NotifyChanged();
-        }
-        
-    private:
-        PLT_Service* m_Service;
-    };
-    
     // methods
     void Cleanup();
     
     /**
      Called by a PLT_StateVariable to keep track of what events need to be 
-     sent by the PLT_ServiceEventTask task.
+     sent and to schedule a notification when the first of them is due.
      @param var PLT_StateVariable pointer
      */
     NPT_Result AddChanged(PLT_StateVariable* var);
@@ -323,16 +317,23 @@ private:
      */
     NPT_Result NotifyChanged();
 
+    /**
+     Ask the event scheduler to call NotifyChanged when the earliest pending
+     state variable is allowed to be published. Must be called with m_Lock held.
+     */
+    NPT_Result ScheduleNotification();
+
     // Events
     /**
      Called by PLT_DeviceHost when it receives a request for a new subscription.
      */
     NPT_Result ProcessNewSubscription(
-        PLT_TaskManagerReference task_manager,
-        const NPT_SocketAddress& addr, 
-        const NPT_String&        callback_urls, 
-        int                      timeout, 
-        NPT_HttpResponse&        response);
+        PLT_EventDispatcherReference dispatcher,
+        PLT_ServiceEventScheduler*   scheduler,
+        const NPT_SocketAddress&     addr, 
+        const NPT_String&            callback_urls, 
+        int                          timeout, 
+        NPT_HttpResponse&            response);
     
     /**
      Called by PLT_DeviceHost when it receives a request renewing an existing
@@ -353,10 +354,17 @@ private:
         const NPT_String&        sid, 
         NPT_HttpResponse&        response);
 
+    /**
+     Called by PLT_DeviceHost before its event scheduler goes away. Pending
+     notifications are cancelled and changes are not scheduled anymore.
+     */
+    NPT_Result DetachEventScheduler();
+
 
 protected:
     // friends that need to call private functions
     friend class PLT_StateVariable; // AddChanged
+    friend class PLT_ServiceEventScheduler; // NotifyChanged
     friend class PLT_DeviceHost;    // ProcessXXSubscription
     
     //members
@@ -367,9 +375,11 @@ protected:
     NPT_String                              m_SCPDURL;
     NPT_String                              m_ControlURL;
     NPT_String                              m_EventSubURL;
-    PLT_ServiceEventTask*                   m_EventTask;
+    PLT_ServiceEventScheduler*              m_EventScheduler;
     NPT_Array<PLT_ActionDesc*>              m_ActionDescs;
     NPT_List<PLT_StateVariable*>            m_StateVars;
+    PLT_NameMap<PLT_ActionDesc*>            m_ActionDescsByName;
+    PLT_NameMap<PLT_StateVariable*>         m_StateVarsByName;
     NPT_Mutex                               m_Lock;
     NPT_List<PLT_StateVariable*>            m_StateVarsChanged;
     NPT_List<PLT_StateVariable*>            m_StateVarsToPublish;
@@ -378,6 +388,56 @@ protected:
     NPT_String                              m_LastChangeNamespace;
 };
 
+/*----------------------------------------------------------------------
+|    PLT_ServiceEventScheduler class
++---------------------------------------------------------------------*/
+/**
+ The PLT_ServiceEventScheduler class sends state variable change events for
+ all the services of a PLT_DeviceHost from a single thread. Services schedule
+ themselves when a state variable changes, at the time its moderation rate
+ allows it to be published, and the task sleeps until the earliest one is due.
+ */
+class PLT_ServiceEventScheduler : public PLT_ThreadTask
+{
+public:
+    PLT_ServiceEventScheduler();
+
+    /**
+     Schedule a service to be notified at a given time. If the service is 
+     already scheduled, the earliest of the two times is kept.
+     @param service the service to notify
+     @param due when to notify, a null timestamp means as soon as possible
+     */
+    NPT_Result Schedule(PLT_Service* service, const NPT_TimeStamp& due);
+
+    /**
+     Cancel any pending notification for a service.
+     */
+    NPT_Result Unschedule(PLT_Service* service);
+
+protected:
+    virtual ~PLT_ServiceEventScheduler() {}
+
+    // PLT_ThreadTask methods
+    virtual void DoAbort();
+    virtual void DoRun();
+    virtual bool IsLongRunning() { return true; }
+
+private:
+    struct Entry {
+        PLT_Service*  m_Service;
+        NPT_TimeStamp m_Due;
+    };
+
+    // methods
+    PLT_Service* PopDueService(NPT_Timeout& timeout);
+
+    // members
+    NPT_Mutex          m_Lock;
+    NPT_SharedVariable m_Wakeup;
+    NPT_List<Entry>    m_Pending; // sorted by due time
+};
+
 /*----------------------------------------------------------------------
 |    PLT_ServiceSCPDURLFinder
 +---------------------------------------------------------------------*/
@@ -0,0 +1,654 @@
+/*****************************************************************
+|
+|   Platinum - SOAP
+|
+| Copyright (c) 2004-2010, Plutinosoft, LLC.
+| All rights reserved.
+| http://www.plutinosoft.com
+|
+| This program is free software; you can redistribute it and/or
+| modify it under the terms of the GNU General Public License
+| as published by the Free Software Foundation; either version 2
+| of the License, or (at your option) any later version.
+|
+| OEMs, ISVs, VARs and other distributors that combine and 
+| distribute commercially licensed software with Platinum software
+| and do not wish to distribute the source code for the commercially
+| licensed software under version 2, or (at your option) any later
+| version, of the GNU General Public License (the "GPL") must enter
+| into a commercial license agreement with Plutinosoft, LLC.
+| licensing@plutinosoft.com
+|  
+| This program is distributed in the hope that it will be useful,
+| but WITHOUT ANY WARRANTY; without even the implied warranty of
+| MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+| GNU General Public License for more details.
+|
+| You should have received a copy of the GNU General Public License
+| along with this program; see the file LICENSE.txt. If not, write to
+| the Free Software Foundation, Inc., 
+| 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+| http://www.gnu.org/licenses/gpl-2.0.html
+|
+****************************************************************/
+
+/*----------------------------------------------------------------------
+|   includes
++---------------------------------------------------------------------*/
+#include "PltSoap.h"
+
+NPT_SET_LOCAL_LOGGER("platinum.core.soap")
+
+/*----------------------------------------------------------------------
+|   macros
++---------------------------------------------------------------------*/
+#define PLT_SOAP_IS_WHITESPACE(c) ((c) == ' ' || (c) == '\t' || (c) == '\r' || (c) == '\n')
+#define PLT_SOAP_WRITE_CONSTANT(s) Write(s, sizeof(s)-1)
+
+/*----------------------------------------------------------------------
+|   constants
++---------------------------------------------------------------------*/
+static const char PLT_SoapEnvelopeStart[] = 
+    "<?xml version=\"1.0\" encoding=\"UTF-8\"?>"
+    "<s:Envelope xmlns:s=\"http://schemas.xmlsoap.org/soap/envelope/\" "
+    "s:encodingStyle=\"http://schemas.xmlsoap.org/soap/encoding/\">"
+    "<s:Body>";
+static const char PLT_SoapEnvelopeEnd[] = 
+    "</s:Body></s:Envelope>";
+static const char PLT_SoapFaultStart[] =
+    "<s:Fault>"
+    "<faultcode>s:Client</faultcode>"
+    "<faultstring>UPnPError</faultstring>"
+    "<detail>"
+    "<UPnPError xmlns=\"urn:schemas-upnp-org:control-1-0\">"
+    "<errorCode>";
+static const char PLT_SoapFaultDescription[] =
+    "</errorCode>"
+    "<errorDescription>";
+static const char PLT_SoapFaultEnd[] =
+    "</errorDescription>"
+    "</UPnPError>"
+    "</detail>"
+    "</s:Fault>";
+
+/*----------------------------------------------------------------------
+|   PLT_SoapParser::ReadBody
++---------------------------------------------------------------------*/
+NPT_Result
+PLT_SoapParser::ReadBody(const NPT_HttpMessage& message, NPT_DataBuffer& body)
+{
+    body.SetDataSize(0);
+
+    // get stream
+    NPT_InputStreamReference stream;
+    NPT_HttpEntity* entity = message.GetEntity();
+    if (!entity || 
+        NPT_FAILED(entity->GetInputStream(stream)) || 
+        stream.IsNull()) {
+        return NPT_FAILURE;
+    }
+
+    // don't let clients make us allocate whatever they claim to send
+    NPT_LargeSize length = entity->GetContentLength();
+    if (length > PLT_SOAP_MAX_BODY_SIZE) return NPT_ERROR_OUT_OF_RANGE;
+
+    // read directly into the buffer, no intermediate string
+    NPT_CHECK_SEVERE(body.Reserve(length?(NPT_Size)length:4096));
+    for (;;) {
+        if (body.GetDataSize() == body.GetBufferSize()) {
+            // chunked or longer than announced
+            if (body.GetBufferSize() >= PLT_SOAP_MAX_BODY_SIZE) return NPT_ERROR_OUT_OF_RANGE;
+            NPT_CHECK_SEVERE(body.Reserve(2*body.GetBufferSize()));
+        }
+
+        NPT_Size bytes_read = 0;
+        NPT_Result result = stream->Read(body.UseData() + body.GetDataSize(), 
+                                         body.GetBufferSize() - body.GetDataSize(), 
+                                         &bytes_read);
+        if (result == NPT_ERROR_EOS) break;
+        NPT_CHECK_WARNING(result);
+
+        body.SetDataSize(body.GetDataSize() + bytes_read);
+        if (length && body.GetDataSize() >= length) break;
+    }
+
+    return NPT_SUCCESS;
+}
+
+/*----------------------------------------------------------------------
+|   PLT_SoapParser::PLT_SoapParser
++---------------------------------------------------------------------*/
+PLT_SoapParser::PLT_SoapParser(const char* xml, NPT_Size size) :
+    m_Data(xml),
+    m_Size(size),
+    m_Position(0),
+    m_Depth(0),
+    m_ActionEnded(false),
+    m_TagIsEnd(false),
+    m_TagIsEmpty(false)
+{
+}
+
+/*----------------------------------------------------------------------
+|   PLT_SoapParser::ParseEnvelope
++---------------------------------------------------------------------*/
+NPT_Result
+PLT_SoapParser::ParseEnvelope()
+{
+    // envelope
+    NPT_CHECK_WARNING(ReadTag());
+    if (m_TagIsEnd || m_TagIsEmpty || m_TagName.Compare("Envelope", true)) {
+        return NPT_ERROR_INVALID_SYNTAX;
+    }
+
+    const NPT_String* uri = ResolvePrefix(m_TagPrefix);
+    m_EnvelopeNamespace = uri?*uri:"";
+    m_EncodingStyle     = m_TagEncodingStyle;
+
+    // skip anything until body (Header)
+    for (;;) {
+        NPT_CHECK_WARNING(ReadTag());
+        if (m_TagIsEnd) return NPT_ERROR_INVALID_SYNTAX;
+        if (m_TagName.Compare("Body", true) == 0) break;
+        if (!m_TagIsEmpty) NPT_CHECK_WARNING(SkipElement());
+    }
+    if (m_TagIsEmpty) return NPT_ERROR_INVALID_SYNTAX;
+
+    // action is the first element of the body
+    NPT_CHECK_WARNING(ReadTag());
+    if (m_TagIsEnd) return NPT_ERROR_INVALID_SYNTAX;
+
+    uri = ResolvePrefix(m_TagPrefix);
+    m_ActionName      = m_TagName;
+    m_ActionNamespace = uri?*uri:"";
+    m_ActionEnded     = m_TagIsEmpty;
+    return NPT_SUCCESS;
+}
+
+/*----------------------------------------------------------------------
+|   PLT_SoapParser::GetNextArgument
++---------------------------------------------------------------------*/
+NPT_Result
+PLT_SoapParser::GetNextArgument(NPT_String& name, NPT_String& value)
+{
+    if (m_ActionEnded) return NPT_ERROR_NO_SUCH_ITEM;
+
+    NPT_CHECK_WARNING(ReadTag());
+    if (m_TagIsEnd) {
+        m_ActionEnded = true;
+        return NPT_ERROR_NO_SUCH_ITEM;
+    }
+
+    name  = m_TagName;
+    value = "";
+    if (m_TagIsEmpty) return NPT_SUCCESS;
+
+    return ReadText(value);
+}
+
+/*----------------------------------------------------------------------
+|   PLT_SoapParser::ReadTag
++---------------------------------------------------------------------*/
+NPT_Result
+PLT_SoapParser::ReadTag()
+{
+    // element was empty, close it now that caller is done with it
+    if (m_TagIsEmpty) {
+        CloseElement();
+        m_TagIsEmpty = false;
+    }
+
+    for (;;) {
+        // skip text in between tags
+        while (m_Position < m_Size && m_Data[m_Position] != '<') ++m_Position;
+        if (m_Position >= m_Size) return NPT_ERROR_EOS;
+
+        const char* markup = m_Data + m_Position;
+        NPT_Size    left   = m_Size - m_Position;
+        if (left >= 2 && markup[1] == '?') {
+            NPT_CHECK_WARNING(SkipUntil("?>"));
+        } else if (left >= 4 && NPT_StringsEqualN(markup, "<!--", 4)) {
+            NPT_CHECK_WARNING(SkipUntil("-->"));
+        } else if (left >= 9 && NPT_StringsEqualN(markup, "<![CDATA[", 9)) {
+            NPT_CHECK_WARNING(SkipUntil("]]>"));
+        } else if (left >= 2 && markup[1] == '!') {
+            NPT_CHECK_WARNING(SkipUntil(">"));
+        } else {
+            break;
+        }
+    }
+
+    ++m_Position;
+    m_TagIsEnd = false;
+    m_TagEncodingStyle = "";
+
+    // end tag
+    if (m_Position < m_Size && m_Data[m_Position] == '/') {
+        ++m_Position;
+        NPT_CHECK_WARNING(ReadName(m_TagPrefix, m_TagName));
+        SkipWhitespace();
+        if (m_Position >= m_Size || m_Data[m_Position] != '>') return NPT_ERROR_INVALID_SYNTAX;
+        ++m_Position;
+
+        if (m_Depth == 0) return NPT_ERROR_INVALID_SYNTAX;
+        m_TagIsEnd = true;
+        CloseElement();
+        return NPT_SUCCESS;
+    }
+
+    // start tag
+    NPT_CHECK_WARNING(ReadName(m_TagPrefix, m_TagName));
+    ++m_Depth;
+
+    NPT_String attr_prefix, attr_name, attr_value;
+    for (;;) {
+        SkipWhitespace();
+        if (m_Position >= m_Size) return NPT_ERROR_INVALID_SYNTAX;
+
+        if (m_Data[m_Position] == '>') {
+            ++m_Position;
+            break;
+        }
+        if (m_Data[m_Position] == '/') {
+            if (m_Position+1 >= m_Size || m_Data[m_Position+1] != '>') return NPT_ERROR_INVALID_SYNTAX;
+            m_Position += 2;
+            m_TagIsEmpty = true;
+            break;
+        }
+
+        // attribute
+        NPT_CHECK_WARNING(ReadName(attr_prefix, attr_name));
+        SkipWhitespace();
+        if (m_Position >= m_Size || m_Data[m_Position] != '=') return NPT_ERROR_INVALID_SYNTAX;
+        ++m_Position;
+        SkipWhitespace();
+        NPT_CHECK_WARNING(ReadAttributeValue(attr_value));
+
+        // namespace declarations are scoped to this element
+        if (attr_prefix == "xmlns" || (attr_prefix.IsEmpty() && attr_name == "xmlns")) {
+            PLT_SoapNamespace ns;
+            ns.m_Prefix = attr_prefix.IsEmpty()?"":attr_name;
+            ns.m_Uri    = attr_value;
+            ns.m_Depth  = m_Depth;
+            m_Namespaces.Add(ns);
+        } else if (attr_name == "encodingStyle") {
+            m_TagEncodingStyle = attr_value;
+        }
+    }
+
+    return NPT_SUCCESS;
+}
+
+/*----------------------------------------------------------------------
+|   PLT_SoapParser::CloseElement
++---------------------------------------------------------------------*/
+void
+PLT_SoapParser::CloseElement()
+{
+    // forget namespaces declared by the element being closed
+    while (m_Namespaces.GetItemCount() && 
+           m_Namespaces[m_Namespaces.GetItemCount()-1].m_Depth >= m_Depth) {
+        m_Namespaces.Erase(&m_Namespaces[m_Namespaces.GetItemCount()-1]);
+    }
+    if (m_Depth) --m_Depth;
+}
+
+/*----------------------------------------------------------------------
+|   PLT_SoapParser::ReadName
++---------------------------------------------------------------------*/
+NPT_Result
+PLT_SoapParser::ReadName(NPT_String& prefix, NPT_String& name)
+{
+    NPT_Size start = m_Position;
+    NPT_Size colon = 0;
+    while (m_Position < m_Size) {
+        char c = m_Data[m_Position];
+        if (PLT_SOAP_IS_WHITESPACE(c) || c == '/' || c == '>' || c == '=') break;
+        if (c == ':' && !colon) colon = m_Position;
+        ++m_Position;
+    }
+    if (m_Position == start || m_Position >= m_Size) return NPT_ERROR_INVALID_SYNTAX;
+
+    if (colon) {
+        prefix.Assign(m_Data+start, colon-start);
+        name.Assign(m_Data+colon+1, m_Position-colon-1);
+    } else {
+        prefix = "";
+        name.Assign(m_Data+start, m_Position-start);
+    }
+    return name.IsEmpty()?NPT_ERROR_INVALID_SYNTAX:NPT_SUCCESS;
+}
+
+/*----------------------------------------------------------------------
+|   PLT_SoapParser::ReadAttributeValue
++---------------------------------------------------------------------*/
+NPT_Result
+PLT_SoapParser::ReadAttributeValue(NPT_String& value)
+{
+    if (m_Position >= m_Size) return NPT_ERROR_INVALID_SYNTAX;
+    char quote = m_Data[m_Position];
+    if (quote != '"' && quote != '\'') return NPT_ERROR_INVALID_SYNTAX;
+
+    value = "";
+    NPT_Size start = ++m_Position;
+    while (m_Position < m_Size && m_Data[m_Position] != quote) {
+        if (m_Data[m_Position] == '&') {
+            value.Append(m_Data+start, m_Position-start);
+
+            NPT_Size end = m_Position+1;
+            while (end < m_Size && end-m_Position < 12 && m_Data[end] != ';') ++end;
+            if (end < m_Size && m_Data[end] == ';') {
+                DecodeEntity(m_Data+m_Position+1, end-m_Position-1, value);
+                m_Position = end+1;
+            } else {
+                value += '&';
+                ++m_Position;
+            }
+            start = m_Position;
+            continue;
+        }
+        ++m_Position;
+    }
+    if (m_Position >= m_Size) return NPT_ERROR_INVALID_SYNTAX;
+
+    value.Append(m_Data+start, m_Position-start);
+    ++m_Position;
+    return NPT_SUCCESS;
+}
+
+/*----------------------------------------------------------------------
+|   PLT_SoapParser::ReadText
++---------------------------------------------------------------------*/
+NPT_Result
+PLT_SoapParser::ReadText(NPT_String& text)
+{
+    NPT_Cardinal depth = m_Depth;
+    NPT_Size     start = m_Position;
+
+    while (m_Position < m_Size) {
+        char c = m_Data[m_Position];
+        if (c == '&') {
+            text.Append(m_Data+start, m_Position-start);
+
+            NPT_Size end = m_Position+1;
+            while (end < m_Size && end-m_Position < 12 && m_Data[end] != ';') ++end;
+            if (end < m_Size && m_Data[end] == ';') {
+                DecodeEntity(m_Data+m_Position+1, end-m_Position-1, text);
+                m_Position = end+1;
+            } else {
+                text += '&';
+                ++m_Position;
+            }
+            start = m_Position;
+        } else if (c == '<') {
+            text.Append(m_Data+start, m_Position-start);
+
+            if (m_Size-m_Position >= 9 && NPT_StringsEqualN(m_Data+m_Position, "<![CDATA[", 9)) {
+                // CDATA content is copied as is
+                NPT_Size begin = m_Position+9;
+                NPT_CHECK_WARNING(SkipUntil("]]>"));
+                text.Append(m_Data+begin, m_Position-3-begin);
+            } else {
+                // nested elements are not expected in arguments, ignore them
+                NPT_CHECK_WARNING(ReadTag());
+                if (m_TagIsEnd) {
+                    return (m_Depth == depth-1)?NPT_SUCCESS:NPT_ERROR_INVALID_SYNTAX;
+                }
+                if (!m_TagIsEmpty) NPT_CHECK_WARNING(SkipElement());
+            }
+            start = m_Position;
+        } else {
+            ++m_Position;
+        }
+    }
+
+    return NPT_ERROR_INVALID_SYNTAX;
+}
+
+/*----------------------------------------------------------------------
+|   PLT_SoapParser::SkipElement
++---------------------------------------------------------------------*/
+NPT_Result
+PLT_SoapParser::SkipElement()
+{
+    // read until the element we're in gets closed
+    NPT_Cardinal depth = m_Depth;
+    while (m_Depth >= depth) {
+        NPT_CHECK_WARNING(ReadTag());
+    }
+    return NPT_SUCCESS;
+}
+
+/*----------------------------------------------------------------------
+|   PLT_SoapParser::SkipUntil
++---------------------------------------------------------------------*/
+NPT_Result
+PLT_SoapParser::SkipUntil(const char* marker)
+{
+    NPT_Size length = NPT_StringLength(marker);
+    while (m_Position + length <= m_Size) {
+        if (NPT_StringsEqualN(m_Data+m_Position, marker, length)) {
+            m_Position += length;
+            return NPT_SUCCESS;
+        }
+        ++m_Position;
+    }
+    return NPT_ERROR_INVALID_SYNTAX;
+}
+
+/*----------------------------------------------------------------------
+|   PLT_SoapParser::SkipWhitespace
++---------------------------------------------------------------------*/
+void
+PLT_SoapParser::SkipWhitespace()
+{
+    while (m_Position < m_Size && PLT_SOAP_IS_WHITESPACE(m_Data[m_Position])) {
+        ++m_Position;
+    }
+}
+
+/*----------------------------------------------------------------------
+|   PLT_SoapParser::ResolvePrefix
++---------------------------------------------------------------------*/
+const NPT_String*
+PLT_SoapParser::ResolvePrefix(const NPT_String& prefix)
+{
+    // innermost declaration wins
+    for (NPT_Cardinal i=m_Namespaces.GetItemCount(); i>0; i--) {
+        if (m_Namespaces[i-1].m_Prefix == prefix) return &m_Namespaces[i-1].m_Uri;
+    }
+    return NULL;
+}
+
+/*----------------------------------------------------------------------
+|   PLT_SoapParser::DecodeEntity
++---------------------------------------------------------------------*/
+void
+PLT_SoapParser::DecodeEntity(const char* entity, NPT_Size size, NPT_String& output)
+{
+    if (size == 2 && NPT_StringsEqualN(entity, "lt", 2)) {
+        output += '<';
+    } else if (size == 2 && NPT_StringsEqualN(entity, "gt", 2)) {
+        output += '>';
+    } else if (size == 3 && NPT_StringsEqualN(entity, "amp", 3)) {
+        output += '&';
+    } else if (size == 4 && NPT_StringsEqualN(entity, "quot", 4)) {
+        output += '"';
+    } else if (size == 4 && NPT_StringsEqualN(entity, "apos", 4)) {
+        output += '\'';
+    } else if (size > 1 && entity[0] == '#') {
+        // character reference, encode as UTF-8
+        NPT_UInt32 code = 0;
+        bool       hex  = (entity[1] == 'x' || entity[1] == 'X');
+        for (NPT_Size i=hex?2:1; i<size; i++) {
+            char c = entity[i];
+            if (c >= '0' && c <= '9') {
+                code = code*(hex?16:10) + (c-'0');
+            } else if (hex && c >= 'a' && c <= 'f') {
+                code = code*16 + (c-'a'+10);
+            } else if (hex && c >= 'A' && c <= 'F') {
+                code = code*16 + (c-'A'+10);
+            } else {
+                code = 0;
+                break;
+            }
+        }
+        if (code == 0 || code > 0x10FFFF) {
+            output += '&';
+            output.Append(entity, size);
+            output += ';';
+        } else if (code < 0x80) {
+            output += (char)code;
+        } else if (code < 0x800) {
+            output += (char)(0xC0 | (code >> 6));
+            output += (char)(0x80 | (code & 0x3F));
+        } else if (code < 0x10000) {
+            output += (char)(0xE0 | (code >> 12));
+            output += (char)(0x80 | ((code >> 6) & 0x3F));
+            output += (char)(0x80 | (code & 0x3F));
+        } else {
+            output += (char)(0xF0 | (code >> 18));
+            output += (char)(0x80 | ((code >> 12) & 0x3F));
+            output += (char)(0x80 | ((code >> 6) & 0x3F));
+            output += (char)(0x80 | (code & 0x3F));
+        }
+    } else {
+        // unknown entity, keep it as is
+        output += '&';
+        output.Append(entity, size);
+        output += ';';
+    }
+}
+
+/*----------------------------------------------------------------------
+|   PLT_SoapWriter::PLT_SoapWriter
++---------------------------------------------------------------------*/
+PLT_SoapWriter::PLT_SoapWriter(NPT_OutputStream* stream /* = NULL */) :
+    m_Stream(stream),
+    m_Size(0)
+{
+}
+
+/*----------------------------------------------------------------------
+|   PLT_SoapWriter::StartEnvelope
++---------------------------------------------------------------------*/
+NPT_Result
+PLT_SoapWriter::StartEnvelope()
+{
+    return PLT_SOAP_WRITE_CONSTANT(PLT_SoapEnvelopeStart);
+}
+
+/*----------------------------------------------------------------------
+|   PLT_SoapWriter::EndEnvelope
++---------------------------------------------------------------------*/
+NPT_Result
+PLT_SoapWriter::EndEnvelope()
+{
+    return PLT_SOAP_WRITE_CONSTANT(PLT_SoapEnvelopeEnd);
+}
+
+/*----------------------------------------------------------------------
+|   PLT_SoapWriter::StartAction
++---------------------------------------------------------------------*/
+NPT_Result
+PLT_SoapWriter::StartAction(const NPT_String& name, 
+                            bool              response, 
+                            const NPT_String& service_type)
+{
+    NPT_CHECK(PLT_SOAP_WRITE_CONSTANT("<u:"));
+    NPT_CHECK(Write(name.GetChars(), name.GetLength()));
+    if (response) NPT_CHECK(PLT_SOAP_WRITE_CONSTANT("Response"));
+    NPT_CHECK(PLT_SOAP_WRITE_CONSTANT(" xmlns:u=\""));
+    NPT_CHECK(WriteEscaped(service_type.GetChars(), service_type.GetLength()));
+    return PLT_SOAP_WRITE_CONSTANT("\">");
+}
+
+/*----------------------------------------------------------------------
+|   PLT_SoapWriter::EndAction
++---------------------------------------------------------------------*/
+NPT_Result
+PLT_SoapWriter::EndAction(const NPT_String& name, bool response)
+{
+    NPT_CHECK(PLT_SOAP_WRITE_CONSTANT("</u:"));
+    NPT_CHECK(Write(name.GetChars(), name.GetLength()));
+    if (response) NPT_CHECK(PLT_SOAP_WRITE_CONSTANT("Response"));
+    return PLT_SOAP_WRITE_CONSTANT(">");
+}
+
+/*----------------------------------------------------------------------
+|   PLT_SoapWriter::WriteArgument
++---------------------------------------------------------------------*/
+NPT_Result
+PLT_SoapWriter::WriteArgument(const NPT_String& name, 
+                              const NPT_String& value, 
+                              const char*       data_type /* = NULL */)
+{
+    NPT_CHECK(PLT_SOAP_WRITE_CONSTANT("<"));
+    NPT_CHECK(Write(name.GetChars(), name.GetLength()));
+    if (data_type) {
+        NPT_CHECK(PLT_SOAP_WRITE_CONSTANT(" xmlns:dt=\"urn:schemas-microsoft-com:datatypes\" dt:dt=\""));
+        NPT_CHECK(WriteEscaped(data_type, NPT_StringLength(data_type)));
+        NPT_CHECK(PLT_SOAP_WRITE_CONSTANT("\""));
+    }
+    NPT_CHECK(PLT_SOAP_WRITE_CONSTANT(">"));
+    NPT_CHECK(WriteEscaped(value.GetChars(), value.GetLength()));
+    NPT_CHECK(PLT_SOAP_WRITE_CONSTANT("</"));
+    NPT_CHECK(Write(name.GetChars(), name.GetLength()));
+    return PLT_SOAP_WRITE_CONSTANT(">");
+}
+
+/*----------------------------------------------------------------------
+|   PLT_SoapWriter::WriteFault
++---------------------------------------------------------------------*/
+NPT_Result
+PLT_SoapWriter::WriteFault(unsigned int code, const NPT_String& desc)
+{
+    char buffer[16];
+    NPT_FormatString(buffer, sizeof(buffer), "%u", code);
+
+    NPT_CHECK(PLT_SOAP_WRITE_CONSTANT(PLT_SoapFaultStart));
+    NPT_CHECK(Write(buffer, NPT_StringLength(buffer)));
+    NPT_CHECK(PLT_SOAP_WRITE_CONSTANT(PLT_SoapFaultDescription));
+    NPT_CHECK(WriteEscaped(desc.GetChars(), desc.GetLength()));
+    return PLT_SOAP_WRITE_CONSTANT(PLT_SoapFaultEnd);
+}
+
+/*----------------------------------------------------------------------
+|   PLT_SoapWriter::Write
++---------------------------------------------------------------------*/
+NPT_Result
+PLT_SoapWriter::Write(const char* data, NPT_Size size)
+{
+    m_Size += size;
+    if (!m_Stream || size == 0) return NPT_SUCCESS;
+
+    return m_Stream->WriteFully(data, size);
+}
+
+/*----------------------------------------------------------------------
+|   PLT_SoapWriter::WriteEscaped
++---------------------------------------------------------------------*/
+NPT_Result
+PLT_SoapWriter::WriteEscaped(const char* value, NPT_Size size)
+{
+    // copy runs of safe characters in one write
+    NPT_Size start = 0;
+    for (NPT_Size i=0; i<size; i++) {
+        const char* entity;
+        NPT_Size    entity_size;
+        switch (value[i]) {
+            case '<':  entity = "&lt;";   entity_size = 4; break;
+            case '>':  entity = "&gt;";   entity_size = 4; break;
+            case '&':  entity = "&amp;";  entity_size = 5; break;
+            case '"':  entity = "&quot;"; entity_size = 6; break;
+            case '\r': entity = "&#xD;";  entity_size = 5; break;
+            default: continue;
+        }
+
+        NPT_CHECK(Write(value+start, i-start));
+        NPT_CHECK(Write(entity, entity_size));
+        start = i+1;
+    }
+
+    return Write(value+start, size-start);
+}
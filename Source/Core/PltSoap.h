@@ -0,0 +1,178 @@
+/*****************************************************************
+|
+|   Platinum - SOAP
+|
+| Copyright (c) 2004-2010, Plutinosoft, LLC.
+| All rights reserved.
+| http://www.plutinosoft.com
+|
+| This program is free software; you can redistribute it and/or
+| modify it under the terms of the GNU General Public License
+| as published by the Free Software Foundation; either version 2
+| of the License, or (at your option) any later version.
+|
+| OEMs, ISVs, VARs and other distributors that combine and 
+| distribute commercially licensed software with Platinum software
+| and do not wish to distribute the source code for the commercially
+| licensed software under version 2, or (at your option) any later
+| version, of the GNU General Public License (the "GPL") must enter
+| into a commercial license agreement with Plutinosoft, LLC.
+| licensing@plutinosoft.com
+|  
+| This program is distributed in the hope that it will be useful,
+| but WITHOUT ANY WARRANTY; without even the implied warranty of
+| MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+| GNU General Public License for more details.
+|
+| You should have received a copy of the GNU General Public License
+| along with this program; see the file LICENSE.txt. If not, write to
+| the Free Software Foundation, Inc., 
+| 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+| http://www.gnu.org/licenses/gpl-2.0.html
+|
+****************************************************************/
+
+/** @file
+ UPnP SOAP
+ */
+
+#ifndef _PLT_SOAP_H_
+#define _PLT_SOAP_H_
+
+/*----------------------------------------------------------------------
+|   includes
++---------------------------------------------------------------------*/
+#include "Neptune.h"
+
+/*----------------------------------------------------------------------
+|   constants
++---------------------------------------------------------------------*/
+#define PLT_SOAP_MAX_BODY_SIZE (1024*1024)
+
+/*----------------------------------------------------------------------
+|   PLT_SoapNamespace struct
++---------------------------------------------------------------------*/
+struct PLT_SoapNamespace {
+    NPT_String   m_Prefix;
+    NPT_String   m_Uri;
+    NPT_Cardinal m_Depth;
+};
+
+/*----------------------------------------------------------------------
+|   PLT_SoapParser class
++---------------------------------------------------------------------*/
+/**
+ The PLT_SoapParser class is a pull parser for SOAP action invocations. It walks
+ the envelope and returns the action arguments one by one directly from the
+ request body, without building a DOM tree.
+ */
+class PLT_SoapParser
+{
+public:
+    /**
+     Read the body of a HTTP message into a buffer suitable for parsing.
+     @param message the HTTP message
+     @param body the buffer to receive the body
+     @return NPT_ERROR_OUT_OF_RANGE if the body is larger than PLT_SOAP_MAX_BODY_SIZE
+     */
+    static NPT_Result ReadBody(const NPT_HttpMessage& message, NPT_DataBuffer& body);
+
+    /**
+     Constructor. The data must remain valid for the lifetime of the parser.
+     @param xml the SOAP envelope
+     @param size the size of the SOAP envelope
+     */
+    PLT_SoapParser(const char* xml, NPT_Size size);
+
+    /**
+     Parse the envelope up to the action element found in the SOAP body.
+     */
+    NPT_Result ParseEnvelope();
+
+    /**
+     Read the next action argument.
+     @param name the argument name without namespace prefix
+     @param value the argument value with entities decoded
+     @return NPT_ERROR_NO_SUCH_ITEM when there are no more arguments
+     */
+    NPT_Result GetNextArgument(NPT_String& name, NPT_String& value);
+
+    const NPT_String& GetEnvelopeNamespace() const { return m_EnvelopeNamespace; }
+    const NPT_String& GetEncodingStyle()     const { return m_EncodingStyle;     }
+    const NPT_String& GetActionName()        const { return m_ActionName;        }
+    const NPT_String& GetActionNamespace()   const { return m_ActionNamespace;   }
+
+private:
+    NPT_Result ReadTag();
+    NPT_Result ReadName(NPT_String& prefix, NPT_String& name);
+    NPT_Result ReadAttributeValue(NPT_String& value);
+    NPT_Result ReadText(NPT_String& text);
+    NPT_Result SkipElement();
+    NPT_Result SkipUntil(const char* marker);
+    void       SkipWhitespace();
+    void       CloseElement();
+    const NPT_String* ResolvePrefix(const NPT_String& prefix);
+    static void DecodeEntity(const char* entity, NPT_Size size, NPT_String& output);
+
+    // members
+    const char*                    m_Data;
+    NPT_Size                       m_Size;
+    NPT_Size                       m_Position;
+    NPT_Cardinal                   m_Depth;
+    NPT_Array<PLT_SoapNamespace>   m_Namespaces;
+    bool                           m_ActionEnded;
+
+    // current tag
+    NPT_String                     m_TagPrefix;
+    NPT_String                     m_TagName;
+    bool                           m_TagIsEnd;
+    bool                           m_TagIsEmpty;
+    NPT_String                     m_TagEncodingStyle;
+
+    // envelope
+    NPT_String                     m_EnvelopeNamespace;
+    NPT_String                     m_EncodingStyle;
+    NPT_String                     m_ActionName;
+    NPT_String                     m_ActionNamespace;
+};
+
+/*----------------------------------------------------------------------
+|   PLT_SoapWriter class
++---------------------------------------------------------------------*/
+/**
+ The PLT_SoapWriter class writes SOAP envelopes directly to an output stream.
+ Fixed markup is copied from constant buffers and values are escaped on the
+ fly. When constructed without a stream, it only computes the size of the
+ output so callers can preallocate or set a content length.
+ */
+class PLT_SoapWriter
+{
+public:
+    PLT_SoapWriter(NPT_OutputStream* stream = NULL);
+
+    NPT_Result StartEnvelope();
+    NPT_Result EndEnvelope();
+    NPT_Result StartAction(const NPT_String& name, 
+                           bool              response, 
+                           const NPT_String& service_type);
+    NPT_Result EndAction(const NPT_String& name, bool response);
+    NPT_Result WriteArgument(const NPT_String& name, 
+                             const NPT_String& value, 
+                             const char*       data_type = NULL);
+    NPT_Result WriteFault(unsigned int code, const NPT_String& desc);
+
+    /**
+     Return the number of bytes written so far.
+     */
+    NPT_Size GetSize() const { return m_Size; }
+
+private:
+    NPT_Result Write(const char* data, NPT_Size size);
+    NPT_Result WriteEscaped(const char* value, NPT_Size size);
+
+    // members
+    NPT_OutputStream* m_Stream;
+    NPT_Size          m_Size;
+};
+
+#endif /* _PLT_SOAP_H_ */
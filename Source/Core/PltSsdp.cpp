@@ -44,6 +44,58 @@
 
 NPT_SET_LOCAL_LOGGER("platinum.core.ssdp")
 
+/*----------------------------------------------------------------------
+|   PLT_SsdpBatch::Add
++---------------------------------------------------------------------*/
+NPT_Result
+PLT_SsdpBatch::Add(const NPT_Byte*          data, 
+                   NPT_Size                 size,
+                   const NPT_SocketAddress* addr /* = NULL */)
+{
+    Packet packet;
+    packet.m_Data.SetData(data, size);
+    packet.m_HasAddress = (addr != NULL);
+    if (addr) packet.m_Address = *addr;
+
+    return m_Packets.Add(packet);
+}
+
+/*----------------------------------------------------------------------
+|   PLT_SsdpBatch::Send
++---------------------------------------------------------------------*/
+NPT_Result
+PLT_SsdpBatch::Send(NPT_UdpSocket& socket, NPT_TimeInterval pacing /* = 0 */) const
+{
+    NPT_Result result = NPT_SUCCESS;
+
+    for (NPT_Ordinal i=0; i<m_Packets.GetItemCount(); i++) {
+        if (i && (float)pacing > 0.f) {
+            NPT_System::Sleep(pacing);
+        }
+
+        NPT_Result res = SendPacket(socket, i);
+        if (NPT_FAILED(res)) result = res;
+    }
+
+    return result;
+}
+
+/*----------------------------------------------------------------------
+|   PLT_SsdpBatch::SendPacket
++---------------------------------------------------------------------*/
+NPT_Result
+PLT_SsdpBatch::SendPacket(NPT_UdpSocket& socket, NPT_Ordinal index) const
+{
+    if (index >= m_Packets.GetItemCount()) return NPT_ERROR_OUT_OF_RANGE;
+
+    const Packet& packet = m_Packets[index];
+    NPT_Result res = socket.Send(packet.m_Data, packet.m_HasAddress?&packet.m_Address:NULL);
+    if (NPT_FAILED(res)) {
+        NPT_LOG_WARNING_1("Failed to send SSDP packet (%d)", res);
+    }
+    return res;
+}
+
 /*----------------------------------------------------------------------
 |   PLT_SsdpSender::SendSsdp
 +---------------------------------------------------------------------*/
@@ -55,27 +107,38 @@ PLT_SsdpSender::SendSsdp(NPT_HttpRequest&   request,
                          bool               notify,
                          const NPT_SocketAddress* addr /* = NULL */)
 {
-    NPT_CHECK_SEVERE(FormatPacket(request, usn, target, socket, notify));
+    PLT_SsdpBatch batch;
+    NPT_CHECK_SEVERE(FormatSsdp(request, usn, target, notify, batch, addr));
+    NPT_CHECK_WARNING(batch.Send(socket));
+    return NPT_SUCCESS;
+}
+
+/*----------------------------------------------------------------------
+|   PLT_SsdpSender::FormatSsdp
++---------------------------------------------------------------------*/
+NPT_Result
+PLT_SsdpSender::FormatSsdp(NPT_HttpRequest&   request,
+                           const char*        usn,
+                           const char*        target,
+                           bool               notify,
+                           PLT_SsdpBatch&     batch,
+                           const NPT_SocketAddress* addr /* = NULL */)
+{
+    NPT_CHECK_SEVERE(FormatPacket(request, usn, target, notify));
 
     // logging
-    NPT_String prefix = NPT_String::Format("Sending SSDP %s packet for %s",
-        (const char*)request.GetMethod(), 
-        usn);
-    PLT_LOG_HTTP_REQUEST(NPT_LOG_LEVEL_FINER, prefix, &request);
+    PLT_LOG_HTTP_REQUEST(NPT_LOG_LEVEL_FINER, 
+        NPT_String::Format("Sending SSDP %s packet for %s",
+            (const char*)request.GetMethod(), 
+            usn), 
+        &request);
 
     // use a memory stream to write all the data
     NPT_MemoryStream stream;
     NPT_Result res = request.Emit(stream);
     NPT_CHECK(res);
 
-    // copy stream into a data packet and send it
-    NPT_LargeSize size;
-    stream.GetSize(size);
-    if (size != (NPT_Size)size) NPT_CHECK(NPT_ERROR_OUT_OF_RANGE);
-
-    NPT_DataBuffer packet(stream.GetData(), (NPT_Size)size);
-    NPT_CHECK_WARNING(socket.Send(packet, addr));
-    return NPT_SUCCESS;
+    return batch.Add(stream.GetData(), stream.GetDataSize(), addr);
 }
 
 /*----------------------------------------------------------------------
@@ -89,7 +152,7 @@ PLT_SsdpSender::SendSsdp(NPT_HttpResponse&  response,
                          bool               notify, 
                          const NPT_SocketAddress* addr /* = NULL */)
 {
-    NPT_CHECK_SEVERE(FormatPacket(response, usn, target, socket, notify));
+    NPT_CHECK_SEVERE(FormatPacket(response, usn, target, notify));
 
     // logging
     NPT_String prefix = NPT_String::Format("Sending SSDP Response:");
@@ -117,11 +180,8 @@ NPT_Result
 PLT_SsdpSender::FormatPacket(NPT_HttpMessage& message, 
                              const char*      usn,
                              const char*      target,
-                             NPT_UdpSocket&   socket,
                              bool             notify)
 {
-    NPT_COMPILER_UNUSED(socket);
-
     PLT_UPnPMessageHelper::SetUSN(message, usn);
     if (notify) {
         PLT_UPnPMessageHelper::SetNT(message, target);
@@ -210,14 +270,510 @@ done:
     return;
 }
 
+/*----------------------------------------------------------------------
+|   PLT_SsdpSearchResponderTask::PLT_SsdpSearchResponderTask
++---------------------------------------------------------------------*/
+PLT_SsdpSearchResponderTask::PLT_SsdpSearchResponderTask(PLT_DeviceHost* device,
+                                                         NPT_Cardinal    max_pending /* = 256 */) :
+    m_Device(device),
+    m_MaxPending(max_pending),
+    m_Socket(NPT_SOCKET_FLAG_CANCELLABLE),
+    m_InterfacesGeneration(0),
+    m_Signature(0),
+    m_DateSeconds(0)
+{
+    m_Wakeup.SetValue(0);
+}
+
+/*----------------------------------------------------------------------
+|   PLT_SsdpSearchResponderTask::Respond
++---------------------------------------------------------------------*/
+NPT_Result
+PLT_SsdpSearchResponderTask::Respond(const NPT_SocketAddress& remote_addr,
+                                     const char*              st,
+                                     const NPT_TimeInterval&  delay)
+{
+    NPT_TimeStamp now;
+    NPT_System::GetCurrentTimeStamp(now);
+
+    PLT_SsdpSearchPendingResponse response;
+    response.m_RemoteAddr = remote_addr;
+    response.m_ST         = st;
+    response.m_Due        = now + delay;
+    response.m_Count      = 0;
+
+    {
+        NPT_AutoLock lock(m_Lock);
+
+        // control points usually repeat their M-SEARCH, answer only once
+        NPT_List<PLT_SsdpSearchPendingResponse>::Iterator pending = m_Pending.GetFirstItem();
+        while (pending) {
+            if ((*pending).m_Count == 0 &&
+                (*pending).m_RemoteAddr == remote_addr && 
+                (*pending).m_ST == response.m_ST) {
+                return NPT_SUCCESS;
+            }
+            ++pending;
+        }
+
+        if (m_Pending.GetItemCount() >= m_MaxPending) {
+            NPT_LOG_WARNING_1("Dropping M-SEARCH response to %s (too many pending)", 
+                (const char*)remote_addr.ToString());
+            return NPT_ERROR_OUT_OF_RESOURCES;
+        }
+
+        // keep list sorted by due time
+        pending = m_Pending.GetFirstItem();
+        while (pending && (*pending).m_Due <= response.m_Due) ++pending;
+        m_Pending.Insert(pending, response);
+    }
+
+    m_Wakeup.SetValue(1);
+    return NPT_SUCCESS;
+}
+
+/*----------------------------------------------------------------------
+|   PLT_SsdpSearchResponderTask::DoAbort
++---------------------------------------------------------------------*/
+void
+PLT_SsdpSearchResponderTask::DoAbort()
+{
+    m_Socket.Cancel();
+    m_Wakeup.SetValue(1);
+}
+
+/*----------------------------------------------------------------------
+|   PLT_SsdpSearchResponderTask::DoRun
++---------------------------------------------------------------------*/
+void
+PLT_SsdpSearchResponderTask::DoRun()
+{
+    while (!IsAborting(0)) {
+        NPT_List<PLT_SsdpSearchPendingResponse> responses;
+        NPT_Timeout timeout = NPT_TIMEOUT_INFINITE;
+        PopDueResponses(responses, timeout);
+
+        if (responses.GetItemCount() == 0) {
+            // sleep until next response is due or a new one is queued
+            m_Wakeup.WaitUntilEquals(1, timeout);
+            m_Wakeup.SetValue(0);
+            continue;
+        }
+
+        Refresh();
+
+        NPT_List<PLT_SsdpSearchPendingResponse>::Iterator response = responses.GetFirstItem();
+        while (response && !IsAborting(0)) {
+            SendResponse(*response);
+
+#if defined(PLATINUM_UPNP_SPECS_STRICT)
+            // send search response twice to be DLNA compliant
+            if ((*response).m_Count++ == 0) {
+                NPT_TimeStamp now;
+                NPT_System::GetCurrentTimeStamp(now);
+                (*response).m_Due = now + NPT_TimeInterval(PLT_DLNA_SSDP_DELAY_GROUP);
+
+                NPT_AutoLock lock(m_Lock);
+                NPT_List<PLT_SsdpSearchPendingResponse>::Iterator pending = m_Pending.GetFirstItem();
+                while (pending && (*pending).m_Due <= (*response).m_Due) ++pending;
+                m_Pending.Insert(pending, *response);
+            }
+#endif
+            ++response;
+        }
+    }
+}
+
+/*----------------------------------------------------------------------
+|   PLT_SsdpSearchResponderTask::PopDueResponses
++---------------------------------------------------------------------*/
+NPT_Result
+PLT_SsdpSearchResponderTask::PopDueResponses(NPT_List<PLT_SsdpSearchPendingResponse>& responses,
+                                             NPT_Timeout&                             timeout)
+{
+    NPT_TimeStamp now;
+    NPT_System::GetCurrentTimeStamp(now);
+
+    NPT_AutoLock lock(m_Lock);
+    NPT_List<PLT_SsdpSearchPendingResponse>::Iterator pending = m_Pending.GetFirstItem();
+    while (pending && (*pending).m_Due <= now) {
+        responses.Add(*pending);
+        m_Pending.Erase(pending);
+        pending = m_Pending.GetFirstItem();
+    }
+
+    timeout = pending?(NPT_Timeout)(((*pending).m_Due - now).ToMillis() + 1):NPT_TIMEOUT_INFINITE;
+    return NPT_SUCCESS;
+}
+
+/*----------------------------------------------------------------------
+|   PLT_SsdpSearchResponderTask::Refresh
++---------------------------------------------------------------------*/
+void
+PLT_SsdpSearchResponderTask::Refresh()
+{
+    // discard preformatted packets if device tree changed
+    NPT_UInt32 signature = ComputeSignature(m_Device);
+    if (signature != m_Signature) {
+        m_Signature = signature;
+        m_Interfaces.Clear();
+    }
+
+    NPT_List<NPT_NetworkInterface*> if_list;
+    NPT_CHECK_LABEL_WARNING(PLT_UPnPMessageHelper::GetNetworkInterfaces(if_list, true), 
+                            done);
+
+    {
+        // rebuild list of local addresses only when interfaces changed
+        NPT_UInt32 generation = PLT_NetworkInterfaceCache::GetInstance().GetGeneration();
+        if (m_Interfaces.GetItemCount() && generation == m_InterfacesGeneration) goto done;
+        m_InterfacesGeneration = generation;
+
+        NPT_List<PLT_SsdpSearchResponseInterface> interfaces;
+        for (NPT_List<NPT_NetworkInterface*>::Iterator net_if = if_list.GetFirstItem(); 
+             net_if; 
+             ++net_if) {
+            NPT_List<NPT_NetworkInterfaceAddress>::Iterator niaddr = 
+                (*net_if)->GetAddresses().GetFirstItem();
+            if (!niaddr) continue;
+
+            PLT_SsdpSearchResponseInterface entry;
+            entry.m_Address = (*niaddr).GetPrimaryAddress();
+            entry.m_NetMask = (*niaddr).GetNetMask();
+
+            // reuse packets already formatted for this address
+            for (NPT_List<PLT_SsdpSearchResponseInterface>::Iterator iface = m_Interfaces.GetFirstItem(); 
+                 iface; 
+                 ++iface) {
+                if ((*iface).m_Address == entry.m_Address) {
+                    entry.m_Formatted = (*iface).m_Formatted;
+                    entry.m_Packets   = (*iface).m_Packets;
+                    break;
+                }
+            }
+            interfaces.Add(entry);
+        }
+        m_Interfaces = interfaces;
+    }
+
+done:
+    if_list.Apply(NPT_ObjectDeleter<NPT_NetworkInterface>());
+}
+
+/*----------------------------------------------------------------------
+|   PLT_SsdpSearchResponderTask::FindInterface
++---------------------------------------------------------------------*/
+NPT_Result
+PLT_SsdpSearchResponderTask::FindInterface(const NPT_IpAddress&              remote_ip,
+                                           PLT_SsdpSearchResponseInterface*& iface)
+{
+    // look for the interface on the same subnet as the remote
+    NPT_List<PLT_SsdpSearchResponseInterface>::Iterator entry = m_Interfaces.GetFirstItem();
+    while (entry) {
+        NPT_UInt32 mask = (*entry).m_NetMask.AsLong();
+        if (mask && (((*entry).m_Address.AsLong() & mask) == (remote_ip.AsLong() & mask))) {
+            iface = &(*entry);
+            return NPT_SUCCESS;
+        }
+        ++entry;
+    }
+
+    // otherwise connect a socket and let the kernel choose 
+    // which interface to use to route to the remote
+    NPT_UdpSocket socket(NPT_SOCKET_FLAG_CANCELLABLE);
+    NPT_CHECK_WARNING(socket.Connect(NPT_SocketAddress(remote_ip, 1900), 5000));
+    NPT_SocketInfo info;
+    socket.GetInfo(info);
+    if (!info.local_address.GetIpAddress().AsLong()) return NPT_FAILURE;
+
+    entry = m_Interfaces.GetFirstItem();
+    while (entry) {
+        if ((*entry).m_Address == info.local_address.GetIpAddress()) {
+            iface = &(*entry);
+            return NPT_SUCCESS;
+        }
+        ++entry;
+    }
+
+    PLT_SsdpSearchResponseInterface route;
+    route.m_Address = info.local_address.GetIpAddress();
+    route.m_NetMask = NPT_IpAddress(0xFFFFFFFF);
+    NPT_CHECK(m_Interfaces.Add(route));
+    iface = &(*m_Interfaces.GetLastItem());
+    return NPT_SUCCESS;
+}
+
+/*----------------------------------------------------------------------
+|   PLT_SsdpSearchResponderTask::SendResponse
++---------------------------------------------------------------------*/
+NPT_Result
+PLT_SsdpSearchResponderTask::SendResponse(const PLT_SsdpSearchPendingResponse& response)
+{
+    PLT_SsdpSearchResponseInterface* iface = NULL;
+    NPT_CHECK_WARNING(FindInterface(response.m_RemoteAddr.GetIpAddress(), iface));
+    if (!iface->m_Formatted) NPT_CHECK_SEVERE(FormatPackets(*iface));
+
+    // Date header only changes once per second
+    NPT_TimeStamp now;
+    NPT_System::GetCurrentTimeStamp(now);
+    if (now.ToSeconds() != m_DateSeconds) {
+        m_DateSeconds = now.ToSeconds();
+        m_DateHeader  = "Date: " + NPT_DateTime(now).ToString(NPT_DateTime::FORMAT_RFC_1123) + "\r\n\r\n";
+    }
+
+    bool all = (response.m_ST == "ssdp:all");
+    NPT_List<PLT_SsdpSearchResponsePacket>::Iterator packet = iface->m_Packets.GetFirstItem();
+    while (packet) {
+        if (all || (*packet).m_Target == response.m_ST) {
+            NPT_LOG_FINE_2("Responding to a M-SEARCH request for %s from %s", 
+                (const char*)response.m_ST,
+                (const char*)response.m_RemoteAddr.ToString());
+
+            m_Buffer  = (*packet).m_Data;
+            m_Buffer += m_DateHeader;
+            NPT_CHECK_WARNING(m_Socket.Send(
+                NPT_DataBuffer(m_Buffer.GetChars(), m_Buffer.GetLength(), false), 
+                &response.m_RemoteAddr));
+        }
+        ++packet;
+    }
+
+    return NPT_SUCCESS;
+}
+
+/*----------------------------------------------------------------------
+|   PLT_SsdpSearchResponderTask::FormatPackets
++---------------------------------------------------------------------*/
+NPT_Result
+PLT_SsdpSearchResponderTask::FormatPackets(PLT_SsdpSearchResponseInterface& iface)
+{
+    NPT_HttpResponse response(200, "OK", NPT_HTTP_PROTOCOL_1_1);
+    PLT_UPnPMessageHelper::SetLocation(response, m_Device->GetDescriptionUrl(iface.m_Address.ToString()));
+    PLT_UPnPMessageHelper::SetLeaseTime(response, m_Device->GetLeaseTime());
+    PLT_UPnPMessageHelper::SetServer(response, PLT_HTTP_DEFAULT_SERVER, false);
+    response.GetHeaders().SetHeader("EXT", "");
+
+    iface.m_Packets.Clear();
+    NPT_CHECK_SEVERE(FormatPackets(m_Device, response, iface.m_Packets));
+
+    iface.m_Formatted = true;
+    return NPT_SUCCESS;
+}
+
+/*----------------------------------------------------------------------
+|   PLT_SsdpSearchResponderTask::FormatPackets
++---------------------------------------------------------------------*/
+NPT_Result
+PLT_SsdpSearchResponderTask::FormatPackets(PLT_DeviceData*                         device,
+                                           NPT_HttpResponse&                       response,
+                                           NPT_List<PLT_SsdpSearchResponsePacket>& packets)
+{
+    // same packets as PLT_DeviceHost::SendSsdpSearchResponse would send for ssdp:all
+    PLT_UPnPMessageHelper::SetBootId(response, device->m_BootId);
+    if (device->m_ConfigId > 0) {
+        PLT_UPnPMessageHelper::SetConfigId(response, device->m_ConfigId);
+    }
+
+    // upnp:rootdevice
+    if (device->m_ParentUUID.IsEmpty()) {
+        NPT_CHECK(FormatPacket(response, 
+            NPT_String("uuid:" + device->m_UUID + "::upnp:rootdevice"), 
+            "upnp:rootdevice", 
+            packets));
+    }
+
+    // uuid:device-UUID
+    NPT_CHECK(FormatPacket(response, 
+        "uuid:" + device->m_UUID, 
+        "uuid:" + device->m_UUID, 
+        packets));
+
+    // uuid:device-UUID::urn:schemas-upnp-org:device:deviceType:ver
+    NPT_CHECK(FormatPacket(response, 
+        NPT_String("uuid:" + device->m_UUID + "::" + device->m_DeviceType), 
+        device->m_DeviceType, 
+        packets));
+
+    // uuid:device-UUID::urn:schemas-upnp-org:service:serviceType:ver
+    for (NPT_Cardinal i=0; i<device->m_Services.GetItemCount(); i++) {
+        NPT_CHECK(FormatPacket(response, 
+            NPT_String("uuid:" + device->m_UUID + "::" + device->m_Services[i]->GetServiceType()), 
+            device->m_Services[i]->GetServiceType(), 
+            packets));
+    }
+
+    // embedded devices
+    for (NPT_Cardinal j=0; j<device->m_EmbeddedDevices.GetItemCount(); j++) {
+        NPT_CHECK(FormatPackets(device->m_EmbeddedDevices[j].AsPointer(), response, packets));
+    }
+
+    return NPT_SUCCESS;
+}
+
+/*----------------------------------------------------------------------
+|   PLT_SsdpSearchResponderTask::FormatPacket
++---------------------------------------------------------------------*/
+NPT_Result
+PLT_SsdpSearchResponderTask::FormatPacket(NPT_HttpResponse&                       response,
+                                          const char*                             usn,
+                                          const char*                             target,
+                                          NPT_List<PLT_SsdpSearchResponsePacket>& packets)
+{
+    PLT_UPnPMessageHelper::SetUSN(response, usn);
+    PLT_UPnPMessageHelper::SetST(response, target);
+
+    NPT_MemoryStream stream;
+    NPT_CHECK(response.Emit(stream));
+
+    // strip final CRLF, the Date header is appended when sending
+    NPT_Size size = stream.GetDataSize();
+    if (size < 2) return NPT_FAILURE;
+
+    PLT_SsdpSearchResponsePacket packet;
+    packet.m_Target = target;
+    packet.m_Data.Assign((const char*)stream.GetData(), size - 2);
+    return packets.Add(packet);
+}
+
+/*----------------------------------------------------------------------
+|   PLT_SsdpSearchResponderTask::ComputeSignature
++---------------------------------------------------------------------*/
+NPT_UInt32
+PLT_SsdpSearchResponderTask::ComputeSignature(PLT_DeviceData* device, 
+                                              NPT_UInt32      signature /* = 0 */)
+{
+    signature = signature*31 + device->m_BootId;
+    signature = signature*31 + device->m_ConfigId;
+    signature = signature*31 + device->m_Services.GetItemCount();
+    signature = signature*31 + (NPT_UInt32)device->m_LeaseTime.ToSeconds();
+    for (NPT_Cardinal i=0; i<device->m_EmbeddedDevices.GetItemCount(); i++) {
+        signature = ComputeSignature(device->m_EmbeddedDevices[i].AsPointer(), signature);
+    }
+
+    return signature;
+}
+
 /*----------------------------------------------------------------------
 |   PLT_SsdpAnnounceInterfaceIterator class
 +---------------------------------------------------------------------*/
 NPT_Result
 PLT_SsdpAnnounceInterfaceIterator::operator()(NPT_NetworkInterface*& net_if) const 
+{
+    NPT_IpAddress addr;
+    PLT_SsdpBatch batch;
+    NPT_CHECK(PLT_SsdpAnnounceScheduler::FormatAnnounce(m_Device, 
+                                                        net_if, 
+                                                        m_Type, 
+                                                        m_Broadcast, 
+                                                        addr, 
+                                                        batch));
+
+    NPT_UdpMulticastSocket multicast_socket(NPT_SOCKET_FLAG_CANCELLABLE);
+    NPT_UdpSocket          broadcast_socket(NPT_SOCKET_FLAG_CANCELLABLE);
+    NPT_UdpSocket*         socket;
+
+    if (m_Broadcast) {
+        socket = &broadcast_socket;
+    } else {
+        NPT_CHECK_SEVERE(multicast_socket.SetInterface(addr));
+        socket = &multicast_socket;
+        multicast_socket.SetTimeToLive(PLT_Constants::GetInstance().GetAnnounceMulticastTimeToLive());
+    }
+
+    // on byebye, don't pace otherwise it hangs when we stop upnp
+    NPT_TimeInterval pacing;
+    if (m_Type != PLT_ANNOUNCETYPE_BYEBYE && m_Device->m_SsdpPacing) {
+        pacing = NPT_TimeInterval(PLT_DLNA_SSDP_DELAY);
+    }
+    batch.Send(*socket, pacing);
+
+#if defined(PLATINUM_UPNP_SPECS_STRICT)
+    // delay alive only as we don't want to delay when stopping
+    if (m_Type != PLT_ANNOUNCETYPE_BYEBYE) {
+        NPT_System::Sleep(NPT_TimeInterval(PLT_DLNA_SSDP_DELAY_GROUP));
+    }
+    
+    batch.Send(*socket, pacing);
+#endif
+
+    return NPT_SUCCESS;
+}
+
+/*----------------------------------------------------------------------
+|   globals
++---------------------------------------------------------------------*/
+static NPT_Mutex                  AnnounceSchedulerLock;
+static PLT_TaskManager            AnnounceSchedulerTaskManager;
+static PLT_SsdpAnnounceScheduler* AnnounceScheduler = NULL;
+
+/*----------------------------------------------------------------------
+|   PLT_SsdpAnnounceScheduler::Schedule
++---------------------------------------------------------------------*/
+NPT_Result
+PLT_SsdpAnnounceScheduler::Schedule(PLT_DeviceHost*  device,
+                                    NPT_TimeInterval repeat,
+                                    NPT_TimeInterval delay,
+                                    bool             byebye_first    /* = false */,
+                                    bool             extra_broadcast /* = false */)
+{
+    NPT_AutoLock lock(AnnounceSchedulerLock);
+
+    if (!AnnounceScheduler) {
+        PLT_SsdpAnnounceScheduler* scheduler = new PLT_SsdpAnnounceScheduler();
+        NPT_Result result = AnnounceSchedulerTaskManager.StartTask(scheduler, NULL, false);
+        if (NPT_FAILED(result)) {
+            scheduler->Kill();
+            NPT_CHECK_SEVERE(result);
+        }
+        AnnounceScheduler = scheduler;
+    }
+
+    NPT_TimeStamp now;
+    NPT_System::GetCurrentTimeStamp(now);
+
+    PLT_SsdpAnnouncedDevice entry;
+    entry.m_Device         = device;
+    entry.m_Repeat         = repeat;
+    entry.m_Due            = now + delay;
+    entry.m_ByeByeFirst    = byebye_first;
+    entry.m_ExtraBroadcast = extra_broadcast;
+    return AnnounceScheduler->Add(entry);
+}
+
+/*----------------------------------------------------------------------
+|   PLT_SsdpAnnounceScheduler::Cancel
++---------------------------------------------------------------------*/
+NPT_Result
+PLT_SsdpAnnounceScheduler::Cancel(PLT_DeviceHost* device)
+{
+    NPT_AutoLock lock(AnnounceSchedulerLock);
+    if (!AnnounceScheduler) return NPT_SUCCESS;
+
+    NPT_Cardinal remaining = 0;
+    AnnounceScheduler->Remove(device, remaining);
+
+    // stop the task with the last device
+    if (remaining == 0) {
+        AnnounceScheduler->Kill();
+        AnnounceScheduler = NULL;
+    }
+
+    return NPT_SUCCESS;
+}
+
+/*----------------------------------------------------------------------
+|   PLT_SsdpAnnounceScheduler::FormatAnnounce
++---------------------------------------------------------------------*/
+NPT_Result
+PLT_SsdpAnnounceScheduler::FormatAnnounce(PLT_DeviceHost*       device,
+                                          NPT_NetworkInterface* net_if,
+                                          PLT_SsdpAnnounceType  type,
+                                          bool                  broadcast,
+                                          NPT_IpAddress&        if_addr,
+                                          PLT_SsdpBatch&        batch)
 {
     // don't use this interface address if it's not broadcast capable
-    if (m_Broadcast && !(net_if->GetFlags() & NPT_NETWORK_INTERFACE_FLAG_BROADCAST)) {
+    if (broadcast && !(net_if->GetFlags() & NPT_NETWORK_INTERFACE_FLAG_BROADCAST)) {
         return NPT_FAILURE;
     }
 
@@ -226,95 +782,589 @@ PLT_SsdpAnnounceInterfaceIterator::operator()(NPT_NetworkInterface*& net_if) con
     if (!niaddr) return NPT_FAILURE;
 
     // Remove disconnected interfaces
-    NPT_IpAddress addr = (*niaddr).GetPrimaryAddress();
-    if (!addr.ToString().Compare("0.0.0.0")) return NPT_FAILURE;
+    if_addr = (*niaddr).GetPrimaryAddress();
+    if (!if_addr.ToString().Compare("0.0.0.0")) return NPT_FAILURE;
     
-    if (!m_Broadcast && 
+    if (!broadcast && 
         !(net_if->GetFlags() & NPT_NETWORK_INTERFACE_FLAG_MULTICAST) && 
         !(net_if->GetFlags() & NPT_NETWORK_INTERFACE_FLAG_LOOPBACK)) {
         NPT_LOG_INFO_2("Not a valid interface: %s (flags: %d)", 
-                       (const char*)addr.ToString(), net_if->GetFlags());
+                       (const char*)if_addr.ToString(), net_if->GetFlags());
         return NPT_FAILURE;
     }
 
-    NPT_HttpUrl            url;
-    NPT_UdpMulticastSocket multicast_socket(NPT_SOCKET_FLAG_CANCELLABLE);
-    NPT_UdpSocket          broadcast_socket(NPT_SOCKET_FLAG_CANCELLABLE);
-    NPT_UdpSocket*         socket;
-
-    if (m_Broadcast) {
+    NPT_HttpUrl url;
+    if (broadcast) {
         url = NPT_HttpUrl((*niaddr).GetBroadcastAddress().ToString(), 1900, "*");
-        socket = &broadcast_socket;
     } else {
         url = NPT_HttpUrl("239.255.255.250", 1900, "*");    
-        NPT_CHECK_SEVERE(multicast_socket.SetInterface(addr));
-        socket = &multicast_socket;
-        multicast_socket.SetTimeToLive(PLT_Constants::GetInstance().GetAnnounceMulticastTimeToLive());
     }
     
     NPT_HttpRequest req(url, "NOTIFY", NPT_HTTP_PROTOCOL_1_1);
     PLT_HttpHelper::SetHost(req, "239.255.255.250:1900");
     
     // Location header valid only for ssdp:alive or ssdp:update messages
-    if (m_Type != PLT_ANNOUNCETYPE_BYEBYE) {
-        PLT_UPnPMessageHelper::SetLocation(req, m_Device->GetDescriptionUrl(addr.ToString()));
+    if (type != PLT_ANNOUNCETYPE_BYEBYE) {
+        PLT_UPnPMessageHelper::SetLocation(req, device->GetDescriptionUrl(if_addr.ToString()));
     }
 
-    NPT_CHECK_SEVERE(m_Device->Announce(req, *socket, m_Type));
+    return PLT_DeviceHost::FormatAnnounce(device, req, type, batch);
+}
 
-#if defined(PLATINUM_UPNP_SPECS_STRICT)
-    // delay alive only as we don't want to delay when stopping
-    if (m_Type != PLT_ANNOUNCETYPE_BYEBYE) {
-        NPT_System::Sleep(NPT_TimeInterval(PLT_DLNA_SSDP_DELAY_GROUP));
+/*----------------------------------------------------------------------
+|   PLT_SsdpAnnounceScheduler::PLT_SsdpAnnounceScheduler
++---------------------------------------------------------------------*/
+PLT_SsdpAnnounceScheduler::PLT_SsdpAnnounceScheduler(NPT_Cardinal rate  /* = PLT_SSDP_ANNOUNCE_RATE */,
+                                                     NPT_Cardinal burst /* = PLT_SSDP_ANNOUNCE_BURST */) :
+    m_SocketsGeneration(0),
+    m_Rate(rate?rate:1),
+    m_Burst(burst?burst:1),
+    m_Tokens(burst?burst:1)
+{
+    m_Wakeup.SetValue(0);
+    NPT_System::GetCurrentTimeStamp(m_LastRefill);
+}
+
+/*----------------------------------------------------------------------
+|   PLT_SsdpAnnounceScheduler::~PLT_SsdpAnnounceScheduler
++---------------------------------------------------------------------*/
+PLT_SsdpAnnounceScheduler::~PLT_SsdpAnnounceScheduler()
+{
+    ClearSockets();
+}
+
+/*----------------------------------------------------------------------
+|   PLT_SsdpAnnounceScheduler::Add
++---------------------------------------------------------------------*/
+NPT_Result
+PLT_SsdpAnnounceScheduler::Add(const PLT_SsdpAnnouncedDevice& device)
+{
+    {
+        NPT_AutoLock lock(m_Lock);
+
+        NPT_List<PLT_SsdpAnnouncedDevice>::Iterator entry = m_Devices.GetFirstItem();
+        while (entry) {
+            if ((*entry).m_Device == device.m_Device) return NPT_ERROR_INVALID_STATE;
+            ++entry;
+        }
+        m_Devices.Add(device);
     }
-    
-    NPT_CHECK_SEVERE(m_Device->Announce(req, *socket, m_Type));
-#endif
 
+    m_Wakeup.SetValue(1);
     return NPT_SUCCESS;
 }
 
 /*----------------------------------------------------------------------
-|   PLT_SsdpDeviceAnnounceUnicastTask::DoRun
+|   PLT_SsdpAnnounceScheduler::Remove
++---------------------------------------------------------------------*/
+NPT_Result
+PLT_SsdpAnnounceScheduler::Remove(PLT_DeviceHost* device, NPT_Cardinal& remaining)
+{
+    // the task holds the lock while formatting and sending, so once we get
+    // it nothing is in progress for this device
+    NPT_AutoLock lock(m_Lock);
+
+    NPT_List<PLT_SsdpAnnouncedDevice>::Iterator entry = m_Devices.GetFirstItem();
+    while (entry) {
+        if ((*entry).m_Device == device) {
+            m_Devices.Erase(entry);
+            break;
+        }
+        ++entry;
+    }
+
+    NPT_List<PLT_SsdpPendingAnnounce>::Iterator pending = m_Pending.GetFirstItem();
+    while (pending) {
+        if ((*pending).m_Device == device) {
+            m_Pending.Erase(pending++);
+        } else {
+            ++pending;
+        }
+    }
+
+    remaining = m_Devices.GetItemCount();
+    return NPT_SUCCESS;
+}
+
+/*----------------------------------------------------------------------
+|   PLT_SsdpAnnounceScheduler::DoAbort
++---------------------------------------------------------------------*/
+void
+PLT_SsdpAnnounceScheduler::DoAbort()
+{
+    m_Wakeup.SetValue(1);
+}
+
+/*----------------------------------------------------------------------
+|   PLT_SsdpAnnounceScheduler::DoRun
++---------------------------------------------------------------------*/
+void
+PLT_SsdpAnnounceScheduler::DoRun()
+{
+    while (!IsAborting(0)) {
+        // reset before looking at the lists so a device added meanwhile 
+        // wakes us up right away
+        m_Wakeup.SetValue(0);
+
+        NPT_Timeout   timeout = NPT_TIMEOUT_INFINITE;
+        NPT_TimeStamp now;
+        {
+            NPT_AutoLock lock(m_Lock);
+            PlanAnnounces(now, timeout);
+            SendAnnounces(now, timeout);
+        }
+
+        m_Wakeup.WaitUntilEquals(1, timeout);
+    }
+}
+
+/*----------------------------------------------------------------------
+|   PLT_SsdpAnnounceScheduler::PlanAnnounces
 +---------------------------------------------------------------------*/
 void
-PLT_SsdpDeviceAnnounceTask::DoRun()
+PLT_SsdpAnnounceScheduler::PlanAnnounces(NPT_TimeStamp& now, NPT_Timeout& timeout)
 {
+    NPT_System::GetCurrentTimeStamp(now);
+
     NPT_List<NPT_NetworkInterface*> if_list;
+    bool                            if_list_valid = false;
+
+    NPT_List<PLT_SsdpAnnouncedDevice>::Iterator entry = m_Devices.GetFirstItem();
+    for (; entry; ++entry) {
+        if ((*entry).m_Due > now) {
+            NPT_Timeout wait = (NPT_Timeout)(((*entry).m_Due - now).ToMillis() + 1);
+            if (timeout == NPT_TIMEOUT_INFINITE || wait < timeout) timeout = wait;
+            continue;
+        }
+
+        if (!if_list_valid) {
+            if (NPT_FAILED(PLT_UPnPMessageHelper::GetNetworkInterfaces(if_list, false))) {
+                if_list.Apply(NPT_ObjectDeleter<NPT_NetworkInterface>());
+                if_list.Clear();
+            }
+            if_list_valid = true;
+        }
 
-    while (1) {
-        NPT_CHECK_LABEL_FATAL(PLT_UPnPMessageHelper::GetNetworkInterfaces(if_list, false),
-                              cleanup);
+        PLT_DeviceHost*  device = (*entry).m_Device;
+        NPT_TimeStamp    start  = now;
+        NPT_TimeInterval spacing;
+        if (device->m_SsdpPacing) spacing = NPT_TimeInterval(PLT_DLNA_SSDP_DELAY);
 
         // if we're announcing our arrival, sends a byebye first (NMPR compliance)
-        if (m_IsByeByeFirst == true) {
-            m_IsByeByeFirst = false;
-            
-            if (m_ExtraBroadcast) {
-                if_list.Apply(PLT_SsdpAnnounceInterfaceIterator(m_Device, PLT_ANNOUNCETYPE_BYEBYE, true));
+        if ((*entry).m_ByeByeFirst) {
+            (*entry).m_ByeByeFirst = false;
+
+            if ((*entry).m_ExtraBroadcast) {
+                PlanAnnounce(if_list, device, PLT_ANNOUNCETYPE_BYEBYE, true, start, NPT_TimeInterval(0.));
             }
-            
-            // multicast now
-            if_list.Apply(PLT_SsdpAnnounceInterfaceIterator(m_Device, PLT_ANNOUNCETYPE_BYEBYE, false));
-            
+            PlanAnnounce(if_list, device, PLT_ANNOUNCETYPE_BYEBYE, false, start, NPT_TimeInterval(0.));
+
             // schedule to announce alive in 200 ms
-            if (IsAborting(200)) break;
+            start += NPT_TimeInterval(.2);
+        }
+
+        if ((*entry).m_ExtraBroadcast) {
+            PlanAnnounce(if_list, device, PLT_ANNOUNCETYPE_ALIVE, true, start, spacing);
+        }
+        PlanAnnounce(if_list, device, PLT_ANNOUNCETYPE_ALIVE, false, start, spacing);
+
+        (*entry).m_Due = start + (*entry).m_Repeat;
+        NPT_Timeout wait = (NPT_Timeout)(((*entry).m_Due - now).ToMillis() + 1);
+        if (timeout == NPT_TIMEOUT_INFINITE || wait < timeout) timeout = wait;
+    }
+
+    if_list.Apply(NPT_ObjectDeleter<NPT_NetworkInterface>());
+}
+
+/*----------------------------------------------------------------------
+|   PLT_SsdpAnnounceScheduler::PlanAnnounce
++---------------------------------------------------------------------*/
+void
+PLT_SsdpAnnounceScheduler::PlanAnnounce(NPT_List<NPT_NetworkInterface*>& if_list,
+                                        PLT_DeviceHost*                  device,
+                                        PLT_SsdpAnnounceType             type,
+                                        bool                             broadcast,
+                                        const NPT_TimeStamp&             due,
+                                        const NPT_TimeInterval&          spacing)
+{
+    NPT_List<NPT_NetworkInterface*>::Iterator net_if = if_list.GetFirstItem();
+    for (; net_if; ++net_if) {
+        PLT_SsdpPendingAnnounce announce;
+        announce.m_Device    = device;
+        announce.m_Batch     = new PLT_SsdpBatch();
+        announce.m_Next      = 0;
+        announce.m_Broadcast = broadcast;
+        announce.m_Due       = due;
+        announce.m_Spacing   = spacing;
+        if (NPT_FAILED(FormatAnnounce(device, 
+                                      *net_if, 
+                                      type, 
+                                      broadcast, 
+                                      announce.m_Interface, 
+                                      *announce.m_Batch))) {
+            continue;
+        }
+        Enqueue(announce);
+
+#if defined(PLATINUM_UPNP_SPECS_STRICT)
+        // send announcement twice to be DLNA compliant, 
+        // delay alive only as we don't want to delay when stopping
+        if (type != PLT_ANNOUNCETYPE_BYEBYE) {
+            announce.m_Due += NPT_TimeInterval(PLT_DLNA_SSDP_DELAY_GROUP);
+        }
+        Enqueue(announce);
+#endif
+    }
+}
+
+/*----------------------------------------------------------------------
+|   PLT_SsdpAnnounceScheduler::Enqueue
++---------------------------------------------------------------------*/
+void
+PLT_SsdpAnnounceScheduler::Enqueue(const PLT_SsdpPendingAnnounce& announce)
+{
+    // keep list sorted by due time
+    NPT_List<PLT_SsdpPendingAnnounce>::Iterator pending = m_Pending.GetFirstItem();
+    while (pending && (*pending).m_Due <= announce.m_Due) ++pending;
+    m_Pending.Insert(pending, announce);
+}
+
+/*----------------------------------------------------------------------
+|   PLT_SsdpAnnounceScheduler::SendAnnounces
++---------------------------------------------------------------------*/
+void
+PLT_SsdpAnnounceScheduler::SendAnnounces(NPT_TimeStamp& now, NPT_Timeout& timeout)
+{
+    NPT_List<PLT_SsdpPendingAnnounce>::Iterator pending;
+    while ((pending = m_Pending.GetFirstItem())) {
+        NPT_System::GetCurrentTimeStamp(now);
+        if ((*pending).m_Due > now) {
+            NPT_Timeout wait = (NPT_Timeout)(((*pending).m_Due - now).ToMillis() + 1);
+            if (timeout == NPT_TIMEOUT_INFINITE || wait < timeout) timeout = wait;
+            return;
+        }
+
+        // refill the bucket with the tokens earned since last time
+        m_Tokens += (double)(now - m_LastRefill).ToMillis() * m_Rate / 1000.;
+        if (m_Tokens > m_Burst) m_Tokens = m_Burst;
+        m_LastRefill = now;
+
+        if (m_Tokens < 1.) {
+            NPT_Timeout wait = (NPT_Timeout)((1. - m_Tokens) * 1000. / m_Rate) + 1;
+            if (timeout == NPT_TIMEOUT_INFINITE || wait < timeout) timeout = wait;
+            return;
+        }
+        m_Tokens -= 1.;
+
+        PLT_SsdpPendingAnnounce announce = *pending;
+        m_Pending.Erase(pending);
+
+        NPT_UdpSocket* socket = NULL;
+        if (NPT_SUCCEEDED(GetSocket(announce, socket))) {
+            announce.m_Batch->SendPacket(*socket, announce.m_Next);
+        }
+
+        // requeue the rest of the batch
+        if (++announce.m_Next < announce.m_Batch->GetPacketCount()) {
+            announce.m_Due = now + announce.m_Spacing;
+            Enqueue(announce);
+        }
+    }
+}
+
+/*----------------------------------------------------------------------
+|   PLT_SsdpAnnounceScheduler::GetSocket
++---------------------------------------------------------------------*/
+NPT_Result
+PLT_SsdpAnnounceScheduler::GetSocket(const PLT_SsdpPendingAnnounce& announce, 
+                                     NPT_UdpSocket*&                socket)
+{
+    // sockets are bound to an interface, recreate them when interfaces change
+    NPT_UInt32 generation = PLT_NetworkInterfaceCache::GetInstance().GetGeneration();
+    if (generation != m_SocketsGeneration) {
+        ClearSockets();
+        m_SocketsGeneration = generation;
+    }
+
+    NPT_List<PLT_SsdpAnnounceSocket>::Iterator entry = m_Sockets.GetFirstItem();
+    for (; entry; ++entry) {
+        if ((*entry).m_Broadcast == announce.m_Broadcast &&
+            (*entry).m_Interface == announce.m_Interface) {
+            socket = (*entry).m_Socket;
+            return NPT_SUCCESS;
+        }
+    }
+
+    if (announce.m_Broadcast) {
+        socket = new NPT_UdpSocket(NPT_SOCKET_FLAG_CANCELLABLE);
+    } else {
+        NPT_UdpMulticastSocket* multicast_socket = new NPT_UdpMulticastSocket(NPT_SOCKET_FLAG_CANCELLABLE);
+        NPT_Result result = multicast_socket->SetInterface(announce.m_Interface);
+        if (NPT_FAILED(result)) {
+            delete multicast_socket;
+            NPT_CHECK_SEVERE(result);
+        }
+        multicast_socket->SetTimeToLive(PLT_Constants::GetInstance().GetAnnounceMulticastTimeToLive());
+        socket = multicast_socket;
+    }
+
+    PLT_SsdpAnnounceSocket new_entry;
+    new_entry.m_Interface = announce.m_Interface;
+    new_entry.m_Broadcast = announce.m_Broadcast;
+    new_entry.m_Socket    = socket;
+    return m_Sockets.Add(new_entry);
+}
+
+/*----------------------------------------------------------------------
+|   PLT_SsdpAnnounceScheduler::ClearSockets
++---------------------------------------------------------------------*/
+void
+PLT_SsdpAnnounceScheduler::ClearSockets()
+{
+    NPT_List<PLT_SsdpAnnounceSocket>::Iterator entry = m_Sockets.GetFirstItem();
+    for (; entry; ++entry) {
+        delete (*entry).m_Socket;
+    }
+    m_Sockets.Clear();
+}
+
+/*----------------------------------------------------------------------
+|   PLT_SsdpPacket::PLT_SsdpPacket
++---------------------------------------------------------------------*/
+PLT_SsdpPacket::PLT_SsdpPacket(const NPT_HttpRequest&        request, 
+                               const NPT_HttpRequestContext& context) :
+    m_Request(new NPT_HttpRequest(request.GetUrl(), 
+                                  request.GetMethod(), 
+                                  request.GetProtocol())),
+    m_Context(context)
+{
+    // SSDP requests have no body, only headers need to be copied
+    NPT_List<NPT_HttpHeader*>::Iterator header = 
+        request.GetHeaders().GetHeaders().GetFirstItem();
+    while (header) {
+        m_Request->GetHeaders().AddHeader((*header)->GetName(), (*header)->GetValue());
+        ++header;
+    }
+}
+
+/*----------------------------------------------------------------------
+|   PLT_SsdpPacketQueue::PLT_SsdpPacketQueue
++---------------------------------------------------------------------*/
+PLT_SsdpPacketQueue::PLT_SsdpPacketQueue(PLT_SsdpPacketListener* listener,
+                                         NPT_Cardinal            max_pending /* = PLT_SSDP_LISTENER_MAX_PENDING */) :
+    m_Listener(listener),
+    m_Head(0),
+    m_Count(0),
+    m_Dropped(0),
+    m_Closed(false)
+{
+    m_Ring.Resize(max_pending?max_pending:1);
+    m_Wakeup.SetValue(0);
+}
+
+/*----------------------------------------------------------------------
+|   PLT_SsdpPacketQueue::GetDroppedCount
++---------------------------------------------------------------------*/
+NPT_Cardinal
+PLT_SsdpPacketQueue::GetDroppedCount()
+{
+    NPT_AutoLock lock(m_Lock);
+    return m_Dropped;
+}
+
+/*----------------------------------------------------------------------
+|   PLT_SsdpPacketQueue::Push
++---------------------------------------------------------------------*/
+NPT_Result
+PLT_SsdpPacketQueue::Push(const PLT_SsdpPacketReference& packet)
+{
+    {
+        NPT_AutoLock lock(m_Lock);
+        if (m_Closed) return NPT_ERROR_INTERRUPTED;
+
+        if (m_Count == m_Ring.GetItemCount()) {
+            // warn on first drop then each time the count doubles
+            ++m_Dropped;
+            if ((m_Dropped & (m_Dropped - 1)) == 0) {
+                NPT_LOG_WARNING_1("SSDP listener falling behind, %d packets dropped", 
+                    m_Dropped);
+            }
+            return NPT_ERROR_OUT_OF_RESOURCES;
+        }
+
+        m_Ring[(m_Head + m_Count) % m_Ring.GetItemCount()] = packet;
+        ++m_Count;
+    }
+
+    m_Wakeup.SetValue(1);
+    return NPT_SUCCESS;
+}
+
+/*----------------------------------------------------------------------
+|   PLT_SsdpPacketQueue::Pop
++---------------------------------------------------------------------*/
+NPT_Result
+PLT_SsdpPacketQueue::Pop(PLT_SsdpPacketReference& packet)
+{
+    for (;;) {
+        {
+            NPT_AutoLock lock(m_Lock);
+            if (m_Closed) return NPT_ERROR_INTERRUPTED;
+
+            if (m_Count) {
+                packet = m_Ring[m_Head];
+                m_Ring[m_Head] = NULL;
+                m_Head = (m_Head + 1) % m_Ring.GetItemCount();
+                --m_Count;
+                return NPT_SUCCESS;
+            }
+
+            // reset while locked so a packet pushed after we unlock wakes us up
+            m_Wakeup.SetValue(0);
+        }
+
+        m_Wakeup.WaitUntilEquals(1, NPT_TIMEOUT_INFINITE);
+    }
+}
+
+/*----------------------------------------------------------------------
+|   PLT_SsdpPacketQueue::Close
++---------------------------------------------------------------------*/
+void
+PLT_SsdpPacketQueue::Close()
+{
+    {
+        NPT_AutoLock lock(m_Lock);
+        m_Closed = true;
+    }
+    m_Wakeup.SetValue(1);
+}
+
+/*----------------------------------------------------------------------
+|   PLT_SsdpPacketListenerTask::DoRun
++---------------------------------------------------------------------*/
+void
+PLT_SsdpPacketListenerTask::DoRun()
+{
+    PLT_SsdpPacketReference packet;
+    while (!IsAborting(0) && NPT_SUCCEEDED(m_Queue->Pop(packet))) {
+        m_Queue->GetListener()->OnSsdpPacket(*packet->m_Request, packet->m_Context);
+        packet = NULL;
+    }
+}
+
+/*----------------------------------------------------------------------
+|    PLT_SsdpListenTask::PLT_SsdpListenTask
++---------------------------------------------------------------------*/
+PLT_SsdpListenTask::PLT_SsdpListenTask(NPT_Socket*  socket,
+                                       NPT_Cardinal max_pending /* = PLT_SSDP_LISTENER_MAX_PENDING */) : 
+    PLT_HttpServerSocketTask(socket, true),
+    m_Queues(new PLT_SsdpPacketQueueList()),
+    m_MaxPending(max_pending)
+{
+    // Change read time out for UDP because iPhone 3.0 seems to hang
+    // after reading everything from the socket even though
+    // more stuff arrived
+#if defined(TARGET_OS_IPHONE) && TARGET_OS_IPHONE
+    m_Socket->SetReadTimeout(10000);
+#endif
+}
+
+/*----------------------------------------------------------------------
+|    PLT_SsdpListenTask::~PLT_SsdpListenTask
++---------------------------------------------------------------------*/
+PLT_SsdpListenTask::~PLT_SsdpListenTask()
+{
+    // stop tasks of listeners which were never removed
+    NPT_List<PLT_SsdpPacketListenerTask*>::Iterator task = m_Tasks.GetFirstItem();
+    while (task) {
+        (*task)->Kill();
+        ++task;
+    }
+}
+
+/*----------------------------------------------------------------------
+|    PLT_SsdpListenTask::AddListener
++---------------------------------------------------------------------*/
+NPT_Result
+PLT_SsdpListenTask::AddListener(PLT_SsdpPacketListener* listener)
+{
+    NPT_AutoLock lock(m_Mutex);
+
+    NPT_List<PLT_SsdpPacketListenerTask*>::Iterator task = m_Tasks.GetFirstItem();
+    while (task) {
+        if ((*task)->GetListener() == listener) return NPT_SUCCESS;
+        ++task;
+    }
+
+    PLT_SsdpPacketQueueReference queue(new PLT_SsdpPacketQueue(listener, m_MaxPending));
+    PLT_SsdpPacketListenerTask* listener_task = new PLT_SsdpPacketListenerTask(queue);
+    NPT_Result result = m_ListenerTasks.StartTask(listener_task, NULL, false);
+    if (NPT_FAILED(result)) {
+        listener_task->Kill();
+        NPT_CHECK_SEVERE(result);
+    }
+    m_Tasks.Add(listener_task);
+
+    // publish a new list, packets being dispatched keep using the old one
+    PLT_SsdpPacketQueueList* queues = new PLT_SsdpPacketQueueList(*m_Queues);
+    queues->Add(queue);
+    m_Queues = queues;
+
+    return NPT_SUCCESS;
+}
+
+/*----------------------------------------------------------------------
+|    PLT_SsdpListenTask::RemoveListener
++---------------------------------------------------------------------*/
+NPT_Result
+PLT_SsdpListenTask::RemoveListener(PLT_SsdpPacketListener* listener)
+{
+    PLT_SsdpPacketListenerTask* listener_task = NULL;
+    {
+        NPT_AutoLock lock(m_Mutex);
+
+        NPT_List<PLT_SsdpPacketListenerTask*>::Iterator task = m_Tasks.GetFirstItem();
+        while (task && (*task)->GetListener() != listener) ++task;
+        if (!task) return NPT_SUCCESS;
+
+        listener_task = *task;
+        m_Tasks.Erase(task);
+
+        PLT_SsdpPacketQueueList* queues = new PLT_SsdpPacketQueueList();
+        PLT_SsdpPacketQueueList::Iterator queue = m_Queues->GetFirstItem();
+        while (queue) {
+            if ((*queue)->GetListener() != listener) queues->Add(*queue);
+            ++queue;
         }
-        
-        if (m_ExtraBroadcast) {
-            if_list.Apply(PLT_SsdpAnnounceInterfaceIterator(m_Device, PLT_ANNOUNCETYPE_ALIVE, true));
+        m_Queues = queues;
+    }
+
+    // wait outside of the lock for the listener to finish 
+    // handling its current packet if any
+    listener_task->Kill();
+    return NPT_SUCCESS;
+}
+
+/*----------------------------------------------------------------------
+|    PLT_SsdpListenTask::GetDroppedCount
++---------------------------------------------------------------------*/
+NPT_Result
+PLT_SsdpListenTask::GetDroppedCount(PLT_SsdpPacketListener* listener, 
+                                    NPT_Cardinal&           dropped)
+{
+    NPT_AutoLock lock(m_Mutex);
+
+    PLT_SsdpPacketQueueList::Iterator queue = m_Queues->GetFirstItem();
+    while (queue) {
+        if ((*queue)->GetListener() == listener) {
+            dropped = (*queue)->GetDroppedCount();
+            return NPT_SUCCESS;
         }
-        
-        // multicast now
-        if_list.Apply(PLT_SsdpAnnounceInterfaceIterator(m_Device, PLT_ANNOUNCETYPE_ALIVE, false));
-        
-        
-cleanup:
-        if_list.Apply(NPT_ObjectDeleter<NPT_NetworkInterface>());
-        if_list.Clear();
+        ++queue;
+    }
 
-        if (IsAborting((NPT_Timeout)m_Repeat.ToMillis())) break;
-    };
+    return NPT_ERROR_NO_SUCH_ITEM;
 }
 
 /*----------------------------------------------------------------------
@@ -369,8 +1419,23 @@ PLT_SsdpListenTask::SetupResponse(NPT_HttpRequest&              request,
 {
     NPT_COMPILER_UNUSED(response);
 
-    NPT_AutoLock lock(m_Mutex);
-    m_Listeners.Apply(PLT_SsdpPacketListenerIterator(request, context));
+    // the lock is only held to grab the current list of queues
+    NPT_Reference<PLT_SsdpPacketQueueList> queues;
+    {
+        NPT_AutoLock lock(m_Mutex);
+        queues = m_Queues;
+    }
+
+    if (queues->GetItemCount()) {
+        // one copy of the request is shared by all listeners
+        PLT_SsdpPacketReference packet(new PLT_SsdpPacket(request, context));
+
+        PLT_SsdpPacketQueueList::Iterator queue = queues->GetFirstItem();
+        while (queue) {
+            (*queue)->Push(packet);
+            ++queue;
+        }
+    }
 
     // return error since we don't have anything to respond
     // as we use a separate task to respond with ssdp
@@ -500,7 +1565,7 @@ done:
 }
 
 /*----------------------------------------------------------------------
-|    PLT_CtrlPointGetDescriptionTask::ProcessResponse
+|    PLT_SsdpSearchTask::ProcessResponse
 +---------------------------------------------------------------------*/
 NPT_Result 
 PLT_SsdpSearchTask::ProcessResponse(NPT_Result                    res, 
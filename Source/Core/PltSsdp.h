@@ -50,6 +50,14 @@
 |   forward declarations
 +---------------------------------------------------------------------*/
 class PLT_DeviceHost;
+class PLT_DeviceData;
+
+/*----------------------------------------------------------------------
+|   constants
++---------------------------------------------------------------------*/
+#define PLT_SSDP_LISTENER_MAX_PENDING 64  // per listener
+#define PLT_SSDP_ANNOUNCE_RATE        100 // packets per second
+#define PLT_SSDP_ANNOUNCE_BURST       32  // packets
 
 /*----------------------------------------------------------------------
 |   PLT_SsdpAnnounceType
@@ -91,6 +99,51 @@ public:
                                                  NPT_HttpResponse*             response) = 0;
 };
 
+/*----------------------------------------------------------------------
+|   PLT_SsdpBatch class
++---------------------------------------------------------------------*/
+/**
+ The PLT_SsdpBatch class holds SSDP packets formatted up front so they can be
+ sent together on the same socket, either in a burst or spaced out.
+ */
+class PLT_SsdpBatch
+{
+public:
+    NPT_Result Add(const NPT_Byte*          data, 
+                   NPT_Size                 size,
+                   const NPT_SocketAddress* addr = NULL);
+
+    NPT_Cardinal GetPacketCount() const { return m_Packets.GetItemCount(); }
+    void         Clear() { m_Packets.Clear(); }
+
+    /**
+     Send all the packets of the batch in order. A packet failing to send
+     does not prevent the next ones from being sent.
+     @param socket the socket to send the packets with
+     @param pacing delay between two packets, 0 to send them back to back
+     @return the last error encountered if any
+     */
+    NPT_Result Send(NPT_UdpSocket& socket, NPT_TimeInterval pacing = NPT_TimeInterval(0.)) const;
+
+    /**
+     Send a single packet of the batch.
+     @param socket the socket to send the packet with
+     @param index index of the packet in the batch
+     */
+    NPT_Result SendPacket(NPT_UdpSocket& socket, NPT_Ordinal index) const;
+
+private:
+    struct Packet {
+        NPT_DataBuffer    m_Data;
+        NPT_SocketAddress m_Address;
+        bool              m_HasAddress;
+    };
+
+    NPT_Array<Packet> m_Packets;
+};
+
+typedef NPT_Reference<PLT_SsdpBatch> PLT_SsdpBatchReference;
+
 /*----------------------------------------------------------------------
 |   PLT_SsdpSender class
 +---------------------------------------------------------------------*/
@@ -114,11 +167,20 @@ public:
                                bool               notify, 
                                const NPT_SocketAddress* addr = NULL);
 
+    /**
+     Format a SSDP request and add it to a batch instead of sending it.
+     */
+    static NPT_Result FormatSsdp(NPT_HttpRequest&   request, 
+                                 const char*        usn,
+                                 const char*        nt,
+                                 bool               notify,
+                                 PLT_SsdpBatch&     batch,
+                                 const NPT_SocketAddress* addr = NULL);
+
 private:
     static NPT_Result FormatPacket(NPT_HttpMessage&   message,
                                    const char*        usn,
                                    const char*        nt,
-                                   NPT_UdpSocket&     socket,
                                    bool               notify);
 };
 
@@ -173,6 +235,113 @@ protected:
     NPT_String          m_ST;
 };
 
+/*----------------------------------------------------------------------
+|   PLT_SsdpSearchResponsePacket struct
++---------------------------------------------------------------------*/
+/**
+ A M-SEARCH response preformatted for a given search target. The packet data
+ is missing the Date header and final CRLF which are appended when sent.
+ */
+struct PLT_SsdpSearchResponsePacket {
+    NPT_String m_Target;
+    NPT_String m_Data;
+};
+
+/*----------------------------------------------------------------------
+|   PLT_SsdpSearchResponseInterface struct
++---------------------------------------------------------------------*/
+/**
+ A local network address with the M-SEARCH response packets advertising
+ a Location reachable through it.
+ */
+struct PLT_SsdpSearchResponseInterface {
+    PLT_SsdpSearchResponseInterface() : m_Formatted(false) {}
+
+    NPT_IpAddress                          m_Address;
+    NPT_IpAddress                          m_NetMask;
+    bool                                   m_Formatted;
+    NPT_List<PLT_SsdpSearchResponsePacket> m_Packets;
+};
+
+/*----------------------------------------------------------------------
+|   PLT_SsdpSearchPendingResponse struct
++---------------------------------------------------------------------*/
+struct PLT_SsdpSearchPendingResponse {
+    NPT_SocketAddress m_RemoteAddr;
+    NPT_String        m_ST;
+    NPT_TimeStamp     m_Due;
+    NPT_Cardinal      m_Count;
+};
+
+/*----------------------------------------------------------------------
+|   PLT_SsdpSearchResponderTask class
++---------------------------------------------------------------------*/
+/**
+ The PLT_SsdpSearchResponderTask class is used by a PLT_DeviceHost to respond
+ to SSDP M-SEARCH requests from a single thread. Responses are queued by due
+ time and sent on one unconnected socket. Packets are formatted once per local
+ address and reused until the device tree or the network interfaces change.
+ */
+class PLT_SsdpSearchResponderTask : public PLT_ThreadTask
+{
+public:
+    PLT_SsdpSearchResponderTask(PLT_DeviceHost* device,
+                                NPT_Cardinal    max_pending = 256);
+
+    /**
+     Queue a response to a M-SEARCH request. A request from the same remote
+     address for the same search target already queued is ignored.
+     @param remote_addr the address of the control point which sent the request
+     @param st the request search target
+     @param delay time to wait before responding
+     */
+    NPT_Result Respond(const NPT_SocketAddress& remote_addr,
+                       const char*              st,
+                       const NPT_TimeInterval&  delay);
+
+protected:
+    virtual ~PLT_SsdpSearchResponderTask() {}
+
+    // PLT_ThreadTask methods
+    virtual void DoAbort();
+    virtual void DoRun();
+    virtual bool IsLongRunning() { return true; }
+
+private:
+    NPT_Result PopDueResponses(NPT_List<PLT_SsdpSearchPendingResponse>& responses,
+                               NPT_Timeout&                             timeout);
+    NPT_Result SendResponse(const PLT_SsdpSearchPendingResponse& response);
+    void       Refresh();
+    NPT_Result FindInterface(const NPT_IpAddress&              remote_ip,
+                             PLT_SsdpSearchResponseInterface*& iface);
+    NPT_Result FormatPackets(PLT_SsdpSearchResponseInterface& iface);
+
+    static NPT_Result FormatPackets(PLT_DeviceData*                         device,
+                                    NPT_HttpResponse&                       response,
+                                    NPT_List<PLT_SsdpSearchResponsePacket>& packets);
+    static NPT_Result FormatPacket(NPT_HttpResponse&                       response,
+                                   const char*                             usn,
+                                   const char*                             target,
+                                   NPT_List<PLT_SsdpSearchResponsePacket>& packets);
+    static NPT_UInt32 ComputeSignature(PLT_DeviceData* device, NPT_UInt32 signature = 0);
+
+private:
+    PLT_DeviceHost*                            m_Device;
+    NPT_Cardinal                               m_MaxPending;
+    NPT_Mutex                                  m_Lock;
+    NPT_List<PLT_SsdpSearchPendingResponse>    m_Pending;
+    NPT_SharedVariable                         m_Wakeup;
+
+    // only accessed by the task thread
+    NPT_UdpSocket                              m_Socket;
+    NPT_List<PLT_SsdpSearchResponseInterface>  m_Interfaces;
+    NPT_UInt32                                 m_InterfacesGeneration;
+    NPT_UInt32                                 m_Signature;
+    NPT_Int64                                  m_DateSeconds;
+    NPT_String                                 m_DateHeader;
+    NPT_String                                 m_Buffer;
+};
+
 /*----------------------------------------------------------------------
 |   PLT_SsdpAnnounceInterfaceIterator class
 +---------------------------------------------------------------------*/
@@ -221,35 +390,125 @@ private:
 };
 
 /*----------------------------------------------------------------------
-|   PLT_SsdpDeviceAnnounceTask class
+|   PLT_SsdpAnnouncedDevice struct
++---------------------------------------------------------------------*/
+struct PLT_SsdpAnnouncedDevice {
+    PLT_DeviceHost*  m_Device;
+    NPT_TimeInterval m_Repeat;
+    NPT_TimeStamp    m_Due;
+    bool             m_ByeByeFirst;
+    bool             m_ExtraBroadcast;
+};
+
+/*----------------------------------------------------------------------
+|   PLT_SsdpPendingAnnounce struct
++---------------------------------------------------------------------*/
+/**
+ The announcement packets of a device for one network interface, sent one
+ at a time starting at m_Due and m_Spacing apart.
+ */
+struct PLT_SsdpPendingAnnounce {
+    PLT_DeviceHost*        m_Device;
+    PLT_SsdpBatchReference m_Batch;
+    NPT_Ordinal            m_Next;
+    NPT_IpAddress          m_Interface;
+    bool                   m_Broadcast;
+    NPT_TimeStamp          m_Due;
+    NPT_TimeInterval       m_Spacing;
+};
+
+/*----------------------------------------------------------------------
+|   PLT_SsdpAnnounceSocket struct
++---------------------------------------------------------------------*/
+struct PLT_SsdpAnnounceSocket {
+    NPT_IpAddress  m_Interface;
+    bool           m_Broadcast;
+    NPT_UdpSocket* m_Socket;
+};
+
+/*----------------------------------------------------------------------
+|   PLT_SsdpAnnounceScheduler class
 +---------------------------------------------------------------------*/
 /**
- The PLT_SsdpDeviceAnnounceTask class is a task to send UPnP Device SSDP announcements
- (alive or byebye). It can be setup to automatically repeat after an interval.
+ The PLT_SsdpAnnounceScheduler class sends the periodic SSDP announcements
+ (alive or byebye) of all the PLT_DeviceHost instances of the process from a 
+ single task. When a device is due, the packets for all its interfaces are
+ formatted at once, then sent as their time comes through a token bucket
+ limiting the overall rate. No thread ever sleeps between packets and stopping
+ a device only waits for the packet being sent if any.
  */
-class PLT_SsdpDeviceAnnounceTask : public PLT_ThreadTask
+class PLT_SsdpAnnounceScheduler : public PLT_ThreadTask
 {
 public:
-    PLT_SsdpDeviceAnnounceTask(PLT_DeviceHost*  device, 
+    /**
+     Start announcing a device. The scheduler task is started with the 
+     first device.
+     @param device the device to announce
+     @param repeat interval between announcements
+     @param delay time to wait before the first announcement
+     @param byebye_first send a bye-bye sequence before the first alive
+     @param extra_broadcast also announce on the broadcast address
+     */
+    static NPT_Result Schedule(PLT_DeviceHost*  device,
                                NPT_TimeInterval repeat,
-                               bool             is_byebye_first = false,
-                               bool             extra_broadcast = false) : 
-        m_Device(device), 
-        m_Repeat(repeat),
-        m_IsByeByeFirst(is_byebye_first),
-        m_ExtraBroadcast(extra_broadcast) {}
+                               NPT_TimeInterval delay,
+                               bool             byebye_first = false,
+                               bool             extra_broadcast = false);
+
+    /**
+     Stop announcing a device. Once this returns, no more packet is sent for 
+     it. The scheduler task is stopped with the last device.
+     */
+    static NPT_Result Cancel(PLT_DeviceHost* device);
+
+    /**
+     Format the announcement of a device on a given network interface.
+     @return NPT_FAILURE if the interface can't be used
+     */
+    static NPT_Result FormatAnnounce(PLT_DeviceHost*       device,
+                                     NPT_NetworkInterface* net_if,
+                                     PLT_SsdpAnnounceType  type,
+                                     bool                  broadcast,
+                                     NPT_IpAddress&        if_addr,
+                                     PLT_SsdpBatch&        batch);
 
 protected:
-    virtual ~PLT_SsdpDeviceAnnounceTask() {}
+    PLT_SsdpAnnounceScheduler(NPT_Cardinal rate  = PLT_SSDP_ANNOUNCE_RATE,
+                              NPT_Cardinal burst = PLT_SSDP_ANNOUNCE_BURST);
+    virtual ~PLT_SsdpAnnounceScheduler();
 
     // PLT_ThreadTask methods
+    virtual void DoAbort();
     virtual void DoRun();
 
-protected:
-    PLT_DeviceHost*             m_Device;
-    NPT_TimeInterval            m_Repeat;
-    bool                        m_IsByeByeFirst;
-    bool                        m_ExtraBroadcast;
+private:
+    NPT_Result Add(const PLT_SsdpAnnouncedDevice& device);
+    NPT_Result Remove(PLT_DeviceHost* device, NPT_Cardinal& remaining);
+    void       PlanAnnounces(NPT_TimeStamp& now, NPT_Timeout& timeout);
+    void       PlanAnnounce(NPT_List<NPT_NetworkInterface*>& if_list,
+                            PLT_DeviceHost*                  device,
+                            PLT_SsdpAnnounceType             type,
+                            bool                             broadcast,
+                            const NPT_TimeStamp&             due,
+                            const NPT_TimeInterval&          spacing);
+    void       Enqueue(const PLT_SsdpPendingAnnounce& announce);
+    void       SendAnnounces(NPT_TimeStamp& now, NPT_Timeout& timeout);
+    NPT_Result GetSocket(const PLT_SsdpPendingAnnounce& announce, NPT_UdpSocket*& socket);
+    void       ClearSockets();
+
+private:
+    NPT_Mutex                               m_Lock;
+    NPT_SharedVariable                      m_Wakeup;
+    NPT_List<PLT_SsdpAnnouncedDevice>       m_Devices;
+    NPT_List<PLT_SsdpPendingAnnounce>       m_Pending;
+    NPT_List<PLT_SsdpAnnounceSocket>        m_Sockets;
+    NPT_UInt32                              m_SocketsGeneration;
+
+    // token bucket
+    double                                  m_Rate;
+    double                                  m_Burst;
+    double                                  m_Tokens;
+    NPT_TimeStamp                           m_LastRefill;
 };
 
 /*----------------------------------------------------------------------
@@ -277,26 +536,87 @@ private:
 };
 
 /*----------------------------------------------------------------------
-|   PLT_SsdpPacketListenerIterator class
+|   PLT_SsdpPacket struct
++---------------------------------------------------------------------*/
+/**
+ A copy of a received SSDP request shared by the queues of all the listeners.
+ */
+struct PLT_SsdpPacket {
+    PLT_SsdpPacket(const NPT_HttpRequest&        request, 
+                   const NPT_HttpRequestContext& context);
+    ~PLT_SsdpPacket() { delete m_Request; }
+
+    NPT_HttpRequest*       m_Request;
+    NPT_HttpRequestContext m_Context;
+};
+
+typedef NPT_Reference<PLT_SsdpPacket> PLT_SsdpPacketReference;
+
+/*----------------------------------------------------------------------
+|   PLT_SsdpPacketQueue class
 +---------------------------------------------------------------------*/
 /**
- The PLT_SsdpPacketListenerIterator class iterates through a list of 
- PLT_SsdpPacketListener instances to notify of a new SSDP incoming packet.
+ The PLT_SsdpPacketQueue class is a bounded ring of SSDP packets waiting to be
+ handed to a PLT_SsdpPacketListener. It is filled by the SSDP listen task and
+ drained by the listener own task. Packets arriving while the ring is full are
+ dropped and counted.
  */
-class PLT_SsdpPacketListenerIterator
+class PLT_SsdpPacketQueue
 {
 public:
-    PLT_SsdpPacketListenerIterator(NPT_HttpRequest&              request, 
-                                   const NPT_HttpRequestContext& context) :
-      m_Request(request), m_Context(context) {}
+    PLT_SsdpPacketQueue(PLT_SsdpPacketListener* listener,
+                        NPT_Cardinal            max_pending = PLT_SSDP_LISTENER_MAX_PENDING);
 
-    NPT_Result operator()(PLT_SsdpPacketListener*& listener) const {
-        return listener->OnSsdpPacket(m_Request, m_Context);
-    }
+    PLT_SsdpPacketListener* GetListener() { return m_Listener; }
+    NPT_Cardinal            GetDroppedCount();
+
+    NPT_Result Push(const PLT_SsdpPacketReference& packet);
+
+    /**
+     Wait for the next packet.
+     @return NPT_ERROR_INTERRUPTED once the queue has been closed
+     */
+    NPT_Result Pop(PLT_SsdpPacketReference& packet);
+    void       Close();
+
+private:
+    PLT_SsdpPacketListener*            m_Listener;
+    NPT_Mutex                          m_Lock;
+    NPT_SharedVariable                 m_Wakeup;
+    NPT_Array<PLT_SsdpPacketReference> m_Ring;
+    NPT_Ordinal                        m_Head;
+    NPT_Cardinal                       m_Count;
+    NPT_Cardinal                       m_Dropped;
+    bool                               m_Closed;
+};
+
+typedef NPT_Reference<PLT_SsdpPacketQueue> PLT_SsdpPacketQueueReference;
+typedef NPT_List<PLT_SsdpPacketQueueReference> PLT_SsdpPacketQueueList;
+
+/*----------------------------------------------------------------------
+|   PLT_SsdpPacketListenerTask class
++---------------------------------------------------------------------*/
+/**
+ The PLT_SsdpPacketListenerTask class calls a PLT_SsdpPacketListener with the
+ packets of its queue so that a slow listener never holds up the reception of
+ SSDP packets for the others.
+ */
+class PLT_SsdpPacketListenerTask : public PLT_ThreadTask
+{
+public:
+    PLT_SsdpPacketListenerTask(PLT_SsdpPacketQueueReference& queue) : m_Queue(queue) {}
+
+    PLT_SsdpPacketListener* GetListener() { return m_Queue->GetListener(); }
+
+protected:
+    virtual ~PLT_SsdpPacketListenerTask() {}
+
+    // PLT_ThreadTask methods
+    virtual void DoAbort() { m_Queue->Close(); }
+    virtual void DoRun();
 
 private:
-    NPT_HttpRequest&              m_Request;
-    const NPT_HttpRequestContext& m_Context;
+    PLT_SsdpPacketQueueReference m_Queue;
 };
 
 /*----------------------------------------------------------------------
@@ -305,38 +625,37 @@ private:
 /**
  The PLT_SsdpListenTask class is used to listen for incoming SSDP packets and 
  keep track of a list of PLT_SsdpPacketListener listeners to notify when a new 
- SSDP packet has arrived.
+ SSDP packet has arrived. Each listener is notified from its own task through
+ a bounded queue. The list of queues is never modified once published: adding
+ or removing a listener replaces it, so packets are dispatched without holding
+ the lock.
  */
 class PLT_SsdpListenTask : public PLT_HttpServerSocketTask
 {
 public:
-    PLT_SsdpListenTask(NPT_Socket* socket) : 
-        PLT_HttpServerSocketTask(socket, true) {
-        // Change read time out for UDP because iPhone 3.0 seems to hang
-        // after reading everything from the socket even though
-        // more stuff arrived
-#if defined(TARGET_OS_IPHONE) && TARGET_OS_IPHONE
-        m_Socket->SetReadTimeout(10000);
-#endif
-    }
-
-    NPT_Result AddListener(PLT_SsdpPacketListener* listener) {
-        NPT_AutoLock lock(m_Mutex);
-        m_Listeners.Add(listener);
-        return NPT_SUCCESS;
-    }
-
-    NPT_Result RemoveListener(PLT_SsdpPacketListener* listener) {
-        NPT_AutoLock lock(m_Mutex);
-        m_Listeners.Remove(listener);
-        return NPT_SUCCESS;
-    }
+    PLT_SsdpListenTask(NPT_Socket*  socket, 
+                       NPT_Cardinal max_pending = PLT_SSDP_LISTENER_MAX_PENDING);
+
+    NPT_Result AddListener(PLT_SsdpPacketListener* listener);
+
+    /**
+     Unregister a listener. Once this returns, the listener is not called 
+     anymore. It must not be called from the listener OnSsdpPacket method.
+     */
+    NPT_Result RemoveListener(PLT_SsdpPacketListener* listener);
+
+    /**
+     Return the number of packets dropped because the listener was not 
+     keeping up.
+     */
+    NPT_Result GetDroppedCount(PLT_SsdpPacketListener* listener, 
+                               NPT_Cardinal&           dropped);
     
     // PLT_Task methods
     void DoAbort();
 
 protected:
-    virtual ~PLT_SsdpListenTask() {}
+    virtual ~PLT_SsdpListenTask();
 
     // PLT_HttpServerSocketTask methods
     NPT_Result GetInputStream(NPT_InputStreamReference& stream);
@@ -346,9 +665,12 @@ protected:
                              NPT_HttpResponse&             response);
 
 protected:
-    PLT_InputDatagramStreamReference  m_Datagram;
-    NPT_List<PLT_SsdpPacketListener*> m_Listeners;
-    NPT_Mutex                         m_Mutex;
+    PLT_InputDatagramStreamReference         m_Datagram;
+    NPT_Reference<PLT_SsdpPacketQueueList>   m_Queues;
+    NPT_List<PLT_SsdpPacketListenerTask*>    m_Tasks;
+    PLT_TaskManager                          m_ListenerTasks;
+    NPT_Cardinal                             m_MaxPending;
+    NPT_Mutex                                m_Mutex;
 };
 
 /*----------------------------------------------------------------------
@@ -372,6 +694,7 @@ protected:
     // PLT_ThreadTask methods
     virtual void DoAbort();
     virtual void DoRun();
+    virtual bool IsLongRunning() { return m_Repeat; }
 
     virtual NPT_Result ProcessResponse(NPT_Result                    res, 
                                        const NPT_HttpRequest&        request,  
@@ -183,6 +183,16 @@ PLT_StateVariable::IsReadyToPublish()
     return false;
 }
 
+/*----------------------------------------------------------------------
+|   PLT_StateVariable::GetNextPublishTime
++---------------------------------------------------------------------*/
+NPT_TimeStamp
+PLT_StateVariable::GetNextPublishTime()
+{
+    if (m_Rate == NPT_TimeStamp()) return NPT_TimeStamp();
+    return m_LastEvent + m_Rate;
+}
+
 /*----------------------------------------------------------------------
 |   PLT_StateVariable::ValidateValue
 +---------------------------------------------------------------------*/
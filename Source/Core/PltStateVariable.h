@@ -171,6 +171,12 @@ protected:
      be notified.
      */
     bool IsReadyToPublish();
+
+    /**
+     Return the earliest time the state variable can be published again given
+     its moderation rate. A null timestamp means it can be published right away.
+     */
+    NPT_TimeStamp GetNextPublishTime();
     
     /**
      Serialize the state variable into xml.
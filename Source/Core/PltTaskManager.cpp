@@ -40,6 +40,407 @@
 
 NPT_SET_LOCAL_LOGGER("platinum.core.taskmanager")
 
+/*----------------------------------------------------------------------
+|   constants
++---------------------------------------------------------------------*/
+#define PLT_TASK_TIMER_TICK          50    /* milliseconds per wheel slot */
+#define PLT_TASK_TIMER_WHEEL_SLOTS   256
+#define PLT_TASK_POOL_IDLE_TIMEOUT   10.   /* seconds before extra idle threads exit */
+#define PLT_TASK_POOL_MAX_THREADS    128   /* short lived tasks, when the task manager has no limit */
+
+/*----------------------------------------------------------------------
+|   PLT_TaskManagerTimer
++---------------------------------------------------------------------*/
+struct PLT_TaskManagerTimer
+{
+    PLT_ThreadTask* m_Task;
+    NPT_Cardinal    m_Rounds; // full wheel turns left before expiring
+};
+
+/*----------------------------------------------------------------------
+|   PLT_TaskManagerPool class
++---------------------------------------------------------------------*/
+/*
+ Runs the short lived tasks of a PLT_TaskManager on reusable threads. Threads 
+ are started on demand when no idle thread can pick up a task, up to 
+ max_threads, and are kept around once done, up to max_idle_threads. Delayed 
+ tasks are kept in a hashed timer wheel advanced by a single timer thread and 
+ are only handed to a thread once due. Long running tasks never get here, they
+ would hold pool threads forever and starve the tasks queued behind them.
+ */
+class PLT_TaskManagerPool
+{
+public:
+    PLT_TaskManagerPool(NPT_Cardinal max_idle_threads, NPT_Cardinal max_threads);
+    ~PLT_TaskManagerPool();
+
+    NPT_Result Schedule(PLT_ThreadTask* task, NPT_TimeInterval delay);
+    NPT_Result Expedite(PLT_ThreadTask* task);
+    NPT_Result FlushTimers();
+
+    // called by pool threads
+    void RunWorker();
+    void RunTimer();
+
+private:
+    NPT_Result Dispatch(PLT_ThreadTask* task);
+    NPT_Result Dispatch(NPT_List<PLT_ThreadTask*>& tasks);
+    void       Discard(PLT_ThreadTask* task);
+    void       AdvanceWheel(NPT_List<PLT_ThreadTask*>& expired);
+
+private:
+    NPT_Mutex                      m_Lock;
+    NPT_Queue<PLT_ThreadTask>      m_RunQueue;
+    NPT_Cardinal                   m_MaxIdleThreads;
+    NPT_Cardinal                   m_MaxThreads;
+    NPT_Cardinal                   m_Threads;
+    NPT_Cardinal                   m_IdleThreads;
+    NPT_Cardinal                   m_Pending;
+    bool                           m_Stopping;
+    NPT_SharedVariable             m_Stop;
+    NPT_Thread*                    m_Timer;
+    NPT_List<PLT_TaskManagerTimer> m_Wheel[PLT_TASK_TIMER_WHEEL_SLOTS];
+    NPT_Cardinal                   m_CurrentSlot;
+    NPT_Cardinal                   m_TimerCount;
+};
+
+/*----------------------------------------------------------------------
+|   PLT_TaskManagerPoolWorker class
++---------------------------------------------------------------------*/
+class PLT_TaskManagerPoolWorker : public NPT_Thread
+{
+public:
+    PLT_TaskManagerPoolWorker(PLT_TaskManagerPool& pool) : 
+        NPT_Thread(true), m_Pool(pool) {} // detached, destroys itself when done
+
+    // NPT_Runnable methods
+    void Run() { m_Pool.RunWorker(); }
+
+private:
+    PLT_TaskManagerPool& m_Pool;
+};
+
+/*----------------------------------------------------------------------
+|   PLT_TaskManagerPoolTimer class
++---------------------------------------------------------------------*/
+class PLT_TaskManagerPoolTimer : public NPT_Thread
+{
+public:
+    PLT_TaskManagerPoolTimer(PLT_TaskManagerPool& pool) : m_Pool(pool) {}
+
+    // NPT_Runnable methods
+    void Run() { m_Pool.RunTimer(); }
+
+private:
+    PLT_TaskManagerPool& m_Pool;
+};
+
+/*----------------------------------------------------------------------
+|   PLT_TaskManagerPool::PLT_TaskManagerPool
++---------------------------------------------------------------------*/
+PLT_TaskManagerPool::PLT_TaskManagerPool(NPT_Cardinal max_idle_threads, 
+                                         NPT_Cardinal max_threads) :
+    m_MaxIdleThreads(max_idle_threads),
+    m_MaxThreads(max_threads?max_threads:1),
+    m_Threads(0),
+    m_IdleThreads(0),
+    m_Pending(0),
+    m_Stopping(false),
+    m_Timer(NULL),
+    m_CurrentSlot(0),
+    m_TimerCount(0)
+{
+    m_Stop.SetValue(0);
+}
+
+/*----------------------------------------------------------------------
+|   PLT_TaskManagerPool::~PLT_TaskManagerPool
++---------------------------------------------------------------------*/
+PLT_TaskManagerPool::~PLT_TaskManagerPool()
+{
+    {
+        NPT_AutoLock lock(m_Lock);
+        m_Stopping = true;
+    }
+    m_Stop.SetValue(1);
+
+    if (m_Timer) {
+        m_Timer->Wait();
+        delete m_Timer;
+    }
+
+    // wait for threads to exit, they only do once there is nothing left to run
+    do {
+        {
+            NPT_AutoLock lock(m_Lock);
+            if (m_Threads == 0) break;
+        }
+        NPT_System::Sleep(NPT_TimeInterval(0.05));
+    } while (1);
+}
+
+/*----------------------------------------------------------------------
+|   PLT_TaskManagerPool::Schedule
++---------------------------------------------------------------------*/
+NPT_Result
+PLT_TaskManagerPool::Schedule(PLT_ThreadTask* task, NPT_TimeInterval delay)
+{
+    NPT_Int64 ticks = (delay.ToMillis() + PLT_TASK_TIMER_TICK - 1) / PLT_TASK_TIMER_TICK;
+    if (ticks <= 0) return Dispatch(task);
+
+    NPT_AutoLock lock(m_Lock);
+    if (m_Stopping) NPT_CHECK_WARNING(NPT_ERROR_INTERRUPTED);
+
+    // start timer thread the first time a task is delayed
+    if (!m_Timer) {
+        m_Timer = new PLT_TaskManagerPoolTimer(*this);
+        if (NPT_FAILED(m_Timer->Start())) {
+            delete m_Timer;
+            m_Timer = NULL;
+            NPT_CHECK_FATAL(NPT_FAILURE);
+        }
+    }
+
+    PLT_TaskManagerTimer timer;
+    timer.m_Task   = task;
+    timer.m_Rounds = (NPT_Cardinal)((ticks - 1) / PLT_TASK_TIMER_WHEEL_SLOTS);
+    m_Wheel[(m_CurrentSlot + ticks) % PLT_TASK_TIMER_WHEEL_SLOTS].Add(timer);
+    ++m_TimerCount;
+
+    return NPT_SUCCESS;
+}
+
+/*----------------------------------------------------------------------
+|   PLT_TaskManagerPool::Expedite
++---------------------------------------------------------------------*/
+NPT_Result
+PLT_TaskManagerPool::Expedite(PLT_ThreadTask* task)
+{
+    {
+        NPT_AutoLock lock(m_Lock);
+
+        // the task is either still waiting in the wheel or already dispatched
+        bool found = false;
+        for (NPT_Cardinal i=0; i<PLT_TASK_TIMER_WHEEL_SLOTS && !found; i++) {
+            NPT_List<PLT_TaskManagerTimer>::Iterator timer = m_Wheel[i].GetFirstItem();
+            while (timer) {
+                if ((*timer).m_Task == task) {
+                    m_Wheel[i].Erase(timer);
+                    --m_TimerCount;
+                    found = true;
+                    break;
+                }
+                ++timer;
+            }
+        }
+
+        if (!found) return NPT_ERROR_NO_SUCH_ITEM;
+    }
+
+    NPT_Result result = Dispatch(task);
+    if (NPT_FAILED(result)) {
+        // we may be called by the task manager while it walks its tasks, so
+        // leave it to the timer thread to retry or discard it on next tick
+        NPT_AutoLock lock(m_Lock);
+        PLT_TaskManagerTimer timer;
+        timer.m_Task   = task;
+        timer.m_Rounds = 0;
+        m_Wheel[(m_CurrentSlot + 1) % PLT_TASK_TIMER_WHEEL_SLOTS].Add(timer);
+        ++m_TimerCount;
+    }
+
+    return result;
+}
+
+/*----------------------------------------------------------------------
+|   PLT_TaskManagerPool::FlushTimers
++---------------------------------------------------------------------*/
+NPT_Result
+PLT_TaskManagerPool::FlushTimers()
+{
+    NPT_List<PLT_ThreadTask*> expired;
+    {
+        NPT_AutoLock lock(m_Lock);
+
+        PLT_TaskManagerTimer timer;
+        for (NPT_Cardinal i=0; i<PLT_TASK_TIMER_WHEEL_SLOTS; i++) {
+            while (NPT_SUCCEEDED(m_Wheel[i].PopHead(timer))) {
+                expired.Add(timer.m_Task);
+            }
+        }
+        m_TimerCount = 0;
+    }
+
+    return Dispatch(expired);
+}
+
+/*----------------------------------------------------------------------
+|   PLT_TaskManagerPool::Dispatch
++---------------------------------------------------------------------*/
+NPT_Result
+PLT_TaskManagerPool::Dispatch(PLT_ThreadTask* task)
+{
+    NPT_AutoLock lock(m_Lock);
+
+    // start a new thread if there aren't enough idle ones to pick up queued tasks,
+    // past the limit tasks wait for a thread to be done with its current task
+    if (m_Pending >= m_IdleThreads && m_Threads < m_MaxThreads) {
+        PLT_TaskManagerPoolWorker* thread = new PLT_TaskManagerPoolWorker(*this);
+        ++m_Threads;
+        ++m_IdleThreads;
+
+        NPT_Result result = thread->Start();
+        if (NPT_FAILED(result)) {
+            --m_Threads;
+            --m_IdleThreads;
+
+            // detached thread didn't start so delete it manually
+            delete thread;
+            NPT_LOG_SEVERE_1("Failed to start pool thread (%d)", result);
+
+            // don't queue a task no thread would ever pick up, 
+            // otherwise it will be by the next available thread
+            if (m_Threads == 0) return result;
+        }
+    }
+
+    NPT_CHECK_SEVERE(m_RunQueue.Push(task));
+    ++m_Pending;
+
+    return NPT_SUCCESS;
+}
+
+/*----------------------------------------------------------------------
+|   PLT_TaskManagerPool::Dispatch
++---------------------------------------------------------------------*/
+NPT_Result
+PLT_TaskManagerPool::Dispatch(NPT_List<PLT_ThreadTask*>& tasks)
+{
+    PLT_ThreadTask* task;
+    while (NPT_SUCCEEDED(tasks.PopHead(task))) {
+        // there is nobody left to report the failure to
+        if (NPT_FAILED(Dispatch(task))) Discard(task);
+    }
+
+    return NPT_SUCCESS;
+}
+
+/*----------------------------------------------------------------------
+|   PLT_TaskManagerPool::Discard
++---------------------------------------------------------------------*/
+void
+PLT_TaskManagerPool::Discard(PLT_ThreadTask* task)
+{
+    NPT_LOG_WARNING_1("Discarding task 0x%p, no thread to run it", (void*)task);
+
+    // finish the task without running it, like PLT_ThreadTask::Run would
+    bool notify_finished = !task->m_AutoDestroy;
+    task->m_TaskManager->RemoveTask(task);
+    if (notify_finished) task->m_Finished.SetValue(1);
+}
+
+/*----------------------------------------------------------------------
+|   PLT_TaskManagerPool::AdvanceWheel
++---------------------------------------------------------------------*/
+void
+PLT_TaskManagerPool::AdvanceWheel(NPT_List<PLT_ThreadTask*>& expired)
+{
+    m_CurrentSlot = (m_CurrentSlot + 1) % PLT_TASK_TIMER_WHEEL_SLOTS;
+
+    NPT_List<PLT_TaskManagerTimer>&          slot  = m_Wheel[m_CurrentSlot];
+    NPT_List<PLT_TaskManagerTimer>::Iterator timer = slot.GetFirstItem();
+    while (timer) {
+        if ((*timer).m_Rounds == 0) {
+            expired.Add((*timer).m_Task);
+            slot.Erase(timer++);
+            --m_TimerCount;
+        } else {
+            --(*timer).m_Rounds;
+            ++timer;
+        }
+    }
+}
+
+/*----------------------------------------------------------------------
+|   PLT_TaskManagerPool::RunTimer
++---------------------------------------------------------------------*/
+void
+PLT_TaskManagerPool::RunTimer()
+{
+    NPT_TimeInterval tick(PLT_TASK_TIMER_TICK/1000.);
+    NPT_TimeStamp    next_tick;
+    NPT_System::GetCurrentTimeStamp(next_tick);
+
+    // wake up every tick until told to stop
+    while (NPT_FAILED(m_Stop.WaitUntilEquals(1, PLT_TASK_TIMER_TICK))) {
+        NPT_List<PLT_ThreadTask*> expired;
+        {
+            NPT_AutoLock lock(m_Lock);
+
+            NPT_TimeStamp now;
+            NPT_System::GetCurrentTimeStamp(now);
+
+            // advance as many slots as ticks elapsed, unless the 
+            // wheel is empty in which case there's no need to catch up
+            if (m_TimerCount == 0) {
+                next_tick = now;
+                continue;
+            }
+
+            while (next_tick <= now) {
+                next_tick = next_tick + tick;
+                AdvanceWheel(expired);
+            }
+        }
+
+        // hand expired tasks to threads outside of the lock
+        Dispatch(expired);
+    }
+}
+
+/*----------------------------------------------------------------------
+|   PLT_TaskManagerPool::RunWorker
++---------------------------------------------------------------------*/
+void
+PLT_TaskManagerPool::RunWorker()
+{
+    NPT_TimeStamp idle_since;
+    NPT_System::GetCurrentTimeStamp(idle_since);
+
+    do {
+        PLT_ThreadTask* task = NULL;
+        if (NPT_SUCCEEDED(m_RunQueue.Pop(task, 500)) && task) {
+            {
+                NPT_AutoLock lock(m_Lock);
+                --m_Pending;
+                --m_IdleThreads;
+            }
+
+            task->Run();
+
+            NPT_AutoLock lock(m_Lock);
+            ++m_IdleThreads;
+            NPT_System::GetCurrentTimeStamp(idle_since);
+            continue;
+        }
+
+        NPT_TimeStamp now;
+        NPT_System::GetCurrentTimeStamp(now);
+
+        // exit when stopping or when there are too many threads idling for a while,
+        // unless a task was queued in the meantime counting on us to pick it up
+        NPT_AutoLock lock(m_Lock);
+        if (m_Pending == 0 &&
+            (m_Stopping || 
+             (m_IdleThreads > m_MaxIdleThreads && 
+              now > idle_since + NPT_TimeInterval(PLT_TASK_POOL_IDLE_TIMEOUT)))) {
+            --m_IdleThreads;
+            --m_Threads;
+            return;
+        }
+    } while (1);
+}
+
 /*----------------------------------------------------------------------
 |   PLT_TaskManager::PLT_TaskManager
 +---------------------------------------------------------------------*/
@@ -47,7 +448,8 @@ PLT_TaskManager::PLT_TaskManager(NPT_Cardinal max_items /* = 0 */) :
     m_Queue(NULL),
     m_MaxTasks(max_items),
     m_RunningTasks(0),
-    m_Stopping(false)
+    m_Stopping(false),
+    m_Pool(NULL)
 {
 }
 
@@ -57,6 +459,33 @@ PLT_TaskManager::PLT_TaskManager(NPT_Cardinal max_items /* = 0 */) :
 PLT_TaskManager::~PLT_TaskManager()
 {    
     Abort();
+    delete m_Pool;
+}
+
+/*----------------------------------------------------------------------
+|   PLT_TaskManager::EnablePool
++---------------------------------------------------------------------*/
+NPT_Result
+PLT_TaskManager::EnablePool(NPT_Cardinal max_idle_threads, /* = 4 */
+                            NPT_Cardinal max_threads)      /* = 0 */
+{
+    NPT_AutoLock lock(m_TasksLock);
+
+    // can't switch once tasks are running
+    if (m_Pool || m_Tasks.GetItemCount()) NPT_CHECK_WARNING(NPT_ERROR_INVALID_STATE);
+
+    if (max_threads == 0) max_threads = m_MaxTasks?m_MaxTasks:PLT_TASK_POOL_MAX_THREADS;
+    m_Pool = new PLT_TaskManagerPool(max_idle_threads, max_threads);
+    return NPT_SUCCESS;
+}
+
+/*----------------------------------------------------------------------
+|   PLT_TaskManager::WakeTask
++---------------------------------------------------------------------*/
+NPT_Result
+PLT_TaskManager::WakeTask(PLT_ThreadTask* task)
+{
+    return m_Pool?m_Pool->Expedite(task):NPT_ERROR_NO_SUCH_ITEM;
 }
 
 /*----------------------------------------------------------------------
@@ -123,6 +552,9 @@ PLT_TaskManager::Abort()
             num_running_tasks = m_Tasks.GetItemCount();
         }
 
+        // run delayed tasks now so they can notice they've been stopped
+        if (m_Pool) m_Pool->FlushTimers();
+
         if (num_running_tasks == 0) 
             break; 
         
@@ -180,8 +612,19 @@ PLT_TaskManager::AddTask(PLT_ThreadTask* task)
         }
     } while (result == NPT_ERROR_TIMEOUT);
 
-    // start task now
-    if (NPT_FAILED(result = task->StartThread())) {
+    // start task now, the pool takes care of the delay if any,
+    // long running tasks get their own thread to leave the pool to others
+    if (m_Pool && !task->IsLongRunning()) {
+        NPT_TimeInterval delay = task->m_Delay;
+        task->m_Delay  = NPT_TimeInterval(0.);
+        task->m_Pooled = true;
+        result = m_Pool->Schedule(task, delay);
+    } else {
+        result = task->StartThread();
+    }
+
+    if (NPT_FAILED(result)) {
+        task->m_Pooled = false;
         m_TasksLock.Unlock();
         
         // Remove task from queue and delete task if autodestroy is set
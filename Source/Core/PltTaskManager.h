@@ -48,6 +48,7 @@
 |   forward declarations
 +---------------------------------------------------------------------*/
 class PLT_ThreadTask;
+class PLT_TaskManagerPool;
 
 /*----------------------------------------------------------------------
 |   PLT_TaskManager class
@@ -95,12 +96,27 @@ public:
      */
     NPT_Cardinal GetMaxTasks() { return m_MaxTasks; }
 
+    /**
+     Run tasks on a pool of reusable threads instead of creating a new thread
+     for each task. Delayed tasks wait on a shared timer wheel without holding 
+     a thread. Tasks declaring themselves long running still get a thread of 
+     their own. Must be called before any task is started.
+     @param max_idle_threads number of idle threads kept around for future tasks
+     @param max_threads maximum number of pool threads, 0 to use the max number
+     of tasks or a default if there is none. Tasks started past it wait for a 
+     pool thread to be done with a short lived task.
+     */
+    NPT_Result EnablePool(NPT_Cardinal max_idle_threads = 4, 
+                          NPT_Cardinal max_threads = 0);
+
 private:
     friend class PLT_ThreadTask;
+    friend class PLT_TaskManagerPool;
 
     // called by PLT_ThreadTask
     NPT_Result AddTask(PLT_ThreadTask* task);
     NPT_Result RemoveTask(PLT_ThreadTask* task);
+    NPT_Result WakeTask(PLT_ThreadTask* task);
 
 private:
     NPT_List<PLT_ThreadTask*>  m_Tasks;
@@ -109,6 +125,7 @@ private:
     NPT_Cardinal               m_MaxTasks;
     NPT_Cardinal               m_RunningTasks;
     bool                       m_Stopping;
+    PLT_TaskManagerPool*       m_Pool;
 };
 
 typedef NPT_Reference<PLT_TaskManager> PLT_TaskManagerReference;
@@ -46,7 +46,8 @@ NPT_SET_LOCAL_LOGGER("platinum.core.threadtask")
 PLT_ThreadTask::PLT_ThreadTask() :
     m_TaskManager(NULL),
     m_Thread(NULL),
-    m_AutoDestroy(false)
+    m_AutoDestroy(false),
+    m_Pooled(false)
 {
 }
 
@@ -67,6 +68,8 @@ PLT_ThreadTask::Start(PLT_TaskManager*  task_manager,/* = NULL */
                       bool              auto_destroy /* = true */)
 {
     m_Abort.SetValue(0);
+    m_Finished.SetValue(0);
+    m_Pooled      = false;
     m_AutoDestroy = auto_destroy;
     m_Delay       = delay?*delay:NPT_TimeStamp(0.);
     m_TaskManager = task_manager;
@@ -115,16 +118,29 @@ PLT_ThreadTask::StartThread()
 NPT_Result
 PLT_ThreadTask::Stop(bool blocking /* = true */)
 {
-    // keep variable around in case
+    // keep variables around in case
     // we get destroyed
-    bool auto_destroy = m_AutoDestroy;
+    bool             auto_destroy = m_AutoDestroy;
+    bool             pooled       = m_Pooled;
+    PLT_TaskManager* task_manager = m_TaskManager;
     
     // tell thread we want to die
     m_Abort.SetValue(1);
     DoAbort();
+
+    // a pooled task still waiting for its delay must run now to notice
+    if (pooled && task_manager) task_manager->WakeTask(this);
     
-    // return without waiting if non blocking or not started
-    if (!blocking || !m_Thread) return NPT_SUCCESS;
+    // return without waiting if non blocking
+    if (!blocking) return NPT_SUCCESS;
+
+    // tasks run by a task manager pool have no thread to wait on
+    if (pooled) {
+        return auto_destroy?NPT_FAILURE:m_Finished.WaitUntilEquals(1, NPT_TIMEOUT_INFINITE);
+    }
+
+    // return without waiting if not started
+    if (!m_Thread) return NPT_SUCCESS;
 
     // if auto-destroy, the thread may be already dead by now 
     // so we can't wait on m_Thread.
@@ -182,7 +198,12 @@ PLT_ThreadTask::Run()
     // notify the Task Manager we're done
     // it will destroy us if m_AutoDestroy is true
     if (m_TaskManager) {
+        // we can't access members once removed if auto destroyed
+        bool notify_finished = m_Pooled && !m_AutoDestroy;
         m_TaskManager->RemoveTask(this);
+
+        // let Stop know the owner can now destroy us
+        if (notify_finished) m_Finished.SetValue(1);
     } else if (m_AutoDestroy) {
         // destroy ourselves otherwise
         delete this;
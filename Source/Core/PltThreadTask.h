@@ -57,6 +57,7 @@ class PLT_ThreadTask : public NPT_Runnable
 {
 public:
     friend class PLT_TaskManager;
+    friend class PLT_TaskManagerPool;
 
     /**
      When a task is not managed by a PLT_TaskManager, the owner must call
@@ -107,6 +108,13 @@ protected:
      */
     virtual void DoRun()     {}
     
+    /**
+     This method to override in derived classes tells whether the task runs for
+     as long as its owner. A task manager running its tasks on a pool of threads
+     gives such a task its own thread so it never holds one of the pool.
+     */
+    virtual bool IsLongRunning() { return false; }
+    
     /**
      A PLT_ThreadTask base class is never instantiated directly.
      */
@@ -132,8 +140,10 @@ private:
     // members
     NPT_SharedVariable  m_Started;
     NPT_SharedVariable  m_Abort;
+    NPT_SharedVariable  m_Finished;
     NPT_Thread*         m_Thread;
     bool                m_AutoDestroy;
+    bool                m_Pooled;
     NPT_TimeInterval    m_Delay;
 };
 
@@ -133,6 +133,7 @@ PLT_UPnP::PLT_UPnP() :
     m_TaskManager(NULL),
     m_Started(false),
     m_SsdpListenTask(NULL),
+    m_SsdpSocket(NULL),
 	m_IgnoreLocalUUIDs(true)
 {
 }
@@ -174,9 +175,14 @@ PLT_UPnP::Start()
     
     /* create the ssdp listener */
     m_SsdpListenTask = new PLT_SsdpListenTask(socket.AsPointer());
+    m_SsdpSocket = socket.AsPointer();
     socket.Detach();
     NPT_Reference<PLT_TaskManager> taskManager(new PLT_TaskManager());
     NPT_CHECK_SEVERE(taskManager->StartTask(m_SsdpListenTask));
+
+    /* watch for network interface changes */
+    taskManager->StartTask(new PLT_NetworkInterfaceMonitorTask());
+    PLT_NetworkInterfaceCache::GetInstance().AddListener(this);
     
     /* start devices & ctrlpoints */
     m_CtrlPoints.Apply(PLT_UPnP_CtrlPointStartIterator(m_SsdpListenTask));
@@ -195,6 +201,9 @@ PLT_UPnP::Start()
 NPT_Result
 PLT_UPnP::Stop()
 {
+    // must be done before locking since listener callback locks as well
+    PLT_NetworkInterfaceCache::GetInstance().RemoveListener(this);
+
     NPT_AutoLock lock(m_Lock);
 
     if (!m_Started) NPT_CHECK_WARNING(NPT_ERROR_INVALID_STATE);
@@ -208,12 +217,31 @@ PLT_UPnP::Stop()
     // stop remaining tasks
     m_TaskManager->Abort();
     m_SsdpListenTask = NULL;
+    m_SsdpSocket = NULL;
     m_TaskManager = NULL;
 
     m_Started = false;
     return NPT_SUCCESS;
 }
 
+/*----------------------------------------------------------------------
+|   PLT_UPnP::OnNetworkInterfacesChanged
++---------------------------------------------------------------------*/
+void
+PLT_UPnP::OnNetworkInterfacesChanged()
+{
+    NPT_AutoLock lock(m_Lock);
+
+    if (!m_Started) return;
+
+    NPT_LOG_INFO("Network interfaces changed, joining multicast group again");
+
+    /* join multicast group for any new ip */
+    NPT_List<NPT_IpAddress> ips;
+    PLT_UPnPMessageHelper::GetIPAddresses(ips);
+    ips.Apply(PLT_SsdpInitMulticastIterator(m_SsdpSocket));
+}
+
 /*----------------------------------------------------------------------
 |   PLT_UPnP::AddDevice
 +---------------------------------------------------------------------*/
@@ -67,7 +67,7 @@ class PLT_SsdpListenTask;
  The PLT_UPnP class maintains a list of devices (PLT_DeviceHost) to advertise and/or 
  control points (PLT_CtrlPoint).
  */
-class PLT_UPnP
+class PLT_UPnP : public PLT_NetworkInterfaceListener
 {
 public:
     /**
@@ -215,6 +215,9 @@ public:
     const char* getArgument_DeviceType(PLT_ArgumentDesc* argumentDesc);
 
 private:
+    // PLT_NetworkInterfaceListener methods
+    void OnNetworkInterfacesChanged();
+
     // members
     NPT_Mutex                           m_Lock;
     NPT_List<PLT_DeviceHostReference>   m_Devices;
@@ -226,6 +229,7 @@ private:
     // and devices to it when they're added
     bool                                m_Started;
     PLT_SsdpListenTask*                 m_SsdpListenTask; 
+    NPT_UdpMulticastSocket*             m_SsdpSocket;
 	bool								m_IgnoreLocalUUIDs;
 };
 
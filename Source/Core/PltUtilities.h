@@ -39,6 +39,7 @@
 |   includes
 +---------------------------------------------------------------------*/
 #include "Neptune.h"
+#include "PltNetworkInterfaceCache.h"
 
 /*----------------------------------------------------------------------
 |   PLT_XmlAttributeFinder
@@ -396,6 +397,383 @@ private:
     NPT_IpAddress m_Value;
 };
 
+/*----------------------------------------------------------------------
+|   PLT_HashHelper
++---------------------------------------------------------------------*/
+/**
+ The PLT_HashHelper class computes 32-bit FNV-1a hashes used to index
+ or fingerprint data. Hashes can be chained by passing a previous result.
+ */
+class PLT_HashHelper
+{
+public:
+    static NPT_UInt32 HashData(const void* data, NPT_Size size, NPT_UInt32 hash = 2166136261U) {
+        const NPT_UInt8* bytes = (const NPT_UInt8*)data;
+        for (NPT_Size i=0; i<size; i++) {
+            hash = (hash ^ bytes[i]) * 16777619U;
+        }
+        return hash;
+    }
+
+    static NPT_UInt32 HashString(const char* str, NPT_UInt32 hash = 2166136261U) {
+        if (!str) return hash;
+        while (*str) {
+            hash = (hash ^ (NPT_UInt8)*str++) * 16777619U;
+        }
+        // terminator so that "ab"+"c" and "a"+"bc" differ
+        return hash * 16777619U;
+    }
+
+    static NPT_UInt32 HashInteger(NPT_UInt32 value, NPT_UInt32 hash = 2166136261U) {
+        return HashData(&value, sizeof(value), hash);
+    }
+};
+
+/*----------------------------------------------------------------------
+|   PLT_NameMap
++---------------------------------------------------------------------*/
+/**
+ The PLT_NameMap class maps names to values with case insensitive lookups,
+ as required for UPnP action, argument and state variable names. Entries are
+ stored in insertion order so the position of a name is a dense index, and
+ are found through an open addressing hash table. When a name is added twice
+ the first entry is kept, like a search through a list would find it.
+ */
+template <typename T>
+class PLT_NameMap
+{
+public:
+    NPT_Cardinal GetItemCount() const { return m_Entries.GetItemCount(); }
+
+    void Clear() {
+        m_Entries.Clear();
+        m_Buckets.Clear();
+    }
+
+    NPT_Result Put(const char* name, const T& value) {
+        if (!name) return NPT_ERROR_INVALID_PARAMETERS;
+
+        // keep the table at most half full
+        if (m_Buckets.GetItemCount() < 2*(m_Entries.GetItemCount()+1)) {
+            Rehash(m_Buckets.GetItemCount()?2*m_Buckets.GetItemCount():16);
+        }
+
+        NPT_UInt32  hash = Hash(name);
+        NPT_Ordinal bucket;
+        if (NPT_SUCCEEDED(Find(name, hash, bucket))) return NPT_SUCCESS;
+
+        Entry entry;
+        entry.m_Name  = name;
+        entry.m_Hash  = hash;
+        entry.m_Value = value;
+        m_Buckets[bucket] = (int)m_Entries.GetItemCount();
+        return m_Entries.Add(entry);
+    }
+
+    NPT_Result Get(const char* name, T& value) const {
+        NPT_Ordinal bucket;
+        if (!name || NPT_FAILED(Find(name, Hash(name), bucket))) return NPT_ERROR_NO_SUCH_ITEM;
+
+        value = m_Entries[m_Buckets[bucket]].m_Value;
+        return NPT_SUCCESS;
+    }
+
+    NPT_Result GetIndex(const char* name, NPT_Ordinal& index) const {
+        NPT_Ordinal bucket;
+        if (!name || NPT_FAILED(Find(name, Hash(name), bucket))) return NPT_ERROR_NO_SUCH_ITEM;
+
+        index = (NPT_Ordinal)m_Buckets[bucket];
+        return NPT_SUCCESS;
+    }
+
+    static NPT_UInt32 Hash(const char* name) {
+        NPT_UInt32 hash = 2166136261U;
+        for (; *name; name++) {
+            char c = *name;
+            if (c >= 'A' && c <= 'Z') c += 'a'-'A';
+            hash = (hash ^ (NPT_UInt8)c) * 16777619U;
+        }
+        return hash;
+    }
+
+private:
+    struct Entry {
+        NPT_String m_Name;
+        NPT_UInt32 m_Hash;
+        T          m_Value;
+    };
+
+    // returns the bucket holding the name, or the empty bucket where it would go
+    NPT_Result Find(const char* name, NPT_UInt32 hash, NPT_Ordinal& bucket) const {
+        NPT_Cardinal count = m_Buckets.GetItemCount();
+        if (count == 0) return NPT_ERROR_NO_SUCH_ITEM;
+
+        for (bucket = hash & (count-1); m_Buckets[bucket] >= 0; bucket = (bucket+1) & (count-1)) {
+            const Entry& entry = m_Entries[m_Buckets[bucket]];
+            if (entry.m_Hash == hash && entry.m_Name.Compare(name, true) == 0) return NPT_SUCCESS;
+        }
+        return NPT_ERROR_NO_SUCH_ITEM;
+    }
+
+    void Rehash(NPT_Cardinal count) {
+        m_Buckets.Resize(count);
+        for (NPT_Ordinal i=0; i<count; i++) m_Buckets[i] = -1;
+
+        for (NPT_Ordinal i=0; i<m_Entries.GetItemCount(); i++) {
+            NPT_Ordinal bucket = m_Entries[i].m_Hash & (count-1);
+            while (m_Buckets[bucket] >= 0) bucket = (bucket+1) & (count-1);
+            m_Buckets[bucket] = (int)i;
+        }
+    }
+
+    // members
+    NPT_Array<Entry> m_Entries;
+    NPT_Array<int>   m_Buckets;
+};
+
+
+/*----------------------------------------------------------------------
+|   PLT_StringMap
++---------------------------------------------------------------------*/
+/**
+ The PLT_StringMap class is a hash table mapping strings such as uuids or 
+ subscription ids to values. Unlike PLT_NameMap, entries can be removed. 
+ Pointers returned by Find are only valid until the next Put or Remove, 
+ adding an entry may move all of them to a larger table.
+ */
+template <typename T>
+class PLT_StringMap
+{
+public:
+    PLT_StringMap(bool ignore_case = false) : 
+        m_Buckets(NULL), m_BucketCount(0), m_Count(0), m_IgnoreCase(ignore_case) {}
+    PLT_StringMap(const PLT_StringMap<T>& other) : 
+        m_Buckets(NULL), m_BucketCount(0), m_Count(0), m_IgnoreCase(other.m_IgnoreCase) {
+        Copy(other);
+    }
+    ~PLT_StringMap() { delete[] m_Buckets; }
+
+    PLT_StringMap<T>& operator=(const PLT_StringMap<T>& other) {
+        if (this != &other) {
+            Clear();
+            m_IgnoreCase = other.m_IgnoreCase;
+            Copy(other);
+        }
+        return *this;
+    }
+
+    NPT_Cardinal GetItemCount() const { return m_Count; }
+
+    void Clear() {
+        delete[] m_Buckets;
+        m_Buckets     = NULL;
+        m_BucketCount = 0;
+        m_Count       = 0;
+    }
+
+    NPT_Result Put(const char* key, const T& value) {
+        if (!key) return NPT_ERROR_INVALID_PARAMETERS;
+
+        T* existing = Find(key);
+        if (existing) {
+            *existing = value;
+            return NPT_SUCCESS;
+        }
+
+        // keep at most one entry per bucket on average
+        if (m_Count >= m_BucketCount) {
+            Rehash(m_BucketCount?2*m_BucketCount:16);
+        }
+
+        Entry entry;
+        entry.m_Key   = key;
+        entry.m_Hash  = Hash(key);
+        entry.m_Value = value;
+        ++m_Count;
+        return m_Buckets[entry.m_Hash & (m_BucketCount-1)].Add(entry);
+    }
+
+    NPT_Result Get(const char* key, T& value) const {
+        const T* found = Find(key);
+        if (!found) return NPT_ERROR_NO_SUCH_ITEM;
+
+        value = *found;
+        return NPT_SUCCESS;
+    }
+
+    T* Find(const char* key) {
+        return const_cast<T*>(((const PLT_StringMap<T>*)this)->Find(key));
+    }
+
+    const T* Find(const char* key) const {
+        if (!key || m_Count == 0) return NULL;
+
+        NPT_UInt32 hash = Hash(key);
+        typename NPT_List<Entry>::Iterator entry = m_Buckets[hash & (m_BucketCount-1)].GetFirstItem();
+        while (entry) {
+            if ((*entry).m_Hash == hash && (*entry).m_Key.Compare(key, m_IgnoreCase) == 0) {
+                return &(*entry).m_Value;
+            }
+            ++entry;
+        }
+        return NULL;
+    }
+
+    NPT_Result Remove(const char* key) {
+        if (!key || m_Count == 0) return NPT_ERROR_NO_SUCH_ITEM;
+
+        NPT_UInt32 hash = Hash(key);
+        NPT_List<Entry>& bucket = m_Buckets[hash & (m_BucketCount-1)];
+        typename NPT_List<Entry>::Iterator entry = bucket.GetFirstItem();
+        while (entry) {
+            if ((*entry).m_Hash == hash && (*entry).m_Key.Compare(key, m_IgnoreCase) == 0) {
+                bucket.Erase(entry);
+                --m_Count;
+                return NPT_SUCCESS;
+            }
+            ++entry;
+        }
+        return NPT_ERROR_NO_SUCH_ITEM;
+    }
+
+    /**
+     Call a function object with each value, in no particular order.
+     */
+    template <typename X>
+    void Apply(const X& function) const {
+        for (NPT_Ordinal i=0; i<m_BucketCount; i++) {
+            typename NPT_List<Entry>::Iterator entry = m_Buckets[i].GetFirstItem();
+            while (entry) {
+                function((*entry).m_Value);
+                ++entry;
+            }
+        }
+    }
+
+private:
+    struct Entry {
+        NPT_String m_Key;
+        NPT_UInt32 m_Hash;
+        T          m_Value;
+    };
+
+    NPT_UInt32 Hash(const char* key) const {
+        return m_IgnoreCase?PLT_NameMap<T>::Hash(key):PLT_HashHelper::HashString(key);
+    }
+
+    void Copy(const PLT_StringMap<T>& other) {
+        if (other.m_BucketCount == 0) return;
+
+        m_Buckets = new NPT_List<Entry>[other.m_BucketCount];
+        for (NPT_Ordinal i=0; i<other.m_BucketCount; i++) m_Buckets[i] = other.m_Buckets[i];
+        m_BucketCount = other.m_BucketCount;
+        m_Count       = other.m_Count;
+    }
+
+    void Rehash(NPT_Cardinal count) {
+        // entries are copied once into the new table which then replaces the old one
+        NPT_List<Entry>* buckets = new NPT_List<Entry>[count];
+        for (NPT_Ordinal i=0; i<m_BucketCount; i++) {
+            typename NPT_List<Entry>::Iterator entry = m_Buckets[i].GetFirstItem();
+            while (entry) {
+                buckets[(*entry).m_Hash & (count-1)].Add(*entry);
+                ++entry;
+            }
+        }
+
+        delete[] m_Buckets;
+        m_Buckets     = buckets;
+        m_BucketCount = count;
+    }
+
+    // members
+    NPT_List<Entry>* m_Buckets;
+    NPT_Cardinal     m_BucketCount; // power of 2
+    NPT_Cardinal     m_Count;
+    bool             m_IgnoreCase;
+};
+
+/*----------------------------------------------------------------------
+|   PLT_TimerHeap
++---------------------------------------------------------------------*/
+/**
+ The PLT_TimerHeap class is a binary min-heap of values ordered by due time,
+ used to only look at what needs to be done now instead of scanning 
+ everything periodically. Entries can't be removed, owners must check that 
+ a value popped is still relevant.
+ */
+template <typename T>
+class PLT_TimerHeap
+{
+public:
+    NPT_Cardinal GetItemCount() const { return m_Entries.GetItemCount(); }
+    void         Clear() { m_Entries.Clear(); }
+
+    NPT_Result Add(const NPT_TimeStamp& due, const T& value) {
+        Entry entry;
+        entry.m_Due   = due;
+        entry.m_Value = value;
+        NPT_CHECK(m_Entries.Add(entry));
+
+        // sift up
+        NPT_Ordinal index = m_Entries.GetItemCount()-1;
+        while (index > 0) {
+            NPT_Ordinal parent = (index-1)/2;
+            if (!(m_Entries[index].m_Due < m_Entries[parent].m_Due)) break;
+            Swap(index, parent);
+            index = parent;
+        }
+        return NPT_SUCCESS;
+    }
+
+    NPT_Result GetNextDue(NPT_TimeStamp& due) const {
+        if (m_Entries.GetItemCount() == 0) return NPT_ERROR_NO_SUCH_ITEM;
+        due = m_Entries[0].m_Due;
+        return NPT_SUCCESS;
+    }
+
+    /**
+     Remove the earliest value if it is due.
+     */
+    NPT_Result PopDue(const NPT_TimeStamp& now, T& value) {
+        if (m_Entries.GetItemCount() == 0 || now < m_Entries[0].m_Due) return NPT_ERROR_NO_SUCH_ITEM;
+
+        value = m_Entries[0].m_Value;
+
+        NPT_Cardinal count = m_Entries.GetItemCount()-1;
+        if (count) Swap(0, count);
+        m_Entries.Resize(count);
+
+        // sift down
+        NPT_Ordinal index = 0;
+        for (;;) {
+            NPT_Ordinal smallest = index;
+            NPT_Ordinal left     = 2*index+1;
+            NPT_Ordinal right    = left+1;
+            if (left < count && m_Entries[left].m_Due < m_Entries[smallest].m_Due) smallest = left;
+            if (right < count && m_Entries[right].m_Due < m_Entries[smallest].m_Due) smallest = right;
+            if (smallest == index) break;
+            Swap(index, smallest);
+            index = smallest;
+        }
+        return NPT_SUCCESS;
+    }
+
+private:
+    struct Entry {
+        NPT_TimeStamp m_Due;
+        T             m_Value;
+    };
+
+    void Swap(NPT_Ordinal a, NPT_Ordinal b) {
+        Entry entry  = m_Entries[a];
+        m_Entries[a] = m_Entries[b];
+        m_Entries[b] = entry;
+    }
+
+    // members
+    NPT_Array<Entry> m_Entries;
+};
 
 /*----------------------------------------------------------------------
 |   PLT_UPnPMessageHelper class
@@ -702,16 +1080,20 @@ public:
 		if (address.ToString() == "127.0.0.1") return true;
         
 		NPT_List<NPT_NetworkInterface*> if_list;
-        NPT_NetworkInterface::GetNetworkInterfaces(if_list);
+        PLT_NetworkInterfaceCache::GetInstance().GetNetworkInterfaces(if_list);
         
+        bool local = false;
 		NPT_List<NPT_NetworkInterface*>::Iterator iface = if_list.GetFirstItem();
         while (iface) {
-			if((*iface)->IsAddressInNetwork(address)) return true;
+			if ((*iface)->IsAddressInNetwork(address)) {
+                local = true;
+                break;
+            }
             ++iface;
         }
         
 		if_list.Apply(NPT_ObjectDeleter<NPT_NetworkInterface>());
-		return false;
+		return local;
 	}
     
 private:
@@ -719,8 +1101,9 @@ private:
     static NPT_Result _GetNetworkInterfaces(NPT_List<NPT_NetworkInterface*>& if_list,
                                             bool include_localhost = false,
                                             bool only_localhost = false) {
+        // read from the cached snapshot to avoid querying the OS every time
         NPT_List<NPT_NetworkInterface*> _if_list;
-        NPT_CHECK(NPT_NetworkInterface::GetNetworkInterfaces(_if_list));
+        NPT_CHECK(PLT_NetworkInterfaceCache::GetInstance().GetNetworkInterfaces(_if_list));
         
         NPT_NetworkInterface* iface;
         while (NPT_SUCCEEDED(_if_list.PopHead(iface))) {
@@ -69,6 +69,25 @@ PLT_MediaRenderer::PLT_MediaRenderer(const char*  friendly_name,
     m_ModelName        = "AV Renderer Device";
     m_ModelURL         = "http://www.plutinosoft.com/platinum";
     m_DlnaDoc          = "DMR-1.50";
+
+    // ConnectionManager
+    m_ActionHandlers.Put("GetCurrentConnectionInfo", &PLT_MediaRenderer::OnGetCurrentConnectionInfo);
+
+    // AVTransport
+    m_ActionHandlers.Put("Next",                     &PLT_MediaRenderer::OnNext);
+    m_ActionHandlers.Put("Pause",                    &PLT_MediaRenderer::OnPause);
+    m_ActionHandlers.Put("Play",                     &PLT_MediaRenderer::OnPlay);
+    m_ActionHandlers.Put("Previous",                 &PLT_MediaRenderer::OnPrevious);
+    m_ActionHandlers.Put("Seek",                     &PLT_MediaRenderer::OnSeek);
+    m_ActionHandlers.Put("Stop",                     &PLT_MediaRenderer::OnStop);
+    m_ActionHandlers.Put("SetAVTransportURI",        &PLT_MediaRenderer::OnSetAVTransportURI);
+    m_ActionHandlers.Put("SetPlayMode",              &PLT_MediaRenderer::OnSetPlayMode);
+
+    // RenderingControl
+    m_ActionHandlers.Put("SetVolume",                &PLT_MediaRenderer::OnSetVolume);
+    m_ActionHandlers.Put("SetVolumeDB",              &PLT_MediaRenderer::OnSetVolumeDB);
+    m_ActionHandlers.Put("GetVolumeDBRange",         &PLT_MediaRenderer::OnGetVolumeDBRange);
+    m_ActionHandlers.Put("SetMute",                  &PLT_MediaRenderer::OnSetMute);
 }
 
 /*----------------------------------------------------------------------
@@ -231,50 +250,10 @@ PLT_MediaRenderer::OnAction(PLT_ActionReference&          action,
 		}
 	}
 
-	/* Is it a ConnectionManager Service Action ? */
-	if (name.Compare("GetCurrentConnectionInfo", true) == 0) {
-		return OnGetCurrentConnectionInfo(action);
-	}  
-
-	/* Is it a AVTransport Service Action ? */
-    if (name.Compare("Next", true) == 0) {
-        return OnNext(action);
-    }
-    if (name.Compare("Pause", true) == 0) {
-        return OnPause(action);
-    }
-    if (name.Compare("Play", true) == 0) {
-        return OnPlay(action);
-    }
-    if (name.Compare("Previous", true) == 0) {
-        return OnPrevious(action);
-    }
-    if (name.Compare("Seek", true) == 0) {
-        return OnSeek(action);
-    }
-    if (name.Compare("Stop", true) == 0) {
-        return OnStop(action);
-    }
-    if (name.Compare("SetAVTransportURI", true) == 0) {
-        return OnSetAVTransportURI(action);
-    }
-    if (name.Compare("SetPlayMode", true) == 0) {
-        return OnSetPlayMode(action);
-    }
-
-    /* Is it a RendererControl Service Action ? */
-    if (name.Compare("SetVolume", true) == 0) {
-          return OnSetVolume(action);
-    }
-	if (name.Compare("SetVolumeDB", true) == 0) {
-		return OnSetVolumeDB(action);
-    }
-	if (name.Compare("GetVolumeDBRange", true) == 0) {
-		return OnGetVolumeDBRange(action);
-
-	}
-    if (name.Compare("SetMute", true) == 0) {
-          return OnSetMute(action);
+    /* dispatch on the action name */
+    ActionHandler handler;
+    if (NPT_SUCCEEDED(m_ActionHandlers.Get(name, handler))) {
+        return (this->*handler)(action);
     }
 
     // other actions rely on state variables
@@ -88,6 +88,8 @@ public:
                                 const PLT_HttpRequestContext& context);
 
 protected:
+    typedef NPT_Result (PLT_MediaRenderer::*ActionHandler)(PLT_ActionReference& action);
+
     virtual ~PLT_MediaRenderer();
 
     // PLT_MediaRendererInterface methods
@@ -112,6 +114,7 @@ protected:
 
 private:
     PLT_MediaRendererDelegate* m_Delegate;
+    PLT_NameMap<ActionHandler> m_ActionHandlers;
 };
 
 #endif /* _PLT_MEDIA_RENDERER_H_ */
@@ -77,6 +77,18 @@ PLT_MediaServer::PLT_MediaServer(const char*  friendly_name,
     m_ModelName        = "AV Media Server Device";
     m_ModelURL         = "http://www.plutinosoft.com/platinum";
     m_DlnaDoc          = "DMS-1.50";
+
+    // ContentDirectory
+    m_ActionHandlers.Put("Browse",                   &PLT_MediaServer::OnBrowse);
+    m_ActionHandlers.Put("Search",                   &PLT_MediaServer::OnSearch);
+    m_ActionHandlers.Put("GetSystemUpdateID",        &PLT_MediaServer::OnGetSystemUpdateID);
+    m_ActionHandlers.Put("GetSortCapabilities",      &PLT_MediaServer::OnGetSortCapabilities);
+    m_ActionHandlers.Put("GetSearchCapabilities",    &PLT_MediaServer::OnGetSearchCapabilities);
+
+    // ConnectionMananger
+    m_ActionHandlers.Put("GetCurrentConnectionIDs",  &PLT_MediaServer::OnGetCurrentConnectionIDs);
+    m_ActionHandlers.Put("GetProtocolInfo",          &PLT_MediaServer::OnGetProtocolInfo);
+    m_ActionHandlers.Put("GetCurrentConnectionInfo", &PLT_MediaServer::OnGetCurrentConnectionInfo);
 }
 
 /*----------------------------------------------------------------------
@@ -159,35 +171,10 @@ NPT_Result
 PLT_MediaServer::OnAction(PLT_ActionReference&          action, 
                           const PLT_HttpRequestContext& context)
 {
-    /* parse the action name */
-    NPT_String name = action->GetActionDesc().GetName();
-                   
-    // ContentDirectory
-    if (name.Compare("Browse", true) == 0) {
-        return OnBrowse(action, context);
-    }
-    if (name.Compare("Search", true) == 0) {
-        return OnSearch(action, context);
-    }
-    if (name.Compare("GetSystemUpdateID", true) == 0) {
-        return OnGetSystemUpdateID(action, context);
-    }
-    if (name.Compare("GetSortCapabilities", true) == 0) {
-        return OnGetSortCapabilities(action, context);
-    }  
-    if (name.Compare("GetSearchCapabilities", true) == 0) {
-        return OnGetSearchCapabilities(action, context);
-    }  
-
-    // ConnectionMananger
-    if (name.Compare("GetCurrentConnectionIDs", true) == 0) {
-        return OnGetCurrentConnectionIDs(action, context);
-    }
-    if (name.Compare("GetProtocolInfo", true) == 0) {
-        return OnGetProtocolInfo(action, context);
-    }    
-    if (name.Compare("GetCurrentConnectionInfo", true) == 0) {
-        return OnGetCurrentConnectionInfo(action, context);
+    /* dispatch on the action name */
+    ActionHandler handler;
+    if (NPT_SUCCEEDED(m_ActionHandlers.Get(action->GetActionDesc().GetName(), handler))) {
+        return (this->*handler)(action, context);
     }
 
     action->SetError(401,"No Such Action.");
@@ -126,6 +126,9 @@ public:
     virtual void UpdateContainerUpdateID(const char* id, NPT_UInt32 update);
     
 protected:
+    typedef NPT_Result (PLT_MediaServer::*ActionHandler)(PLT_ActionReference&          action,
+                                                         const PLT_HttpRequestContext& context);
+
     virtual ~PLT_MediaServer();
     
     // PLT_DeviceHost methods
@@ -181,7 +184,8 @@ protected:
                                          const PLT_HttpRequestContext& context);
     
 private:
-    PLT_MediaServerDelegate* m_Delegate;
+    PLT_MediaServerDelegate*   m_Delegate;
+    PLT_NameMap<ActionHandler> m_ActionHandlers;
 };
 
 #endif /* _PLT_MEDIA_SERVER_H_ */
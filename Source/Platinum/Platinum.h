@@ -81,14 +81,22 @@ cross-platform logging system.
 #include "PltArgument.h"
 #include "PltConstants.h"
 #include "PltCtrlPointTask.h"
+#include "PltCtrlPointInspector.h"
+#include "PltCtrlPointInvoker.h"
 #include "PltDatagramStream.h"
 #include "PltDeviceHost.h"
 #include "PltEvent.h"
+#include "PltFileCache.h"
+#include "PltSeekIndex.h"
+#include "PltSCPDCache.h"
 #include "PltHttp.h"
 #include "PltHttpClientTask.h"
 #include "PltHttpServer.h"
 #include "PltHttpServerTask.h"
+#include "PltHttpServerReactor.h"
+#include "PltNetworkInterfaceCache.h"
 #include "PltService.h"
+#include "PltSoap.h"
 #include "PltSsdp.h"
 #include "PltStateVariable.h"
 #include "PltTaskManager.h"
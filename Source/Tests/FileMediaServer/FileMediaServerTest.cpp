@@ -38,6 +38,7 @@
 +---------------------------------------------------------------------*/
 #include "PltUPnP.h"
 #include "PltFileMediaServer.h"
+#include "PltFileCache.h"
 
 #include <stdlib.h>
 
@@ -51,6 +52,7 @@ struct Options {
     const char* friendly_name;
     const char* guid;
     NPT_UInt32  port;
+    NPT_UInt32  cache_size;
 } Options;
 
 /*----------------------------------------------------------------------
@@ -59,9 +61,10 @@ struct Options {
 static void
 PrintUsageAndExit()
 {
-    fprintf(stderr, "usage: FileMediaServerTest [-f <friendly_name>] [-p <port>] [-g <guid>] <path>\n");
+    fprintf(stderr, "usage: FileMediaServerTest [-f <friendly_name>] [-p <port>] [-g <guid>] [-c <megabytes>] <path>\n");
     fprintf(stderr, "-f : optional upnp device friendly name\n");
     fprintf(stderr, "-p : optional http port\n");
+    fprintf(stderr, "-c : optional memory shared by clients reading the same files\n");
     fprintf(stderr, "<path> : local path to serve\n");
     exit(1);
 }
@@ -79,6 +82,7 @@ ParseCommandLine(char** args)
     Options.friendly_name = NULL;
     Options.guid = NULL;
     Options.port = 0;
+    Options.cache_size = 0;
 
     while ((arg = *args++)) {
         if (!strcmp(arg, "-f")) {
@@ -90,6 +94,11 @@ ParseCommandLine(char** args)
                 fprintf(stderr, "ERROR: invalid argument\n");
                 PrintUsageAndExit();
             }
+        } else if (!strcmp(arg, "-c")) {
+            if (NPT_FAILED(NPT_ParseInteger32(*args++, Options.cache_size))) {
+                fprintf(stderr, "ERROR: invalid argument\n");
+                PrintUsageAndExit();
+            }
         } else if (Options.path == NULL) {
             Options.path = arg;
         } else {
@@ -119,6 +128,11 @@ main(int /* argc */, char** argv)
 
 	/* for faster DLNA faster testing */
     PLT_Constants::GetInstance().SetDefaultDeviceLease(NPT_TimeInterval(60.));
+
+    /* share file blocks between clients */
+    if (Options.cache_size) {
+        PLT_FileCache::GetInstance().SetMaxSize((NPT_LargeSize)Options.cache_size*1024*1024);
+    }
     
     PLT_UPnP upnp;
     PLT_DeviceHostReference device(
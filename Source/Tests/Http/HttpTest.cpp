@@ -52,6 +52,7 @@ NPT_SET_LOCAL_LOGGER("platinum.core.http.test")
 //#define TEST3
 //#define TEST4
 #define TEST5
+#define TEST6
 
 /*----------------------------------------------------------------------
 |   globals
@@ -369,6 +370,44 @@ Test5(NPT_HttpUrl url)
 }
 #endif
 
+#ifdef TEST6
+/*----------------------------------------------------------------------
+|   Test6
++---------------------------------------------------------------------*/
+static bool
+Test6(NPT_HttpUrl url, NPT_Cardinal count)
+{
+    NPT_LOG_INFO("########### TEST 6 ######################");
+    
+    NPT_HttpClient client;
+    NPT_TimeStamp  start, end;
+    
+    // requests/sec on a single keep-alive connection
+    NPT_System::GetCurrentTimeStamp(start);
+    for (NPT_Cardinal i=0; i<count; i++) {
+        NPT_HttpRequest   request(url, NPT_HTTP_METHOD_GET, NPT_HTTP_PROTOCOL_1_1);
+        NPT_HttpResponse* response = NULL;
+        if (NPT_FAILED(client.SendRequest(request, response)) || !response) return false;
+        
+        NPT_HttpEntity* entity = response->GetEntity();
+        NPT_DataBuffer  buffer;
+        if (entity && NPT_FAILED(entity->Load(buffer))) {
+            delete response;
+            return false;
+        }
+        delete response;
+    }
+    NPT_System::GetCurrentTimeStamp(end);
+    
+    double elapsed = (end - start).ToSeconds();
+    printf("%d requests in %f secs: %d req/s\n", 
+           count, 
+           elapsed, 
+           elapsed>0.?(int)(count/elapsed):0);
+    return true;
+}
+#endif
+
 /*----------------------------------------------------------------------
 |   PrintUsageAndExit
 +---------------------------------------------------------------------*/
@@ -465,6 +504,11 @@ main(int argc, char** argv)
         url = "/test";
     }
 
+    /* add small static handler to measure request overhead */
+    const char* small_body = "<ok/>";
+    NPT_HttpRequestHandler* small_handler = new NPT_HttpStaticRequestHandler(small_body, "text/xml", false);
+    http_server.AddRequestHandler(small_handler, "/small");
+
     /* add custom handler */
     PLT_RingBufferStreamReference ringbuffer_stream(new PLT_RingBufferStream());
     NPT_InputStreamReference stream(ringbuffer_stream);
@@ -515,6 +559,11 @@ main(int argc, char** argv)
     if (!result) return -1;
 #endif
     
+#ifdef TEST6
+    result = Test6(NPT_HttpUrl("127.0.0.1", http_server.GetPort(), "/small"), 2000);
+    if (!result) return -1;
+#endif
+    
     NPT_System::Sleep(NPT_TimeInterval(1.f));
     
     // abort server tasks that are waiting on ring buffer stream
@@ -0,0 +1,487 @@
+/*****************************************************************
+|
+|   Platinum - HTTP benchmark
+|
+| Copyright (c) 2004-2010, Plutinosoft, LLC.
+| All rights reserved.
+| http://www.plutinosoft.com
+|
+| This program is free software; you can redistribute it and/or
+| modify it under the terms of the GNU General Public License
+| as published by the Free Software Foundation; either version 2
+| of the License, or (at your option) any later version.
+|
+| OEMs, ISVs, VARs and other distributors that combine and 
+| distribute commercially licensed software with Platinum software
+| and do not wish to distribute the source code for the commercially
+| licensed software under version 2, or (at your option) any later
+| version, of the GNU General Public License (the "GPL") must enter
+| into a commercial license agreement with Plutinosoft, LLC.
+| licensing@plutinosoft.com
+| 
+| This program is distributed in the hope that it will be useful,
+| but WITHOUT ANY WARRANTY; without even the implied warranty of
+| MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+| GNU General Public License for more details.
+|
+| You should have received a copy of the GNU General Public License
+| along with this program; see the file LICENSE.txt. If not, write to
+| the Free Software Foundation, Inc., 
+| 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+| http://www.gnu.org/licenses/gpl-2.0.html
+|
+****************************************************************/
+
+
+/*----------------------------------------------------------------------
+|   includes
++---------------------------------------------------------------------*/
+#include "Neptune.h"
+#include "PltUPnP.h"
+#include "PltTaskManager.h"
+#include "PltHttpServer.h"
+#include "PltFileMediaServer.h"
+#include "PltMediaRenderer.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+NPT_SET_LOCAL_LOGGER("platinum.core.http.benchmark")
+
+/*----------------------------------------------------------------------
+|   constants
++---------------------------------------------------------------------*/
+#define BENCHMARK_DATA_SIZE  (1024*1024)
+#define BENCHMARK_RANGE_SIZE 65536
+
+/*----------------------------------------------------------------------
+|   globals
++---------------------------------------------------------------------*/
+struct Options {
+    const char* mode;
+    const char* path;
+    const char* file;
+    NPT_UInt32  clients;
+    NPT_UInt32  duration;
+    NPT_UInt32  workers;
+} Options;
+
+/*----------------------------------------------------------------------
+|   BenchmarkRequest
++---------------------------------------------------------------------*/
+struct BenchmarkRequest {
+    NPT_String    m_Path;
+    NPT_String    m_SoapAction; // POST when set
+    NPT_String    m_Body;
+    NPT_LargeSize m_RangeSize;  // random ranges of resource when not 0
+};
+
+/*----------------------------------------------------------------------
+|   BenchmarkResults
++---------------------------------------------------------------------*/
+class BenchmarkResults
+{
+public:
+    BenchmarkResults() : m_Errors(0) {}
+
+    void Add(const NPT_Array<NPT_UInt32>& latencies, NPT_Cardinal errors) {
+        NPT_AutoLock lock(m_Lock);
+        for (NPT_Cardinal i=0; i<latencies.GetItemCount(); i++) {
+            m_Latencies.Add(latencies[i]);
+        }
+        m_Errors += errors;
+    }
+
+    NPT_Mutex             m_Lock;
+    NPT_Array<NPT_UInt32> m_Latencies; // microseconds
+    NPT_Cardinal          m_Errors;
+};
+
+/*----------------------------------------------------------------------
+|   BenchmarkClientTask
++---------------------------------------------------------------------*/
+class BenchmarkClientTask : public PLT_ThreadTask
+{
+public:
+    BenchmarkClientTask(NPT_UInt16                        port,
+                        const NPT_List<BenchmarkRequest>& requests,
+                        const NPT_TimeStamp&              deadline,
+                        BenchmarkResults&                 results) :
+        m_Port(port), 
+        m_Requests(requests), 
+        m_Deadline(deadline), 
+        m_Results(results) {}
+
+protected:
+    // PLT_ThreadTask methods
+    // no DoAbort, a request in flight when stopped is let to complete
+    virtual void DoRun();
+
+private:
+    NPT_Result SendRequest(const BenchmarkRequest& benchmark_request);
+
+    NPT_HttpClient             m_Client;
+    NPT_UInt16                 m_Port;
+    NPT_List<BenchmarkRequest> m_Requests;
+    NPT_TimeStamp              m_Deadline;
+    BenchmarkResults&          m_Results;
+};
+
+/*----------------------------------------------------------------------
+|   BenchmarkClientTask::SendRequest
++---------------------------------------------------------------------*/
+NPT_Result
+BenchmarkClientTask::SendRequest(const BenchmarkRequest& benchmark_request)
+{
+    NPT_HttpUrl       url("127.0.0.1", m_Port, benchmark_request.m_Path);
+    NPT_HttpResponse* response = NULL;
+    NPT_Result        res;
+
+    NPT_HttpRequest request(url, 
+                            benchmark_request.m_SoapAction.IsEmpty()?NPT_HTTP_METHOD_GET:NPT_HTTP_METHOD_POST, 
+                            NPT_HTTP_PROTOCOL_1_1);
+    if (!benchmark_request.m_SoapAction.IsEmpty()) {
+        NPT_HttpEntity* entity = new NPT_HttpEntity();
+        entity->SetInputStream(benchmark_request.m_Body);
+        entity->SetContentType("text/xml; charset=\"utf-8\"");
+        request.SetEntity(entity);
+        request.GetHeaders().SetHeader("SOAPAction", "\"" + benchmark_request.m_SoapAction + "\"");
+    } else if (benchmark_request.m_RangeSize > BENCHMARK_RANGE_SIZE) {
+        NPT_UInt64 start = NPT_System::GetRandomInteger() % (benchmark_request.m_RangeSize - BENCHMARK_RANGE_SIZE);
+        request.GetHeaders().SetHeader(NPT_HTTP_HEADER_RANGE, 
+            "bytes=" + NPT_String::FromIntegerU(start) + "-" + NPT_String::FromIntegerU(start + BENCHMARK_RANGE_SIZE - 1));
+    }
+
+    res = m_Client.SendRequest(request, response);
+    if (NPT_SUCCEEDED(res) && response) {
+        // read the whole body so the connection can be reused
+        NPT_HttpEntity* entity = response->GetEntity();
+        NPT_DataBuffer  buffer;
+        if (entity) res = entity->Load(buffer);
+        if (NPT_SUCCEEDED(res) && response->GetStatusCode() >= 400) res = NPT_FAILURE;
+    }
+
+    delete response;
+    return NPT_SUCCEEDED(res)?NPT_SUCCESS:NPT_FAILURE;
+}
+
+/*----------------------------------------------------------------------
+|   BenchmarkClientTask::DoRun
++---------------------------------------------------------------------*/
+void
+BenchmarkClientTask::DoRun()
+{
+    NPT_Array<NPT_UInt32> latencies;
+    NPT_Cardinal          errors = 0;
+    NPT_Ordinal           next = 0;
+
+    while (!IsAborting(0)) {
+        NPT_TimeStamp start, end;
+        NPT_System::GetCurrentTimeStamp(start);
+        if (start > m_Deadline) break;
+
+        // cycle through the requests of the workload
+        NPT_List<BenchmarkRequest>::Iterator request = m_Requests.GetItem(next++ % m_Requests.GetItemCount());
+        if (NPT_FAILED(SendRequest(*request))) {
+            ++errors;
+            continue;
+        }
+
+        NPT_System::GetCurrentTimeStamp(end);
+        latencies.Add((NPT_UInt32)((end - start).ToSeconds()*1000000.));
+    }
+
+    m_Results.Add(latencies, errors);
+}
+
+/*----------------------------------------------------------------------
+|   CompareLatencies
++---------------------------------------------------------------------*/
+static int
+CompareLatencies(const void* a, const void* b)
+{
+    NPT_UInt32 latency_a = *(const NPT_UInt32*)a;
+    NPT_UInt32 latency_b = *(const NPT_UInt32*)b;
+    return (latency_a < latency_b)?-1:((latency_a > latency_b)?1:0);
+}
+
+/*----------------------------------------------------------------------
+|   PrintProcessStats
++---------------------------------------------------------------------*/
+static void
+PrintProcessStats()
+{
+#if defined(__linux__)
+    FILE* file = fopen("/proc/self/status", "r");
+    if (file == NULL) return;
+
+    char line[256];
+    while (fgets(line, sizeof(line), file)) {
+        if (!strncmp(line, "Threads:", 8) || !strncmp(line, "VmRSS:", 6) || !strncmp(line, "VmHWM:", 6)) {
+            printf("%s", line);
+        }
+    }
+    fclose(file);
+#else
+    printf("threads/rss: not available on this platform\n");
+#endif
+}
+
+/*----------------------------------------------------------------------
+|   BuildSoapBody
++---------------------------------------------------------------------*/
+static NPT_String
+BuildSoapBody(const char* service_type, const char* action, const char* arguments)
+{
+    NPT_String body = 
+        "<?xml version=\"1.0\" encoding=\"utf-8\"?>"
+        "<s:Envelope xmlns:s=\"http://schemas.xmlsoap.org/soap/envelope/\" "
+        "s:encodingStyle=\"http://schemas.xmlsoap.org/soap/encoding/\"><s:Body>";
+    body += NPT_String("<u:") + action + " xmlns:u=\"" + service_type + "\">";
+    body += arguments;
+    body += NPT_String("</u:") + action + "></s:Body></s:Envelope>";
+    return body;
+}
+
+/*----------------------------------------------------------------------
+|   AddSoapRequest
++---------------------------------------------------------------------*/
+static NPT_Result
+AddSoapRequest(PLT_DeviceHostReference&    device, 
+               const char*                 service_type, 
+               const char*                 action, 
+               const char*                 arguments,
+               NPT_List<BenchmarkRequest>& requests)
+{
+    PLT_Service* service = NULL;
+    NPT_CHECK_SEVERE(device->FindServiceByType(service_type, service));
+
+    BenchmarkRequest request;
+    request.m_Path       = service->GetControlURL();
+    request.m_SoapAction = NPT_String(service_type) + "#" + action;
+    request.m_Body       = BuildSoapBody(service_type, action, arguments);
+    request.m_RangeSize  = 0;
+    return requests.Add(request);
+}
+
+/*----------------------------------------------------------------------
+|   PrintUsageAndExit
++---------------------------------------------------------------------*/
+static void
+PrintUsageAndExit(char** args)
+{
+    fprintf(stderr, "usage: %s [-m http|server|renderer] [-c <clients>] [-d <seconds>] [-w <workers>] [-f <file>] [<path>]\n", args[0]);
+    fprintf(stderr, "-m : server to benchmark (default http)\n");
+    fprintf(stderr, "     http: small documents and 64KB ranges of a 1MB document\n");
+    fprintf(stderr, "     server: ContentDirectory Browse of <path> and ranges of <file> in <path>\n");
+    fprintf(stderr, "     renderer: AVTransport GetTransportInfo and GetPositionInfo\n");
+    fprintf(stderr, "-c : number of concurrent keep-alive clients (default 8)\n");
+    fprintf(stderr, "-d : duration in seconds (default 10)\n");
+    fprintf(stderr, "-w : http mode only, use a reactor with this many workers\n");
+    fprintf(stderr, "-f : server mode only, file relative to <path> to request ranges of\n");
+    exit(1);
+}
+
+/*----------------------------------------------------------------------
+|   ParseCommandLine
++---------------------------------------------------------------------*/
+static void
+ParseCommandLine(char** args)
+{
+    const char* arg;
+    char**      tmp = args+1;
+
+    /* default values */
+    Options.mode     = "http";
+    Options.path     = NULL;
+    Options.file     = NULL;
+    Options.clients  = 8;
+    Options.duration = 10;
+    Options.workers  = 0;
+
+    while ((arg = *tmp++)) {
+        if (!strcmp(arg, "-m") && *tmp) {
+            Options.mode = *tmp++;
+        } else if (!strcmp(arg, "-f") && *tmp) {
+            Options.file = *tmp++;
+        } else if (!strcmp(arg, "-c") && *tmp) {
+            if (NPT_FAILED(NPT_ParseInteger32(*tmp++, Options.clients, false)) || !Options.clients) {
+                fprintf(stderr, "ERROR: invalid number of clients\n");
+                exit(1);
+            }
+        } else if (!strcmp(arg, "-d") && *tmp) {
+            if (NPT_FAILED(NPT_ParseInteger32(*tmp++, Options.duration, false)) || !Options.duration) {
+                fprintf(stderr, "ERROR: invalid duration\n");
+                exit(1);
+            }
+        } else if (!strcmp(arg, "-w") && *tmp) {
+            if (NPT_FAILED(NPT_ParseInteger32(*tmp++, Options.workers, false))) {
+                fprintf(stderr, "ERROR: invalid number of workers\n");
+                exit(1);
+            }
+        } else if (Options.path == NULL && arg[0] != '-') {
+            Options.path = arg;
+        } else {
+            fprintf(stderr, "ERROR: invalid argument %s\n", arg);
+            PrintUsageAndExit(args);
+        }
+    }
+
+    if (strcmp(Options.mode, "http") && 
+        strcmp(Options.mode, "server") && 
+        strcmp(Options.mode, "renderer")) {
+        fprintf(stderr, "ERROR: invalid mode\n");
+        PrintUsageAndExit(args);
+    }
+    if (!strcmp(Options.mode, "server") && Options.path == NULL) {
+        fprintf(stderr, "ERROR: path missing\n");
+        PrintUsageAndExit(args);
+    }
+}
+
+/*----------------------------------------------------------------------
+|   main
++---------------------------------------------------------------------*/
+int
+main(int argc, char** argv)
+{
+    NPT_COMPILER_UNUSED(argc);
+
+    NPT_List<BenchmarkRequest> requests;
+    NPT_UInt16                 port = 0;
+
+    /* parse command line */
+    ParseCommandLine(argv);
+
+    /* http mode */
+    PLT_HttpServer* http_server = NULL;
+    NPT_DataBuffer  data(BENCHMARK_DATA_SIZE);
+    data.SetDataSize(BENCHMARK_DATA_SIZE);
+    if (!strcmp(Options.mode, "http")) {
+        http_server = new PLT_HttpServer();
+        http_server->AddRequestHandler(new NPT_HttpStaticRequestHandler("<ok/>", "text/xml", false), "/small");
+        http_server->AddRequestHandler(
+            new NPT_HttpStaticRequestHandler(data.GetData(), data.GetDataSize(), "application/octet-stream", false), 
+            "/data");
+        if (Options.workers) NPT_CHECK_SEVERE(http_server->EnableReactor(Options.workers));
+        NPT_CHECK_SEVERE(http_server->Start());
+        port = (NPT_UInt16)http_server->GetPort();
+
+        BenchmarkRequest request;
+        request.m_Path      = "/small";
+        request.m_RangeSize = 0;
+        requests.Add(request);
+        request.m_Path      = "/data";
+        request.m_RangeSize = BENCHMARK_DATA_SIZE;
+        requests.Add(request);
+    }
+
+    /* device modes */
+    PLT_UPnP                upnp;
+    PLT_DeviceHostReference device;
+    if (!strcmp(Options.mode, "server")) {
+        device = new PLT_FileMediaServer(Options.path, "Platinum Benchmark Media Server");
+        upnp.AddDevice(device);
+        NPT_CHECK_SEVERE(upnp.Start());
+        port = device->GetPort();
+
+        NPT_CHECK_SEVERE(AddSoapRequest(device, 
+            "urn:schemas-upnp-org:service:ContentDirectory:1", 
+            "Browse",
+            "<ObjectID>0</ObjectID><BrowseFlag>BrowseDirectChildren</BrowseFlag>"
+            "<Filter>*</Filter><StartingIndex>0</StartingIndex>"
+            "<RequestedCount>0</RequestedCount><SortCriteria></SortCriteria>",
+            requests));
+
+        if (Options.file) {
+            NPT_FileInfo info;
+            NPT_CHECK_SEVERE(NPT_File::GetInfo(NPT_String(Options.path) + NPT_FilePath::Separator + Options.file, &info));
+
+            BenchmarkRequest request;
+            request.m_Path      = "/%25/" + NPT_Uri::PercentEncode(Options.file, NPT_Uri::PathCharsToEncode);
+            request.m_RangeSize = info.m_Size;
+            requests.Add(request);
+        }
+    } else if (!strcmp(Options.mode, "renderer")) {
+        device = new PLT_MediaRenderer("Platinum Benchmark Media Renderer");
+        upnp.AddDevice(device);
+        NPT_CHECK_SEVERE(upnp.Start());
+        port = device->GetPort();
+
+        NPT_CHECK_SEVERE(AddSoapRequest(device, 
+            "urn:schemas-upnp-org:service:AVTransport:1", 
+            "GetTransportInfo",
+            "<InstanceID>0</InstanceID>",
+            requests));
+        NPT_CHECK_SEVERE(AddSoapRequest(device, 
+            "urn:schemas-upnp-org:service:AVTransport:1", 
+            "GetPositionInfo",
+            "<InstanceID>0</InstanceID>",
+            requests));
+    }
+
+    /* small delay to let the server start */
+    NPT_System::Sleep(NPT_TimeInterval(1.f));
+
+    printf("benchmarking %s on port %d: %d clients for %d secs\n", 
+           Options.mode, 
+           port, 
+           Options.clients, 
+           Options.duration);
+
+    /* run clients */
+    BenchmarkResults results;
+    PLT_TaskManager  task_manager;
+    NPT_TimeStamp    start, deadline, end;
+    NPT_System::GetCurrentTimeStamp(start);
+    deadline = start + NPT_TimeInterval((double)Options.duration);
+    NPT_Array<PLT_ThreadTask*> clients;
+    for (NPT_Cardinal i=0; i<Options.clients; i++) {
+        PLT_ThreadTask* client = new BenchmarkClientTask(port, requests, deadline, results);
+        if (NPT_SUCCEEDED(task_manager.StartTask(client, NULL, false))) {
+            clients.Add(client);
+        } else {
+            /* not auto destroyed, the task manager left it to us */
+            client->Kill();
+        }
+    }
+
+    /* sample process stats while loaded */
+    NPT_System::Sleep(NPT_TimeInterval((double)Options.duration/2));
+    PrintProcessStats();
+
+    /* clients stop issuing requests at the deadline, wait for the last 
+       ones to complete instead of aborting them */
+    NPT_System::Sleep(NPT_TimeInterval((double)Options.duration/2));
+    for (NPT_Cardinal i=0; i<clients.GetItemCount(); i++) {
+        clients[i]->Kill();
+    }
+    NPT_System::GetCurrentTimeStamp(end);
+
+    /* report */
+    NPT_Cardinal count = results.m_Latencies.GetItemCount();
+    double       elapsed = (end - start).ToSeconds();
+    if (count) {
+        qsort(&results.m_Latencies[0], count, sizeof(NPT_UInt32), CompareLatencies);
+        printf("requests: %d, errors: %d, %d req/s\n", 
+               count, 
+               results.m_Errors, 
+               elapsed>0.?(int)(count/elapsed):0);
+        printf("latency: p50 %d us, p99 %d us, max %d us\n", 
+               results.m_Latencies[count*50/100], 
+               results.m_Latencies[count*99/100], 
+               results.m_Latencies[count-1]);
+    } else {
+        printf("no request succeeded (%d errors)\n", results.m_Errors);
+    }
+
+    /* cleanup */
+    if (http_server) {
+        http_server->Stop();
+        delete http_server;
+    }
+    if (!device.IsNull()) upnp.Stop();
+
+    return (count && !results.m_Errors)?0:1;
+}
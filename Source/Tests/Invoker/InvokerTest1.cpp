@@ -0,0 +1,413 @@
+/*****************************************************************
+|
+|   Platinum - Invoker Test
+|
+| Copyright (c) 2004-2010, Plutinosoft, LLC.
+| All rights reserved.
+| http://www.plutinosoft.com
+|
+| This program is free software; you can redistribute it and/or
+| modify it under the terms of the GNU General Public License
+| as published by the Free Software Foundation; either version 2
+| of the License, or (at your option) any later version.
+|
+| OEMs, ISVs, VARs and other distributors that combine and 
+| distribute commercially licensed software with Platinum software
+| and do not wish to distribute the source code for the commercially
+| licensed software under version 2, or (at your option) any later
+| version, of the GNU General Public License (the "GPL") must enter
+| into a commercial license agreement with Plutinosoft, LLC.
+| licensing@plutinosoft.com
+| 
+| This program is distributed in the hope that it will be useful,
+| but WITHOUT ANY WARRANTY; without even the implied warranty of
+| MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+| GNU General Public License for more details.
+|
+| You should have received a copy of the GNU General Public License
+| along with this program; see the file LICENSE.txt. If not, write to
+| the Free Software Foundation, Inc., 
+| 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+| http://www.gnu.org/licenses/gpl-2.0.html
+|
+****************************************************************/
+
+
+/*----------------------------------------------------------------------
+|   includes
++---------------------------------------------------------------------*/
+#include <stdlib.h>
+#include <stdio.h>
+#include "Neptune.h"
+#include "Platinum.h"
+
+NPT_SET_LOCAL_LOGGER("platinum.test.invoker")
+
+/*----------------------------------------------------------------------
+|       macros
++---------------------------------------------------------------------*/
+#define SHOULD_SUCCEED(r)                                        \
+    do {                                                         \
+        if (NPT_FAILED(r)) {                                     \
+            fprintf(stderr, "FAILED: line %d\n", __LINE__);      \
+            NPT_ASSERT(0);                                       \
+        }                                                        \
+    } while(0)                                         
+
+#define SHOULD_FAIL(r)                                           \
+    do {                                                         \
+        if (NPT_SUCCEEDED(r)) {                                  \
+            fprintf(stderr, "should have failed line %d (%d)\n", \
+                __LINE__, r);                                    \
+            NPT_ASSERT(0);                                       \
+        }                                                        \
+    } while(0)                                  
+
+#define SHOULD_EQUAL_I(a, b)                                     \
+    do {                                                         \
+        if ((a) != (b)) {                                        \
+            fprintf(stderr, "got %d expected %d line %d\n",      \
+                (int)a, (int)b, __LINE__);                       \
+            NPT_ASSERT(0);                                       \
+        }                                                        \
+    } while(0)                                  
+
+#define SHOULD_BE_TRUE(a)                                        \
+    do {                                                         \
+        if (!(a)) {                                              \
+            fprintf(stderr, "FAILED: line %d\n", __LINE__);      \
+            NPT_ASSERT(0);                                       \
+        }                                                        \
+    } while(0)                                  
+
+#define INVOKER_TEST_DEVICE_TYPE  "urn:schemas-upnp-org:device:InvokerTest:1"
+#define INVOKER_TEST_SERVICE_TYPE "urn:schemas-upnp-org:service:InvokerTest:1"
+
+/*----------------------------------------------------------------------
+|   globals
++---------------------------------------------------------------------*/
+/* one action, answered after the number of milliseconds passed */
+static const char* SCPDXML =
+    "<?xml version=\"1.0\" encoding=\"utf-8\"?>"
+    "<scpd xmlns=\"urn:schemas-upnp-org:service-1-0\">"
+      "<specVersion><major>1</major><minor>0</minor></specVersion>"
+      "<actionList>"
+        "<action>"
+          "<name>Wait</name>"
+          "<argumentList>"
+            "<argument>"
+              "<name>Milliseconds</name>"
+              "<direction>in</direction>"
+              "<relatedStateVariable>A_ARG_TYPE_Milliseconds</relatedStateVariable>"
+            "</argument>"
+          "</argumentList>"
+        "</action>"
+      "</actionList>"
+      "<serviceStateTable>"
+        "<stateVariable sendEvents=\"no\">"
+          "<name>A_ARG_TYPE_Milliseconds</name>"
+          "<dataType>ui4</dataType>"
+        "</stateVariable>"
+      "</serviceStateTable>"
+    "</scpd>";
+
+/*----------------------------------------------------------------------
+|   InvokerTestDevice class
++---------------------------------------------------------------------*/
+class InvokerTestDevice : public PLT_DeviceHost
+{
+public:
+    InvokerTestDevice() : 
+        PLT_DeviceHost("/", "", INVOKER_TEST_DEVICE_TYPE, "Platinum Invoker Test") {}
+
+    // PLT_DeviceHost methods
+    virtual NPT_Result SetupServices() {
+        PLT_Service* service = new PLT_Service(this,
+                                               INVOKER_TEST_SERVICE_TYPE,
+                                               "urn:upnp-org:serviceId:InvokerTest.001",
+                                               "InvokerTest");
+        NPT_Result res = service->SetSCPDXML(SCPDXML);
+        if (NPT_SUCCEEDED(res)) res = AddService(service);
+        if (NPT_FAILED(res)) delete service;
+        return res;
+    }
+
+    virtual NPT_Result OnAction(PLT_ActionReference&          action, 
+                                const PLT_HttpRequestContext& /* context */) {
+        NPT_String value;
+        NPT_Int32  milliseconds = 0;
+        if (action->GetActionDesc().GetName().Compare("Wait") || 
+            NPT_FAILED(action->GetArgumentValue("Milliseconds", value)) ||
+            NPT_FAILED(value.ToInteger(milliseconds))) {
+            action->SetError(402, "Invalid Args");
+            return NPT_FAILURE;
+        }
+
+        if (milliseconds) NPT_System::Sleep(NPT_TimeInterval((double)milliseconds/1000.));
+        return NPT_SUCCESS;
+    }
+};
+
+/*----------------------------------------------------------------------
+|   InvokerTestListener class
++---------------------------------------------------------------------*/
+class InvokerTestListener : public PLT_CtrlPointListener
+{
+public:
+    InvokerTestListener() : m_Count(0) {
+        m_DeviceAdded.SetValue(0);
+        m_Responded.SetValue(0);
+    }
+
+    NPT_Result WaitForDevice(PLT_DeviceDataReference& device, NPT_Timeout timeout) {
+        NPT_CHECK(m_DeviceAdded.WaitUntilEquals(1, timeout));
+        NPT_AutoLock lock(m_Lock);
+        device = m_Device;
+        return NPT_SUCCESS;
+    }
+
+    int GetResponseCount() {
+        NPT_AutoLock lock(m_Lock);
+        return m_Count;
+    }
+
+    NPT_Result WaitForResponses(int count, NPT_Timeout timeout) {
+        return m_Responded.WaitUntilEquals(count, timeout);
+    }
+
+    // number of responses received for an action and the result of the last one
+    int GetResponses(PLT_ActionReference& action, NPT_Result& result) {
+        NPT_AutoLock lock(m_Lock);
+        int count = 0;
+        for (NPT_List<Response>::Iterator response = m_Responses.GetFirstItem(); response; ++response) {
+            if ((*response).m_Action == action.AsPointer()) {
+                result = (*response).m_Result;
+                ++count;
+            }
+        }
+        return count;
+    }
+
+    // PLT_CtrlPointListener methods
+    virtual NPT_Result OnDeviceAdded(PLT_DeviceDataReference& device) {
+        if (device->GetType().Compare(INVOKER_TEST_DEVICE_TYPE)) return NPT_SUCCESS;
+
+        NPT_AutoLock lock(m_Lock);
+        m_Device = device;
+        m_DeviceAdded.SetValue(1);
+        return NPT_SUCCESS;
+    }
+    virtual NPT_Result OnDeviceRemoved(PLT_DeviceDataReference& /* device */) {
+        return NPT_SUCCESS;
+    }
+    virtual NPT_Result OnActionResponse(NPT_Result res, PLT_ActionReference& action, void* /* userdata */) {
+        NPT_AutoLock lock(m_Lock);
+        Response response = { action.AsPointer(), res };
+        m_Responses.Add(response);
+        m_Responded.SetValue(++m_Count);
+        return NPT_SUCCESS;
+    }
+    virtual NPT_Result OnEventNotify(PLT_Service* /* service */, NPT_List<PLT_StateVariable*>* /* vars */) {
+        return NPT_SUCCESS;
+    }
+
+private:
+    struct Response {
+        PLT_Action* m_Action;
+        NPT_Result  m_Result;
+    };
+
+    NPT_Mutex               m_Lock;
+    PLT_DeviceDataReference m_Device;
+    NPT_SharedVariable      m_DeviceAdded;
+    NPT_List<Response>      m_Responses;
+    int                     m_Count;
+    NPT_SharedVariable      m_Responded;
+};
+
+/*----------------------------------------------------------------------
+|   CreateWaitAction
++---------------------------------------------------------------------*/
+static PLT_ActionReference
+CreateWaitAction(PLT_CtrlPointReference&  ctrl_point,
+                 PLT_DeviceDataReference& device,
+                 NPT_UInt32               milliseconds,
+                 NPT_Timeout              timeout = 0)
+{
+    PLT_ActionReference action;
+    SHOULD_SUCCEED(ctrl_point->CreateAction(device, INVOKER_TEST_SERVICE_TYPE, "Wait", action));
+    SHOULD_SUCCEED(action->SetArgumentValue("Milliseconds", NPT_String::FromIntegerU(milliseconds)));
+    if (timeout) action->SetTimeout(timeout);
+    return action;
+}
+
+/*----------------------------------------------------------------------
+|   TestSuiteInvoke
++---------------------------------------------------------------------*/
+static void
+TestSuiteInvoke(PLT_CtrlPointReference&  ctrl_point, 
+                PLT_DeviceDataReference& device, 
+                InvokerTestListener&     listener)
+{
+    int        count = listener.GetResponseCount();
+    NPT_Result result;
+
+    /* actions to the same device are answered in order, once each */
+    PLT_ActionReference first  = CreateWaitAction(ctrl_point, device, 0);
+    PLT_ActionReference second = CreateWaitAction(ctrl_point, device, 0);
+    SHOULD_SUCCEED(ctrl_point->InvokeAction(first));
+    SHOULD_SUCCEED(ctrl_point->InvokeAction(second));
+    SHOULD_SUCCEED(listener.WaitForResponses(count+2, 10000));
+    SHOULD_EQUAL_I(listener.GetResponses(first, result), 1);
+    SHOULD_SUCCEED(result);
+    SHOULD_EQUAL_I(listener.GetResponses(second, result), 1);
+    SHOULD_SUCCEED(result);
+
+    /* too late to cancel */
+    result = ctrl_point->CancelAction(first);
+    SHOULD_EQUAL_I(result, NPT_ERROR_NO_SUCH_ITEM);
+}
+
+/*----------------------------------------------------------------------
+|   TestSuiteCancel
++---------------------------------------------------------------------*/
+static void
+TestSuiteCancel(PLT_CtrlPointReference&  ctrl_point, 
+                PLT_DeviceDataReference& device, 
+                InvokerTestListener&     listener)
+{
+    int        count = listener.GetResponseCount();
+    NPT_Result result;
+
+    /* one action being sent, one queued behind it */
+    PLT_ActionReference sent   = CreateWaitAction(ctrl_point, device, 5000);
+    PLT_ActionReference queued = CreateWaitAction(ctrl_point, device, 0);
+    SHOULD_SUCCEED(ctrl_point->InvokeAction(sent));
+    SHOULD_SUCCEED(ctrl_point->InvokeAction(queued));
+    NPT_System::Sleep(NPT_TimeInterval(.5));
+
+    /* both come back interrupted well before the device answers */
+    NPT_TimeStamp start, end;
+    NPT_System::GetCurrentTimeStamp(start);
+    SHOULD_SUCCEED(ctrl_point->CancelAction(queued));
+    SHOULD_SUCCEED(ctrl_point->CancelAction(sent));
+    SHOULD_SUCCEED(listener.WaitForResponses(count+2, 2000));
+    NPT_System::GetCurrentTimeStamp(end);
+    SHOULD_BE_TRUE((end - start).ToMillis() < 2000);
+
+    SHOULD_EQUAL_I(listener.GetResponses(sent, result), 1);
+    SHOULD_EQUAL_I(result, NPT_ERROR_INTERRUPTED);
+    SHOULD_EQUAL_I(listener.GetResponses(queued, result), 1);
+    SHOULD_EQUAL_I(result, NPT_ERROR_INTERRUPTED);
+
+    /* cancelling twice reports nothing more */
+    result = ctrl_point->CancelAction(sent);
+    SHOULD_EQUAL_I(result, NPT_ERROR_NO_SUCH_ITEM);
+
+    /* the device can still be reached afterwards */
+    PLT_ActionReference next = CreateWaitAction(ctrl_point, device, 0);
+    SHOULD_SUCCEED(ctrl_point->InvokeAction(next));
+    SHOULD_SUCCEED(listener.WaitForResponses(count+3, 10000));
+    SHOULD_EQUAL_I(listener.GetResponses(next, result), 1);
+    SHOULD_SUCCEED(result);
+    SHOULD_EQUAL_I(listener.GetResponses(sent, result), 1);
+}
+
+/*----------------------------------------------------------------------
+|   TestSuiteTimeout
++---------------------------------------------------------------------*/
+static void
+TestSuiteTimeout(PLT_CtrlPointReference&  ctrl_point, 
+                 PLT_DeviceDataReference& device, 
+                 InvokerTestListener&     listener)
+{
+    int        count = listener.GetResponseCount();
+    NPT_Result result;
+
+    /* the action gives up after its own timeout, not the default one */
+    PLT_ActionReference slow = CreateWaitAction(ctrl_point, device, 5000, 500);
+    NPT_TimeStamp start, end;
+    NPT_System::GetCurrentTimeStamp(start);
+    SHOULD_SUCCEED(ctrl_point->InvokeAction(slow));
+    SHOULD_SUCCEED(listener.WaitForResponses(count+1, 3000));
+    NPT_System::GetCurrentTimeStamp(end);
+    SHOULD_BE_TRUE((end - start).ToMillis() < 3000);
+    SHOULD_EQUAL_I(listener.GetResponses(slow, result), 1);
+    SHOULD_FAIL(result);
+
+    /* an action fast enough for its timeout still succeeds */
+    PLT_ActionReference fast = CreateWaitAction(ctrl_point, device, 100, 5000);
+    SHOULD_SUCCEED(ctrl_point->InvokeAction(fast));
+    SHOULD_SUCCEED(listener.WaitForResponses(count+2, 10000));
+    SHOULD_EQUAL_I(listener.GetResponses(fast, result), 1);
+    SHOULD_SUCCEED(result);
+}
+
+/*----------------------------------------------------------------------
+|   TestSuiteStop
++---------------------------------------------------------------------*/
+static void
+TestSuiteStop(PLT_UPnP&                upnp,
+              PLT_CtrlPointReference&  ctrl_point, 
+              PLT_DeviceDataReference& device, 
+              InvokerTestListener&     listener)
+{
+    int        count = listener.GetResponseCount();
+    NPT_Result result;
+
+    PLT_ActionReference sent    = CreateWaitAction(ctrl_point, device, 2000);
+    PLT_ActionReference queued1 = CreateWaitAction(ctrl_point, device, 0);
+    PLT_ActionReference queued2 = CreateWaitAction(ctrl_point, device, 0);
+    SHOULD_SUCCEED(ctrl_point->InvokeAction(sent));
+    SHOULD_SUCCEED(ctrl_point->InvokeAction(queued1));
+    SHOULD_SUCCEED(ctrl_point->InvokeAction(queued2));
+    NPT_System::Sleep(NPT_TimeInterval(.5));
+
+    /* every action is answered by the time the control point is stopped */
+    SHOULD_SUCCEED(upnp.Stop());
+    SHOULD_EQUAL_I(listener.GetResponseCount(), count+3);
+
+    SHOULD_EQUAL_I(listener.GetResponses(sent, result), 1);
+    SHOULD_FAIL(result);
+    SHOULD_EQUAL_I(listener.GetResponses(queued1, result), 1);
+    SHOULD_EQUAL_I(result, NPT_ERROR_INTERRUPTED);
+    SHOULD_EQUAL_I(listener.GetResponses(queued2, result), 1);
+    SHOULD_EQUAL_I(result, NPT_ERROR_INTERRUPTED);
+
+    /* nothing can be invoked once stopped */
+    SHOULD_FAIL(ctrl_point->InvokeAction(sent));
+}
+
+/*----------------------------------------------------------------------
+|   main
++---------------------------------------------------------------------*/
+int
+main(int /*argc*/, char** /*argv*/)
+{
+    PLT_UPnP upnp;
+    upnp.SetIgnoreLocalUUIDs(false);
+
+    PLT_DeviceHostReference device_host(new InvokerTestDevice());
+    upnp.AddDevice(device_host);
+
+    /* no search, the device is inspected directly below */
+    InvokerTestListener    listener;
+    PLT_CtrlPointReference ctrl_point(new PLT_CtrlPoint(NULL));
+    ctrl_point->AddListener(&listener);
+    upnp.AddCtrlPoint(ctrl_point);
+
+    SHOULD_SUCCEED(upnp.Start());
+    SHOULD_SUCCEED(ctrl_point->InspectDevice(NPT_HttpUrl(device_host->GetDescriptionUrl("127.0.0.1")), 
+                                             device_host->GetUUID()));
+
+    PLT_DeviceDataReference device;
+    SHOULD_SUCCEED(listener.WaitForDevice(device, 10000));
+
+    TestSuiteInvoke(ctrl_point, device, listener);
+    TestSuiteCancel(ctrl_point, device, listener);
+    TestSuiteTimeout(ctrl_point, device, listener);
+    TestSuiteStop(upnp, ctrl_point, device, listener);
+
+    ctrl_point->RemoveListener(&listener);
+    return 0;
+}
@@ -0,0 +1,271 @@
+/*****************************************************************
+|
+|   Platinum - Seek Index Test
+|
+| Copyright (c) 2004-2010, Plutinosoft, LLC.
+| All rights reserved.
+| http://www.plutinosoft.com
+|
+| This program is free software; you can redistribute it and/or
+| modify it under the terms of the GNU General Public License
+| as published by the Free Software Foundation; either version 2
+| of the License, or (at your option) any later version.
+|
+| OEMs, ISVs, VARs and other distributors that combine and 
+| distribute commercially licensed software with Platinum software
+| and do not wish to distribute the source code for the commercially
+| licensed software under version 2, or (at your option) any later
+| version, of the GNU General Public License (the "GPL") must enter
+| into a commercial license agreement with Plutinosoft, LLC.
+| licensing@plutinosoft.com
+| 
+| This program is distributed in the hope that it will be useful,
+| but WITHOUT ANY WARRANTY; without even the implied warranty of
+| MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+| GNU General Public License for more details.
+|
+| You should have received a copy of the GNU General Public License
+| along with this program; see the file LICENSE.txt. If not, write to
+| the Free Software Foundation, Inc., 
+| 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+| http://www.gnu.org/licenses/gpl-2.0.html
+|
+****************************************************************/
+
+
+/*----------------------------------------------------------------------
+|   includes
++---------------------------------------------------------------------*/
+#include <stdlib.h>
+#include <stdio.h>
+#include "Neptune.h"
+#include "Platinum.h"
+
+/*----------------------------------------------------------------------
+|       macros
++---------------------------------------------------------------------*/
+#define SHOULD_SUCCEED(r)                                        \
+    do {                                                         \
+        if (NPT_FAILED(r)) {                                     \
+            fprintf(stderr, "FAILED: line %d\n", __LINE__);      \
+            NPT_ASSERT(0);                                       \
+        }                                                        \
+    } while(0)                                         
+
+#define SHOULD_FAIL(r)                                           \
+    do {                                                         \
+        if (NPT_SUCCEEDED(r)) {                                  \
+            fprintf(stderr, "should have failed line %d (%d)\n", \
+                __LINE__, r);                                    \
+            NPT_ASSERT(0);                                       \
+        }                                                        \
+    } while(0)                                  
+
+#define SHOULD_EQUAL_I(a, b)                                     \
+    do {                                                         \
+        if ((a) != (b)) {                                        \
+            fprintf(stderr, "got %d expected %d line %d\n",      \
+                (int)a, (int)b, __LINE__);                       \
+            NPT_ASSERT(0);                                       \
+        }                                                        \
+    } while(0)                                  
+
+
+#define SHOULD_EQUAL_S(a, b)                                     \
+    do {                                                         \
+        if (!NPT_StringsEqual(a,b)) {                            \
+            fprintf(stderr, "got %s, expected %s line %d\n",     \
+                a, b, __LINE__);                                 \
+            NPT_ASSERT(0);                                           \
+        }                                                        \
+    } while(0)     
+
+/*----------------------------------------------------------------------
+|   TestSuiteNptTime
++---------------------------------------------------------------------*/
+static void
+TestSuiteNptTime()
+{
+    NPT_UInt64 time;
+
+    SHOULD_SUCCEED(PLT_SeekIndex::ParseNptTime("12.5", time));
+    SHOULD_EQUAL_I(time, 12500);
+    SHOULD_SUCCEED(PLT_SeekIndex::ParseNptTime("1:02:03.25", time));
+    SHOULD_EQUAL_I(time, 3723250);
+    SHOULD_SUCCEED(PLT_SeekIndex::ParseNptTime("0", time));
+    SHOULD_EQUAL_I(time, 0);
+
+    SHOULD_FAIL(PLT_SeekIndex::ParseNptTime("", time));
+    SHOULD_FAIL(PLT_SeekIndex::ParseNptTime(".5", time));
+    SHOULD_FAIL(PLT_SeekIndex::ParseNptTime("now", time));
+
+    SHOULD_EQUAL_S(PLT_SeekIndex::FormatNptTime(3723250).GetChars(), "3723.250");
+}
+
+/*----------------------------------------------------------------------
+|   TestSuiteLookup
++---------------------------------------------------------------------*/
+static void
+TestSuiteLookup()
+{
+    PLT_SeekIndex index;
+    NPT_Position  offset;
+
+    index.SetSize(1000);
+    index.SetDuration(3000);
+    SHOULD_FAIL(index.FindOffset(0, offset));
+
+    SHOULD_SUCCEED(index.Add(0, 0));
+    SHOULD_SUCCEED(index.Add(1000, 300));
+    SHOULD_SUCCEED(index.Add(2000, 600));
+    SHOULD_FAIL(index.Add(1500, 700));
+
+    SHOULD_SUCCEED(index.FindOffset(1500, offset));
+    SHOULD_EQUAL_I(offset, 300);
+    SHOULD_SUCCEED(index.FindOffset(2000, offset));
+    SHOULD_EQUAL_I(offset, 600);
+    SHOULD_FAIL(index.FindOffset(3500, offset));
+    SHOULD_SUCCEED(index.FindEndOffset(1500, offset));
+    SHOULD_EQUAL_I(offset, 600);
+    SHOULD_SUCCEED(index.FindEndOffset(2500, offset));
+    SHOULD_EQUAL_I(offset, 1000);
+
+    /* round trip through the sidecar format */
+    NPT_String    text;
+    PLT_SeekIndex parsed;
+    SHOULD_SUCCEED(index.Serialize(text));
+    SHOULD_SUCCEED(parsed.Parse(text));
+    SHOULD_EQUAL_I(parsed.GetEntryCount(), 3);
+    SHOULD_EQUAL_I(parsed.GetDuration(), 3000);
+    SHOULD_EQUAL_I(parsed.GetSize(), 1000);
+}
+
+/*----------------------------------------------------------------------
+|   TestSuiteMpegTs
++---------------------------------------------------------------------*/
+static void
+TestSuiteMpegTs()
+{
+    /* 20000 packets with a PCR each, 1ms apart */
+    NPT_DataBuffer data(20000*188);
+    data.SetDataSize(20000*188);
+    NPT_SetMemory(data.UseData(), 0, data.GetDataSize());
+    for (NPT_UInt64 i=0; i<20000; i++) {
+        NPT_Byte*  packet = data.UseData()+i*188;
+        NPT_UInt64 pcr    = i*90;
+        packet[0]  = 0x47;
+        packet[1]  = 0x01;
+        packet[3]  = 0x30;
+        packet[4]  = 7;
+        packet[5]  = 0x10;
+        packet[6]  = (NPT_Byte)(pcr >> 25);
+        packet[7]  = (NPT_Byte)(pcr >> 17);
+        packet[8]  = (NPT_Byte)(pcr >> 9);
+        packet[9]  = (NPT_Byte)(pcr >> 1);
+        packet[10] = (NPT_Byte)((pcr & 1) << 7);
+    }
+
+    PLT_SeekIndex    index;
+    NPT_MemoryStream stream(data.GetData(), data.GetDataSize());
+    SHOULD_SUCCEED(PLT_SeekIndex::BuildMpegTs(stream, data.GetDataSize(), index));
+
+    NPT_Position offset;
+    SHOULD_SUCCEED(index.FindOffset(10000, offset));
+    SHOULD_EQUAL_I(offset % 188, 0);
+    SHOULD_EQUAL_I(offset <= 10000*188, true);
+
+    /* time seek request for the second half */
+    NPT_Position  start_offset;
+    NPT_LargeSize length;
+    NPT_String    time_seek_range;
+    SHOULD_SUCCEED(PLT_HttpServer::SetupTimeSeek(index, "npt=10-", start_offset, length, time_seek_range));
+    SHOULD_EQUAL_I(start_offset, offset);
+    SHOULD_EQUAL_I(length, data.GetDataSize() - offset);
+    SHOULD_FAIL(PLT_HttpServer::SetupTimeSeek(index, "npt=100-", start_offset, length, time_seek_range));
+    SHOULD_FAIL(PLT_HttpServer::SetupTimeSeek(index, "bytes=0-", start_offset, length, time_seek_range));
+}
+
+/*----------------------------------------------------------------------
+|   TestSuiteMp3
++---------------------------------------------------------------------*/
+static void
+TestSuiteMp3()
+{
+    /* MPEG 1 layer III, 128kbps, 44.1kHz, no Xing header */
+    NPT_DataBuffer data(1000000);
+    data.SetDataSize(1000000);
+    NPT_SetMemory(data.UseData(), 0, data.GetDataSize());
+    data.UseData()[0] = 0xFF;
+    data.UseData()[1] = 0xFB;
+    data.UseData()[2] = 0x90;
+
+    PLT_SeekIndex    index;
+    NPT_MemoryStream stream(data.GetData(), data.GetDataSize());
+    SHOULD_SUCCEED(PLT_SeekIndex::BuildMp3(stream, data.GetDataSize(), index));
+    SHOULD_EQUAL_I(index.GetDuration(), 62500);
+
+    NPT_Position offset;
+    SHOULD_SUCCEED(index.FindOffset(31250, offset));
+    SHOULD_EQUAL_I(offset, 500000);
+}
+
+/*----------------------------------------------------------------------
+|   TestSuiteMp4
++---------------------------------------------------------------------*/
+static void
+TestSuiteMp4()
+{
+    /* a byte range of the media data can't be played without the movie box */
+    SHOULD_EQUAL_I(PLT_SeekIndex::IsSupported("movie.mp4"), false);
+    SHOULD_EQUAL_I(PLT_SeekIndex::IsSupported("movie.M4V"), false);
+    SHOULD_EQUAL_I(PLT_SeekIndex::IsSupported("movie.mov"), false);
+    SHOULD_EQUAL_I(PLT_SeekIndex::IsSupported("movie.ts"), true);
+    SHOULD_EQUAL_I(PLT_SeekIndex::IsSupported("song.mp3"), true);
+
+    /* an index saved next to the file is not used either */
+    NPT_String    path    = "SeekIndexTest1.mp4";
+    NPT_String    sidecar = path + PLT_SEEK_INDEX_FILE_EXTENSION;
+    NPT_String    movie   = "not a movie";
+    NPT_String    text;
+    PLT_SeekIndex saved;
+    saved.SetSize(movie.GetLength());
+    saved.SetDuration(1000);
+    SHOULD_SUCCEED(saved.Add(0, 0));
+    SHOULD_SUCCEED(saved.Serialize(text));
+    SHOULD_SUCCEED(NPT_File::Save(path, movie));
+    SHOULD_SUCCEED(NPT_File::Save(sidecar, text));
+
+    NPT_FileInfo           info;
+    PLT_SeekIndexCache     cache;
+    PLT_SeekIndexReference index;
+    SHOULD_SUCCEED(NPT_File::GetInfo(path, &info));
+    SHOULD_EQUAL_I(cache.GetIndex(path, info, index), NPT_ERROR_NOT_SUPPORTED);
+    SHOULD_EQUAL_I(index.IsNull(), true);
+
+    /* time seek is then refused */
+    NPT_HttpRequest request("http://127.0.0.1/movie.mp4", NPT_HTTP_METHOD_GET);
+    request.GetHeaders().SetHeader("TimeSeekRange.dlna.org", "npt=0-");
+    NPT_HttpResponse response(200, "OK", NPT_HTTP_PROTOCOL_1_1);
+    response.SetEntity(new NPT_HttpEntity());
+    NPT_HttpRequestContext   context;
+    NPT_InputStreamReference body(new NPT_MemoryStream(movie.GetChars(), movie.GetLength()));
+    SHOULD_SUCCEED(PLT_HttpServer::ServeStream(request, context, response, body, "video/mp4", index.AsPointer()));
+    SHOULD_EQUAL_I(response.GetStatusCode(), 406);
+
+    NPT_File::RemoveFile(path);
+    NPT_File::RemoveFile(sidecar);
+}
+
+/*----------------------------------------------------------------------
+|       main
++---------------------------------------------------------------------*/
+int
+main(int /*argc*/, char** /*argv*/)
+{
+    TestSuiteNptTime();
+    TestSuiteLookup();
+    TestSuiteMpegTs();
+    TestSuiteMp3();
+    TestSuiteMp4();
+    return 0;
+}
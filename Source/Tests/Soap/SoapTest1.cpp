@@ -0,0 +1,325 @@
+/*****************************************************************
+|
+|   Platinum - SOAP Test
+|
+| Copyright (c) 2004-2010, Plutinosoft, LLC.
+| All rights reserved.
+| http://www.plutinosoft.com
+|
+| This program is free software; you can redistribute it and/or
+| modify it under the terms of the GNU General Public License
+| as published by the Free Software Foundation; either version 2
+| of the License, or (at your option) any later version.
+|
+| OEMs, ISVs, VARs and other distributors that combine and 
+| distribute commercially licensed software with Platinum software
+| and do not wish to distribute the source code for the commercially
+| licensed software under version 2, or (at your option) any later
+| version, of the GNU General Public License (the "GPL") must enter
+| into a commercial license agreement with Plutinosoft, LLC.
+| licensing@plutinosoft.com
+| 
+| This program is distributed in the hope that it will be useful,
+| but WITHOUT ANY WARRANTY; without even the implied warranty of
+| MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+| GNU General Public License for more details.
+|
+| You should have received a copy of the GNU General Public License
+| along with this program; see the file LICENSE.txt. If not, write to
+| the Free Software Foundation, Inc., 
+| 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+| http://www.gnu.org/licenses/gpl-2.0.html
+|
+****************************************************************/
+
+
+/*----------------------------------------------------------------------
+|   includes
++---------------------------------------------------------------------*/
+#include <stdlib.h>
+#include <stdio.h>
+#include "Neptune.h"
+#include "Platinum.h"
+
+/*----------------------------------------------------------------------
+|       macros
++---------------------------------------------------------------------*/
+#define SHOULD_SUCCEED(r)                                        \
+    do {                                                         \
+        if (NPT_FAILED(r)) {                                     \
+            fprintf(stderr, "FAILED: line %d\n", __LINE__);      \
+            NPT_ASSERT(0);                                       \
+        }                                                        \
+    } while(0)                                         
+
+#define SHOULD_EQUAL_I(a, b)                                     \
+    do {                                                         \
+        if ((a) != (b)) {                                        \
+            fprintf(stderr, "got %d expected %d line %d\n",      \
+                (int)a, (int)b, __LINE__);                       \
+            NPT_ASSERT(0);                                       \
+        }                                                        \
+    } while(0)                                  
+
+#define SHOULD_EQUAL_S(a, b)                                     \
+    do {                                                         \
+        if (!NPT_StringsEqual(a,b)) {                            \
+            fprintf(stderr, "got %s, expected %s line %d\n",     \
+                a, b, __LINE__);                                 \
+            NPT_ASSERT(0);                                       \
+        }                                                        \
+    } while(0)     
+
+#define SOAP_TEST_ITERATIONS 10000
+
+/*----------------------------------------------------------------------
+|   globals
++---------------------------------------------------------------------*/
+static const char* BrowseRequest = 
+    "<?xml version=\"1.0\" encoding=\"utf-8\"?>\r\n"
+    "<s:Envelope xmlns:s=\"http://schemas.xmlsoap.org/soap/envelope/\" "
+    "s:encodingStyle=\"http://schemas.xmlsoap.org/soap/encoding/\">"
+    "<s:Body>"
+    "<u:Browse xmlns:u=\"urn:schemas-upnp-org:service:ContentDirectory:1\">"
+    "<ObjectID>0/Music/Albums</ObjectID>"
+    "<BrowseFlag>BrowseDirectChildren</BrowseFlag>"
+    "<Filter>dc:title,upnp:class,res@duration,res@protocolInfo</Filter>"
+    "<StartingIndex>0</StartingIndex>"
+    "<RequestedCount>200</RequestedCount>"
+    "<SortCriteria></SortCriteria>"
+    "</u:Browse>"
+    "</s:Body>"
+    "</s:Envelope>";
+
+static const char* SetAVTransportURIRequest = 
+    "<?xml version=\"1.0\" encoding=\"utf-8\"?>\r\n"
+    "<s:Envelope xmlns:s=\"http://schemas.xmlsoap.org/soap/envelope/\" "
+    "s:encodingStyle=\"http://schemas.xmlsoap.org/soap/encoding/\">\r\n"
+    "  <s:Body>\r\n"
+    "    <u:SetAVTransportURI xmlns:u=\"urn:schemas-upnp-org:service:AVTransport:1\">\r\n"
+    "      <InstanceID>0</InstanceID>\r\n"
+    "      <CurrentURI>http://192.168.1.10:8080/track.mp3?id=12&amp;fmt=mp3</CurrentURI>\r\n"
+    "      <CurrentURIMetaData>&lt;DIDL-Lite xmlns=&quot;urn:schemas-upnp-org:metadata-1-0/DIDL-Lite/&quot; "
+    "xmlns:dc=&quot;http://purl.org/dc/elements/1.1/&quot; "
+    "xmlns:upnp=&quot;urn:schemas-upnp-org:metadata-1-0/upnp/&quot;&gt;"
+    "&lt;item id=&quot;12&quot; parentID=&quot;3&quot; restricted=&quot;1&quot;&gt;"
+    "&lt;dc:title&gt;Caf&#233; &amp; Bar&lt;/dc:title&gt;"
+    "&lt;upnp:class&gt;object.item.audioItem.musicTrack&lt;/upnp:class&gt;"
+    "&lt;res protocolInfo=&quot;http-get:*:audio/mpeg:*&quot;&gt;http://192.168.1.10:8080/track.mp3?id=12&amp;amp;fmt=mp3&lt;/res&gt;"
+    "&lt;/item&gt;&lt;/DIDL-Lite&gt;</CurrentURIMetaData>\r\n"
+    "    </u:SetAVTransportURI>\r\n"
+    "  </s:Body>\r\n"
+    "</s:Envelope>\r\n";
+
+/*----------------------------------------------------------------------
+|   ParseWithDom
++---------------------------------------------------------------------*/
+static NPT_Result
+ParseWithDom(const char* xml, NPT_String& action, NPT_List<NPT_String>& args)
+{
+    NPT_XmlElementNode* tree = NULL;
+    NPT_CHECK(PLT_XmlHelper::Parse(xml, tree));
+
+    NPT_XmlElementNode* body = PLT_XmlHelper::GetChild(tree, "Body");
+    NPT_XmlElementNode* soap_action = NULL;
+    if (body) PLT_XmlHelper::GetChild(body, soap_action);
+    if (!soap_action) {
+        delete tree;
+        return NPT_FAILURE;
+    }
+
+    action = soap_action->GetTag();
+    for (NPT_List<NPT_XmlNode*>::Iterator child = soap_action->GetChildren().GetFirstItem(); 
+         child; 
+         child++) {
+        NPT_XmlElementNode* arg = (*child)->AsElementNode();
+        if (!arg) continue;
+
+        args.Add(arg->GetTag());
+        args.Add(arg->GetText()?*arg->GetText():"");
+    }
+
+    delete tree;
+    return NPT_SUCCESS;
+}
+
+/*----------------------------------------------------------------------
+|   ParseWithSoapParser
++---------------------------------------------------------------------*/
+static NPT_Result
+ParseWithSoapParser(const char* xml, NPT_String& action, NPT_List<NPT_String>& args)
+{
+    PLT_SoapParser parser(xml, NPT_StringLength(xml));
+    NPT_CHECK(parser.ParseEnvelope());
+
+    action = parser.GetActionName();
+
+    NPT_Result res;
+    NPT_String name, value;
+    while (NPT_SUCCEEDED(res = parser.GetNextArgument(name, value))) {
+        args.Add(name);
+        args.Add(value);
+    }
+    return (res == NPT_ERROR_NO_SUCH_ITEM)?NPT_SUCCESS:res;
+}
+
+/*----------------------------------------------------------------------
+|   TestSuiteCompare
++---------------------------------------------------------------------*/
+static void
+TestSuiteCompare(const char* xml, const char* action_name, NPT_Cardinal arg_count)
+{
+    NPT_String           dom_action, soap_action;
+    NPT_List<NPT_String> dom_args, soap_args;
+
+    SHOULD_SUCCEED(ParseWithDom(xml, dom_action, dom_args));
+    SHOULD_SUCCEED(ParseWithSoapParser(xml, soap_action, soap_args));
+
+    SHOULD_EQUAL_S(dom_action.GetChars(), action_name);
+    SHOULD_EQUAL_S(soap_action.GetChars(), action_name);
+    SHOULD_EQUAL_I(dom_args.GetItemCount(), arg_count*2);
+    SHOULD_EQUAL_I(soap_args.GetItemCount(), arg_count*2);
+
+    NPT_List<NPT_String>::Iterator dom_arg  = dom_args.GetFirstItem();
+    NPT_List<NPT_String>::Iterator soap_arg = soap_args.GetFirstItem();
+    for (; dom_arg && soap_arg; dom_arg++, soap_arg++) {
+        SHOULD_EQUAL_S(soap_arg->GetChars(), dom_arg->GetChars());
+    }
+}
+
+/*----------------------------------------------------------------------
+|   TestSuiteEnvelope
++---------------------------------------------------------------------*/
+static void
+TestSuiteEnvelope()
+{
+    PLT_SoapParser parser(BrowseRequest, NPT_StringLength(BrowseRequest));
+    SHOULD_SUCCEED(parser.ParseEnvelope());
+    SHOULD_EQUAL_S(parser.GetEnvelopeNamespace().GetChars(), "http://schemas.xmlsoap.org/soap/envelope/");
+    SHOULD_EQUAL_S(parser.GetEncodingStyle().GetChars(), "http://schemas.xmlsoap.org/soap/encoding/");
+    SHOULD_EQUAL_S(parser.GetActionNamespace().GetChars(), "urn:schemas-upnp-org:service:ContentDirectory:1");
+
+    /* truncated envelope */
+    NPT_String name, value;
+    PLT_SoapParser truncated(BrowseRequest, NPT_StringLength(BrowseRequest)-40);
+    SHOULD_SUCCEED(truncated.ParseEnvelope());
+    NPT_Result res;
+    while (NPT_SUCCEEDED(res = truncated.GetNextArgument(name, value))) {}
+    SHOULD_EQUAL_I(res == NPT_ERROR_NO_SUCH_ITEM, 0);
+}
+
+/*----------------------------------------------------------------------
+|   TestSuiteReadBody
++---------------------------------------------------------------------*/
+static void
+TestSuiteReadBody()
+{
+    NPT_HttpRequest request("http://127.0.0.1/control", "POST", NPT_HTTP_PROTOCOL_1_1);
+    NPT_DataBuffer  body;
+
+    /* regular body */
+    NPT_HttpEntity* entity = NULL;
+    PLT_HttpHelper::SetBody(request, BrowseRequest, &entity);
+    SHOULD_SUCCEED(PLT_SoapParser::ReadBody(request, body));
+    SHOULD_EQUAL_I(body.GetDataSize(), NPT_StringLength(BrowseRequest));
+
+    /* announced length too large, nothing allocated */
+    entity->SetContentLength((NPT_LargeSize)PLT_SOAP_MAX_BODY_SIZE+1);
+    SHOULD_EQUAL_I(PLT_SoapParser::ReadBody(request, body), NPT_ERROR_OUT_OF_RANGE);
+
+    /* no length, body keeps coming */
+    NPT_MemoryStreamReference stream(new NPT_MemoryStream(PLT_SOAP_MAX_BODY_SIZE+1));
+    stream->SetDataSize(PLT_SOAP_MAX_BODY_SIZE+1);
+    entity->SetInputStream((NPT_InputStreamReference)stream, false);
+    entity->SetContentLength(0);
+    SHOULD_EQUAL_I(PLT_SoapParser::ReadBody(request, body), NPT_ERROR_OUT_OF_RANGE);
+}
+
+/*----------------------------------------------------------------------
+|   TestSuiteWriter
++---------------------------------------------------------------------*/
+static void
+TestSuiteWriter()
+{
+    NPT_String didl = "<DIDL-Lite><item id=\"1\"><dc:title>A & B</dc:title></item></DIDL-Lite>";
+    NPT_String xml;
+    NPT_StringOutputStream stream(&xml);
+
+    /* sizing pass must match what gets written */
+    PLT_SoapWriter sizer;
+    PLT_SoapWriter writer(&stream);
+    for (int pass=0; pass<2; pass++) {
+        PLT_SoapWriter& w = pass?writer:sizer;
+        SHOULD_SUCCEED(w.StartEnvelope());
+        SHOULD_SUCCEED(w.StartAction("Browse", true, "urn:schemas-upnp-org:service:ContentDirectory:1"));
+        SHOULD_SUCCEED(w.WriteArgument("Result", didl, "string"));
+        SHOULD_SUCCEED(w.WriteArgument("NumberReturned", "1"));
+        SHOULD_SUCCEED(w.EndAction("Browse", true));
+        SHOULD_SUCCEED(w.EndEnvelope());
+    }
+    SHOULD_EQUAL_I(sizer.GetSize(), xml.GetLength());
+    SHOULD_EQUAL_I(writer.GetSize(), xml.GetLength());
+
+    /* read it back */
+    NPT_String name, value;
+    PLT_SoapParser parser(xml, xml.GetLength());
+    SHOULD_SUCCEED(parser.ParseEnvelope());
+    SHOULD_EQUAL_S(parser.GetActionName().GetChars(), "BrowseResponse");
+    SHOULD_SUCCEED(parser.GetNextArgument(name, value));
+    SHOULD_EQUAL_S(name.GetChars(), "Result");
+    SHOULD_EQUAL_S(value.GetChars(), didl.GetChars());
+    SHOULD_SUCCEED(parser.GetNextArgument(name, value));
+    SHOULD_EQUAL_S(value.GetChars(), "1");
+
+    /* faults */
+    xml = "";
+    PLT_SoapWriter fault(&stream);
+    SHOULD_SUCCEED(fault.StartEnvelope());
+    SHOULD_SUCCEED(fault.WriteFault(701, "Invalid <Name>"));
+    SHOULD_SUCCEED(fault.EndEnvelope());
+    SHOULD_EQUAL_I(xml.Find("<errorCode>701</errorCode><errorDescription>Invalid &lt;Name&gt;</errorDescription>") > 0, 1);
+}
+
+/*----------------------------------------------------------------------
+|   TestSuiteBenchmark
++---------------------------------------------------------------------*/
+static void
+TestSuiteBenchmark(const char* name, const char* xml)
+{
+    NPT_TimeStamp before, after;
+    NPT_String    action;
+
+    NPT_System::GetCurrentTimeStamp(before);
+    for (int i=0; i<SOAP_TEST_ITERATIONS; i++) {
+        NPT_List<NPT_String> args;
+        ParseWithDom(xml, action, args);
+    }
+    NPT_System::GetCurrentTimeStamp(after);
+    double dom = (double)(after-before).ToMillis()*1000.0/SOAP_TEST_ITERATIONS;
+
+    NPT_System::GetCurrentTimeStamp(before);
+    for (int i=0; i<SOAP_TEST_ITERATIONS; i++) {
+        NPT_List<NPT_String> args;
+        ParseWithSoapParser(xml, action, args);
+    }
+    NPT_System::GetCurrentTimeStamp(after);
+    double soap = (double)(after-before).ToMillis()*1000.0/SOAP_TEST_ITERATIONS;
+
+    printf("%s: dom %.2f us/parse, soap parser %.2f us/parse\n", name, dom, soap);
+}
+
+/*----------------------------------------------------------------------
+|       main
++---------------------------------------------------------------------*/
+int
+main(int /*argc*/, char** /*argv*/)
+{
+    TestSuiteEnvelope();
+    TestSuiteReadBody();
+    TestSuiteWriter();
+    TestSuiteCompare(BrowseRequest, "Browse", 6);
+    TestSuiteCompare(SetAVTransportURIRequest, "SetAVTransportURI", 3);
+    TestSuiteBenchmark("Browse", BrowseRequest);
+    TestSuiteBenchmark("SetAVTransportURI", SetAVTransportURIRequest);
+    return 0;
+}
@@ -0,0 +1,247 @@
+/*****************************************************************
+|
+|   Platinum - Utilities Test
+|
+| Copyright (c) 2004-2010, Plutinosoft, LLC.
+| All rights reserved.
+| http://www.plutinosoft.com
+|
+| This program is free software; you can redistribute it and/or
+| modify it under the terms of the GNU General Public License
+| as published by the Free Software Foundation; either version 2
+| of the License, or (at your option) any later version.
+|
+| OEMs, ISVs, VARs and other distributors that combine and 
+| distribute commercially licensed software with Platinum software
+| and do not wish to distribute the source code for the commercially
+| licensed software under version 2, or (at your option) any later
+| version, of the GNU General Public License (the "GPL") must enter
+| into a commercial license agreement with Plutinosoft, LLC.
+| licensing@plutinosoft.com
+| 
+| This program is distributed in the hope that it will be useful,
+| but WITHOUT ANY WARRANTY; without even the implied warranty of
+| MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+| GNU General Public License for more details.
+|
+| You should have received a copy of the GNU General Public License
+| along with this program; see the file LICENSE.txt. If not, write to
+| the Free Software Foundation, Inc., 
+| 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+| http://www.gnu.org/licenses/gpl-2.0.html
+|
+****************************************************************/
+
+
+
+/*----------------------------------------------------------------------
+|   includes
++---------------------------------------------------------------------*/
+#include <stdlib.h>
+#include <stdio.h>
+#include "Neptune.h"
+#include "Platinum.h"
+
+/*----------------------------------------------------------------------
+|       macros
++---------------------------------------------------------------------*/
+#define SHOULD_SUCCEED(r)                                        \
+    do {                                                         \
+        if (NPT_FAILED(r)) {                                     \
+            fprintf(stderr, "FAILED: line %d\n", __LINE__);      \
+            NPT_ASSERT(0);                                       \
+        }                                                        \
+    } while(0)                                         
+
+#define SHOULD_FAIL(r)                                           \
+    do {                                                         \
+        if (NPT_SUCCEEDED(r)) {                                  \
+            fprintf(stderr, "should have failed line %d (%d)\n", \
+                __LINE__, r);                                    \
+            NPT_ASSERT(0);                                       \
+        }                                                        \
+    } while(0)                                  
+
+#define SHOULD_EQUAL_I(a, b)                                     \
+    do {                                                         \
+        if ((a) != (b)) {                                        \
+            fprintf(stderr, "got %d expected %d line %d\n",      \
+                (int)a, (int)b, __LINE__);                       \
+            NPT_ASSERT(0);                                       \
+        }                                                        \
+    } while(0)                                  
+
+#define SHOULD_BE_TRUE(a)                                        \
+    do {                                                         \
+        if (!(a)) {                                              \
+            fprintf(stderr, "FAILED: line %d\n", __LINE__);      \
+            NPT_ASSERT(0);                                       \
+        }                                                        \
+    } while(0)                                  
+
+#define UTILITIES_TEST_KEYS 100
+
+/*----------------------------------------------------------------------
+|   TestSuiteStringMap
++---------------------------------------------------------------------*/
+static void
+TestSuiteStringMap()
+{
+    PLT_StringMap<int> map;
+    int                value;
+
+    SHOULD_FAIL(map.Get("missing", value));
+    SHOULD_FAIL(map.Remove("missing"));
+    SHOULD_FAIL(map.Put(NULL, 0));
+
+    /* enough keys to grow the table several times */
+    for (int i=0; i<UTILITIES_TEST_KEYS; i++) {
+        SHOULD_SUCCEED(map.Put("uuid:" + NPT_String::FromInteger(i), i));
+    }
+    SHOULD_EQUAL_I(map.GetItemCount(), UTILITIES_TEST_KEYS);
+    for (int i=0; i<UTILITIES_TEST_KEYS; i++) {
+        SHOULD_SUCCEED(map.Get("uuid:" + NPT_String::FromInteger(i), value));
+        SHOULD_EQUAL_I(value, i);
+    }
+
+    /* keys are case sensitive by default, putting again replaces the value */
+    SHOULD_FAIL(map.Get("UUID:1", value));
+    SHOULD_SUCCEED(map.Put("uuid:1", 1000));
+    SHOULD_EQUAL_I(map.GetItemCount(), UTILITIES_TEST_KEYS);
+    SHOULD_SUCCEED(map.Get("uuid:1", value));
+    SHOULD_EQUAL_I(value, 1000);
+
+    /* values can be changed through Find */
+    int* found = map.Find("uuid:2");
+    SHOULD_BE_TRUE(found != NULL);
+    *found = 2000;
+    SHOULD_SUCCEED(map.Get("uuid:2", value));
+    SHOULD_EQUAL_I(value, 2000);
+
+    /* remove every other key */
+    for (int i=0; i<UTILITIES_TEST_KEYS; i+=2) {
+        SHOULD_SUCCEED(map.Remove("uuid:" + NPT_String::FromInteger(i)));
+    }
+    SHOULD_EQUAL_I(map.GetItemCount(), UTILITIES_TEST_KEYS/2);
+    for (int i=0; i<UTILITIES_TEST_KEYS; i++) {
+        if (i%2) {
+            SHOULD_SUCCEED(map.Get("uuid:" + NPT_String::FromInteger(i), value));
+        } else {
+            SHOULD_FAIL(map.Get("uuid:" + NPT_String::FromInteger(i), value));
+        }
+    }
+
+    /* copies are independent */
+    PLT_StringMap<int> copy(map);
+    SHOULD_SUCCEED(copy.Remove("uuid:1"));
+    SHOULD_SUCCEED(map.Get("uuid:1", value));
+    SHOULD_EQUAL_I(copy.GetItemCount(), UTILITIES_TEST_KEYS/2-1);
+    copy = map;
+    SHOULD_SUCCEED(copy.Get("uuid:1", value));
+    SHOULD_EQUAL_I(value, 1000);
+
+    map.Clear();
+    SHOULD_EQUAL_I(map.GetItemCount(), 0);
+    SHOULD_FAIL(map.Get("uuid:1", value));
+    SHOULD_SUCCEED(map.Put("uuid:1", 1));
+    SHOULD_EQUAL_I(map.GetItemCount(), 1);
+
+    /* case insensitive keys */
+    PLT_StringMap<int> nocase(true);
+    SHOULD_SUCCEED(nocase.Put("urn:Service:1", 1));
+    SHOULD_SUCCEED(nocase.Get("URN:SERVICE:1", value));
+    SHOULD_EQUAL_I(value, 1);
+    SHOULD_SUCCEED(nocase.Remove("urn:service:1"));
+    SHOULD_EQUAL_I(nocase.GetItemCount(), 0);
+}
+
+/*----------------------------------------------------------------------
+|   TestSuiteNameMap
++---------------------------------------------------------------------*/
+static void
+TestSuiteNameMap()
+{
+    PLT_NameMap<int> map;
+    int              value;
+    NPT_Ordinal      index;
+
+    SHOULD_SUCCEED(map.Put("Play", 1));
+    SHOULD_SUCCEED(map.Put("Stop", 2));
+
+    /* a name added twice keeps the first entry, lookups ignore case */
+    SHOULD_SUCCEED(map.Put("PLAY", 3));
+    SHOULD_EQUAL_I(map.GetItemCount(), 2);
+    SHOULD_SUCCEED(map.Get("play", value));
+    SHOULD_EQUAL_I(value, 1);
+    SHOULD_SUCCEED(map.GetIndex("Play", index));
+    SHOULD_EQUAL_I(index, 0);
+    SHOULD_SUCCEED(map.GetIndex("stop", index));
+    SHOULD_EQUAL_I(index, 1);
+    SHOULD_FAIL(map.Get("Pause", value));
+
+    /* indexes stay dense and in insertion order while the table grows */
+    for (int i=0; i<UTILITIES_TEST_KEYS; i++) {
+        SHOULD_SUCCEED(map.Put("Action" + NPT_String::FromInteger(i), i));
+    }
+    for (int i=0; i<UTILITIES_TEST_KEYS; i++) {
+        SHOULD_SUCCEED(map.GetIndex("action" + NPT_String::FromInteger(i), index));
+        SHOULD_EQUAL_I(index, i+2);
+    }
+}
+
+/*----------------------------------------------------------------------
+|   TestSuiteTimerHeap
++---------------------------------------------------------------------*/
+static void
+TestSuiteTimerHeap()
+{
+    PLT_TimerHeap<int> heap;
+    NPT_TimeStamp      due;
+    int                value;
+
+    SHOULD_FAIL(heap.GetNextDue(due));
+    SHOULD_FAIL(heap.PopDue(NPT_TimeStamp(1000.), value));
+
+    /* add in scrambled order, 37 is prime so i*37%100 visits every value */
+    for (int i=0; i<UTILITIES_TEST_KEYS; i++) {
+        int seconds = (i*37)%UTILITIES_TEST_KEYS + 1;
+        SHOULD_SUCCEED(heap.Add(NPT_TimeStamp((double)seconds), seconds));
+    }
+    SHOULD_EQUAL_I(heap.GetItemCount(), UTILITIES_TEST_KEYS);
+    SHOULD_SUCCEED(heap.GetNextDue(due));
+    SHOULD_BE_TRUE(due == NPT_TimeStamp(1.));
+
+    /* nothing is due yet */
+    SHOULD_FAIL(heap.PopDue(NPT_TimeStamp(0.5), value));
+
+    /* only what is due comes out, earliest first */
+    for (int i=1; i<=UTILITIES_TEST_KEYS/2; i++) {
+        SHOULD_SUCCEED(heap.PopDue(NPT_TimeStamp((double)UTILITIES_TEST_KEYS/2), value));
+        SHOULD_EQUAL_I(value, i);
+    }
+    SHOULD_FAIL(heap.PopDue(NPT_TimeStamp((double)UTILITIES_TEST_KEYS/2), value));
+
+    /* values added later still come out in order */
+    SHOULD_SUCCEED(heap.Add(NPT_TimeStamp(60.5), 0));
+    for (int i=UTILITIES_TEST_KEYS/2+1; i<=UTILITIES_TEST_KEYS; i++) {
+        SHOULD_SUCCEED(heap.PopDue(NPT_TimeStamp(1000.), value));
+        SHOULD_EQUAL_I(value, i);
+        if (i == 60) {
+            SHOULD_SUCCEED(heap.PopDue(NPT_TimeStamp(1000.), value));
+            SHOULD_EQUAL_I(value, 0);
+        }
+    }
+    SHOULD_EQUAL_I(heap.GetItemCount(), 0);
+}
+
+/*----------------------------------------------------------------------
+|   main
++---------------------------------------------------------------------*/
+int
+main(int /*argc*/, char** /*argv*/)
+{
+    TestSuiteStringMap();
+    TestSuiteNameMap();
+    TestSuiteTimerHeap();
+    return 0;
+}